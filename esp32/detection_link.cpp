@@ -0,0 +1,160 @@
+#include <Arduino.h>
+
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+
+#include "detection_protocol.h"
+#include "detection_link.h"
+#include "intersection_config.h"
+#include "preemption_link.h"
+#include "socket_watch.h"
+#include "traffic_state.h"
+
+static_assert(DETECTION_UDP_PORT != PREEMPTION_UDP_PORT && DETECTION_EDGE_UDP_PORT != PREEMPTION_UDP_PORT &&
+              DETECTION_UDP_PORT != DETECTION_EDGE_UDP_PORT, "Controller UDP ports must be distinct");
+
+// One sender: the server, or the camera's edge counter. Each numbers its
+// updates on its own, in a new session after every restart.
+typedef struct {
+  int socket;
+  detection_window_t window;
+} detection_source_t;
+
+static detection_source_t server_source = {-1, {0, 0, false}};
+static detection_source_t edge_source = {-1, {0, 0, false}};
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static detection_link_stats_t stats = {0, 0, 0, 0, 0, 0, 0, 0};
+
+// One datagram, aligned for the in-place decode
+static uint8_t buffer[64] __attribute__((aligned(4)));
+
+// Non-blocking UDP socket on `port`, watched for input in the executor layout
+static int open_socket(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0)
+    return -1;
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  socket_watch_add(fd);
+  return fd;
+}
+
+void detection_link_init(void)
+{
+  server_source.socket = open_socket(DETECTION_UDP_PORT);
+  edge_source.socket = open_socket(DETECTION_EDGE_UDP_PORT);
+
+  if (server_source.socket < 0 || edge_source.socket < 0)
+    Serial.println("[Detection] Failed to open a socket");
+
+  Serial.print("[Detection] Listening on UDP port ");
+  Serial.print(DETECTION_UDP_PORT);
+  Serial.print(", edge counter on ");
+  Serial.println(DETECTION_EDGE_UDP_PORT);
+}
+
+static void apply(const detection_datagram_t *update, bool edge)
+{
+  uint8_t approaches = update->approach_count < APPROACH_COUNT ? update->approach_count : APPROACH_COUNT;
+  traffic_detection_t *detection = traffic_state_edit();
+
+  for (uint8_t a = 0; a < approaches; a++)
+    detection->counts[a] = update->counts[a];
+
+  // Any approach: the emergency phase is fixed (EMERGENCY_PHASE). The edge
+  // counter cannot see ambulances and leaves the state as it was.
+  if (!edge)
+    detection->ambulance = update->ambulance_mask != 0;
+  detection->capture_us = update->capture_us;
+  detection->edge = edge;
+
+  traffic_state_publish();
+}
+
+// Edge counts stand in only while the server's have gone quiet
+static bool server_silent(void)
+{
+  const traffic_detection_t *detection = traffic_state_edit();
+  return detection->edge || (uint32_t) millis() - detection->updated_ms >= DETECTION_EDGE_TAKEOVER_MS;
+}
+
+static void poll_source(detection_source_t *source, bool edge)
+{
+  if (source->socket < 0)
+    return;
+
+  int length;
+  while ((length = recv(source->socket, buffer, sizeof(buffer), MSG_DONTWAIT)) >= 0)
+  {
+    uint32_t start = micros();
+
+    const detection_datagram_t *update = length > 0 ? detection_datagram_decode(buffer, (size_t) length) : NULL;
+    if (update == NULL)
+    {
+      portENTER_CRITICAL(&stats_mux);
+      stats.rejected++;
+      portEXIT_CRITICAL(&stats_mux);
+      continue;
+    }
+
+    if (!detection_window_accept(&source->window, update->session, update->sequence))
+    {
+      portENTER_CRITICAL(&stats_mux);
+      stats.stale++;
+      portEXIT_CRITICAL(&stats_mux);
+      continue;
+    }
+
+    if (edge)
+    {
+      bool applied = server_silent();
+      if (applied)
+        apply(update, true);
+
+      portENTER_CRITICAL(&stats_mux);
+      stats.edge_received++;
+      if (applied)
+        stats.edge_applied++;
+      portEXIT_CRITICAL(&stats_mux);
+      continue;
+    }
+
+    apply(update, false);
+
+    uint32_t elapsed_us = micros() - start;
+
+    portENTER_CRITICAL(&stats_mux);
+    stats.received++;
+    stats.last_sequence = update->sequence;
+    stats.last_decode_us = elapsed_us;
+    if (elapsed_us > stats.max_decode_us)
+      stats.max_decode_us = elapsed_us;
+    portEXIT_CRITICAL(&stats_mux);
+  }
+}
+
+void detection_link_poll(void)
+{
+  poll_source(&server_source, false);
+  poll_source(&edge_source, true);
+}
+
+void detection_link_get_stats(detection_link_stats_t *out)
+{
+  portENTER_CRITICAL(&stats_mux);
+  *out = stats;
+  portEXIT_CRITICAL(&stats_mux);
+}
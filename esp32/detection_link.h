@@ -0,0 +1,42 @@
+#ifndef _DETECTION_LINK_H_
+#define _DETECTION_LINK_H_
+
+#include <stdint.h>
+
+// Receives binary detection updates (detection_protocol.h) over UDP and
+// feeds them to the controller: vehicle counts become approach demand and
+// the ambulance bits raise or clear the emergency.
+//
+// The camera's edge counter sends approximate counts of its own to
+// DETECTION_EDGE_UDP_PORT. They are only applied once the server has sent
+// nothing (binary or Socket.IO) for DETECTION_EDGE_TAKEOVER_MS, and never
+// touch the ambulance state; the server's next update takes over again.
+
+// UDP ports the controller listens on, keep them distinct:
+//   4210  DETECTION_UDP_PORT       server detection updates
+//   4211  PREEMPTION_UDP_PORT      emergency vehicle preemption (preemption_link.h)
+//   4212  DETECTION_EDGE_UDP_PORT  camera edge counter (EDGE_COUNTER_PORT)
+#define DETECTION_UDP_PORT         4210
+#define DETECTION_EDGE_UDP_PORT    4212
+#define DETECTION_EDGE_TAKEOVER_MS 3000
+
+typedef struct {
+  uint32_t received;        // Valid datagrams applied
+  uint32_t rejected;        // Wrong size, magic or version
+  uint32_t stale;           // Out of order or repeated sequence numbers of a session
+  uint32_t last_sequence;
+  uint32_t last_decode_us;  // Decode and apply time of the last update
+  uint32_t max_decode_us;
+  uint32_t edge_received;   // Valid edge counter datagrams
+  uint32_t edge_applied;    // Of those, applied while the server was silent
+} detection_link_stats_t;
+
+void detection_link_init(void);
+
+// Drain pending datagrams without blocking, call from the network task.
+// The sockets are watched (socket_watch.h), the executor runs it on input.
+void detection_link_poll(void);
+
+void detection_link_get_stats(detection_link_stats_t *stats);
+
+#endif //_DETECTION_LINK_H_
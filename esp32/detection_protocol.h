@@ -0,0 +1,104 @@
+#ifndef _DETECTION_PROTOCOL_H_
+#define _DETECTION_PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary detection update, sent as one UDP datagram to DETECTION_UDP_PORT
+// of the controller (DETECTION_EDGE_UDP_PORT from the camera). Fixed
+// layout, little-endian, 24 bytes:
+//
+//   0  u8   magic           DETECTION_MAGIC
+//   1  u8   version         DETECTION_VERSION
+//   2  u8   approach_count  Entries of counts[] in use (1..4)
+//   3  u8   ambulance_mask  Bit n: ambulance seen on approach n
+//   4  u32  session         Random, drawn by the sender at every start
+//   8  u32  sequence        Incremented by the sender for every update
+//  12  u32  capture_us      Camera clock (esp_timer) of the counted frame,
+//                           as in the fragment header; 0 if unknown
+//  16  u16  counts[4]       Vehicles per approach
+//
+// The receiver keeps the session and highest sequence of every sender
+// (detection_window_t). A new session means the sender restarted and its
+// numbering starts over, so it is accepted at once.
+//
+// server/server.js encodeDetectionUpdate() writes the same layout, and so
+// does the camera's edge counter with the copy of this file in
+// esp32_camera/ (keep the two identical). The decoder validates in place
+// and returns a pointer into the receive buffer, nothing is copied. Fields
+// are used in host order, which is little-endian on every target (ESP32,
+// x86 hosts). No Arduino dependencies.
+
+#define DETECTION_MAGIC          0xD7
+#define DETECTION_VERSION        2
+#define DETECTION_MAX_APPROACHES 4
+
+typedef struct __attribute__((packed)) {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t approach_count;
+  uint8_t ambulance_mask;
+  uint32_t session;
+  uint32_t sequence;
+  uint32_t capture_us;
+  uint16_t counts[DETECTION_MAX_APPROACHES];
+} detection_datagram_t;
+
+static_assert(sizeof(detection_datagram_t) == 24, "Detection datagram layout changed");
+
+// Last update accepted from one sender
+typedef struct {
+  uint32_t session;
+  uint32_t sequence;
+  bool valid;
+} detection_window_t;
+
+// NULL if the datagram is too short, not ours or of another version
+static inline const detection_datagram_t *detection_datagram_decode(const uint8_t *data, size_t length)
+{
+  if (length < sizeof(detection_datagram_t))
+    return NULL;
+
+  const detection_datagram_t *datagram = (const detection_datagram_t *) data;
+
+  if (datagram->magic != DETECTION_MAGIC || datagram->version != DETECTION_VERSION)
+    return NULL;
+  if (datagram->approach_count == 0 || datagram->approach_count > DETECTION_MAX_APPROACHES)
+    return NULL;
+
+  return datagram;
+}
+
+static inline void detection_datagram_encode(detection_datagram_t *datagram, uint32_t session, uint32_t sequence,
+                                             uint32_t capture_us, const uint16_t *counts, uint8_t approach_count,
+                                             uint8_t ambulance_mask)
+{
+  if (approach_count > DETECTION_MAX_APPROACHES)
+    approach_count = DETECTION_MAX_APPROACHES;
+
+  memset(datagram, 0, sizeof(*datagram));
+  datagram->magic = DETECTION_MAGIC;
+  datagram->version = DETECTION_VERSION;
+  datagram->approach_count = approach_count;
+  datagram->ambulance_mask = ambulance_mask;
+  datagram->session = session;
+  datagram->sequence = sequence;
+  datagram->capture_us = capture_us;
+  memcpy(datagram->counts, counts, approach_count * sizeof(uint16_t));
+}
+
+// True, and remembered, if the update is newer than the last one accepted
+// from its sender (with wrap-around) or comes from a new session
+static inline bool detection_window_accept(detection_window_t *window, uint32_t session, uint32_t sequence)
+{
+  if (window->valid && session == window->session && (int32_t)(sequence - window->sequence) <= 0)
+    return false;
+
+  window->valid = true;
+  window->session = session;
+  window->sequence = sequence;
+  return true;
+}
+
+#endif //_DETECTION_PROTOCOL_H_
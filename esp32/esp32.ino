@@ -13,6 +13,14 @@
 #include "pin_config.h"
 #include "motor.h"
 #include "fsm.h"
+#include "timer_service.h"
+#include "intersection_config.h"
+#include "intersection_control.h"
+#include "executor.h"
+#include "task_monitor.h"
+#include "traffic_state.h"
+#include "preemption_link.h"
+#include "socket_watch.h"
 
 WiFiMulti WiFiMulti;
 
@@ -26,19 +34,69 @@ uint16_t updPort    = 3000;
 char ssid[] = "WEECEF49";  // your network SSID (name)
 char pass[] = "kb147576";  // your network password (use for WPA, or use as key for WEP), length must be 8+
 
+// Shared HMAC key of the preemption channel, same as PREEMPTION_KEY of tools/preemption_sender
+char preemptionKey[] = "change-me-preemption-key";
+
 
 volatile bool system_initialized = false;
-volatile uint32_t car_count = 0;
-volatile bool has_ambulance = false;
-volatile uint32_t duration = MIN_GREEN_DURATION_MS;
-volatile uint32_t greenDuration = MIN_GREEN_DURATION_MS;
-volatile uint32_t increaseInDuration = 0;
+
+// Ambulance state acted on, owned by the control side (traffic_control_poll)
+bool has_ambulance = false;
+
+// Wi-Fi link drops and recoveries after the first connection
+volatile uint32_t wifi_disconnects = 0;
+volatile uint32_t wifi_reconnects = 0;
+static bool wifi_was_connected = false;
+
+// Task stacks in bytes, for both layouts (see executor.h)
+#define TIMER_STACK_SIZE      2048
+#define MOTOR_STACK_SIZE      2048
+#define TRAFFIC_STACK_SIZE    2048
+#define SOCKET_IO_STACK_SIZE  4096
+#define FSM_STACK_SIZE        4096
+#define PREEMPTION_STACK_SIZE 3072
+#define EXECUTOR_STACK_SIZE   6144  // Deepest path: socket event -> FSM action -> queue send
+#define SOCKET_WATCH_STACK_SIZE 2048
+
+#if SYSTEM_EXECUTOR
+#define TASK_STACKS_TOTAL (EXECUTOR_STACK_SIZE + SOCKET_WATCH_STACK_SIZE)
+#else
+#define TASK_STACKS_TOTAL (TIMER_STACK_SIZE + MOTOR_STACK_SIZE + TRAFFIC_STACK_SIZE + SOCKET_IO_STACK_SIZE + FSM_STACK_SIZE + PREEMPTION_STACK_SIZE)
+#endif
+
+void show_phase(uint8_t phase);
+void show_emergency(void);
+
+// What the intersection controller's phases do on the board
+static const intersection_control_hooks_t controlHooks = { show_phase, show_emergency };
+
+// Station events, the core reconnects on its own after a drop
+void wifi_event(WiFiEvent_t event) {
+  if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED && wifi_was_connected) {
+    wifi_disconnects++;
+  }
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    if (wifi_was_connected) {
+      wifi_reconnects++;
+    }
+    wifi_was_connected = true;
+  }
+}
+
+// Create a task on the application core and watch its stack usage
+void start_task(void (*function)(void *), const char *name, uint32_t stack_size, UBaseType_t priority) {
+  TaskHandle_t task = NULL;
+  xTaskCreatePinnedToCore(function, name, stack_size, NULL, priority, &task, 1);
+  task_monitor_add(name, task, stack_size);
+}
 
 void setup() {
   Serial.begin(115200);
   Serial.setDebugOutput(true);
 
 
+  WiFi.onEvent(wifi_event, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  WiFi.onEvent(wifi_event, ARDUINO_EVENT_WIFI_STA_GOT_IP);
   WiFiMulti.addAP(ssid, pass);
 
   Serial.print("Connecting to ");
@@ -62,34 +120,32 @@ void setup() {
   Serial.print(", port: ");
   Serial.println(serverPort);
 
-  fsm_init(STATE_IDLE);
-
-  // Register FSM transitions
-  // Transitions for traffic light control normal mode
-  fsm_register_transition(STATE_IDLE, STATE_STREET_1_GREEN_STREET_2_RED, EVENT_START, street_1_green_street_2_red_action);
-  fsm_register_transition(STATE_STREET_1_GREEN_STREET_2_RED, STATE_STREET_1_YELLOW_STREET_2_RED, EVENT_SWITCH, street_1_yellow_street_2_red_action);
-  fsm_register_transition(STATE_STREET_1_YELLOW_STREET_2_RED, STATE_STREET_1_RED_STREET_2_GREEN, EVENT_SWITCH, street_1_red_street_2_green_action);
-  fsm_register_transition(STATE_STREET_1_RED_STREET_2_GREEN, STATE_STREET_1_RED_STREET_2_YELLOW, EVENT_SWITCH, street_1_red_street_2_yellow_action);
-  fsm_register_transition(STATE_STREET_1_RED_STREET_2_YELLOW, STATE_STREET_1_GREEN_STREET_2_RED, EVENT_SWITCH, street_1_green_street_2_red_action);
-
-  // Transitions for emergency handling
-  fsm_register_transition(STATE_STREET_1_GREEN_STREET_2_RED, STATE_EMERGENCY, EVENT_EMERGENCY, emergency_action);
-  fsm_register_transition(STATE_STREET_1_YELLOW_STREET_2_RED, STATE_EMERGENCY, EVENT_EMERGENCY, emergency_action);
-  fsm_register_transition(STATE_STREET_1_RED_STREET_2_GREEN, STATE_EMERGENCY, EVENT_EMERGENCY, emergency_action);
-  fsm_register_transition(STATE_STREET_1_RED_STREET_2_YELLOW, STATE_EMERGENCY, EVENT_EMERGENCY, emergency_action);
-
-  // Transition to resume normal operation after emergency ends
-  fsm_register_transition(STATE_EMERGENCY, STATE_STREET_1_GREEN_STREET_2_RED, EVENT_CLEAR_EMERGENCY, street_1_green_street_2_red_action);
-
-  xTaskCreatePinnedToCore(motor_task, "Motor Task", 2048, NULL, 5, NULL, 1);
-  xTaskCreatePinnedToCore(traffic_light_task, "Traffic Task", 2048, NULL, 5, NULL, 1);
-  xTaskCreatePinnedToCore(socket_io_task, "Socket IO Task", 4096, NULL, 20, NULL, 1);  // Larger stack, run on core 0
-  xTaskCreatePinnedToCore(traffic_loop_task, "Traffic Loop Task", 4096, NULL, 5, NULL, 1);
-  xTaskCreatePinnedToCore(fsm_task, "FSM Task", 4096, NULL, 10, NULL, 1);
+  intersection_control_init(SIGNAL_TIMING_WEBSTER, &controlHooks);
+  fsm_dispatcher_add(&intersectionFsm);
+  preemption_link_init((const uint8_t *) preemptionKey, strlen(preemptionKey));
+
+#if SYSTEM_EXECUTOR
+  // Every component as a handler of one task, on one stack. The watcher
+  // only wakes it when a socket has input.
+  socket_watch_init();
+  start_task(executor_task, "Executor Task", EXECUTOR_STACK_SIZE, 10);
+  start_task(socket_watch_task, "Watch Task", SOCKET_WATCH_STACK_SIZE, 22);
+#else
+  start_task(timer_service_task, "Timer Task", TIMER_STACK_SIZE, 15);
+  start_task(motor_task, "Motor Task", MOTOR_STACK_SIZE, 5);
+  start_task(traffic_light_task, "Traffic Task", TRAFFIC_STACK_SIZE, 5);
+  start_task(socket_io_task, "Socket IO Task", SOCKET_IO_STACK_SIZE, 20);  // Larger stack
+  start_task(fsm_task, "FSM Task", FSM_STACK_SIZE, 10);
+  start_task(preemption_link_task, "Preemption Task", PREEMPTION_STACK_SIZE, 22);  // Above every other task
+#endif
+
+  Serial.print("Task stacks: ");
+  Serial.print(TASK_STACKS_TOTAL);
+  Serial.println(" bytes");
 
   // Wait for tasks to initialize their queues
   Serial.println("Waiting for tasks to initialize...");
-  while (!motor_is_ready() || !traffic_light_is_ready() || !fsm_is_ready()) {
+  while (!timer_service_is_ready() || !motor_is_ready() || !traffic_light_is_ready() || !fsm_is_ready(&intersectionFsm)) {
     vTaskDelay(pdMS_TO_TICKS(10));
   }
   Serial.println("All tasks initialized!");
@@ -97,7 +153,7 @@ void setup() {
   // Mark system as initialized
   system_initialized = true;
 
-  fsm_push_event(EVENT_START);
+  fsm_push_event(&intersectionFsm, EVENT_START);
 
 }
 
@@ -107,12 +163,46 @@ void fsm_task(void *pvParams) {
     vTaskDelay(pdMS_TO_TICKS(10));
   }
   
+  // Wake up only when an event is pushed to any instance
+  fsm_dispatcher_set_task(xTaskGetCurrentTaskHandle());
+
   while (true) {
-    fsm_process_events();
-    vTaskDelay(pdMS_TO_TICKS(10));
+    // Drain first so events pushed before registration are not missed
+    traffic_control_poll();
+    fsm_dispatcher_process();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
   }
 }
 
+#if SYSTEM_EXECUTOR
+uint32_t fsm_poll(void) {
+  traffic_control_poll();
+  fsm_dispatcher_process();
+  // fsm_push_event() notifies the executor task
+  return EXECUTOR_WAIT_FOREVER;
+}
+
+void executor_task(void *pvParams) {
+  timer_service_init();
+  motor_init();
+  traffic_light_init();
+  socket_io_init();
+  fsm_dispatcher_set_task(xTaskGetCurrentTaskHandle());
+
+  // Producers first so their output is applied within the same pass,
+  // preemption before anything else
+  executor_add("preempt", preemption_link_poll);
+  executor_add("socket", socket_io_poll);
+  executor_add("timer", timer_service_poll);
+  executor_add("fsm", fsm_poll);
+  executor_add("traffic", traffic_light_poll);
+  executor_add("motor", motor_poll);
+  executor_add("watch", socket_watch_poll);  // Last, the sockets are drained
+
+  executor_run();
+}
+#endif
+
 void loop() {
   // Empty loop - everything runs in tasks
   vTaskDelay(pdMS_TO_TICKS(1000));
@@ -126,66 +216,96 @@ void emergency_stop(void) {
   traffic_light_turn_off_all();
 }
 
-void traffic_loop_task(void *pvParams) {
-
-  // Wait for system initialization to complete
-  while (!system_initialized) {
-    vTaskDelay(pdMS_TO_TICKS(10));
+// Raise or clear the emergency when the ambulance detection changes
+void traffic_ambulance_changed(bool present) {
+  if (present && !has_ambulance) {
+    has_ambulance = true;
+    Serial.println("Ambulance detected! Prioritizing traffic light.");
+    fsm_push_event(&intersectionFsm, EVENT_EMERGENCY);
   }
-
-  uint32_t last_switch_time = millis();
-
-  while (true) {
-    if (millis() - last_switch_time > duration)
-    {
-      last_switch_time = millis();
-      if (has_ambulance) {
-        // Skip normal operation during emergency
-        continue;
-      }
-  
-      fsm_push_event(EVENT_SWITCH);
-    }
-    
-    Serial.println((millis() - last_switch_time) / 1000);
-    vTaskDelay(pdMS_TO_TICKS(1000)); // Adjust delay as needed
+  if (!present && has_ambulance) {
+    has_ambulance = false;
+    Serial.println("Ambulance cleared! Resuming normal operation.");
+    fsm_push_event(&intersectionFsm, EVENT_CLEAR_EMERGENCY);
   }
 }
 
-void street_1_green_street_2_red_action(void) {
-  traffic_light_set(TRAFFIC_LIGHT_1, GREEN);
-  traffic_light_set(TRAFFIC_LIGHT_2, RED);
-  duration = greenDuration + increaseInDuration;
-  Serial.println("Street 1 GREEN, Street 2 RED");
-}
+// Control side of traffic_state.h, runs on the FSM task right before its
+// events are dispatched: applies a new detection snapshot once and executes
+// the commands the network task posted
+void traffic_control_poll(void) {
+  static uint32_t appliedVersion = 0;
+  static bool detectionAmbulance = false;
+  static bool preemptionHeld = false;  // Until the preemption channel clears it
+
+  traffic_detection_t detection;
+  uint32_t version;
+  if (traffic_state_read(&detection, &version) && version != appliedVersion) {
+    appliedVersion = version;
+
+    // Picked up by the timing engine when the next cycle starts
+    for (uint8_t a = 0; a < APPROACH_COUNT; a++) {
+      signal_timing_set_demand(&signalTiming, a, detection.counts[a]);
+    }
+    detectionAmbulance = detection.ambulance;
+    traffic_ambulance_changed(detectionAmbulance || preemptionHeld);
+  }
 
-void street_1_yellow_street_2_red_action(void) {
-  traffic_light_set(TRAFFIC_LIGHT_1, YELLOW);
-  traffic_light_set(TRAFFIC_LIGHT_2, RED);
-  duration = YELLOW_DURATION_MS;
-  Serial.println("Street 1 YELLOW, Street 2 RED");
+  traffic_command_t command;
+  while (traffic_state_take(&command)) {
+    switch (command.type) {
+      case TRAFFIC_COMMAND_EMERGENCY:
+        traffic_ambulance_changed(true);
+        break;
+      case TRAFFIC_COMMAND_RESET:
+        preemptionHeld = false;
+        traffic_ambulance_changed(false);
+        motor_stop();
+        break;
+      case TRAFFIC_COMMAND_PUMP_OPEN:
+        open_pump();
+        break;
+      case TRAFFIC_COMMAND_PUMP_CLOSE:
+        close_pump();
+        break;
+      case TRAFFIC_COMMAND_MOTOR_STOP:
+        motor_stop();
+        break;
+      case TRAFFIC_COMMAND_EMERGENCY_STOP:
+        emergency_stop();
+        break;
+      case TRAFFIC_COMMAND_PREEMPT:
+        preemptionHeld = true;
+        if (fsm_get_current_state(&intersectionFsm) == STATE_EMERGENCY) {
+          // Already holding the emergency phase, emergency_action() will not run
+          preemption_link_applied();
+        }
+        traffic_ambulance_changed(true);
+        break;
+      case TRAFFIC_COMMAND_PREEMPT_CLEAR:
+        preemptionHeld = false;
+        traffic_ambulance_changed(detectionAmbulance);
+        break;
+    }
+  }
 }
 
-void street_1_red_street_2_green_action(void) {
-  traffic_light_set(TRAFFIC_LIGHT_1, RED);
-  traffic_light_set(TRAFFIC_LIGHT_2, GREEN);
-  duration = greenDuration - increaseInDuration;
-  Serial.println("Street 1 RED, Street 2 GREEN");
-}
+void show_phase(uint8_t phase) {
+  traffic_light_set_phase(PHASE_MASKS.masks[phase]);
 
-void street_1_red_street_2_yellow_action(void) {
-  traffic_light_set(TRAFFIC_LIGHT_1, RED);
-  traffic_light_set(TRAFFIC_LIGHT_2, YELLOW);
-  duration = YELLOW_DURATION_MS;
-  Serial.println("Street 1 RED, Street 2 YELLOW");
+  Serial.print("Phase ");
+  Serial.print(phase);
+  Serial.print(PHASES[phase].green ? ": GREEN" : ": YELLOW");
+  Serial.print(" on approach ");
+  Serial.println(PHASES[phase].approach + 1);
 }
 
-void emergency_action(void) {
-  // In emergency, turn both lights to red
-  traffic_light_set(TRAFFIC_LIGHT_1, GREEN);
-  traffic_light_set(TRAFFIC_LIGHT_2, RED);
+void show_emergency(void) {
+  // In emergency, give green to the approach of EMERGENCY_PHASE, red to the others
+  traffic_light_set_phase(PHASE_MASKS.masks[EMERGENCY_PHASE]);
+  preemption_link_applied();
   close_pump();
-  Serial.println("Street 1 GREEN, Street 2 RED, EMERGENCY!");
+  Serial.println("EMERGENCY! Holding emergency phase");
 }
 
 typedef enum {
@@ -195,16 +315,24 @@ typedef enum {
 
 pump_state_t pump_status = PUMP_OFF;
 
+void pump_done(void *arg, motor_result_t result, uint16_t position) {
+  if (result == MOTOR_RESULT_DONE) {
+    Serial.print("Pump ");
+    Serial.println(position == MOTOR_POSITION_OPEN ? "open" : "closed");
+  }
+}
+
 void open_pump(void) {
   if (pump_status == PUMP_ON) {
     return;
   }
   Serial.println("Opening pump...");
+  if (!motor_move_to(MOTOR_POSITION_OPEN, pump_done, NULL)) {
+    // pump_status unchanged, the next call tries again
+    Serial.println("[Pump] Open refused, motor queue full");
+    return;
+  }
   pump_status = PUMP_ON;
-  motor_turn_left();
-  
-  vTaskDelay(pdMS_TO_TICKS(PUMP_DURATION_MS));
-  motor_stop();
 }
 
 void close_pump(void) {
@@ -212,8 +340,10 @@ void close_pump(void) {
     return;
   }
   Serial.println("Closing pump...");
+  if (!motor_move_to(MOTOR_POSITION_CLOSED, pump_done, NULL)) {
+    // pump_status unchanged, the next call tries again
+    Serial.println("[Pump] Close refused, motor queue full");
+    return;
+  }
   pump_status = PUMP_OFF;
-  motor_turn_right();
-  vTaskDelay(pdMS_TO_TICKS(PUMP_DURATION_MS));
-  motor_stop();
 }
\ No newline at end of file
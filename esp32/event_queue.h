@@ -0,0 +1,435 @@
+#ifndef _EVENT_QUEUE_H_
+#define _EVENT_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free event queues for the FSM.
+//
+// LockFreeRing is a bounded multi-producer ring (Vyukov style: every cell
+// carries a sequence number, producers claim a slot with one CAS on the tail).
+// Any task or ISR may push, pop is meant for a single consumer task.
+//
+// PriorityEventQueue stacks two rings into lanes: the safety lane is always
+// drained first. Safety events carry state (emergency on, emergency off,
+// stop), so that lane never refuses one: the newest safety state wins. Every
+// safety event takes a sequence number when it is pushed. If the safety ring
+// is full the event goes to the overflow latch, which overwrites the oldest
+// latched event. The consumer delivers the latch once the ring holds nothing
+// older and skips anything older than what it already delivered, so safety
+// events keep their order across ring and latch. Superseded events are
+// counted as coalesced.
+//
+// The latch has one slot per producer that may push safety events at the
+// same time, plus one the consumer may be reading, so an overflowing
+// producer always finds a slot without waiting for anybody.
+//
+// Only <atomic> is used so the queue builds and runs on a Linux host too.
+
+// Per-lane counters, snapshot with PriorityEventQueue::get_stats()
+typedef struct {
+    uint32_t pushed;        // Events accepted
+    uint32_t dropped;       // Events rejected because the lane was full
+    uint32_t coalesced;     // Safety events parked in the overflow latch
+    uint32_t depth;         // Events waiting right now
+    uint32_t high_water;    // Largest depth ever seen
+    uint32_t max_delay_us;  // Worst enqueue to dequeue delay
+} EventLaneStats;
+
+template <typename T, size_t CAPACITY>
+class LockFreeRing {
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "Ring capacity must be a power of two");
+
+public:
+    LockFreeRing() {
+        for (size_t i = 0; i < CAPACITY; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    // Returns false when the ring is full
+    bool push(const T& item) {
+        uint32_t pos = tail.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell& cell = cells[pos & MASK];
+            uint32_t seq = cell.sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - pos);
+
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.item = item;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false when the ring is empty
+    bool pop(T& item) {
+        uint32_t pos = head.load(std::memory_order_relaxed);
+
+        while (true) {
+            Cell& cell = cells[pos & MASK];
+            uint32_t seq = cell.sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)(seq - (pos + 1));
+
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = cell.item;
+                    cell.sequence.store(pos + CAPACITY, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Copy of the item pop() would return next, consumer side only
+    bool peek(T& item) const {
+        uint32_t pos = head.load(std::memory_order_relaxed);
+        const Cell& cell = cells[pos & MASK];
+
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        item = cell.item;
+        return true;
+    }
+
+    // Approximate number of queued items (exact when producers are idle)
+    uint32_t depth() const {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_relaxed);
+        return t - h;
+    }
+
+private:
+    static constexpr uint32_t MASK = CAPACITY - 1;
+
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        T item;
+    };
+
+    Cell cells[CAPACITY];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+};
+
+// T must provide an `event` member (enum or integer) and a `timestamp_us`
+// member (uint32_t) set by the producer. SAFETY_PRODUCERS is the number of
+// tasks and ISRs that may push safety events concurrently.
+template <typename T, size_t SAFETY_CAPACITY, size_t NORMAL_CAPACITY, size_t SAFETY_PRODUCERS>
+class PriorityEventQueue {
+    static_assert(SAFETY_PRODUCERS >= 1, "At least one task pushes safety events");
+
+public:
+    enum Lane {
+        LANE_SAFETY = 0,
+        LANE_NORMAL = 1,
+        LANE_COUNT
+    };
+
+    PriorityEventQueue() : safetySequence(0), lastDelivered(0), delivered(false) {
+        for (size_t i = 0; i < LATCH_SLOTS; i++) {
+            latch[i].state.store(LATCH_EMPTY, std::memory_order_relaxed);
+            latch[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < LANE_COUNT; i++) {
+            counters[i].pushed.store(0, std::memory_order_relaxed);
+            counters[i].dropped.store(0, std::memory_order_relaxed);
+            counters[i].coalesced.store(0, std::memory_order_relaxed);
+            counters[i].highWater.store(0, std::memory_order_relaxed);
+            counters[i].maxDelayUs.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false when a normal event had to be dropped, a safety event is
+    // always taken
+    bool push(const T& item, Lane lane) {
+        LaneCounters& c = counters[lane];
+
+        if (lane == LANE_SAFETY) {
+            SafetyItem stamped;
+            stamped.item = item;
+            stamped.sequence = safetySequence.fetch_add(1, std::memory_order_relaxed);
+
+            if (!safety.push(stamped)) {
+                push_latch(stamped, c);
+            }
+            c.pushed.fetch_add(1, std::memory_order_relaxed);
+            update_high_water(c, safety.depth());
+            return true;
+        }
+
+        if (!normal.push(item)) {
+            c.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        c.pushed.fetch_add(1, std::memory_order_relaxed);
+        update_high_water(c, normal.depth());
+        return true;
+    }
+
+    // Pops the next event, safety lane first. `now_us` feeds the delay stats.
+    bool pop(T& item, uint32_t now_us) {
+        if (pop_safety(item)) {
+            update_delay(counters[LANE_SAFETY], now_us - item.timestamp_us);
+            return true;
+        }
+
+        if (normal.pop(item)) {
+            update_delay(counters[LANE_NORMAL], now_us - item.timestamp_us);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Discard everything queued (consumer side only)
+    void clear(void) {
+        T item;
+        while (pop_safety(item) || normal.pop(item)) {
+        }
+    }
+
+    bool empty(void) const {
+        if (safety.depth() != 0 || normal.depth() != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < LATCH_SLOTS; i++) {
+            if (latch_flag(latch[i].state.load(std::memory_order_acquire)) != LATCH_EMPTY) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void get_stats(Lane lane, EventLaneStats* stats) const {
+        const LaneCounters& c = counters[lane];
+        stats->pushed = c.pushed.load(std::memory_order_relaxed);
+        stats->dropped = c.dropped.load(std::memory_order_relaxed);
+        stats->coalesced = c.coalesced.load(std::memory_order_relaxed);
+        stats->high_water = c.highWater.load(std::memory_order_relaxed);
+        stats->max_delay_us = c.maxDelayUs.load(std::memory_order_relaxed);
+        stats->depth = (lane == LANE_SAFETY) ? safety.depth() : normal.depth();
+    }
+
+private:
+    struct SafetyItem {
+        T item;
+        uint32_t sequence;  // Push order across the ring and the latch
+    };
+
+    struct LaneCounters {
+        std::atomic<uint32_t> pushed;
+        std::atomic<uint32_t> dropped;
+        std::atomic<uint32_t> coalesced;
+        std::atomic<uint32_t> highWater;
+        std::atomic<uint32_t> maxDelayUs;
+    };
+
+    // Latch slot states, in the low bits of the state word. The rest counts
+    // the times the slot was filled or emptied, so a state seen earlier
+    // cannot be mistaken for the current one.
+    enum : uint32_t {
+        LATCH_EMPTY = 0,
+        LATCH_WRITING,      // Claimed by a producer, not readable yet
+        LATCH_FULL,
+        LATCH_READING,      // Claimed by the consumer
+        LATCH_FLAGS = 3,
+        LATCH_VERSION = 4
+    };
+
+    static constexpr size_t LATCH_SLOTS = SAFETY_PRODUCERS + 1;
+
+    struct LatchSlot {
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> sequence;  // Of the item, readable while FULL
+        SafetyItem item;
+    };
+
+    static uint32_t latch_flag(uint32_t state) {
+        return state & LATCH_FLAGS;
+    }
+
+    static uint32_t latch_next(uint32_t state, uint32_t flag) {
+        return ((state & ~LATCH_FLAGS) + LATCH_VERSION) | flag;
+    }
+
+    static bool newer(uint32_t sequence, uint32_t than) {
+        return (int32_t)(sequence - than) > 0;
+    }
+
+    // Store a safety event the ring had no room for: take a free latch slot,
+    // or overwrite the oldest latched event if it is older than this one
+    void push_latch(const SafetyItem& stamped, LaneCounters& c) {
+        while (true) {
+            LatchSlot* oldest = NULL;
+            uint32_t oldestState = 0;
+            uint32_t oldestSequence = 0;
+
+            for (size_t i = 0; i < LATCH_SLOTS; i++) {
+                LatchSlot& slot = latch[i];
+                uint32_t state = slot.state.load(std::memory_order_acquire);
+
+                if (latch_flag(state) == LATCH_EMPTY) {
+                    if (slot.state.compare_exchange_strong(state, state | LATCH_WRITING, std::memory_order_acquire)) {
+                        write_latch(slot, state, stamped);
+                        return;
+                    }
+                } else if (latch_flag(state) == LATCH_FULL) {
+                    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+                    if (oldest == NULL || newer(oldestSequence, sequence)) {
+                        oldest = &slot;
+                        oldestState = state;
+                        oldestSequence = sequence;
+                    }
+                }
+            }
+
+            // At most SAFETY_PRODUCERS - 1 other producers and the consumer
+            // hold a slot, so one was empty or full; it changed if neither
+            if (oldest == NULL) {
+                continue;
+            }
+
+            if (!newer(stamped.sequence, oldestSequence)) {
+                // Every latched event is newer, this one is superseded already
+                c.coalesced.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (oldest->state.compare_exchange_strong(oldestState, (oldestState & ~LATCH_FLAGS) | LATCH_WRITING,
+                                                      std::memory_order_acquire)) {
+                c.coalesced.fetch_add(1, std::memory_order_relaxed);
+                write_latch(*oldest, oldestState, stamped);
+                return;
+            }
+        }
+    }
+
+    static void write_latch(LatchSlot& slot, uint32_t claimed, const SafetyItem& stamped) {
+        slot.item = stamped;
+        slot.sequence.store(stamped.sequence, std::memory_order_relaxed);
+        slot.state.store(latch_next(claimed, LATCH_FULL), std::memory_order_release);
+    }
+
+    // Newest latched event, false if no slot is full
+    bool take_latch(SafetyItem& item) {
+        while (true) {
+            LatchSlot* newest = NULL;
+            uint32_t newestState = 0;
+            uint32_t newestSequence = 0;
+
+            for (size_t i = 0; i < LATCH_SLOTS; i++) {
+                uint32_t state = latch[i].state.load(std::memory_order_acquire);
+                if (latch_flag(state) != LATCH_FULL) {
+                    continue;
+                }
+                uint32_t sequence = latch[i].sequence.load(std::memory_order_relaxed);
+                if (newest == NULL || newer(sequence, newestSequence)) {
+                    newest = &latch[i];
+                    newestState = state;
+                    newestSequence = sequence;
+                }
+            }
+
+            if (newest == NULL) {
+                return false;
+            }
+            if (newest->state.compare_exchange_strong(newestState, (newestState & ~LATCH_FLAGS) | LATCH_READING,
+                                                      std::memory_order_acquire)) {
+                item = newest->item;
+                newest->state.store(latch_next(newestState, LATCH_EMPTY), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    // Sequence of the newest latched event without taking it
+    bool peek_latch(uint32_t& sequence) const {
+        bool found = false;
+        for (size_t i = 0; i < LATCH_SLOTS; i++) {
+            if (latch_flag(latch[i].state.load(std::memory_order_acquire)) != LATCH_FULL) {
+                continue;
+            }
+            uint32_t candidate = latch[i].sequence.load(std::memory_order_relaxed);
+            if (!found || newer(candidate, sequence)) {
+                sequence = candidate;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Next safety event: the latch once nothing older is left in the ring.
+    // Events older than the last one delivered were superseded while they
+    // waited and are skipped.
+    bool pop_safety(T& item) {
+        while (true) {
+            SafetyItem next;
+            uint32_t latched = 0;
+
+            if (peek_latch(latched) && (!safety.peek(next) || newer(next.sequence, latched))) {
+                if (!take_latch(next)) {
+                    // Claimed by a producer overwriting it, look again
+                    continue;
+                }
+            } else if (!safety.pop(next)) {
+                return false;
+            }
+
+            if (delivered && !newer(next.sequence, lastDelivered)) {
+                counters[LANE_SAFETY].coalesced.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            delivered = true;
+            lastDelivered = next.sequence;
+            item = next.item;
+            return true;
+        }
+    }
+
+    static void update_max(std::atomic<uint32_t>& target, uint32_t value) {
+        uint32_t current = target.load(std::memory_order_relaxed);
+        while (value > current &&
+               !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    static void update_high_water(LaneCounters& c, uint32_t depth) {
+        update_max(c.highWater, depth);
+    }
+
+    static void update_delay(LaneCounters& c, uint32_t delay_us) {
+        update_max(c.maxDelayUs, delay_us);
+    }
+
+    LockFreeRing<SafetyItem, SAFETY_CAPACITY> safety;
+    LockFreeRing<T, NORMAL_CAPACITY> normal;
+    std::atomic<uint32_t> safetySequence;
+
+    // Overflow latch for the safety lane. A slot belongs to whoever moved its
+    // state to WRITING or READING until it is set to FULL or EMPTY again.
+    LatchSlot latch[LATCH_SLOTS];
+
+    // Consumer side only
+    uint32_t lastDelivered;
+    bool delivered;
+
+    LaneCounters counters[LANE_COUNT];
+};
+
+#endif // _EVENT_QUEUE_H_
@@ -0,0 +1,134 @@
+#include <Arduino.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "executor.h"
+
+typedef struct {
+  const char *name;
+  executor_handler_t handler;
+} executor_entry_t;
+
+static executor_entry_t handlers[EXECUTOR_MAX_HANDLERS];
+static int handler_count = 0;
+
+static TaskHandle_t executor_task_handle = NULL;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static executor_stats_t stats = {0, 0, 0, 0};
+
+// Current load window
+static uint32_t window_start_us = 0;
+static uint32_t window_idle_us = 0;
+
+bool executor_add(const char *name, executor_handler_t handler)
+{
+  if (handler_count >= EXECUTOR_MAX_HANDLERS)
+  {
+    Serial.println("[Executor] Too many handlers!");
+    return false;
+  }
+
+  handlers[handler_count].name = name;
+  handlers[handler_count].handler = handler;
+  handler_count++;
+  return true;
+}
+
+uint32_t executor_poll(void)
+{
+  uint32_t start = micros();
+  uint32_t wait_ms = EXECUTOR_WAIT_FOREVER;
+
+  for (int i = 0; i < handler_count; i++)
+  {
+    uint32_t wait = handlers[i].handler();
+    if (wait < wait_ms)
+      wait_ms = wait;
+  }
+
+  uint32_t elapsed_us = micros() - start;
+
+  portENTER_CRITICAL(&stats_mux);
+  stats.passes++;
+  if (elapsed_us > stats.max_pass_us)
+    stats.max_pass_us = elapsed_us;
+  portEXIT_CRITICAL(&stats_mux);
+
+  return wait_ms;
+}
+
+static void account_idle(uint32_t idle_us)
+{
+  uint32_t now = micros();
+
+  window_idle_us += idle_us;
+
+  uint32_t window_us = now - window_start_us;
+  if (window_us < EXECUTOR_LOAD_WINDOW_MS * 1000UL)
+    return;
+
+  uint32_t permille = (uint32_t)((uint64_t) window_idle_us * 1000 / window_us);
+
+  portENTER_CRITICAL(&stats_mux);
+  stats.idle_permille = permille > 1000 ? 1000 : permille;
+  portEXIT_CRITICAL(&stats_mux);
+
+  window_start_us = now;
+  window_idle_us = 0;
+}
+
+void executor_run(void)
+{
+  executor_task_handle = xTaskGetCurrentTaskHandle();
+  window_start_us = micros();
+
+  Serial.print("[Executor] Running ");
+  Serial.print(handler_count);
+  Serial.println(" handlers");
+
+  while (true)
+  {
+    uint32_t wait_ms = executor_poll();
+
+    if (wait_ms == 0)
+    {
+      account_idle(0);
+      continue;
+    }
+
+    TickType_t wait = wait_ms == EXECUTOR_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms);
+    if (wait == 0)
+      wait = 1;
+
+    uint32_t sleep_start = micros();
+    uint32_t notified = ulTaskNotifyTake(pdTRUE, wait);
+    account_idle(micros() - sleep_start);
+
+    if (notified)
+    {
+      portENTER_CRITICAL(&stats_mux);
+      stats.wakes++;
+      portEXIT_CRITICAL(&stats_mux);
+    }
+  }
+}
+
+void executor_wake(void)
+{
+  if (executor_task_handle != NULL)
+    xTaskNotifyGive(executor_task_handle);
+}
+
+bool executor_is_running(void)
+{
+  return executor_task_handle != NULL;
+}
+
+void executor_get_stats(executor_stats_t *out)
+{
+  portENTER_CRITICAL(&stats_mux);
+  *out = stats;
+  portEXIT_CRITICAL(&stats_mux);
+}
@@ -0,0 +1,58 @@
+#ifndef _EXECUTOR_H_
+#define _EXECUTOR_H_
+
+#include <stdint.h>
+
+// Cooperative run-to-completion executor.
+//
+// With SYSTEM_EXECUTOR set, the timer service, motor, traffic light, Socket IO,
+// preemption and FSM components run as handlers of one task on one stack
+// instead of six tasks. Every handler does whatever work is ready and returns
+// how long it can wait before it needs to run again; the executor sleeps on its
+// task notification until the nearest of those deadlines, or until a producer
+// queues work and calls executor_wake(). Socket input wakes it through the
+// socket watcher (socket_watch.h). tools/executor_check checks the order.
+//
+// Only the task notification and micros() are used, so the executor builds on
+// a Linux host with the shims in tools/traffic_sim/host.
+
+// 0: one FreeRTOS task per component (default), 1: single executor task
+#ifndef SYSTEM_EXECUTOR
+#define SYSTEM_EXECUTOR 0
+#endif
+
+#define EXECUTOR_MAX_HANDLERS   8
+#define EXECUTOR_WAIT_FOREVER   UINT32_MAX
+
+// CPU load is measured over windows of this length
+#define EXECUTOR_LOAD_WINDOW_MS 1000
+
+// Run pending work and return the milliseconds until the next run is needed
+// (0 to run again right away, EXECUTOR_WAIT_FOREVER to wait for a wake)
+typedef uint32_t (*executor_handler_t)(void);
+
+typedef struct {
+  uint32_t passes;           // Executor passes over all handlers
+  uint32_t wakes;            // Sleeps ended by executor_wake() or a notification
+  uint32_t max_pass_us;      // Longest pass (worst latency added to any handler)
+  uint16_t idle_permille;    // Time spent sleeping over the last load window
+} executor_stats_t;
+
+// Register a handler, call before executor_run()
+bool executor_add(const char *name, executor_handler_t handler);
+
+// One pass over every handler, returns the shortest wait they asked for
+uint32_t executor_poll(void);
+
+// Run the handlers forever in the calling task
+void executor_run(void);
+
+// Ask the executor to run a pass soon, safe from any task. No-op when the
+// executor is not running (task layout).
+void executor_wake(void);
+
+bool executor_is_running(void);
+
+void executor_get_stats(executor_stats_t *stats);
+
+#endif //_EXECUTOR_H_
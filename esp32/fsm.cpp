@@ -1,142 +1,285 @@
 #include "fsm.h"
+#include "fsm_trace.h"
 
-// Global current state variable
-State currentState = STATE_IDLE;
+// Instances served by the dispatcher task
+static Fsm* instances[FSM_MAX_INSTANCES];
+static int instanceCount = 0;
 
-// Transition table
-static Transition transitionTable[MAX_TRANSITIONS];
-static int transitionCount = 0;
+// Task woken by fsm_push_event() (the dispatcher blocks until notified)
+static TaskHandle_t notifyTask = NULL;
 
-// FreeRTOS event queue
-static QueueHandle_t eventQueue = NULL;
+// Histogram bucket of a latency: 0 and 1 us get their own, above that
+// the top bit selects the octave and the next bit the half of it
+static uint8_t latency_bucket(uint32_t latency_us) {
+    if (latency_us < 2) {
+        return (uint8_t) latency_us;
+    }
+    uint8_t msb = 31 - __builtin_clz(latency_us);
+    uint32_t bucket = 2 * msb + ((latency_us >> (msb - 1)) & 1);
+    return bucket < FSM_LATENCY_BUCKETS ? bucket : FSM_LATENCY_BUCKETS - 1;
+}
 
-// Private helper function to find matching transition
-static Transition* find_transition(State state, Event event) {
-    for (int i = 0; i < transitionCount; i++) {
-        if (transitionTable[i].currentState == state && 
-            transitionTable[i].transitionEvent == event) {
-            return &transitionTable[i];
-        }
+// Largest latency that falls into a bucket
+static uint32_t latency_bucket_limit(uint8_t bucket) {
+    if (bucket < 2) {
+        return bucket;
     }
-    return NULL;
+    uint8_t msb = bucket / 2;
+    uint32_t lower = (uint32_t) (2 | (bucket & 1)) << (msb - 1);
+    return lower + ((uint32_t) 1 << (msb - 1)) - 1;
 }
 
-// Initialize FSM
-void fsm_init(State initialState) {
-    currentState = initialState;
-    transitionCount = 0;
-    
-    // Create FreeRTOS queue for events
-    if (eventQueue == NULL) {
-        eventQueue = xQueueCreate(MAX_EVENTS, sizeof(Event));
-        if (eventQueue == NULL) {
-            Serial.println("Error: Failed to create event queue!");
-        }
+static void record_latency(FsmLatencyStats* stats, uint32_t latency_us) {
+    stats->count++;
+    stats->buckets[latency_bucket(latency_us)]++;
+    stats->last_us = latency_us;
+    if (latency_us > stats->max_us) {
+        stats->max_us = latency_us;
+    }
+    if (stats->count == 1) {
+        stats->avg_us = latency_us;
+    } else {
+        stats->avg_us = stats->avg_us - (stats->avg_us >> 4) + (latency_us >> 4);
     }
 }
 
-// Register a transition in the transition table
-bool fsm_register_transition(State fromState, State toState, Event event, ActionFunction action) {
-    if (transitionCount >= MAX_TRANSITIONS) {
-        Serial.println("Error: Transition table full!");
+// Private helper function to find matching transition
+static const Transition* find_transition(const Fsm* fsm, State state, Event event) {
+    if (fsm->table == NULL) {
+        return NULL;
+    }
+    return fsm->table->find(state, event);
+}
+
+// Dispatch one queued event, returns false when the queue is empty
+static bool process_one(Fsm* fsm) {
+    QueuedEvent queued;
+    if (!fsm->queue.pop(queued, (uint32_t) micros())) {
         return false;
     }
-    
-    transitionTable[transitionCount].currentState = fromState;
-    transitionTable[transitionCount].nextState = toState;
-    transitionTable[transitionCount].transitionEvent = event;
-    transitionTable[transitionCount].action = action;
-    transitionCount++;
-    
+
+    if (!fsm_dispatch_event(fsm, queued.event)) {
+        Serial.print("Warning: No transition found for event ");
+        Serial.print(queued.event);
+        Serial.print(" in state ");
+        Serial.print(fsm->currentState);
+        Serial.print(" (FSM ");
+        Serial.print(fsm->id);
+        Serial.println(")");
+        return true;
+    }
+
+    uint32_t latency_us = (uint32_t) micros() - queued.timestamp_us;
+    record_latency(fsm_is_safety_event(queued.event) ? &fsm->safetyLatency : &fsm->normalLatency, latency_us);
     return true;
 }
 
+// Initialize FSM
+void fsm_init(Fsm* fsm, uint8_t id, State initialState, const TransitionTable* table, void* context) {
+    fsm->id = id;
+    fsm->currentState = initialState;
+    fsm->stateEnteredMs = (uint32_t) millis();
+    fsm->table = table;
+    fsm->context = context;
+    fsm->safetyLatency = FsmLatencyStats();
+    fsm->normalLatency = FsmLatencyStats();
+    fsm->queue.clear();
+}
+
+// Events that must never wait behind or be dropped for normal traffic
+bool fsm_is_safety_event(Event event) {
+    switch (event) {
+        case EVENT_EMERGENCY:
+        case EVENT_CLEAR_EMERGENCY:
+        case EVENT_STOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
 // Add event to the queue
-void fsm_push_event(Event event) {
-    if (eventQueue == NULL) {
-        Serial.println("Error: Event queue not initialized!");
+void fsm_push_event(Fsm* fsm, Event event) {
+    QueuedEvent queued;
+    queued.event = event;
+    queued.timestamp_us = (uint32_t) micros();
+
+    FsmEventQueue::Lane lane = fsm_is_safety_event(event) ? FsmEventQueue::LANE_SAFETY : FsmEventQueue::LANE_NORMAL;
+
+    if (!fsm->queue.push(queued, lane)) {
+        Serial.println("Warning: Event queue full, normal event discarded!");
         return;
     }
-    
-    if (xQueueSend(eventQueue, &event, 0) != pdPASS) {
-        Serial.println("Warning: Event queue full, event discarded!");
-    }
+
+    fsm_dispatcher_wake();
 }
 
-// Process all events in the queue (main loop function)
-void fsm_process_events(void) {
-    if (eventQueue == NULL) {
-        Serial.println("[FSM] ERROR: Event queue is NULL!");
-        return;
+// Process all events in the queue, returns true if any event was handled
+bool fsm_process_events(Fsm* fsm) {
+    if (fsm->table == NULL) {
+        Serial.println("[FSM] ERROR: Transition table is NULL!");
+        return false;
     }
     
-    Event event;
-    while (xQueueReceive(eventQueue, &event, 0) == pdPASS) {
-        if (!fsm_dispatch_event(event)) {
-            Serial.print("Warning: No transition found for event ");
-            Serial.print(event);
-            Serial.print(" in state ");
-            Serial.println(currentState);
-        }
+    bool handled = false;
+    while (process_one(fsm)) {
+        handled = true;
     }
+    return handled;
 }
 
 // Event dispatcher - handles a single event and transitions state
-bool fsm_dispatch_event(Event event) {
+bool fsm_dispatch_event(Fsm* fsm, Event event) {
     // Find matching transition
-    Transition* transition = find_transition(currentState, event);
+    const Transition* transition = find_transition(fsm, fsm->currentState, event);
     
     if (transition == NULL) {
         // No transition found for this state-event combination
         return false;
     }
     
-    Serial.print("FSM Transition: ");
-    Serial.print(currentState);
+#if FSM_SERIAL_TRACE
+    Serial.print("FSM ");
+    Serial.print(fsm->id);
+    Serial.print(" Transition: ");
+    Serial.print(fsm->currentState);
     Serial.print(" -> ");
     Serial.print(transition->nextState);
     Serial.print(" (Event: ");
     Serial.print(event);
     Serial.println(")");
+#endif
     
     // Execute action if defined
+    uint32_t actionStart = (uint32_t) micros();
     if (transition->action != NULL) {
-        transition->action();
+        transition->action(fsm, transition->nextState);
     }
+    uint32_t actionTime = (uint32_t) micros() - actionStart;
+    
+    // Keep a binary record of the transition
+    fsm_trace_record(actionStart, fsm->id, fsm->currentState, transition->nextState, event, actionTime);
     
     // Change state to next state
-    currentState = transition->nextState;
+    if (transition->nextState != fsm->currentState) {
+        fsm->stateEnteredMs = (uint32_t) millis();
+    }
+    fsm->currentState = transition->nextState;
     
     return true;
 }
 
 // Get current state
-State fsm_get_current_state(void) {
-    return currentState;
+State fsm_get_current_state(const Fsm* fsm) {
+    return fsm->currentState;
 }
 
 // Set current state directly (bypass transition logic)
-void fsm_set_current_state(State state) {
+void fsm_set_current_state(Fsm* fsm, State state) {
     Serial.print("FSM State set directly to: ");
     Serial.println(state);
-    currentState = state;
+    fsm->currentState = state;
+    fsm->stateEnteredMs = (uint32_t) millis();
 }
 
-// Reset FSM to initial state
-void fsm_reset(State initialState) {
-    currentState = initialState;
-    transitionCount = 0;
+// Reset FSM to initial state (the transition table is kept)
+void fsm_reset(Fsm* fsm, State initialState) {
+    fsm->currentState = initialState;
+    fsm->stateEnteredMs = (uint32_t) millis();
     
     // Clear event queue
-    if (eventQueue != NULL) {
-        xQueueReset(eventQueue);
-    }
+    fsm->queue.clear();
     
     Serial.print("FSM Reset to state: ");
     Serial.println(initialState);
 }
 
 // Check if FSM is ready
-bool fsm_is_ready(void) {
-    return eventQueue != NULL;
+bool fsm_is_ready(const Fsm* fsm) {
+    return fsm->table != NULL;
+}
+
+// Snapshot queue counters for both lanes
+void fsm_get_queue_stats(const Fsm* fsm, EventLaneStats* safety, EventLaneStats* normal) {
+    if (safety != NULL) {
+        fsm->queue.get_stats(FsmEventQueue::LANE_SAFETY, safety);
+    }
+    if (normal != NULL) {
+        fsm->queue.get_stats(FsmEventQueue::LANE_NORMAL, normal);
+    }
+}
+
+// Snapshot event-to-action latency for both lanes
+void fsm_get_latency_stats(const Fsm* fsm, FsmLatencyStats* safety, FsmLatencyStats* normal) {
+    if (safety != NULL) {
+        *safety = fsm->safetyLatency;
+    }
+    if (normal != NULL) {
+        *normal = fsm->normalLatency;
+    }
+}
+
+// Latency below which the given share of events (in permille) completed,
+// rounded up to the bucket limit and capped at the observed maximum
+uint32_t fsm_latency_percentile(const FsmLatencyStats* stats, uint16_t permille) {
+    uint32_t total = 0;
+    for (uint8_t b = 0; b < FSM_LATENCY_BUCKETS; b++) {
+        total += stats->buckets[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t wanted = ((uint64_t) total * permille + 999) / 1000;
+    uint32_t seen = 0;
+    for (uint8_t b = 0; b < FSM_LATENCY_BUCKETS; b++) {
+        seen += stats->buckets[b];
+        if (seen >= wanted && seen > 0) {
+            uint32_t limit = latency_bucket_limit(b);
+            return (b == FSM_LATENCY_BUCKETS - 1 || limit > stats->max_us) ? stats->max_us : limit;
+        }
+    }
+    return stats->max_us;
+}
+
+// Time spent in the current state
+uint32_t fsm_get_time_in_state_ms(const Fsm* fsm) {
+    return (uint32_t) millis() - fsm->stateEnteredMs;
+}
+
+// Register an instance with the dispatcher (call before the dispatcher task starts)
+bool fsm_dispatcher_add(Fsm* fsm) {
+    if (instanceCount >= FSM_MAX_INSTANCES) {
+        Serial.println("Error: Too many FSM instances!");
+        return false;
+    }
+    instances[instanceCount++] = fsm;
+    return true;
+}
+
+// Register the task that processes events, it is notified on every push
+void fsm_dispatcher_set_task(TaskHandle_t task) {
+    notifyTask = task;
+}
+
+// Wake the dispatcher task, for producers of work it polls besides events
+void fsm_dispatcher_wake(void) {
+    if (notifyTask != NULL) {
+        xTaskNotifyGive(notifyTask);
+    }
+}
+
+// Process the events of all instances, one event per instance per pass so a
+// busy intersection cannot starve the others. Safety events still come first
+// within each instance.
+void fsm_dispatcher_process(void) {
+    bool handled = true;
+    while (handled) {
+        handled = false;
+        for (int i = 0; i < instanceCount; i++) {
+            if (instances[i]->table != NULL && process_one(instances[i])) {
+                handled = true;
+            }
+        }
+    }
 }
@@ -4,19 +4,35 @@
 #include <Arduino.h>
 #include <stdbool.h>
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
+#include <freertos/task.h>
 
-// Define maximum number of transitions
-#define MAX_TRANSITIONS 32
+#include "fsm_table.h"
+#include "event_queue.h"
+#include "intersection_config.h"
+
+// Define maximum number of queued events (lane sizes, powers of two)
 #define MAX_EVENTS 16
+#define MAX_SAFETY_EVENTS 8
+
+// Tasks that may push safety events at the same time: only the control side
+// of traffic_state.h does, on the FSM task or the executor
+#define MAX_SAFETY_PRODUCERS 1
+
+// Maximum number of FSM instances driven by one dispatcher task
+#ifndef FSM_MAX_INSTANCES
+#define FSM_MAX_INSTANCES 4
+#endif
+
+// Print every transition to serial (the binary trace in fsm_trace.h is always kept)
+#ifndef FSM_SERIAL_TRACE
+#define FSM_SERIAL_TRACE 0
+#endif
 
 // State enum - you can extend this with your specific states
 typedef enum {
     STATE_IDLE,
-    STATE_STREET_1_GREEN_STREET_2_RED,
-    STATE_STREET_1_YELLOW_STREET_2_RED,
-    STATE_STREET_1_RED_STREET_2_GREEN,
-    STATE_STREET_1_RED_STREET_2_YELLOW,
+    STATE_PHASE_FIRST,  // One state per entry of PHASES[] (intersection_config.h)
+    STATE_PHASE_LAST = STATE_PHASE_FIRST + PHASE_COUNT - 1,
     STATE_EMERGENCY,
     STATE_MOTOR_OPEN,
     STATE_MOTOR_CLOSE,
@@ -24,6 +40,7 @@ typedef enum {
     STATE_ERROR,
     STATE_COMPLETE,
     // Add more states as needed
+    STATE_COUNT  // Must stay last
 } State;
 
 // Event enum - you can extend this with your specific events
@@ -39,10 +56,14 @@ typedef enum {
     EVENT_SUCCESS,
     EVENT_FAILURE,
     // Add more events as needed
+    EVENT_COUNT  // Must stay last
 } Event;
 
-// Action function pointer type
-typedef void (*ActionFunction)(void);
+typedef struct Fsm Fsm;
+
+// Action function pointer type, receives the instance taking the transition
+// and the state it is entering
+typedef void (*ActionFunction)(Fsm* fsm, State nextState);
 
 // Transition structure
 typedef struct {
@@ -52,18 +73,68 @@ typedef struct {
     ActionFunction action;  // Optional action to execute during transition
 } Transition;
 
-// Global current state variable
-extern State currentState;
+// Event waiting in the FSM queue, stamped when it was pushed
+typedef struct {
+    Event event;
+    uint32_t timestamp_us;
+} QueuedEvent;
+
+// Latency histogram: two buckets per power of two (about 40% wide), the
+// last one also counts everything above 2^(FSM_LATENCY_BUCKETS / 2) us
+#define FSM_LATENCY_BUCKETS 40
+
+// Event-to-action latency: from fsm_push_event() until the transition action returned
+typedef struct {
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t avg_us;   // Running average (1/16 weight per sample)
+    uint32_t buckets[FSM_LATENCY_BUCKETS];
+} FsmLatencyStats;
+
+// Dense State x Event lookup, built at compile time with fsm_build_table()
+typedef FsmTable<Transition, STATE_COUNT, EVENT_COUNT> TransitionTable;
+
+// Build a TransitionTable from a transition list, declare the result constexpr
+template <size_t N>
+constexpr TransitionTable fsm_make_table(const Transition (&transitions)[N]) {
+    return fsm_build_table<Transition, STATE_COUNT, EVENT_COUNT>(transitions);
+}
+
+// Lock-free event queue, safety events (emergency handling) use their own lane
+typedef PriorityEventQueue<QueuedEvent, MAX_SAFETY_EVENTS, MAX_EVENTS, MAX_SAFETY_PRODUCERS> FsmEventQueue;
+
+// One state machine instance: own state, transition table and event queue
+struct Fsm {
+    uint8_t id;                      // Instance id, recorded in the trace
+    State currentState;
+    uint32_t stateEnteredMs;         // millis() when currentState was entered
+    const TransitionTable* table;    // Lives in flash, shared between instances
+    FsmEventQueue queue;
+    FsmLatencyStats safetyLatency;
+    FsmLatencyStats normalLatency;
+    void* context;                   // User data for the actions (e.g. intersection)
+};
 
 // Function declarations
-void fsm_init(State initialState);
-bool fsm_register_transition(State currentState, State nextState, Event event, ActionFunction action);
-void fsm_push_event(Event event);
-void fsm_process_events(void);
-bool fsm_dispatch_event(Event event);
-State fsm_get_current_state(void);
-void fsm_set_current_state(State state);
-void fsm_reset(State initialState);
-bool fsm_is_ready(void);
+void fsm_init(Fsm* fsm, uint8_t id, State initialState, const TransitionTable* table, void* context);
+void fsm_push_event(Fsm* fsm, Event event);
+bool fsm_process_events(Fsm* fsm);
+bool fsm_dispatch_event(Fsm* fsm, Event event);
+State fsm_get_current_state(const Fsm* fsm);
+void fsm_set_current_state(Fsm* fsm, State state);
+void fsm_reset(Fsm* fsm, State initialState);
+bool fsm_is_ready(const Fsm* fsm);
+bool fsm_is_safety_event(Event event);
+void fsm_get_queue_stats(const Fsm* fsm, EventLaneStats* safety, EventLaneStats* normal);
+void fsm_get_latency_stats(const Fsm* fsm, FsmLatencyStats* safety, FsmLatencyStats* normal);
+uint32_t fsm_latency_percentile(const FsmLatencyStats* stats, uint16_t permille);
+uint32_t fsm_get_time_in_state_ms(const Fsm* fsm);
+
+// Dispatcher: one task processes the events of every registered instance
+bool fsm_dispatcher_add(Fsm* fsm);
+void fsm_dispatcher_set_task(TaskHandle_t task);
+void fsm_dispatcher_wake(void);
+void fsm_dispatcher_process(void);
 
 #endif // _FSM_H_
@@ -0,0 +1,100 @@
+#ifndef _FSM_TABLE_H_
+#define _FSM_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Dense (state x event) transition lookup.
+//
+// The table is built by fsm_build_table() from a plain list of transitions.
+// Declaring the result `constexpr` puts it in .rodata (flash) and makes every
+// lookup a single indexed load instead of a scan over the list.
+//
+// T must provide `currentState`, `nextState` and `transitionEvent` members
+// that convert to size_t. The helpers below have no Arduino dependencies so
+// the same table can be built and exercised on a Linux host.
+template <typename T, size_t NUM_STATES, size_t NUM_EVENTS>
+struct FsmTable {
+    T cells[NUM_STATES][NUM_EVENTS];
+    bool valid[NUM_STATES][NUM_EVENTS];
+
+    constexpr const T* find(size_t state, size_t event) const {
+        return (state < NUM_STATES && event < NUM_EVENTS && valid[state][event])
+            ? &cells[state][event]
+            : nullptr;
+    }
+};
+
+// Build the dense table from a transition list (evaluated at compile time
+// when the result is declared constexpr)
+template <typename T, size_t NUM_STATES, size_t NUM_EVENTS, size_t N>
+constexpr FsmTable<T, NUM_STATES, NUM_EVENTS> fsm_build_table(const T (&transitions)[N]) {
+    FsmTable<T, NUM_STATES, NUM_EVENTS> table{};
+
+    for (size_t i = 0; i < N; i++) {
+        size_t state = transitions[i].currentState;
+        size_t event = transitions[i].transitionEvent;
+
+        table.cells[state][event] = transitions[i];
+        table.valid[state][event] = true;
+    }
+
+    return table;
+}
+
+// Every state and event in the list fits inside the table
+template <typename T, size_t NUM_STATES, size_t NUM_EVENTS, size_t N>
+constexpr bool fsm_transitions_in_range(const T (&transitions)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        if ((size_t)transitions[i].currentState >= NUM_STATES ||
+            (size_t)transitions[i].nextState >= NUM_STATES ||
+            (size_t)transitions[i].transitionEvent >= NUM_EVENTS) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// No two transitions share the same (state, event) pair
+template <typename T, size_t N>
+constexpr bool fsm_transitions_unique(const T (&transitions)[N]) {
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = i + 1; j < N; j++) {
+            if (transitions[i].currentState == transitions[j].currentState &&
+                transitions[i].transitionEvent == transitions[j].transitionEvent) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Every transition starts from a state reachable from the initial state
+template <typename T, size_t NUM_STATES, size_t N>
+constexpr bool fsm_transitions_reachable(const T (&transitions)[N], size_t initialState) {
+    bool reached[NUM_STATES] = {};
+    reached[initialState] = true;
+
+    // Relax until no new state is discovered (at most NUM_STATES passes)
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < N; i++) {
+            size_t from = transitions[i].currentState;
+            size_t to = transitions[i].nextState;
+            if (reached[from] && !reached[to]) {
+                reached[to] = true;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < N; i++) {
+        if (!reached[(size_t)transitions[i].currentState]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // _FSM_TABLE_H_
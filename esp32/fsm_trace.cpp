@@ -0,0 +1,55 @@
+#include <string.h>
+#include <atomic>
+
+#include "fsm_trace.h"
+
+// Ring of the most recent transitions. Single writer (FSM task), the index
+// only grows so readers can tell which slots were overwritten while copying.
+static FsmTraceRecord traceRing[FSM_TRACE_SIZE];
+static std::atomic<uint32_t> traceHead(0);
+
+void fsm_trace_record(uint32_t timestamp_us, uint8_t instance, uint8_t fromState, uint8_t toState, uint8_t event, uint32_t action_us)
+{
+  uint32_t head = traceHead.load(std::memory_order_relaxed);
+  FsmTraceRecord* record = &traceRing[head % FSM_TRACE_SIZE];
+
+  record->timestamp_us = timestamp_us;
+  record->action_us = action_us;
+  record->instance = instance;
+  record->fromState = fromState;
+  record->toState = toState;
+  record->event = event;
+
+  traceHead.store(head + 1, std::memory_order_release);
+}
+
+size_t fsm_trace_snapshot(FsmTraceRecord* out, size_t max_records)
+{
+  uint32_t head = traceHead.load(std::memory_order_acquire);
+  uint32_t available = head < FSM_TRACE_SIZE ? head : FSM_TRACE_SIZE;
+  uint32_t count = available < max_records ? available : (uint32_t) max_records;
+  uint32_t first = head - count;
+
+  for (uint32_t i = 0; i < count; i++) {
+    memcpy(&out[i], &traceRing[(first + i) % FSM_TRACE_SIZE], sizeof(FsmTraceRecord));
+  }
+
+  // Drop the oldest records whose slots the writer reused (or is reusing)
+  // while we were copying
+  uint32_t headAfter = traceHead.load(std::memory_order_acquire);
+  int32_t overwritten = (int32_t)(headAfter + 1 - FSM_TRACE_SIZE - first);
+  if (overwritten >= (int32_t) count) {
+    return 0;
+  }
+  if (overwritten > 0) {
+    memmove(out, out + overwritten, (count - overwritten) * sizeof(FsmTraceRecord));
+    count -= overwritten;
+  }
+
+  return count;
+}
+
+uint32_t fsm_trace_total(void)
+{
+  return traceHead.load(std::memory_order_relaxed);
+}
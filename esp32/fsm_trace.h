@@ -0,0 +1,30 @@
+#ifndef _FSM_TRACE_H_
+#define _FSM_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of transitions kept in the trace ring (12 bytes each)
+#define FSM_TRACE_SIZE 128
+
+// One FSM transition, stored little-endian as-is when dumped
+typedef struct __attribute__((packed)) {
+    uint32_t timestamp_us;   // micros() when the action started
+    uint32_t action_us;      // Time spent inside the transition action
+    uint8_t instance;        // Fsm::id of the state machine
+    uint8_t fromState;
+    uint8_t toState;
+    uint8_t event;
+} FsmTraceRecord;
+
+// Append a record, called from the FSM task only
+void fsm_trace_record(uint32_t timestamp_us, uint8_t instance, uint8_t fromState, uint8_t toState, uint8_t event, uint32_t action_us);
+
+// Copy up to max_records of the most recent records (oldest first) into out,
+// returns the number copied. Safe to call from another task.
+size_t fsm_trace_snapshot(FsmTraceRecord* out, size_t max_records);
+
+// Total number of transitions recorded since boot
+uint32_t fsm_trace_total(void);
+
+#endif // _FSM_TRACE_H_
@@ -0,0 +1,173 @@
+#ifndef _INTERSECTION_CONFIG_H_
+#define _INTERSECTION_CONFIG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pin_config.h"
+#include "traffic_light.h"
+
+// Compile-time description of the intersection: the signal head of every
+// approach, the phase sequence and the base timing of each phase. The FSM
+// states/transitions (intersection_fsm.h) and the GPIO mask of every phase
+// are generated from these tables, so switching a phase costs one table
+// lookup no matter how many approaches there are.
+
+// Number of approaches (signal heads): 2, 3 or 4
+#ifndef INTERSECTION_APPROACHES
+#define INTERSECTION_APPROACHES 2
+#endif
+
+#define APPROACH_COUNT INTERSECTION_APPROACHES
+
+static_assert(APPROACH_COUNT >= 2 && APPROACH_COUNT <= 4, "Supported intersections have 2 to 4 approaches");
+
+// Head 4 uses GPIO16/17, which PSRAM takes on WROVER modules (see pin_config.h)
+#if defined(BOARD_HAS_PSRAM) && APPROACH_COUNT >= 4 && (TRAFFIC_4_YELLOW == 16 || TRAFFIC_4_GREEN == 17)
+#error "TRAFFIC_4_YELLOW/GREEN are on the PSRAM pins, pick other pins in pin_config.h"
+#endif
+
+// Signal head pins, indexed by traffic_light_color_t
+typedef struct {
+  uint8_t pins[3];
+} approach_config_t;
+
+typedef struct {
+  traffic_light_color_t aspects[APPROACH_COUNT];
+  uint8_t approach;       // Approach served by this phase
+  uint32_t duration_ms;   // Base duration
+  bool green;             // Green phase, its length follows the approach demand
+} phase_config_t;
+
+static constexpr approach_config_t APPROACHES[APPROACH_COUNT] = {
+  {{ TRAFFIC_1_RED, TRAFFIC_1_YELLOW, TRAFFIC_1_GREEN }},
+  {{ TRAFFIC_2_RED, TRAFFIC_2_YELLOW, TRAFFIC_2_GREEN }},
+#if APPROACH_COUNT >= 3
+  {{ TRAFFIC_3_RED, TRAFFIC_3_YELLOW, TRAFFIC_3_GREEN }},
+#endif
+#if APPROACH_COUNT >= 4
+  {{ TRAFFIC_4_RED, TRAFFIC_4_YELLOW, TRAFFIC_4_GREEN }},
+#endif
+};
+
+// Phase sequence, run in order and wrapped around
+static constexpr phase_config_t PHASES[] = {
+#if APPROACH_COUNT == 2
+  {{ GREEN,  RED    }, 0, MIN_GREEN_DURATION_MS, true  },
+  {{ YELLOW, RED    }, 0, YELLOW_DURATION_MS,    false },
+  {{ RED,    GREEN  }, 1, MIN_GREEN_DURATION_MS, true  },
+  {{ RED,    YELLOW }, 1, YELLOW_DURATION_MS,    false },
+#elif APPROACH_COUNT == 3
+  {{ GREEN,  RED,    RED    }, 0, MIN_GREEN_DURATION_MS, true  },
+  {{ YELLOW, RED,    RED    }, 0, YELLOW_DURATION_MS,    false },
+  {{ RED,    GREEN,  RED    }, 1, MIN_GREEN_DURATION_MS, true  },
+  {{ RED,    YELLOW, RED    }, 1, YELLOW_DURATION_MS,    false },
+  {{ RED,    RED,    GREEN  }, 2, MIN_GREEN_DURATION_MS, true  },
+  {{ RED,    RED,    YELLOW }, 2, YELLOW_DURATION_MS,    false },
+#else
+  {{ GREEN,  RED,    RED,    RED    }, 0, MIN_GREEN_DURATION_MS, true  },
+  {{ YELLOW, RED,    RED,    RED    }, 0, YELLOW_DURATION_MS,    false },
+  {{ RED,    GREEN,  RED,    RED    }, 1, MIN_GREEN_DURATION_MS, true  },
+  {{ RED,    YELLOW, RED,    RED    }, 1, YELLOW_DURATION_MS,    false },
+  {{ RED,    RED,    GREEN,  RED    }, 2, MIN_GREEN_DURATION_MS, true  },
+  {{ RED,    RED,    YELLOW, RED    }, 2, YELLOW_DURATION_MS,    false },
+  {{ RED,    RED,    RED,    GREEN  }, 3, MIN_GREEN_DURATION_MS, true  },
+  {{ RED,    RED,    RED,    YELLOW }, 3, YELLOW_DURATION_MS,    false },
+#endif
+};
+
+#define PHASE_COUNT (sizeof(PHASES) / sizeof(PHASES[0]))
+
+// Phase held while an emergency vehicle passes, and the one resumed after it
+#define EMERGENCY_PHASE   0
+#define FIRST_PHASE       0
+
+static_assert(PHASE_COUNT >= 2, "An intersection needs at least two phases");
+static_assert(EMERGENCY_PHASE < PHASE_COUNT && FIRST_PHASE < PHASE_COUNT, "Phase index out of range");
+
+#define TRAFFIC_LIGHT_BIT(_PIN) ((traffic_light_mask_t) 1 << (_PIN))
+
+constexpr bool traffic_light_pins_valid() {
+  for (size_t a = 0; a < APPROACH_COUNT; a++) {
+    for (size_t c = 0; c < 3; c++) {
+      if (APPROACHES[a].pins[c] >= 32) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static_assert(traffic_light_pins_valid(), "Signal pins must be on GPIO0-31 to share one output register");
+
+// Pin mask lighting `color` on approach `id`
+constexpr traffic_light_mask_t traffic_light_head_mask(traffic_light_id_t id, traffic_light_color_t color) {
+  return TRAFFIC_LIGHT_BIT(APPROACHES[id].pins[color]);
+}
+
+// All three lamps of approach `id`
+constexpr traffic_light_mask_t traffic_light_approach_mask(traffic_light_id_t id) {
+  return traffic_light_head_mask(id, RED) | traffic_light_head_mask(id, YELLOW) | traffic_light_head_mask(id, GREEN);
+}
+
+constexpr traffic_light_mask_t traffic_light_all_mask() {
+  traffic_light_mask_t mask = 0;
+  for (size_t a = 0; a < APPROACH_COUNT; a++) {
+    mask |= traffic_light_approach_mask(a);
+  }
+  return mask;
+}
+
+#define TRAFFIC_LIGHT_ALL_MASK traffic_light_all_mask()
+
+// Pin mask of a whole phase (the aspect of every head)
+constexpr traffic_light_mask_t traffic_light_phase_mask(const phase_config_t& phase) {
+  traffic_light_mask_t mask = 0;
+  for (size_t a = 0; a < APPROACH_COUNT; a++) {
+    mask |= traffic_light_head_mask(a, phase.aspects[a]);
+  }
+  return mask;
+}
+
+// Conflict check: no unknown pins and at most one approach showing green
+constexpr bool traffic_light_mask_is_safe(traffic_light_mask_t mask) {
+  if ((mask & ~TRAFFIC_LIGHT_ALL_MASK) != 0) {
+    return false;
+  }
+
+  int greens = 0;
+  for (size_t a = 0; a < APPROACH_COUNT; a++) {
+    if (mask & traffic_light_head_mask(a, GREEN)) {
+      greens++;
+    }
+  }
+  return greens <= 1;
+}
+
+// Precomputed GPIO mask of every phase
+typedef struct {
+  traffic_light_mask_t masks[PHASE_COUNT];
+} phase_mask_table_t;
+
+constexpr phase_mask_table_t traffic_light_build_phase_masks() {
+  phase_mask_table_t table{};
+  for (size_t p = 0; p < PHASE_COUNT; p++) {
+    table.masks[p] = traffic_light_phase_mask(PHASES[p]);
+  }
+  return table;
+}
+
+static constexpr phase_mask_table_t PHASE_MASKS = traffic_light_build_phase_masks();
+
+constexpr bool traffic_light_phases_safe() {
+  for (size_t p = 0; p < PHASE_COUNT; p++) {
+    if (!traffic_light_mask_is_safe(PHASE_MASKS.masks[p]) || PHASES[p].approach >= APPROACH_COUNT) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static_assert(traffic_light_phases_safe(), "A phase shows green on more than one approach");
+
+#endif //_INTERSECTION_CONFIG_H_
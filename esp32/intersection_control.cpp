@@ -0,0 +1,100 @@
+#include <Arduino.h>
+
+#include "intersection_config.h"
+#include "intersection_fsm.h"
+#include "intersection_control.h"
+
+Fsm intersectionFsm;
+phase_timer_t phaseTimer;
+signal_timing_t signalTiming;
+
+static intersection_control_hooks_t control_hooks;
+
+static void phase_action(Fsm *fsm, State nextState);
+static void emergency_action(Fsm *fsm, State nextState);
+
+// FSM transitions, generated from the phase sequence in intersection_config.h
+static constexpr IntersectionTransitions transitions = intersection_build_transitions(phase_action, emergency_action);
+
+static_assert(fsm_transitions_in_range<Transition, STATE_COUNT, EVENT_COUNT>(transitions.items), "FSM transition uses an out of range state or event");
+static_assert(fsm_transitions_unique(transitions.items), "FSM transition table has duplicate (state, event) entries");
+static_assert(fsm_transitions_reachable<Transition, STATE_COUNT>(transitions.items, STATE_IDLE), "FSM transition table has entries unreachable from STATE_IDLE");
+
+// Dense State x Event lookup, stored in flash
+static constexpr TransitionTable transitionTable = fsm_make_table(transitions.items);
+
+static void signal_timing_setup(signal_timing_mode_t mode)
+{
+  signal_timing_config_t config = {};
+
+  config.mode = mode;
+  config.approach_count = APPROACH_COUNT;
+  config.min_green_ms = SAFE_MIN_GREEN_MS;
+  config.max_green_ms = MAX_GREEN_DURATION_MS;
+  config.min_cycle_ms = MIN_CYCLE_MS;
+  config.max_cycle_ms = MAX_CYCLE_MS;
+  config.saturation_flow = SATURATION_FLOW_VPS;
+  config.smoothing = DEMAND_SMOOTHING;
+  config.base_green_ms = MIN_GREEN_DURATION_MS;
+  config.extra_per_car_ms = EXTRA_TIME_PER_CAR_MS;
+  config.car_threshold = CAR_COUNT_THRESHOLD;
+
+  // Every non-green phase is lost time for the cycle
+  for (uint8_t phase = 0; phase < PHASE_COUNT; phase++)
+  {
+    if (!PHASES[phase].green)
+      config.lost_time_ms += PHASES[phase].duration_ms;
+  }
+
+  signal_timing_init(&signalTiming, &config);
+}
+
+void intersection_control_init(signal_timing_mode_t mode, const intersection_control_hooks_t *hooks)
+{
+  control_hooks = *hooks;
+
+  signal_timing_setup(mode);
+  fsm_init(&intersectionFsm, 0, STATE_IDLE, &transitionTable, NULL);
+  phase_timer_init(&phaseTimer, &intersectionFsm, EVENT_SWITCH);
+}
+
+// Green phases take the split computed by the timing engine for their
+// approach at the start of the cycle, stretched when the queue waiting now
+// needs longer to clear
+uint32_t intersection_phase_duration(uint8_t phase)
+{
+  const phase_config_t &config = PHASES[phase];
+
+  if (!config.green)
+    return config.duration_ms;
+
+  return signal_timing_start_green(&signalTiming, config.approach);
+}
+
+static void phase_action(Fsm *fsm, State nextState)
+{
+  uint8_t phase = intersection_state_phase(nextState);
+
+  // Queues grow while their approach is red, that is how arrivals are measured
+  signal_timing_phase_started(&signalTiming, PHASES[phase].approach, millis());
+
+  // New cycle: plan every green from the demand seen during the last one
+  if (phase == FIRST_PHASE)
+    signal_timing_update(&signalTiming);
+
+  if (control_hooks.phase_started)
+    control_hooks.phase_started(phase);
+
+  phase_timer_start(&phaseTimer, intersection_phase_duration, phase);
+}
+
+static void emergency_action(Fsm *fsm, State nextState)
+{
+  signal_timing_phase_started(&signalTiming, PHASES[EMERGENCY_PHASE].approach, millis());
+
+  // Hold the lights until the emergency is cleared
+  phase_timer_cancel(&phaseTimer);
+
+  if (control_hooks.emergency_started)
+    control_hooks.emergency_started();
+}
@@ -0,0 +1,34 @@
+#ifndef _INTERSECTION_CONTROL_H_
+#define _INTERSECTION_CONTROL_H_
+
+#include <stdint.h>
+
+#include "fsm.h"
+#include "phase_timer.h"
+#include "signal_timing.h"
+
+// Intersection controller: the FSM running the phase sequence of
+// intersection_config.h, the timer that ends every phase and the timing
+// engine that sizes the greens. The transition actions report phase changes
+// to the timing engine, plan a new cycle when FIRST_PHASE starts and time
+// the phase; what the phase means for the outputs is left to the hooks, so
+// the firmware (signal heads, pump, preemption) and tools/traffic_sim
+// (simulated queues) run the same control logic.
+
+typedef struct {
+  void (*phase_started)(uint8_t phase);  // Show PHASES[phase], before its timer starts
+  void (*emergency_started)(void);       // Show EMERGENCY_PHASE, held until cleared
+} intersection_control_hooks_t;
+
+extern Fsm intersectionFsm;
+extern phase_timer_t phaseTimer;
+extern signal_timing_t signalTiming;
+
+// (Re)initialize the FSM, phase timer and timing engine. The FSM is left in
+// STATE_IDLE, push EVENT_START to run the first phase.
+void intersection_control_init(signal_timing_mode_t mode, const intersection_control_hooks_t *hooks);
+
+// Phase length, evaluated when the phase starts
+uint32_t intersection_phase_duration(uint8_t phase);
+
+#endif // _INTERSECTION_CONTROL_H_
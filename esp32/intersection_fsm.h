@@ -0,0 +1,52 @@
+#ifndef _INTERSECTION_FSM_H_
+#define _INTERSECTION_FSM_H_
+
+#include <stddef.h>
+
+#include "fsm.h"
+#include "intersection_config.h"
+
+// FSM transitions generated from the phase sequence in intersection_config.h:
+//   IDLE      --START-->           first phase
+//   phase N   --SWITCH-->          phase N + 1 (wrapping around)
+//   phase N   --EMERGENCY-->       EMERGENCY
+//   EMERGENCY --CLEAR_EMERGENCY--> first phase
+
+#define INTERSECTION_TRANSITION_COUNT (2 + 2 * PHASE_COUNT)
+
+typedef struct {
+    Transition items[INTERSECTION_TRANSITION_COUNT];
+} IntersectionTransitions;
+
+constexpr State intersection_phase_state(size_t phase) {
+    return (State)(STATE_PHASE_FIRST + phase);
+}
+
+constexpr bool intersection_is_phase_state(State state) {
+    return state >= STATE_PHASE_FIRST && state <= STATE_PHASE_LAST;
+}
+
+constexpr uint8_t intersection_state_phase(State state) {
+    return (uint8_t)(state - STATE_PHASE_FIRST);
+}
+
+constexpr IntersectionTransitions intersection_build_transitions(ActionFunction phaseAction, ActionFunction emergencyAction) {
+    IntersectionTransitions transitions{};
+    size_t n = 0;
+
+    transitions.items[n++] = { STATE_IDLE, intersection_phase_state(FIRST_PHASE), EVENT_START, phaseAction };
+
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        transitions.items[n++] = { intersection_phase_state(p), intersection_phase_state((p + 1) % PHASE_COUNT), EVENT_SWITCH, phaseAction };
+    }
+
+    for (size_t p = 0; p < PHASE_COUNT; p++) {
+        transitions.items[n++] = { intersection_phase_state(p), STATE_EMERGENCY, EVENT_EMERGENCY, emergencyAction };
+    }
+
+    transitions.items[n++] = { STATE_EMERGENCY, intersection_phase_state(FIRST_PHASE), EVENT_CLEAR_EMERGENCY, phaseAction };
+
+    return transitions;
+}
+
+#endif // _INTERSECTION_FSM_H_
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "json_writer.h"
+
+static void put(json_writer_t *writer, const char *text, size_t length)
+{
+  if (writer->overflow)
+    return;
+
+  // Keep room for the terminator
+  if (writer->length + length >= writer->capacity)
+  {
+    writer->overflow = true;
+    writer->buffer[writer->length] = '\0';
+    return;
+  }
+
+  memcpy(writer->buffer + writer->length, text, length);
+  writer->length += length;
+  writer->buffer[writer->length] = '\0';
+}
+
+static void put_char(json_writer_t *writer, char c)
+{
+  put(writer, &c, 1);
+}
+
+// Separator and key of the next member
+static void member(json_writer_t *writer, const char *key)
+{
+  if (writer->has_member[writer->depth])
+    put_char(writer, ',');
+  writer->has_member[writer->depth] = true;
+
+  if (key != NULL)
+  {
+    put_char(writer, '"');
+    put(writer, key, strlen(key));
+    put(writer, "\":", 2);
+  }
+}
+
+static void begin(json_writer_t *writer, const char *key, char open)
+{
+  member(writer, key);
+  put_char(writer, open);
+
+  if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH)
+  {
+    writer->overflow = true;
+    return;
+  }
+  writer->depth++;
+  writer->has_member[writer->depth] = false;
+}
+
+static void end(json_writer_t *writer, char close)
+{
+  if (writer->depth > 0)
+    writer->depth--;
+  put_char(writer, close);
+}
+
+void json_writer_init(json_writer_t *writer, char *buffer, size_t capacity)
+{
+  memset(writer, 0, sizeof(*writer));
+  writer->buffer = buffer;
+  writer->capacity = capacity;
+  writer->overflow = capacity == 0;
+  if (capacity > 0)
+    buffer[0] = '\0';
+}
+
+void json_writer_raw(json_writer_t *writer, const char *text)
+{
+  put(writer, text, strlen(text));
+}
+
+void json_writer_begin_object(json_writer_t *writer, const char *key)
+{
+  begin(writer, key, '{');
+}
+
+void json_writer_end_object(json_writer_t *writer)
+{
+  end(writer, '}');
+}
+
+void json_writer_begin_array(json_writer_t *writer, const char *key)
+{
+  begin(writer, key, '[');
+}
+
+void json_writer_end_array(json_writer_t *writer)
+{
+  end(writer, ']');
+}
+
+void json_writer_u32(json_writer_t *writer, const char *key, uint32_t value)
+{
+  char digits[12];
+  int length = snprintf(digits, sizeof(digits), "%lu", (unsigned long) value);
+
+  member(writer, key);
+  put(writer, digits, (size_t) length);
+}
+
+void json_writer_i32(json_writer_t *writer, const char *key, int32_t value)
+{
+  char digits[12];
+  int length = snprintf(digits, sizeof(digits), "%ld", (long) value);
+
+  member(writer, key);
+  put(writer, digits, (size_t) length);
+}
+
+void json_writer_bool(json_writer_t *writer, const char *key, bool value)
+{
+  member(writer, key);
+  if (value)
+    put(writer, "true", 4);
+  else
+    put(writer, "false", 5);
+}
+
+void json_writer_string(json_writer_t *writer, const char *key, const char *value)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+
+  member(writer, key);
+  put_char(writer, '"');
+
+  for (const char *c = value; *c != '\0'; c++)
+  {
+    switch (*c)
+    {
+      case '"':  put(writer, "\\\"", 2); break;
+      case '\\': put(writer, "\\\\", 2); break;
+      case '\n': put(writer, "\\n", 2); break;
+      case '\r': put(writer, "\\r", 2); break;
+      case '\t': put(writer, "\\t", 2); break;
+      default:
+        if ((uint8_t) *c < 0x20)
+        {
+          char escaped[6] = {'\\', 'u', '0', '0', hexDigits[(uint8_t) *c >> 4], hexDigits[*c & 0x0F]};
+          put(writer, escaped, sizeof(escaped));
+        }
+        else
+        {
+          put_char(writer, *c);
+        }
+        break;
+    }
+  }
+
+  put_char(writer, '"');
+}
+
+const char *json_writer_finish(json_writer_t *writer, size_t *length)
+{
+  if (writer->overflow)
+    return NULL;
+
+  if (length != NULL)
+    *length = writer->length;
+  return writer->buffer;
+}
@@ -0,0 +1,43 @@
+#ifndef _JSON_WRITER_H_
+#define _JSON_WRITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Streaming JSON encoder into a caller provided buffer, for periodic
+// telemetry that must not touch the heap. Keys are written as given (no
+// escaping), string values are escaped. Once the buffer is full every
+// further write is ignored and overflow is set, the output stays terminated.
+
+#define JSON_WRITER_MAX_DEPTH 8
+
+typedef struct {
+  char *buffer;
+  size_t capacity;
+  size_t length;
+  uint8_t depth;
+  bool overflow;
+  bool has_member[JSON_WRITER_MAX_DEPTH];  // Comma needed before the next member
+} json_writer_t;
+
+void json_writer_init(json_writer_t *writer, char *buffer, size_t capacity);
+
+// Verbatim text, e.g. a Socket.IO namespace prefix
+void json_writer_raw(json_writer_t *writer, const char *text);
+
+// Containers, key is NULL inside arrays and at the top level
+void json_writer_begin_object(json_writer_t *writer, const char *key);
+void json_writer_end_object(json_writer_t *writer);
+void json_writer_begin_array(json_writer_t *writer, const char *key);
+void json_writer_end_array(json_writer_t *writer);
+
+// Members, key is NULL for array elements
+void json_writer_u32(json_writer_t *writer, const char *key, uint32_t value);
+void json_writer_i32(json_writer_t *writer, const char *key, int32_t value);
+void json_writer_bool(json_writer_t *writer, const char *key, bool value);
+void json_writer_string(json_writer_t *writer, const char *key, const char *value);
+
+// Terminated output, NULL if it did not fit
+const char *json_writer_finish(json_writer_t *writer, size_t *length);
+
+#endif //_JSON_WRITER_H_
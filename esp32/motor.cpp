@@ -1,4 +1,3 @@
-
 #include <Arduino.h>
 
 #include "freertos/FreeRTOS.h"
@@ -7,90 +6,301 @@
 
 #include "pin_config.h"
 #include "motor.h"
+#include "executor.h"
+
+// Position is tracked in microseconds of full speed travel, so one unit of
+// duty applied for one microsecond moves it by duty / MOTOR_DUTY_MAX
+#define MOTOR_DUTY_MAX      ((1 << MOTOR_PWM_RESOLUTION) - 1)
+#define MOTOR_MIN_DUTY      (MOTOR_DUTY_MAX * MOTOR_MIN_DUTY_PERCENT / 100)
+#define MOTOR_TRAVEL_US     ((int32_t) PUMP_DURATION_MS * 1000)
 
 typedef enum {
-  MOTOR_LEFT,
-  MOTOR_RIGHT,
-  MOTOR_STOP
+  MOTOR_MOVE,
+  MOTOR_HALT
+} motor_command_type_t;
+
+typedef struct {
+  motor_command_type_t type;
+  uint16_t position;
+  motor_callback_t callback;
+  void *arg;
 } motor_command_t;
 
-QueueHandle_t motor_queue = NULL;
+static QueueHandle_t motor_queue = NULL;
 
-void motor_task(void *pvParams)
+// Controller state, only touched by the motor task
+static int32_t position_us = 0;        // Assumed closed at boot (pump starts PUMP_OFF)
+static int32_t target_us = 0;
+static bool has_target = false;
+static int8_t direction = 0;           // +1 opening, -1 closing, 0 idle
+static int32_t duty = 0;
+static uint32_t last_update_us = 0;
+static motor_callback_t done_callback = NULL;
+static void *done_arg = NULL;
+
+// Published for other tasks
+static volatile uint16_t reported_position = MOTOR_POSITION_CLOSED;
+static volatile bool moving = false;
+static volatile uint32_t dropped_commands = 0;
+
+static uint16_t to_permille(int32_t travel_us)
 {
-  motor_queue = xQueueCreate(10, sizeof(motor_command_t));
+  return (uint16_t)((int64_t) travel_us * MOTOR_POSITION_OPEN / MOTOR_TRAVEL_US);
+}
 
-  if (motor_queue == NULL)
+static void write_outputs(void)
+{
+  // H-bridge: PWM on the pin of the current direction, the other held low
+  ledcWrite(MOTOR_PIN_1, direction > 0 ? duty : 0);
+  ledcWrite(MOTOR_PIN_2, direction < 0 ? duty : 0);
+}
+
+static void finish(motor_result_t result)
+{
+  motor_callback_t callback = done_callback;
+  void *arg = done_arg;
+
+  done_callback = NULL;
+  done_arg = NULL;
+  has_target = false;
+
+  if (callback != NULL)
+    callback(arg, result, to_permille(position_us));
+}
+
+static void halt(void)
+{
+  duty = 0;
+  direction = 0;
+  write_outputs();
+}
+
+static void handle_command(const motor_command_t *command)
+{
+  switch (command->type)
   {
-    // Queue creation failed
-    Serial.println("[Motor] Failed to create motor queue");
-    vTaskDelete(NULL);
+  case MOTOR_MOVE:
+    if (has_target)
+      finish(MOTOR_RESULT_SUPERSEDED);
+
+    target_us = (int32_t)((int64_t) command->position * MOTOR_TRAVEL_US / MOTOR_POSITION_OPEN);
+    done_callback = command->callback;
+    done_arg = command->arg;
+    has_target = true;
+    break;
+
+  case MOTOR_HALT:
+    halt();
+    if (has_target)
+      finish(MOTOR_RESULT_STOPPED);
+    break;
+  }
+}
+
+// Advance the position estimate and ramp the duty toward the target
+static void update(void)
+{
+  uint32_t now = micros();
+  int32_t elapsed_us = (int32_t)(now - last_update_us);
+  last_update_us = now;
+
+  // Integrate the travel done with the duty applied since the last update,
+  // stopping on the target if it was crossed within the period
+  bool arrived = false;
+  if (direction != 0 && duty > 0)
+  {
+    int32_t travelled = (int32_t)((int64_t) elapsed_us * duty / MOTOR_DUTY_MAX);
+    int32_t distance = (target_us - position_us) * direction;
+
+    if (has_target && distance >= 0 && travelled >= distance)
+    {
+      position_us = target_us;
+      arrived = true;
+    }
+    else
+    {
+      position_us += direction * travelled;
+      if (position_us < 0)
+        position_us = 0;
+      if (position_us > MOTOR_TRAVEL_US)
+        position_us = MOTOR_TRAVEL_US;
+    }
+  }
+
+  reported_position = to_permille(position_us);
+
+  if (!has_target)
+  {
+    if (duty > 0)
+      halt();
+    moving = false;
     return;
   }
 
-  pinMode(MOTOR_PIN_1, OUTPUT);
-  pinMode(MOTOR_PIN_2, OUTPUT);
+  int32_t remaining = target_us - position_us;
+  int8_t wanted = remaining > 0 ? 1 : (remaining < 0 ? -1 : 0);
 
-  digitalWrite(MOTOR_PIN_1, LOW);
-  digitalWrite(MOTOR_PIN_2, LOW);
+  if (arrived || wanted == 0)
+  {
+    halt();
+    moving = false;
+    finish(MOTOR_RESULT_DONE);
+    return;
+  }
 
-  Serial.println("[Motor] Motor task started");
-  
-  motor_command_t command;
-  
-  while (true)
+  moving = true;
+
+  int32_t step = (int32_t)((int64_t) MOTOR_DUTY_MAX * MOTOR_CONTROL_PERIOD_MS / MOTOR_RAMP_MS);
+  if (step < 1)
+    step = 1;
+
+  int32_t desired;
+  if (direction != wanted)
   {
-    if (xQueueReceive(motor_queue, &command, pdMS_TO_TICKS(10)) == pdTRUE)
+    // Ramp down before reversing
+    desired = 0;
+    if (duty <= step)
     {
-      // Process motor command
-      switch (command)
-      {
-        case MOTOR_LEFT:
-          digitalWrite(MOTOR_PIN_1, HIGH);
-          digitalWrite(MOTOR_PIN_2, LOW);
-          break;
-        case MOTOR_RIGHT:
-          digitalWrite(MOTOR_PIN_1, LOW);
-          digitalWrite(MOTOR_PIN_2, HIGH);
-          break;
-        case MOTOR_STOP:
-          digitalWrite(MOTOR_PIN_1, LOW);
-          digitalWrite(MOTOR_PIN_2, LOW);
-          break;
-      }
+      duty = 0;
+      direction = wanted;
+      desired = MOTOR_MIN_DUTY;
     }
-    vTaskDelay(pdMS_TO_TICKS(10)); // Small delay to prevent task hogging CPU
   }
+  else
+  {
+    // Distance covered while ramping from the current duty down to zero
+    int32_t distance = remaining < 0 ? -remaining : remaining;
+    int32_t braking = (int32_t)((int64_t) duty * duty * MOTOR_RAMP_MS * 1000 / ((int64_t) MOTOR_DUTY_MAX * MOTOR_DUTY_MAX) / 2);
+    desired = distance <= braking ? MOTOR_MIN_DUTY : MOTOR_DUTY_MAX;
+  }
+
+  if (duty < desired)
+    duty = duty + step > desired ? desired : duty + step;
+  else if (duty > desired)
+    duty = duty - step < desired ? desired : duty - step;
+
+  // Never crawl below the stall duty while still travelling
+  if (direction == wanted && duty < MOTOR_MIN_DUTY)
+    duty = MOTOR_MIN_DUTY;
+
+  write_outputs();
 }
 
-void motor_turn_left()
+void motor_init(void)
 {
+  motor_queue = xQueueCreate(10, sizeof(motor_command_t));
+
   if (motor_queue == NULL)
+  {
+    // Queue creation failed
+    Serial.println("[Motor] Failed to create motor queue");
     return;
+  }
+
+  ledcAttach(MOTOR_PIN_1, MOTOR_PWM_FREQUENCY, MOTOR_PWM_RESOLUTION);
+  ledcAttach(MOTOR_PIN_2, MOTOR_PWM_FREQUENCY, MOTOR_PWM_RESOLUTION);
+  halt();
 
-  motor_command_t command = MOTOR_LEFT;
-  xQueueSend(motor_queue, &command, pdMS_TO_TICKS(100));
+  Serial.println("[Motor] Motor started");
 }
 
-void motor_turn_right()
+static void receive(const motor_command_t *command)
 {
+  if (!moving)
+    last_update_us = micros();
+  handle_command(command);
+}
+
+uint32_t motor_poll(void)
+{
+  motor_command_t command;
+
+  while (xQueueReceive(motor_queue, &command, 0) == pdTRUE)
+    receive(&command);
+
+  if (moving || has_target)
+    update();
+
+  return moving ? MOTOR_CONTROL_PERIOD_MS : MOTOR_WAIT_FOREVER;
+}
+
+void motor_task(void *pvParams)
+{
+  motor_init();
+
   if (motor_queue == NULL)
+  {
+    vTaskDelete(NULL);
     return;
+  }
+
+  motor_command_t command;
+
+  while (true)
+  {
+    // Tick at the control period while moving, sleep until a command otherwise
+    TickType_t wait = moving ? pdMS_TO_TICKS(MOTOR_CONTROL_PERIOD_MS) : portMAX_DELAY;
 
-  motor_command_t command = MOTOR_RIGHT;
-  xQueueSend(motor_queue, &command, pdMS_TO_TICKS(100));
+    if (xQueueReceive(motor_queue, &command, wait) == pdTRUE)
+      receive(&command);
+
+    update();
+  }
 }
 
-void motor_stop()
+static bool send_command(const motor_command_t *command)
 {
   if (motor_queue == NULL)
-    return;
+    return false;
+
+  // Never block the caller, it may be the socket or FSM task
+  if (xQueueSend(motor_queue, command, 0) != pdTRUE)
+  {
+    dropped_commands++;
+    return false;
+  }
+
+  executor_wake();
+  return true;
+}
+
+bool motor_move_to(uint16_t position, motor_callback_t callback, void *arg)
+{
+  motor_command_t command;
+  command.type = MOTOR_MOVE;
+  command.position = position > MOTOR_POSITION_OPEN ? MOTOR_POSITION_OPEN : position;
+  command.callback = callback;
+  command.arg = arg;
+  return send_command(&command);
+}
 
-  motor_command_t command = MOTOR_STOP;
-  xQueueSend(motor_queue, &command, pdMS_TO_TICKS(100));
+void motor_stop()
+{
+  motor_command_t command;
+  command.type = MOTOR_HALT;
+  command.position = 0;
+  command.callback = NULL;
+  command.arg = NULL;
+  send_command(&command);
+}
+
+uint16_t motor_get_position()
+{
+  return reported_position;
+}
+
+bool motor_is_moving()
+{
+  return moving;
 }
 
 bool motor_is_ready()
 {
   return motor_queue != NULL;
-}
\ No newline at end of file
+}
+
+void motor_get_queue_stats(motor_queue_stats_t *out)
+{
+  out->depth = motor_queue != NULL ? uxQueueMessagesWaiting(motor_queue) : 0;
+  out->dropped = dropped_commands;
+}
@@ -1,11 +1,53 @@
 #ifndef _MOTOR_H_
 #define _MOTOR_H_
 
+#include <stdint.h>
+
+// Asynchronous pump actuator. Callers give a target position and return
+// right away; the motor task ramps the PWM duty up and down, integrates an
+// estimated position from the applied duty and reports completion through
+// the callback. A new target mid-travel (e.g. close while still opening)
+// ramps down, reverses and only covers the remaining distance.
+
+// Estimated position, in permille of the full travel
+#define MOTOR_POSITION_CLOSED  0
+#define MOTOR_POSITION_OPEN    1000
+
+typedef enum {
+  MOTOR_RESULT_DONE = 0,     // Target reached
+  MOTOR_RESULT_SUPERSEDED,   // Replaced by a newer target before reaching it
+  MOTOR_RESULT_STOPPED       // Halted by motor_stop()
+} motor_result_t;
+
+// Runs in the motor task, keep it short and never block
+typedef void (*motor_callback_t)(void *arg, motor_result_t result, uint16_t position);
+
+// Command queue occupancy and commands refused because it was full
+typedef struct {
+  uint32_t depth;
+  uint32_t dropped;
+} motor_queue_stats_t;
+
+// Returned by motor_poll() when the motor is idle
+#define MOTOR_WAIT_FOREVER  UINT32_MAX
+
 void motor_task(void *pvParams);
 
-void motor_turn_left();
-void motor_turn_right();
+// Executor layout (executor.h): init once, then poll. Returns the
+// milliseconds until the next control update is due.
+void motor_init(void);
+uint32_t motor_poll(void);
+
+// Move to `position` (MOTOR_POSITION_CLOSED..MOTOR_POSITION_OPEN), never
+// blocks. Returns false if the command queue is full or not created yet.
+bool motor_move_to(uint16_t position, motor_callback_t callback, void *arg);
+
+// Cut the outputs immediately and drop the current target
 void motor_stop();
+
+uint16_t motor_get_position();
+bool motor_is_moving();
 bool motor_is_ready();
+void motor_get_queue_stats(motor_queue_stats_t *stats);
 
-#endif //_MOTOR_H_
\ No newline at end of file
+#endif //_MOTOR_H_
@@ -0,0 +1,101 @@
+#include <Arduino.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "phase_timer.h"
+
+// The phase generation is passed as the timer tag: a timer that fires after
+// its phase was restarted or cancelled carries an old generation and is
+// ignored, so a phase can never switch twice.
+
+static portMUX_TYPE phase_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void phase_expired(void *arg, uint32_t generation)
+{
+  phase_timer_t *phase = (phase_timer_t *) arg;
+  uint32_t now = micros();
+
+  portENTER_CRITICAL(&phase_mux);
+  if (generation != phase->generation)
+  {
+    portEXIT_CRITICAL(&phase_mux);
+    return;
+  }
+
+  phase->timer = TIMER_ID_NONE;
+
+  int32_t error_us = (int32_t)((now - phase->start_us) - phase->duration_ms * 1000UL);
+  uint32_t abs_error_us = error_us < 0 ? (uint32_t)(-error_us) : (uint32_t) error_us;
+
+  phase->stats.phases++;
+  phase->stats.last_error_us = error_us;
+  if (abs_error_us > phase->stats.max_abs_error_us)
+    phase->stats.max_abs_error_us = abs_error_us;
+  portEXIT_CRITICAL(&phase_mux);
+
+  fsm_push_event(phase->fsm, phase->event);
+}
+
+// Swap in a new timer for the given generation, cancels whichever loses
+static void install_timer(phase_timer_t *phase, uint32_t generation, timer_id_t timer)
+{
+  timer_id_t old_timer = TIMER_ID_NONE;
+
+  portENTER_CRITICAL(&phase_mux);
+  if (phase->generation == generation)
+  {
+    old_timer = phase->timer;
+    phase->timer = timer;
+  }
+  else
+  {
+    old_timer = timer;
+  }
+  portEXIT_CRITICAL(&phase_mux);
+
+  timer_service_cancel(old_timer);
+}
+
+void phase_timer_init(phase_timer_t *phase, Fsm *fsm, Event event)
+{
+  phase->fsm = fsm;
+  phase->event = event;
+  phase->timer = TIMER_ID_NONE;
+  phase->generation = 0;
+  phase->start_us = 0;
+  phase->duration_ms = 0;
+  phase->stats = phase_timer_stats_t();
+}
+
+void phase_timer_start(phase_timer_t *phase, phase_duration_fn_t duration_fn, uint8_t index)
+{
+  uint32_t duration_ms = duration_fn(index);
+
+  portENTER_CRITICAL(&phase_mux);
+  uint32_t generation = ++phase->generation;
+  phase->start_us = micros();
+  phase->duration_ms = duration_ms;
+  portEXIT_CRITICAL(&phase_mux);
+
+  // Scheduling notifies the timer task, keep it outside the critical section
+  timer_id_t timer = timer_service_schedule(duration_ms, phase_expired, phase, generation);
+  install_timer(phase, generation, timer);
+}
+
+void phase_timer_cancel(phase_timer_t *phase)
+{
+  portENTER_CRITICAL(&phase_mux);
+  timer_id_t timer = phase->timer;
+  phase->generation++;
+  phase->timer = TIMER_ID_NONE;
+  portEXIT_CRITICAL(&phase_mux);
+
+  timer_service_cancel(timer);
+}
+
+void phase_timer_get_stats(phase_timer_t *phase, phase_timer_stats_t *stats)
+{
+  portENTER_CRITICAL(&phase_mux);
+  *stats = phase->stats;
+  portEXIT_CRITICAL(&phase_mux);
+}
@@ -0,0 +1,40 @@
+#ifndef _PHASE_TIMER_H_
+#define _PHASE_TIMER_H_
+
+#include <stdint.h>
+
+#include "fsm.h"
+#include "timer_service.h"
+
+// Computes the length of phase `index` (of PHASES[]) when it starts
+typedef uint32_t (*phase_duration_fn_t)(uint8_t index);
+
+// Phase-length error measured when the timer fires (actual - configured)
+typedef struct {
+  uint32_t phases;
+  int32_t last_error_us;
+  uint32_t max_abs_error_us;
+} phase_timer_stats_t;
+
+// Fires `event` into `fsm` exactly when the current phase expires
+typedef struct {
+  Fsm *fsm;
+  Event event;
+  timer_id_t timer;
+  uint32_t generation;   // Bumped whenever the pending timer is replaced
+  uint32_t start_us;
+  uint32_t duration_ms;
+  phase_timer_stats_t stats;
+} phase_timer_t;
+
+void phase_timer_init(phase_timer_t *phase, Fsm *fsm, Event event);
+
+// Start timing a new phase, called from the transition action entering it
+void phase_timer_start(phase_timer_t *phase, phase_duration_fn_t duration_fn, uint8_t index);
+
+// Stop timing (e.g. while an emergency holds the lights)
+void phase_timer_cancel(phase_timer_t *phase);
+
+void phase_timer_get_stats(phase_timer_t *phase, phase_timer_stats_t *stats);
+
+#endif //_PHASE_TIMER_H_
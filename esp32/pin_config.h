@@ -12,7 +12,30 @@
 #define TRAFFIC_2_YELLOW  26
 #define TRAFFIC_2_GREEN   27
 
-#define PUMP_DURATION_MS        2700 // 2.7 seconds
+// Only used by 3 and 4 approach intersections (see intersection_config.h).
+// The heads share one output register, so every lamp is on GPIO0-31, and
+// the free pins there are not all plain outputs. These assume an
+// ESP32-WROOM-32 (DevKitC) without PSRAM:
+//   16, 17  PSRAM clock/chip select on WROVER modules, unusable there
+//   5       strapping pin, must not be pulled low by the driver at reset
+//   13, 14  JTAG TCK/TMS, unavailable while debugging over JTAG; 14
+//           toggles during boot, so head 4 may flash red on reset
+// On a WROVER board, move head 4 off 16/17 before building 4 approaches.
+#define TRAFFIC_3_RED     4
+#define TRAFFIC_3_YELLOW  5
+#define TRAFFIC_3_GREEN   13
+
+#define TRAFFIC_4_RED     14
+#define TRAFFIC_4_YELLOW  16
+#define TRAFFIC_4_GREEN   17
+
+#define PUMP_DURATION_MS        2700 // 2.7 seconds of full speed travel from closed to open
+
+#define MOTOR_PWM_FREQUENCY     20000 // 20 kHz, above audible range
+#define MOTOR_PWM_RESOLUTION    10    // bits
+#define MOTOR_RAMP_MS           300   // 0 to full duty
+#define MOTOR_MIN_DUTY_PERCENT  30    // Below this the motor stalls
+#define MOTOR_CONTROL_PERIOD_MS 10    // Ramp/position update period while moving
 
 #define STATUS_UPDATE_INTERVAL_MS   2000
 
@@ -22,11 +45,17 @@
 
 
 #define MIN_GREEN_DURATION_MS   30000 // 30 seconds
+#define SAFE_MIN_GREEN_MS       10000 // Shortest green the timing engine gives (pedestrian crossing)
+#define MAX_GREEN_DURATION_MS   90000 // 90 seconds
+#define MIN_CYCLE_MS            40000 // 40 seconds
+#define MAX_CYCLE_MS           180000 // 3 minutes
+#define SATURATION_FLOW_VPS     0.5f  // Vehicles per second per green approach (~1800 veh/h)
+#define DEMAND_SMOOTHING        0.3f  // Weight of the newest count when averaging demand
+
+// Original fixed-step rule, kept as SIGNAL_TIMING_LEGACY (see signal_timing.h)
 #define EXTRA_TIME_PER_CAR_MS   3000  // 3 seconds per detected car
 #define CAR_COUNT_THRESHOLD     9    // Max number of cars to consider for extra time
 
 #define SPEED_THRESHOLD         80   // (~80 km/h)
 
-#define TOTAL_GREEN_TIME_MS(_CAR_COUNT) (MIN_GREEN_DURATION_MS + (EXTRA_TIME_PER_CAR_MS * (_CAR_COUNT - CAR_COUNT_THRESHOLD))) 
-
 #endif //_PIN_CONFIG_H_
\ No newline at end of file
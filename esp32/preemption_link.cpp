@@ -0,0 +1,305 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "mbedtls/md.h"
+
+#include "executor.h"
+#include "preemption_protocol.h"
+#include "preemption_link.h"
+#include "socket_watch.h"
+#include "traffic_state.h"
+
+// Newest accepted message, stored in NVS so a reboot does not reopen the
+// window to replays
+typedef struct {
+  uint32_t session;
+  uint32_t highest;
+} stored_window_t;
+
+typedef struct {
+  bool valid;
+  struct sockaddr_in from;
+  uint32_t session;
+  uint32_t sequence;
+  uint32_t received_us;
+} pending_request_t;
+
+static int preemption_socket = -1;
+
+// One HMAC context per calling task: the receive path and the control side
+static mbedtls_md_context_t receive_hmac;
+static mbedtls_md_context_t applied_hmac;
+
+// Only touched by the receive path
+static preemption_window_t window = {0, 0, 0, false};
+static uint8_t buffer[64] __attribute__((aligned(4)));
+
+static portMUX_TYPE pending_mux = portMUX_INITIALIZER_UNLOCKED;
+static pending_request_t pending = {};
+
+// Written by the receive path, stored by whichever side gets to it first
+static Preferences preferences;
+static bool preferences_open = false;
+static stored_window_t accepted_window = {0, 0};
+static bool store_due = false;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static preemption_link_stats_t stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static bool hmac_setup(mbedtls_md_context_t *context, const uint8_t *key, size_t key_length)
+{
+  mbedtls_md_init(context);
+
+  // Allocates once here, nothing is allocated per datagram
+  if (mbedtls_md_setup(context, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0)
+    return false;
+
+  return mbedtls_md_hmac_starts(context, key, key_length) == 0;
+}
+
+static void compute_tag(mbedtls_md_context_t *context, const preemption_message_t *message, uint8_t *tag)
+{
+  uint8_t digest[32];
+
+  mbedtls_md_hmac_reset(context);
+  mbedtls_md_hmac_update(context, (const uint8_t *) message, PREEMPTION_SIGNED_SIZE);
+  mbedtls_md_hmac_finish(context, digest);
+
+  memcpy(tag, digest, PREEMPTION_TAG_SIZE);
+}
+
+static void send_ack(mbedtls_md_context_t *context, const struct sockaddr_in *to, uint32_t session, uint32_t sequence,
+                     preemption_status_t status, uint32_t elapsed_us)
+{
+  preemption_message_t ack;
+
+  preemption_message_encode(&ack, PREEMPTION_ACK, status, session, sequence, elapsed_us);
+  compute_tag(context, &ack, ack.tag);
+
+  sendto(preemption_socket, &ack, sizeof(ack), 0, (const struct sockaddr *) to, sizeof(*to));
+}
+
+static void count(uint32_t *counter)
+{
+  portENTER_CRITICAL(&stats_mux);
+  (*counter)++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+// Flash writes stall both cores, so a request is stored only once its
+// emergency phase is set (preemption_link_applied()). A reboot in between
+// lets that one message be replayed.
+static void store_window(void)
+{
+  stored_window_t stored;
+  bool due;
+
+  portENTER_CRITICAL(&pending_mux);
+  due = store_due;
+  stored = accepted_window;
+  store_due = false;
+  portEXIT_CRITICAL(&pending_mux);
+
+  // One blob, so session and sequence always change together
+  if (due && preferences_open && preferences.putBytes(PREEMPTION_NVS_KEY, &stored, sizeof(stored)) != sizeof(stored))
+    count(&stats.store_errors);
+}
+
+static void load_window(void)
+{
+  preferences_open = preferences.begin(PREEMPTION_NVS_NAMESPACE, false);
+
+  stored_window_t stored;
+  if (preferences_open && preferences.getBytes(PREEMPTION_NVS_KEY, &stored, sizeof(stored)) == sizeof(stored))
+  {
+    preemption_window_restore(&window, stored.session, stored.highest);
+    accepted_window = stored;
+
+    Serial.print("[Preemption] Restored session ");
+    Serial.print(stored.session);
+    Serial.print(", sequence ");
+    Serial.println(stored.highest);
+  }
+}
+
+static void handle(int length, const struct sockaddr_in *from, uint32_t received_us)
+{
+  const preemption_message_t *message = length > 0 ? preemption_message_decode(buffer, (size_t) length) : NULL;
+
+  if (message == NULL || (message->type != PREEMPTION_REQUEST && message->type != PREEMPTION_CLEAR))
+  {
+    count(&stats.rejected);
+    return;
+  }
+
+  // Never answer unauthenticated datagrams
+  uint8_t tag[PREEMPTION_TAG_SIZE];
+  compute_tag(&receive_hmac, message, tag);
+  if (!preemption_tag_equal(tag, message->tag))
+  {
+    count(&stats.bad_tag);
+    return;
+  }
+
+  preemption_status_t status = preemption_window_check(&window, message->session, message->sequence);
+
+  if (status == PREEMPTION_STATUS_ACCEPTED)
+  {
+    bool request = message->type == PREEMPTION_REQUEST;
+
+    // A request is acknowledged again as applied by the control side, a
+    // clear cancels that
+    pending_request_t next;
+    next.valid = request;
+    next.from = *from;
+    next.session = message->session;
+    next.sequence = message->sequence;
+    next.received_us = received_us;
+
+    if (traffic_state_post(request ? TRAFFIC_COMMAND_PREEMPT : TRAFFIC_COMMAND_PREEMPT_CLEAR, 0))
+    {
+      // Only remembered once acted on, so a retry after BUSY goes through
+      // and a refused clear leaves the request in force acknowledged. The
+      // control side runs below this task or later in the same executor
+      // pass, so it cannot look for the pending request before this.
+      preemption_window_accept(&window, message->session, message->sequence);
+      count(&stats.accepted);
+
+      portENTER_CRITICAL(&pending_mux);
+      pending = next;
+      accepted_window.session = window.session;
+      accepted_window.highest = window.highest;
+      store_due = true;
+      portEXIT_CRITICAL(&pending_mux);
+    }
+    else
+    {
+      status = PREEMPTION_STATUS_BUSY;
+      count(&stats.busy);
+    }
+  }
+  else
+  {
+    count(status == PREEMPTION_STATUS_DUPLICATE ? &stats.duplicates : &stats.stale);
+  }
+
+  send_ack(&receive_hmac, from, message->session, message->sequence, status, micros() - received_us);
+
+  // Nothing waits on a clear
+  if (status == PREEMPTION_STATUS_ACCEPTED && message->type == PREEMPTION_CLEAR)
+    store_window();
+}
+
+// False when nothing was received
+static bool receive(int flags)
+{
+  struct sockaddr_in from;
+  socklen_t from_length = sizeof(from);
+
+  int length = recvfrom(preemption_socket, buffer, sizeof(buffer), flags, (struct sockaddr *) &from, &from_length);
+  if (length < 0)
+    return false;
+
+  handle(length, &from, micros());
+  return true;
+}
+
+bool preemption_link_init(const uint8_t *key, size_t key_length)
+{
+  if (!hmac_setup(&receive_hmac, key, key_length) || !hmac_setup(&applied_hmac, key, key_length))
+  {
+    Serial.println("[Preemption] HMAC setup failed");
+    return false;
+  }
+
+  load_window();
+
+  preemption_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (preemption_socket < 0)
+  {
+    Serial.println("[Preemption] Failed to create socket");
+    return false;
+  }
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(PREEMPTION_UDP_PORT);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  if (bind(preemption_socket, (struct sockaddr *) &address, sizeof(address)) < 0)
+  {
+    Serial.println("[Preemption] Failed to bind socket");
+    close(preemption_socket);
+    preemption_socket = -1;
+    return false;
+  }
+
+  socket_watch_add(preemption_socket);
+
+  Serial.print("[Preemption] Listening on UDP port ");
+  Serial.println(PREEMPTION_UDP_PORT);
+  return true;
+}
+
+void preemption_link_task(void *pvParams)
+{
+  if (preemption_socket < 0)
+  {
+    vTaskDelete(NULL);
+    return;
+  }
+
+  while (true)
+  {
+    receive(0);
+  }
+}
+
+uint32_t preemption_link_poll(void)
+{
+  if (preemption_socket < 0)
+    return EXECUTOR_WAIT_FOREVER;
+
+  // Drain everything queued on the socket
+  while (receive(MSG_DONTWAIT))
+  {
+  }
+
+  return EXECUTOR_WAIT_FOREVER;
+}
+
+void preemption_link_applied(void)
+{
+  pending_request_t request;
+
+  portENTER_CRITICAL(&pending_mux);
+  request = pending;
+  pending.valid = false;
+  portEXIT_CRITICAL(&pending_mux);
+
+  if (!request.valid)
+    return;
+
+  uint32_t elapsed_us = micros() - request.received_us;
+
+  portENTER_CRITICAL(&stats_mux);
+  stats.last_apply_us = elapsed_us;
+  if (elapsed_us > stats.max_apply_us)
+    stats.max_apply_us = elapsed_us;
+  portEXIT_CRITICAL(&stats_mux);
+
+  send_ack(&applied_hmac, &request.from, request.session, request.sequence, PREEMPTION_STATUS_APPLIED, elapsed_us);
+
+  store_window();
+}
+
+void preemption_link_get_stats(preemption_link_stats_t *out)
+{
+  portENTER_CRITICAL(&stats_mux);
+  *out = stats;
+  portEXIT_CRITICAL(&stats_mux);
+}
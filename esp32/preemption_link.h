@@ -0,0 +1,52 @@
+#ifndef _PREEMPTION_LINK_H_
+#define _PREEMPTION_LINK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Authenticated preemption channel (preemption_protocol.h): requests from
+// an emergency vehicle sender go straight to the controller over UDP,
+// independent of the server and the Socket.IO connection. Accepted requests
+// are acknowledged right away, and once more when the emergency phase has
+// been set, so the sender measures detection-to-green latency end to end.
+//
+// The receive path blocks on its own socket in a task above every other
+// controller task, or runs first in the executor pass (SYSTEM_EXECUTOR)
+// that the socket watcher (socket_watch.h) starts when a datagram arrives.
+
+// Controller UDP ports are listed in detection_link.h
+#define PREEMPTION_UDP_PORT 4211
+
+// NVS entry of the newest accepted session and sequence, kept across reboots
+#define PREEMPTION_NVS_NAMESPACE "preemption"
+#define PREEMPTION_NVS_KEY       "window"
+
+typedef struct {
+  uint32_t accepted;        // Requests and clears acted on
+  uint32_t duplicates;      // Repeats of an accepted sequence, acknowledged again
+  uint32_t stale;           // Older session or sequence below the window
+  uint32_t rejected;        // Wrong size, magic or version
+  uint32_t bad_tag;         // Authentication failed, dropped without reply
+  uint32_t busy;            // Controller mailbox full
+  uint32_t store_errors;    // Window not written to NVS
+  uint32_t last_apply_us;   // Receive to emergency phase set, last request
+  uint32_t max_apply_us;
+} preemption_link_stats_t;
+
+// Open the socket, after Wi-Fi is up. `key` is the shared HMAC key.
+bool preemption_link_init(const uint8_t *key, size_t key_length);
+
+// Task layout: receive and handle datagrams forever
+void preemption_link_task(void *pvParams);
+
+// Executor layout: handle pending datagrams without blocking, the socket
+// watcher wakes the executor for the next ones
+uint32_t preemption_link_poll(void);
+
+// Called by the control side once the emergency phase is set (or was
+// already held), acknowledges the pending request as applied
+void preemption_link_applied(void);
+
+void preemption_link_get_stats(preemption_link_stats_t *stats);
+
+#endif //_PREEMPTION_LINK_H_
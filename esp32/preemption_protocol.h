@@ -0,0 +1,167 @@
+#ifndef _PREEMPTION_PROTOCOL_H_
+#define _PREEMPTION_PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Emergency vehicle preemption, sent as one UDP datagram to
+// PREEMPTION_UDP_PORT of the controller and answered with acknowledgements
+// of the same layout. Little-endian, 24 bytes:
+//
+//   0  u8   magic      PREEMPTION_MAGIC
+//   1  u8   version    PREEMPTION_VERSION
+//   2  u8   type       preemption_type_t
+//   3  u8   arg        Request/clear: reserved, sent as 0. Ack:
+//                      preemption_status_t
+//   4  u32  session    Sender start time, grows with every sender restart
+//   8  u32  sequence   Incremented by the sender for every request/clear
+//  12  u32  value      Request/clear: sender clock. Ack: microseconds since
+//                      the request was received
+//  16  u8   tag[8]     HMAC-SHA256(key, bytes 0..15), first 8 bytes
+//
+// The receiver keeps the newest session and a window of the last
+// PREEMPTION_WINDOW sequences in it: repeats of an accepted sequence are
+// acknowledged again without acting twice, older sessions and sequences
+// below the window are refused. The receiver stores the newest session and
+// sequence across its own restarts (preemption_window_restore()), otherwise
+// the first authenticated message after a reboot, a replay included, would
+// be accepted. tools/preemption_sender writes the same layout. The tag is
+// computed by the caller, this header has no crypto and no Arduino
+// dependencies.
+
+#define PREEMPTION_MAGIC    0xE7
+#define PREEMPTION_VERSION  1
+#define PREEMPTION_TAG_SIZE 8
+#define PREEMPTION_WINDOW   64
+
+typedef enum {
+  PREEMPTION_REQUEST = 0x01,   // Give the emergency phase and hold it
+  PREEMPTION_CLEAR   = 0x02,   // Release the hold
+  PREEMPTION_ACK     = 0x81
+} preemption_type_t;
+
+typedef enum {
+  PREEMPTION_STATUS_ACCEPTED = 0,  // Handed to the controller
+  PREEMPTION_STATUS_DUPLICATE,     // Already handled, not acted on again
+  PREEMPTION_STATUS_STALE,         // Older session or below the window
+  PREEMPTION_STATUS_BUSY,          // Controller queue full, retry
+  PREEMPTION_STATUS_APPLIED        // Emergency phase on (request only)
+} preemption_status_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t type;
+  uint8_t arg;
+  uint32_t session;
+  uint32_t sequence;
+  uint32_t value;
+  uint8_t tag[PREEMPTION_TAG_SIZE];
+} preemption_message_t;
+
+static_assert(sizeof(preemption_message_t) == 24, "Preemption message layout changed");
+
+// Bytes covered by the tag
+#define PREEMPTION_SIGNED_SIZE offsetof(preemption_message_t, tag)
+
+typedef struct {
+  uint32_t session;
+  uint32_t highest;    // Highest sequence accepted in the session
+  uint64_t seen;       // Bit n: highest - n was accepted
+  bool valid;
+} preemption_window_t;
+
+// NULL if the datagram is too short, not ours or of another version. The
+// tag still has to be checked.
+static inline const preemption_message_t *preemption_message_decode(const uint8_t *data, size_t length)
+{
+  if (length < sizeof(preemption_message_t))
+    return NULL;
+
+  const preemption_message_t *message = (const preemption_message_t *) data;
+
+  if (message->magic != PREEMPTION_MAGIC || message->version != PREEMPTION_VERSION)
+    return NULL;
+
+  return message;
+}
+
+// Fills every field but the tag
+static inline void preemption_message_encode(preemption_message_t *message, preemption_type_t type, uint8_t arg,
+                                             uint32_t session, uint32_t sequence, uint32_t value)
+{
+  memset(message, 0, sizeof(*message));
+  message->magic = PREEMPTION_MAGIC;
+  message->version = PREEMPTION_VERSION;
+  message->type = type;
+  message->arg = arg;
+  message->session = session;
+  message->sequence = sequence;
+  message->value = value;
+}
+
+// Compare without an early exit, so the time taken leaks nothing
+static inline bool preemption_tag_equal(const uint8_t *a, const uint8_t *b)
+{
+  uint8_t diff = 0;
+  for (size_t i = 0; i < PREEMPTION_TAG_SIZE; i++)
+    diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+// Classify an authenticated message against the window, without changing it
+static inline preemption_status_t preemption_window_check(const preemption_window_t *window, uint32_t session,
+                                                          uint32_t sequence)
+{
+  if (!window->valid || session > window->session)
+    return PREEMPTION_STATUS_ACCEPTED;
+  if (session < window->session)
+    return PREEMPTION_STATUS_STALE;
+
+  if (sequence > window->highest)
+    return PREEMPTION_STATUS_ACCEPTED;
+
+  uint32_t age = window->highest - sequence;
+  if (age >= PREEMPTION_WINDOW)
+    return PREEMPTION_STATUS_STALE;
+
+  return (window->seen >> age) & 1 ? PREEMPTION_STATUS_DUPLICATE : PREEMPTION_STATUS_ACCEPTED;
+}
+
+// Record a message that was acted on (check it first)
+static inline void preemption_window_accept(preemption_window_t *window, uint32_t session, uint32_t sequence)
+{
+  if (!window->valid || session != window->session)
+  {
+    window->valid = true;
+    window->session = session;
+    window->highest = sequence;
+    window->seen = 1;
+    return;
+  }
+
+  if (sequence > window->highest)
+  {
+    uint32_t shift = sequence - window->highest;
+    window->seen = shift >= PREEMPTION_WINDOW ? 0 : window->seen << shift;
+    window->seen |= 1;
+    window->highest = sequence;
+    return;
+  }
+
+  window->seen |= (uint64_t) 1 << (window->highest - sequence);
+}
+
+// Window of a receiver that restarted, from the session and highest
+// sequence it stored: every sequence up to `highest` counts as accepted, so
+// none of them is acted on again
+static inline void preemption_window_restore(preemption_window_t *window, uint32_t session, uint32_t highest)
+{
+  window->valid = true;
+  window->session = session;
+  window->highest = highest;
+  window->seen = UINT64_MAX;
+}
+
+#endif //_PREEMPTION_PROTOCOL_H_
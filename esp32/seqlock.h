@@ -0,0 +1,94 @@
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+// Single-writer sequence lock: the writer never blocks or waits, readers
+// copy the value and retry if a write overlapped the copy, so they always
+// get a complete snapshot of one write. The sequence is odd while a write
+// is in progress; every completed write adds 2, so the (even) sequence a
+// reader saw also tells whether anything changed since its last read.
+//
+// The value is kept as relaxed atomic words, so a reader racing the writer
+// is well defined (it only retries). Only <atomic> is used so the lock
+// builds and runs on a Linux host too.
+
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock value must be trivially copyable");
+
+public:
+    Seqlock() {
+        sequence.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Publish a new value, only one task may write
+    void write(const T& value) {
+        uint32_t buffer[WORDS] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; i++) {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // One attempt, false if a write was in progress or overlapped the copy
+    bool try_read(T& value, uint32_t& version) const {
+        uint32_t buffer[WORDS];
+
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+
+        for (size_t i = 0; i < WORDS; i++) {
+            buffer[i] = words[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+
+        memcpy(&value, buffer, sizeof(T));
+        version = before;
+        return true;
+    }
+
+    // Retry until a consistent copy is made, returns its version. A write
+    // takes a few hundred cycles, so this only spins while one is running.
+    // A reader that can preempt the writer on the same core would spin
+    // forever: read from a task of lower or equal priority, or use try_read().
+    uint32_t read(T& value) const {
+        uint32_t version;
+        while (!try_read(value, version)) {
+        }
+        return version;
+    }
+
+    // Version of the last completed write (0 before the first one)
+    uint32_t version() const {
+        return sequence.load(std::memory_order_acquire) & ~(uint32_t) 1;
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> words[WORDS];
+};
+
+#endif // _SEQLOCK_H_
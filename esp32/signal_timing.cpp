@@ -0,0 +1,193 @@
+#include <string.h>
+
+#include "signal_timing.h"
+
+// Above this total flow ratio the intersection is saturated, use the max cycle
+#define SIGNAL_TIMING_MAX_FLOW_RATIO  0.9f
+
+// Highest share of its green an approach should need (degree of
+// saturation). Min greens lengthen the cycle, so the splits are widened
+// until every approach stays under it.
+#define SIGNAL_TIMING_MAX_SATURATION  0.9f
+#define SIGNAL_TIMING_SPLIT_PASSES    4
+
+static uint32_t clamp_ms(float value, uint32_t min_ms, uint32_t max_ms)
+{
+  if (value <= (float) min_ms)
+    return min_ms;
+  if (value >= (float) max_ms)
+    return max_ms;
+  return (uint32_t) value;
+}
+
+static void update_legacy(signal_timing_t *timing)
+{
+  const signal_timing_config_t *config = &timing->config;
+
+  uint32_t cars = timing->latest[0];
+  uint32_t extra_ms = cars > config->car_threshold ? config->extra_per_car_ms * (cars - config->car_threshold) : 0;
+
+  for (uint8_t a = 0; a < config->approach_count; a++)
+  {
+    if (a == 0)
+      timing->green_ms[a] = config->base_green_ms + extra_ms;
+    else
+      timing->green_ms[a] = config->base_green_ms > config->min_green_ms + extra_ms ? config->base_green_ms - extra_ms : config->min_green_ms;
+  }
+}
+
+static void update_webster(signal_timing_t *timing)
+{
+  const signal_timing_config_t *config = &timing->config;
+
+  float ratios[SIGNAL_TIMING_MAX_APPROACHES];
+  float total_ratio = 0.0f;
+
+  for (uint8_t a = 0; a < config->approach_count; a++)
+  {
+    ratios[a] = timing->demand[a] / config->saturation_flow;
+    total_ratio += ratios[a];
+  }
+
+  float lost_s = (float) config->lost_time_ms / 1000.0f;
+  float cycle_ms;
+
+  if (total_ratio >= SIGNAL_TIMING_MAX_FLOW_RATIO)
+    cycle_ms = (float) config->max_cycle_ms;
+  else
+    cycle_ms = 1000.0f * (1.5f * lost_s + 5.0f) / (1.0f - total_ratio);
+
+  cycle_ms = (float) clamp_ms(cycle_ms, config->min_cycle_ms, config->max_cycle_ms);
+
+  float effective_green_ms = cycle_ms - (float) config->lost_time_ms;
+
+  for (uint8_t a = 0; a < config->approach_count; a++)
+  {
+    // No demand anywhere: share the cycle evenly
+    float share = total_ratio > 0.0f ? ratios[a] / total_ratio : 1.0f / config->approach_count;
+    timing->green_ms[a] = clamp_ms(effective_green_ms * share, config->min_green_ms, config->max_green_ms);
+  }
+
+  for (int pass = 0; pass < SIGNAL_TIMING_SPLIT_PASSES; pass++)
+  {
+    float planned_ms = (float) config->lost_time_ms;
+    for (uint8_t a = 0; a < config->approach_count; a++)
+      planned_ms += (float) timing->green_ms[a];
+
+    for (uint8_t a = 0; a < config->approach_count; a++)
+    {
+      uint32_t needed_ms = clamp_ms(planned_ms * ratios[a] / SIGNAL_TIMING_MAX_SATURATION, config->min_green_ms,
+                                    config->max_green_ms);
+      if (needed_ms > timing->green_ms[a])
+        timing->green_ms[a] = needed_ms;
+    }
+  }
+}
+
+void signal_timing_init(signal_timing_t *timing, const signal_timing_config_t *config)
+{
+  memset(timing, 0, sizeof(*timing));
+  timing->config = *config;
+
+  if (timing->config.approach_count > SIGNAL_TIMING_MAX_APPROACHES)
+    timing->config.approach_count = SIGNAL_TIMING_MAX_APPROACHES;
+
+  for (uint8_t a = 0; a < timing->config.approach_count; a++)
+    timing->green_ms[a] = config->mode == SIGNAL_TIMING_LEGACY ? config->base_green_ms : config->min_green_ms;
+
+  timing->cycle_ms = config->lost_time_ms + config->min_green_ms * timing->config.approach_count;
+  timing->served = SIGNAL_TIMING_NO_APPROACH;
+}
+
+void signal_timing_set_demand(signal_timing_t *timing, uint8_t approach, uint32_t vehicles)
+{
+  if (approach < timing->config.approach_count)
+    timing->latest[approach] = vehicles;
+}
+
+void signal_timing_phase_started(signal_timing_t *timing, uint8_t approach, uint32_t now_ms)
+{
+  for (uint8_t a = 0; a < timing->config.approach_count; a++)
+  {
+    signal_timing_red_t *red = &timing->red[a];
+    bool was_red = timing->served != SIGNAL_TIMING_NO_APPROACH && timing->served != a;
+    bool is_red = approach != a;
+    uint32_t vehicles = timing->latest[a];
+
+    if (!was_red && is_red)
+    {
+      red->start_ms = now_ms;
+      red->start_vehicles = vehicles;
+    }
+    else if (was_red && !is_red)
+    {
+      // A shrinking count while red is detection noise, not departures
+      red->arrivals += vehicles > red->start_vehicles ? vehicles - red->start_vehicles : 0;
+      red->observed_ms += now_ms - red->start_ms;
+    }
+  }
+
+  timing->served = approach;
+}
+
+void signal_timing_update(signal_timing_t *timing)
+{
+  const signal_timing_config_t *config = &timing->config;
+
+  // Approaches not red since the last update keep their rate
+  for (uint8_t a = 0; a < config->approach_count; a++)
+  {
+    signal_timing_red_t *red = &timing->red[a];
+    if (red->observed_ms == 0)
+      continue;
+
+    float sample = (float) red->arrivals * 1000.0f / (float) red->observed_ms;
+    timing->demand[a] = red->measured ? timing->demand[a] + config->smoothing * (sample - timing->demand[a]) : sample;
+
+    red->measured = true;
+    red->arrivals = 0;
+    red->observed_ms = 0;
+  }
+
+  if (config->mode == SIGNAL_TIMING_LEGACY)
+    update_legacy(timing);
+  else
+    update_webster(timing);
+
+  uint32_t cycle_ms = config->lost_time_ms;
+  for (uint8_t a = 0; a < config->approach_count; a++)
+    cycle_ms += timing->green_ms[a];
+
+  timing->cycle_ms = cycle_ms;
+  timing->cycles++;
+}
+
+uint32_t signal_timing_green_ms(const signal_timing_t *timing, uint8_t approach)
+{
+  if (approach >= timing->config.approach_count)
+    return timing->config.min_green_ms;
+  return timing->green_ms[approach];
+}
+
+uint32_t signal_timing_start_green(signal_timing_t *timing, uint8_t approach)
+{
+  const signal_timing_config_t *config = &timing->config;
+
+  if (approach >= config->approach_count)
+    return config->min_green_ms;
+  if (config->mode == SIGNAL_TIMING_LEGACY)
+    return timing->green_ms[approach];
+
+  // Time to discharge the queue while vehicles keep arriving
+  float spare_flow = config->saturation_flow - timing->demand[approach];
+  float clear_ms = spare_flow > 0.0f ? 1000.0f * (float) timing->latest[approach] / spare_flow : (float) config->max_green_ms;
+
+  if (clear_ms > (float) timing->green_ms[approach])
+    timing->green_ms[approach] = clamp_ms(clear_ms, config->min_green_ms, config->max_green_ms);
+  return timing->green_ms[approach];
+}
+
+uint32_t signal_timing_cycle_ms(const signal_timing_t *timing)
+{
+  return timing->cycle_ms;
+}
@@ -0,0 +1,95 @@
+#ifndef _SIGNAL_TIMING_H_
+#define _SIGNAL_TIMING_H_
+
+#include <stdint.h>
+
+// Demand-responsive signal timing.
+//
+// Takes the vehicles queued on every approach (what the camera counts) and,
+// once per cycle, computes the cycle length and the green split of each
+// approach with Webster's method:
+//
+//   y_i = q_i / s                 flow ratio (arrival rate / saturation flow)
+//   C   = (1.5 L + 5) / (1 - Y)   optimal cycle, Y = sum(y_i), L = lost time
+//   g_i = (C - L) * y_i / Y       green split
+//
+// clamped to the configured min/max green and cycle. A queue count is not
+// a flow: the arrival rate q_i is measured while approach i is red, when
+// nothing leaves its queue, as the growth of the queue over that time. The
+// phase changes are reported with signal_timing_phase_started(). The rate
+// is smoothed between cycles so one noisy detection does not swing the plan.
+//
+// SIGNAL_TIMING_LEGACY reproduces the original rule (approach 0 gets
+// EXTRA_TIME_PER_CAR_MS per car above the threshold, the others lose the same
+// amount) so both can be compared, with the others clamped at min green
+// instead of underflowing.
+//
+// Plain C++ with no Arduino dependencies, builds on a Linux host.
+
+#define SIGNAL_TIMING_MAX_APPROACHES 4
+
+// No approach served (before the first phase)
+#define SIGNAL_TIMING_NO_APPROACH 0xFF
+
+typedef enum {
+  SIGNAL_TIMING_WEBSTER = 0,
+  SIGNAL_TIMING_LEGACY  = 1
+} signal_timing_mode_t;
+
+typedef struct {
+  signal_timing_mode_t mode;
+  uint8_t approach_count;
+  uint32_t lost_time_ms;         // Non-green time per cycle (sum of yellow phases)
+  uint32_t min_green_ms;
+  uint32_t max_green_ms;
+  uint32_t min_cycle_ms;
+  uint32_t max_cycle_ms;
+  float saturation_flow;         // Vehicles per second discharged by a green approach
+  float smoothing;               // Weight of the newest demand sample, 0..1
+
+  // SIGNAL_TIMING_LEGACY only
+  uint32_t base_green_ms;
+  uint32_t extra_per_car_ms;
+  uint32_t car_threshold;
+} signal_timing_config_t;
+
+// Queue growth of one approach while it is red
+typedef struct {
+  uint32_t start_ms;        // Red since
+  uint32_t start_vehicles;  // Queued when it turned red
+  uint32_t arrivals;        // Growth over the red periods closed this cycle
+  uint32_t observed_ms;     // Length of those red periods
+  bool measured;            // demand[] holds a measured rate
+} signal_timing_red_t;
+
+typedef struct {
+  signal_timing_config_t config;
+  volatile uint32_t latest[SIGNAL_TIMING_MAX_APPROACHES];   // Written by set_demand()
+  signal_timing_red_t red[SIGNAL_TIMING_MAX_APPROACHES];
+  uint8_t served;                                            // Approach of the running phase
+  float demand[SIGNAL_TIMING_MAX_APPROACHES];                // Smoothed arrivals per second
+  uint32_t green_ms[SIGNAL_TIMING_MAX_APPROACHES];
+  uint32_t cycle_ms;
+  uint32_t cycles;
+} signal_timing_t;
+
+void signal_timing_init(signal_timing_t *timing, const signal_timing_config_t *config);
+
+// Vehicles queued on `approach` right now, safe to call from any task
+void signal_timing_set_demand(signal_timing_t *timing, uint8_t approach, uint32_t vehicles);
+
+// A phase serving `approach` (green or its yellow) started, every other
+// approach is red. Call from the task that calls signal_timing_update().
+void signal_timing_phase_started(signal_timing_t *timing, uint8_t approach, uint32_t now_ms);
+
+// Recompute the cycle length and green splits, call once at the start of a cycle
+void signal_timing_update(signal_timing_t *timing);
+
+uint32_t signal_timing_green_ms(const signal_timing_t *timing, uint8_t approach);
+
+// Green of the phase starting now on `approach`: the planned split, longer
+// when the queue waiting now needs more time to clear (Webster only)
+uint32_t signal_timing_start_green(signal_timing_t *timing, uint8_t approach);
+uint32_t signal_timing_cycle_ms(const signal_timing_t *timing);
+
+#endif //_SIGNAL_TIMING_H_
@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include "esp_system.h"
+#include "esp_heap_caps.h"
 
 #include <Arduino.h>
 
@@ -13,36 +14,71 @@
 #include "pin_config.h"
 #include "motor.h"
 #include "fsm.h"
+#include "fsm_trace.h"
+#include "intersection_control.h"
+#include "executor.h"
+#include "socket_io_parser.h"
+#include "detection_link.h"
+#include "intersection_config.h"
+#include "json_writer.h"
+#include "traffic_state.h"
+#include "preemption_link.h"
+#include "socket_watch.h"
+#include "task_monitor.h"
 
 #define SOCKET_IO_STATUS_OK         "ok"
 #define SOCKET_IO_STATUS_ERROR      "error"
 
 const char *devicesNS = "/devices";
 
-SocketIOclient socketIO;
+// Exposes the server connection to the socket watcher
+class WatchedSocketIOclient : public SocketIOclient
+{
+public:
+  // Socket of the connection, -1 while there is none
+  int fd(void)
+  {
+    return _client.tcp != NULL ? _client.tcp->fd() : -1;
+  }
+
+  // Input loop() has not handled yet, some of it may already be off the socket
+  int pending(void)
+  {
+    return _client.tcp != NULL ? _client.tcp->available() : 0;
+  }
+};
+
+WatchedSocketIOclient socketIO;
 
 extern IPAddress serverIP;
 extern uint16_t serverPort;
 extern uint16_t updPort;
 
-extern volatile uint32_t car_count;
-extern volatile bool has_ambulance;
-extern volatile uint32_t increaseInDuration;
+extern volatile uint32_t wifi_disconnects;
+extern volatile uint32_t wifi_reconnects;
 
-void open_pump(void);
-void close_pump(void);
 void socket_io_exec_command(String command, JsonVariant requestData, JsonVariant responseData);
 void socket_io_send_ack(JsonVariant requestData, JsonVariant responseData);
 void socket_io_send_status(void);
+void socket_io_send_fsm_trace(void);
+void socket_io_handle_event(const char *packet, size_t length);
 
 void socketIOEvent(const socketIOmessageType_t type, const uint8_t * payload, const size_t length);
 
-void socket_io_task(void * pvParams)
+static unsigned long statusTimestamp = 0;
+
+// Connections to the server, the library reconnects on its own
+static uint32_t socket_connects = 0;
+
+// Connection socket handed to the socket watcher, new on every reconnect
+static int watched_fd = -1;
+
+void socket_io_init(void)
 {
-  Serial.println("[IOc] Socket IO task starting...");
+  Serial.println("[IOc] Socket IO starting...");
 
   // setReconnectInterval to 10s, new from v2.5.1 to avoid flooding server. Default is 0.5s
-  socketIO.setReconnectInterval(5000);
+  socketIO.setReconnectInterval(SOCKET_IO_RECONNECT_INTERVAL_MS);
 
   // server address, port and URL
   socketIO.begin(serverIP, serverPort);
@@ -51,23 +87,204 @@ void socket_io_task(void * pvParams)
   // event handler
   socketIO.onEvent(socketIOEvent);
 
-  unsigned long messageTimestamp = 0;
+  // binary detection updates arrive over UDP
+  detection_link_init();
+}
+
+uint32_t socket_io_poll(void)
+{
+  socketIO.loop();
+  detection_link_poll();
+
+  int fd = socketIO.fd();
+  if (fd != watched_fd)
+  {
+    socket_watch_remove(watched_fd);
+    socket_watch_add(fd);
+    watched_fd = fd;
+  }
+
+  uint32_t sinceStatus = millis() - statusTimestamp;
+  if (sinceStatus > STATUS_UPDATE_INTERVAL_MS)
+  {
+    statusTimestamp = millis();
+    sinceStatus = 0;
+
+    socket_io_send_status();
+  }
+
+  // loop() handles one frame per call, the rest may sit in the client's buffer
+  if (socketIO.pending() > 0)
+    return 0;
+
+  // Also keeps the Engine.IO heartbeat of loop() going (every 20 s)
+  uint32_t wait = STATUS_UPDATE_INTERVAL_MS + 1 - sinceStatus;
+  if (!socketIO.isConnected() && wait > SOCKET_IO_CONNECT_POLL_MS)
+    wait = SOCKET_IO_CONNECT_POLL_MS;
+
+  return wait;
+}
+
+void socket_io_task(void * pvParams)
+{
+  socket_io_init();
+
   while(true)
   {
-    socketIO.loop();    
-    
-    if (millis() - messageTimestamp > STATUS_UPDATE_INTERVAL_MS)
+    socket_io_poll();
+    vTaskDelay(pdMS_TO_TICKS(SOCKET_IO_POLL_MS)); // Small delay to prevent task hogging CPU
+  }
+}
+
+
+// Typed payloads of the inbound events
+typedef struct {
+  socket_io_span_t message;
+} message_event_t;
+
+typedef struct {
+  uint32_t action;    // socket_io_hash() of the action name
+} control_command_event_t;
+
+typedef struct {
+  uint32_t car_count;
+  bool has_ambulance;
+} detection_event_t;
+
+typedef struct {
+  uint32_t speed;
+} speed_event_t;
+
+static const socket_io_field_t MESSAGE_FIELDS[] = {
+  SOCKET_IO_FIELD(message_event_t, message, "message", SOCKET_IO_STRING),
+};
+
+static const socket_io_field_t CONTROL_COMMAND_FIELDS[] = {
+  SOCKET_IO_FIELD(control_command_event_t, action, "action", SOCKET_IO_HASH),
+};
+
+static const socket_io_field_t DETECTION_FIELDS[] = {
+  SOCKET_IO_FIELD(detection_event_t, car_count, "car_count", SOCKET_IO_U32),
+  SOCKET_IO_FIELD(detection_event_t, has_ambulance, "has_ambulance", SOCKET_IO_BOOL),
+};
+
+static const socket_io_field_t SPEED_FIELDS[] = {
+  SOCKET_IO_FIELD(speed_event_t, speed, "speed", SOCKET_IO_U32),
+};
+
+#define SOCKET_IO_READ(_EVENT, _FIELDS, _OUT) \
+  socket_io_read_fields(_EVENT, _FIELDS, sizeof(_FIELDS) / sizeof(_FIELDS[0]), _OUT)
+
+// Parse /devices,["name",{...}] in place and dispatch on the name hash
+void socket_io_handle_event(const char *packet, size_t length)
+{
+  socket_io_event_t event;
+
+  if (!socket_io_parse_event(packet, length, &event))
+  {
+    Serial.println("[IOc] Malformed event dropped");
+    return;
+  }
+
+  switch (event.name_hash)
+  {
+    case socket_io_hash("message"):
     {
-      messageTimestamp = millis();
-      
-      socket_io_send_status();
+      message_event_t data = {};
+      SOCKET_IO_READ(&event, MESSAGE_FIELDS, &data);
+
+      Serial.print("[Server] ");
+      Serial.write((const uint8_t *) data.message.text, data.message.length);
+      Serial.println();
+      break;
+    }
+
+    case socket_io_hash("control_command"):
+    {
+      control_command_event_t data = {};
+      SOCKET_IO_READ(&event, CONTROL_COMMAND_FIELDS, &data);
+
+      if (data.action == socket_io_hash("emergency"))
+      {
+        traffic_state_post(TRAFFIC_COMMAND_EMERGENCY, 0);
+      }
+      else if (data.action == socket_io_hash("reset"))
+      {
+        traffic_state_post(TRAFFIC_COMMAND_RESET, 0);
+      }
+      break;
+    }
+
+    case socket_io_hash("set_car_count"):
+    {
+      detection_event_t data = {};
+      SOCKET_IO_READ(&event, DETECTION_FIELDS, &data);
+
+      // The camera watches approach 0
+      traffic_detection_t *detection = traffic_state_edit();
+      detection->counts[0] = data.car_count;
+      detection->capture_us = 0;
+      detection->edge = false;
+      traffic_state_publish();
+      break;
+    }
+
+    case socket_io_hash("set_speed"):
+    {
+      speed_event_t data = {};
+      SOCKET_IO_READ(&event, SPEED_FIELDS, &data);
+
+      if (data.speed > SPEED_THRESHOLD) {
+        Serial.print("High speed detected: ");
+        Serial.print(data.speed);
+        Serial.println(" km/h. Considering emergency.");
+        traffic_state_post(TRAFFIC_COMMAND_PUMP_OPEN, data.speed);
+      } else {
+        Serial.print("Normal speed: ");
+        Serial.print(data.speed);
+        Serial.println(" km/h.");
+        traffic_state_post(TRAFFIC_COMMAND_PUMP_CLOSE, data.speed);
+      }
+      break;
+    }
+
+    case socket_io_hash("detection_update"):
+    {
+      detection_event_t data = {};
+      SOCKET_IO_READ(&event, DETECTION_FIELDS, &data);
+
+      traffic_detection_t *detection = traffic_state_edit();
+      detection->counts[0] = data.car_count;
+      detection->ambulance = data.has_ambulance;
+      detection->capture_us = 0;
+      detection->edge = false;
+      traffic_state_publish();
+      break;
     }
 
-    vTaskDelay(pdMS_TO_TICKS(1)); // Small delay to prevent task hogging CPU
+    case socket_io_hash("emergency_stop"):
+      Serial.println("Emergency stop received from server!!");
+
+      // Stop motor and turn off all traffic lights
+      traffic_state_post(TRAFFIC_COMMAND_EMERGENCY_STOP, 0);
+      break;
+
+    case socket_io_hash("dump_fsm_trace"):
+      socket_io_send_fsm_trace();
+      break;
+
+    case socket_io_hash("emergency"):
+      Serial.println("Emergency state!!");
+
+      // Resume normal operation
+      traffic_state_post(TRAFFIC_COMMAND_MOTOR_STOP, 0);
+      break;
+
+    default:
+      break;
   }
 }
 
-
 void socketIOEvent(const socketIOmessageType_t type, const uint8_t * payload, const size_t length) 
 {
   switch(type) 
@@ -78,6 +295,7 @@ void socketIOEvent(const socketIOmessageType_t type, const uint8_t * payload, co
       break;
 
     case sIOtype_CONNECT:
+      socket_connects++;
       Serial.print("[IOc] Connected to url: ");
       
       if (payload) {
@@ -96,134 +314,11 @@ void socketIOEvent(const socketIOmessageType_t type, const uint8_t * payload, co
         Serial.println("[IOc] Empty payload received for EVENT");
         break;
       }
-      {
-        Serial.print("[IOc] Get event: ");
-        Serial.println((char *)payload);
-
-        char *packet = (char *)payload;
-
-        // Skip to the beginning of array /devices,["start"]
-        while (packet[0] != '[') packet++;
-
-        Serial.println(packet);
-
-        // Json document to carry event name and data
-        JsonDocument request;
-        
-        // Parse payload into json document
-        deserializeJson(request, (char*) packet);
-        
-        // Extract event name
-        String eventName = request[0];
-
-        // Extract request data
-        JsonVariant requestData = request[1];
-
-        // Prepare response document
-        JsonDocument response;
-        JsonObject responseData = response.to<JsonObject>();
-
-        if (eventName == "message")
-        {
-          String output = requestData["message"];
-
-          Serial.print("[Server] ");
-          Serial.println(output);
-        } else if (eventName == "control_command") 
-        {
-          String action = requestData["action"];
-          // Serial.print("Control command received: ");
-          if (action == "emergency")
-          {
-            // Serial.println("Start command received from server!!");
-            if (!has_ambulance) {
-              has_ambulance = true;
-              Serial.println("Ambulance detected! Prioritizing traffic light.");
-              fsm_push_event(EVENT_EMERGENCY);
-            }
-            
-            // Start motor
-            // motor_start();
-          } else if (action == "reset")
-          {
-            // Serial.println("Stop command received from server!!");
-            if (has_ambulance) {
-              has_ambulance = false;
-              Serial.println("Ambulance cleared! Resuming normal operation.");
-              fsm_push_event(EVENT_CLEAR_EMERGENCY);
-            }
-            // Stop motor
-            motor_stop();
-          }
-        } else if (eventName == "set_car_count") {
-          car_count = requestData["car_count"].as<uint32_t>();
-          // Serial.print("Car count set to: ");
-          // Serial.println(car_count);
-          if (car_count > CAR_COUNT_THRESHOLD)
-          {
-            increaseInDuration = EXTRA_TIME_PER_CAR_MS * (car_count - CAR_COUNT_THRESHOLD);
-          } else {
-            increaseInDuration = 0;
-          }
-        } else if (eventName == "set_speed") {
-          uint32_t speed = requestData["speed"].as<uint32_t>();
-          
-          if (speed > SPEED_THRESHOLD) {
-            Serial.print("High speed detected: ");
-            Serial.print(speed);
-            Serial.println(" km/h. Considering emergency.");
-            open_pump();
-          } else {
-            Serial.print("Normal speed: ");
-            Serial.print(speed);
-            Serial.println(" km/h.");
-            close_pump();
-          }
-        } else if (eventName == "detection_update")
-        {
-          uint32_t local_car_count = requestData["car_count"].as<uint32_t>();
-          bool local_has_ambulance = requestData["has_ambulance"].as<bool>();
-
-          if (local_has_ambulance && !has_ambulance) {
-            has_ambulance = true;
-            Serial.println("Ambulance detected! Prioritizing traffic light.");
-            fsm_push_event(EVENT_EMERGENCY);
-          }
-          if (!local_has_ambulance && has_ambulance) {
-            has_ambulance = false;
-            Serial.println("Ambulance cleared! Resuming normal operation.");
-            fsm_push_event(EVENT_CLEAR_EMERGENCY);
-          }
-
-          if (local_car_count > CAR_COUNT_THRESHOLD)
-          {
-            increaseInDuration = EXTRA_TIME_PER_CAR_MS * (local_car_count - CAR_COUNT_THRESHOLD);
-          } else {
-            increaseInDuration = 0;
-          }
-
-          // Serial.print("Cars count updated: ");
-          // Serial.println(car_count);
-          // Serial.print("Has ambulance: ");
-          // Serial.println(has_ambulance ? "Yes" : "No");
-        } else if (eventName == "emergency_stop")
-        {
-          Serial.println("Emergency stop received from server!!");
-
-          // Stop motor
-          motor_stop();
-
-          // Turn off all traffic lights
-          traffic_light_turn_off_all();
-        } 
-        else if (eventName == "emergency")
-        {
-          Serial.println("Emergency state!!");
-
-          // Resume normal operation
-          motor_stop();
-        }
-      }
+#if SOCKET_IO_SERIAL_TRACE
+      Serial.print("[IOc] Get event: ");
+      Serial.println((char *)payload);
+#endif
+      socket_io_handle_event((const char *)payload, length);
       break;
 
     case sIOtype_ACK:
@@ -278,32 +373,201 @@ void socket_io_send_status(void)
     return;
   }
 
-  uint32_t now = (uint32_t) millis();
+  // Encoded in place, nothing is allocated per report
+  static char output[SOCKET_IO_STATUS_BUFFER_SIZE];
+  static FsmLatencyStats safetyLatency, normalLatency;
+
+  json_writer_t json;
+  json_writer_init(&json, output, sizeof(output));
+
+  // /devices,["status_update",{...}] (camelCase fields)
+  json_writer_raw(&json, devicesNS);
+  json_writer_raw(&json, ",");
+  json_writer_begin_array(&json, NULL);
+  json_writer_string(&json, NULL, "status_update");
+  json_writer_begin_object(&json, NULL);
+
+  json_writer_u32(&json, "uptimeMs", (uint32_t) millis());
+
+  // link quality and how often it had to recover
+  json_writer_i32(&json, "WiFi Dbm", WiFi.RSSI());
+  json_writer_u32(&json, "wifiDisconnects", wifi_disconnects);
+  json_writer_u32(&json, "wifiReconnects", wifi_reconnects);
+  json_writer_u32(&json, "socketConnects", socket_connects);
+
+  // controller state
+  json_writer_u32(&json, "fsmState", fsm_get_current_state(&intersectionFsm));
+  json_writer_u32(&json, "timeInStateMs", fsm_get_time_in_state_ms(&intersectionFsm));
+
+  // event-to-action latency of the FSM (emergency lane and normal lane)
+  fsm_get_latency_stats(&intersectionFsm, &safetyLatency, &normalLatency);
+  json_writer_u32(&json, "emergencyLatencyUs", safetyLatency.last_us);
+  json_writer_u32(&json, "emergencyLatencyMaxUs", safetyLatency.max_us);
+  json_writer_u32(&json, "emergencyLatencyP50Us", fsm_latency_percentile(&safetyLatency, 500));
+  json_writer_u32(&json, "emergencyLatencyP99Us", fsm_latency_percentile(&safetyLatency, 990));
+  json_writer_u32(&json, "eventLatencyAvgUs", normalLatency.avg_us);
+  json_writer_u32(&json, "eventLatencyMaxUs", normalLatency.max_us);
+  json_writer_u32(&json, "eventLatencyP50Us", fsm_latency_percentile(&normalLatency, 500));
+  json_writer_u32(&json, "eventLatencyP90Us", fsm_latency_percentile(&normalLatency, 900));
+  json_writer_u32(&json, "eventLatencyP99Us", fsm_latency_percentile(&normalLatency, 990));
+
+  // phase-length error of the signal timer
+  phase_timer_stats_t phaseStats;
+  phase_timer_get_stats(&phaseTimer, &phaseStats);
+  json_writer_i32(&json, "phaseErrorUs", phaseStats.last_error_us);
+  json_writer_u32(&json, "phaseErrorMaxUs", phaseStats.max_abs_error_us);
+
+  // command-to-pin latency of the signal outputs
+  traffic_light_latency_t lightLatency;
+  traffic_light_get_latency(&lightLatency);
+  json_writer_u32(&json, "lightLatencyUs", lightLatency.last_us);
+  json_writer_u32(&json, "lightLatencyMaxUs", lightLatency.max_us);
+
+  // memory: fragmentation shows as a largest block well below the free total
+  json_writer_u32(&json, "freeHeap", esp_get_free_heap_size());
+  json_writer_u32(&json, "minFreeHeap", esp_get_minimum_free_heap_size());
+  json_writer_u32(&json, "largestFreeBlock", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+  // stack headroom of every task (bytes never used)
+  json_writer_begin_array(&json, "tasks");
+  task_monitor_entry_t task;
+  for (uint8_t i = 0; task_monitor_get(i, &task); i++)
+  {
+    json_writer_begin_object(&json, NULL);
+    json_writer_string(&json, "name", task.name);
+    json_writer_u32(&json, "stackSize", task.stack_size);
+    json_writer_u32(&json, "stackFreeMin", task.stack_free_min);
+    json_writer_end_object(&json);
+  }
+  json_writer_end_array(&json);
 
-  // Create JSON message for Socket.IO status event (camelCase fields)
-  JsonDocument response;
+  // scheduling cost of the task layout (SYSTEM_EXECUTOR)
+  if (executor_is_running())
+  {
+    executor_stats_t executorStats;
+    executor_get_stats(&executorStats);
+    json_writer_u32(&json, "executorIdlePermille", executorStats.idle_permille);
+    json_writer_u32(&json, "executorMaxPassUs", executorStats.max_pass_us);
+
+    socket_watch_stats_t watchStats;
+    socket_watch_get_stats(&watchStats);
+    json_writer_u32(&json, "socketWakes", watchStats.wakes);
+  }
 
-  // event name
-  response.add("status_update");
+  // queue depths and losses
+  EventLaneStats safetyLane, normalLane;
+  fsm_get_queue_stats(&intersectionFsm, &safetyLane, &normalLane);
+  traffic_light_queue_stats_t lightQueue;
+  traffic_light_get_queue_stats(&lightQueue);
+  motor_queue_stats_t motorQueue;
+  motor_get_queue_stats(&motorQueue);
+
+  json_writer_begin_object(&json, "queues");
+  json_writer_begin_object(&json, "fsmSafety");
+  json_writer_u32(&json, "depth", safetyLane.depth);
+  json_writer_u32(&json, "highWater", safetyLane.high_water);
+  json_writer_u32(&json, "dropped", safetyLane.dropped);
+  json_writer_u32(&json, "coalesced", safetyLane.coalesced);
+  json_writer_end_object(&json);
+  json_writer_begin_object(&json, "fsmNormal");
+  json_writer_u32(&json, "depth", normalLane.depth);
+  json_writer_u32(&json, "highWater", normalLane.high_water);
+  json_writer_u32(&json, "dropped", normalLane.dropped);
+  json_writer_u32(&json, "coalesced", normalLane.coalesced);
+  json_writer_end_object(&json);
+  json_writer_begin_object(&json, "trafficLight");
+  json_writer_u32(&json, "depth", lightQueue.depth);
+  json_writer_u32(&json, "dropped", lightQueue.dropped);
+  json_writer_end_object(&json);
+  json_writer_begin_object(&json, "motor");
+  json_writer_u32(&json, "depth", motorQueue.depth);
+  json_writer_u32(&json, "dropped", motorQueue.dropped);
+  json_writer_end_object(&json);
+  json_writer_end_object(&json);
+
+  // binary detection link
+  detection_link_stats_t detectionStats;
+  detection_link_get_stats(&detectionStats);
+  json_writer_u32(&json, "detectionUpdates", detectionStats.received);
+  json_writer_u32(&json, "detectionRejected", detectionStats.rejected + detectionStats.stale);
+  json_writer_u32(&json, "detectionDecodeUs", detectionStats.last_decode_us);
+  json_writer_u32(&json, "detectionDecodeMaxUs", detectionStats.max_decode_us);
+  json_writer_u32(&json, "edgeUpdates", detectionStats.edge_received);
+  json_writer_u32(&json, "edgeApplied", detectionStats.edge_applied);
+
+  // network to control hand-off
+  traffic_state_stats_t stateStats;
+  traffic_state_get_stats(&stateStats);
+  json_writer_u32(&json, "detectionPublished", stateStats.published);
+  json_writer_u32(&json, "commandsDropped", stateStats.dropped);
+
+  // direct preemption channel, receive to emergency phase set
+  preemption_link_stats_t preemptionStats;
+  preemption_link_get_stats(&preemptionStats);
+  json_writer_u32(&json, "preemptAccepted", preemptionStats.accepted);
+  json_writer_u32(&json, "preemptRefused", preemptionStats.duplicates + preemptionStats.stale + preemptionStats.busy);
+  json_writer_u32(&json, "preemptBadTag", preemptionStats.bad_tag + preemptionStats.rejected);
+  json_writer_u32(&json, "preemptApplyUs", preemptionStats.last_apply_us);
+  json_writer_u32(&json, "preemptApplyMaxUs", preemptionStats.max_apply_us);
+  json_writer_u32(&json, "preemptStoreErrors", preemptionStats.store_errors);
+
+  // estimated pump position, permille of full travel
+  json_writer_u32(&json, "pumpPosition", motor_get_position());
+
+  // current signal plan
+  json_writer_u32(&json, "cycleMs", signal_timing_cycle_ms(&signalTiming));
+  json_writer_begin_array(&json, "greenMs");
+  for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+  {
+    json_writer_u32(&json, NULL, signal_timing_green_ms(&signalTiming, a));
+  }
+  json_writer_end_array(&json);
 
-  // payload
-  JsonObject data = response.createNestedObject();
-  data["uptimeMs"] = now;
+  json_writer_end_object(&json);
+  json_writer_end_array(&json);
 
-  // firmware, battery and rssi
-  data["WiFi Dbm"] = WiFi.RSSI();
+  size_t length;
+  if (json_writer_finish(&json, &length) == NULL)
+  {
+    Serial.println("[IOc] Status larger than SOCKET_IO_STATUS_BUFFER_SIZE, not sent");
+    return;
+  }
 
-  // serialize and send
-  String packet;
-  serializeJson(response, packet);
+  socketIO.sendEVENT(output, length);
+}
 
-  String output = devicesNS;
-  output += ","; 
-  output += packet;
-  socketIO.sendEVENT(output);
+// Dump the FSM transition trace as hex encoded binary records:
+// /devices,["fsm_trace",{"total":N,"recordSize":12,"records":"<hex>"}]
+void socket_io_send_fsm_trace(void)
+{
+  if (!socketIO.isConnected())
+  {
+    Serial.println("[IOc] Not connected, cannot send FSM trace");
+    return;
+  }
+
+  static FsmTraceRecord records[FSM_TRACE_SIZE];
+  static char output[64 + FSM_TRACE_SIZE * sizeof(FsmTraceRecord) * 2 + 8];
+  static const char hexDigits[] = "0123456789abcdef";
+
+  size_t count = fsm_trace_snapshot(records, FSM_TRACE_SIZE);
+
+  int length = snprintf(output, sizeof(output), "%s,[\"fsm_trace\",{\"total\":%u,\"recordSize\":%u,\"records\":\"",
+                        devicesNS, (unsigned) fsm_trace_total(), (unsigned) sizeof(FsmTraceRecord));
+
+  const uint8_t *bytes = (const uint8_t *) records;
+  for (size_t i = 0; i < count * sizeof(FsmTraceRecord); i++)
+  {
+    output[length++] = hexDigits[bytes[i] >> 4];
+    output[length++] = hexDigits[bytes[i] & 0x0F];
+  }
+
+  output[length++] = '"';
+  output[length++] = '}';
+  output[length++] = ']';
+  output[length] = '\0';
 
-  // Serial.print("[IOc] Sent status: ");
-  // Serial.println(output);
+  socketIO.sendEVENT(output, length);
 }
 
 void socket_io_exec_command(String command, JsonVariant requestData, JsonVariant responseData)
@@ -2,7 +2,34 @@
 #define _SOCKET_IO_MANAGER_H_
 
 
+#include <stdint.h>
+
+// Print every inbound event packet to serial
+#ifndef SOCKET_IO_SERIAL_TRACE
+#define SOCKET_IO_SERIAL_TRACE 0
+#endif
+
+// Socket polling period of the task layout, the client library has no
+// readiness notification. The executor layout watches the socket instead
+// (socket_watch.h).
+#define SOCKET_IO_POLL_MS 1
+
+// Executor layout: loop() period while there is no connection, the library
+// connects and retries from it
+#define SOCKET_IO_CONNECT_POLL_MS 500
+
+// Between connection attempts
+#define SOCKET_IO_RECONNECT_INTERVAL_MS 5000
+
+// Preallocated status_update payload, the report is dropped if it grows past it
+#define SOCKET_IO_STATUS_BUFFER_SIZE 2048
+
 void socket_io_task(void * pvParams);
 
+// Executor layout (executor.h): init once, then poll. Returns the time to
+// the next status report, or 0 while the client holds unread input.
+void socket_io_init(void);
+uint32_t socket_io_poll(void);
+
 
 #endif
@@ -0,0 +1,224 @@
+#include <string.h>
+
+#include "socket_io_parser.h"
+
+uint32_t socket_io_hash_n(const char *text, size_t length)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ (uint8_t) text[i]) * 16777619u;
+  return hash;
+}
+
+static const char *skip_spaces(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    p++;
+  return p;
+}
+
+// `p` is on the opening quote, returns the closing quote or NULL
+static const char *find_string_end(const char *p, const char *end)
+{
+  for (p++; p < end; p++)
+  {
+    if (*p == '\\')
+      p++;
+    else if (*p == '"')
+      return p;
+  }
+  return NULL;
+}
+
+// Returns the first character after the value starting at `p`, or NULL
+static const char *skip_value(const char *p, const char *end)
+{
+  if (p >= end)
+    return NULL;
+
+  if (*p == '"')
+  {
+    const char *close = find_string_end(p, end);
+    return close ? close + 1 : NULL;
+  }
+
+  if (*p == '{' || *p == '[')
+  {
+    int depth = 0;
+    for (; p < end; p++)
+    {
+      if (*p == '"')
+      {
+        p = find_string_end(p, end);
+        if (p == NULL)
+          return NULL;
+      }
+      else if (*p == '{' || *p == '[')
+      {
+        depth++;
+      }
+      else if (*p == '}' || *p == ']')
+      {
+        if (--depth == 0)
+          return p + 1;
+      }
+    }
+    return NULL;
+  }
+
+  // Number or literal
+  const char *start = p;
+  while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\r' && *p != '\n' && *p != '\t')
+    p++;
+  return p > start ? p : NULL;
+}
+
+static bool span_equals(const char *p, const char *end, const char *literal)
+{
+  size_t length = strlen(literal);
+  return (size_t)(end - p) == length && memcmp(p, literal, length) == 0;
+}
+
+static uint32_t parse_u32(const char *p, const char *end)
+{
+  if (p < end && *p == '-')
+    return 0;
+
+  uint32_t value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+  {
+    uint32_t next = value * 10 + (uint32_t)(*p - '0');
+    if (next < value)
+      return UINT32_MAX;
+    value = next;
+  }
+  return value;
+}
+
+bool socket_io_parse_event(const char *packet, size_t length, socket_io_event_t *event)
+{
+  const char *end = packet + length;
+  const char *p = (const char *) memchr(packet, '[', length);
+
+  if (p == NULL)
+    return false;
+
+  p = skip_spaces(p + 1, end);
+  if (p >= end || *p != '"')
+    return false;
+
+  const char *close = find_string_end(p, end);
+  if (close == NULL)
+    return false;
+
+  event->name.text = p + 1;
+  event->name.length = (uint16_t)(close - p - 1);
+  event->name_hash = socket_io_hash_n(event->name.text, event->name.length);
+  event->data.text = NULL;
+  event->data.length = 0;
+
+  p = skip_spaces(close + 1, end);
+  if (p < end && *p == ',')
+  {
+    p = skip_spaces(p + 1, end);
+    const char *value_end = skip_value(p, end);
+    if (value_end == NULL)
+      return false;
+
+    event->data.text = p;
+    event->data.length = (uint16_t)(value_end - p);
+  }
+
+  return true;
+}
+
+static void store_field(const socket_io_field_t *field, const char *value, const char *value_end, uint8_t *out)
+{
+  bool is_string = *value == '"';
+  const char *text = is_string ? value + 1 : value;
+  const char *text_end = is_string ? value_end - 1 : value_end;
+
+  switch (field->type)
+  {
+  case SOCKET_IO_U32:
+  {
+    uint32_t number = parse_u32(text, text_end);
+    memcpy(out + field->offset, &number, sizeof(number));
+    break;
+  }
+
+  case SOCKET_IO_BOOL:
+  {
+    bool flag = span_equals(text, text_end, "true") || (parse_u32(text, text_end) != 0);
+    memcpy(out + field->offset, &flag, sizeof(flag));
+    break;
+  }
+
+  case SOCKET_IO_HASH:
+  {
+    uint32_t hash = socket_io_hash_n(text, text_end - text);
+    memcpy(out + field->offset, &hash, sizeof(hash));
+    break;
+  }
+
+  case SOCKET_IO_STRING:
+  {
+    socket_io_span_t span = { text, (uint16_t)(text_end - text) };
+    memcpy(out + field->offset, &span, sizeof(span));
+    break;
+  }
+  }
+}
+
+int socket_io_read_fields(const socket_io_event_t *event, const socket_io_field_t *fields, size_t count, void *out)
+{
+  if (event->data.length == 0 || event->data.text[0] != '{')
+    return -1;
+
+  const char *p = event->data.text + 1;
+  const char *end = event->data.text + event->data.length;
+  int found = 0;
+
+  while (true)
+  {
+    p = skip_spaces(p, end);
+    if (p < end && *p == '}')
+      return found;
+
+    // "key"
+    if (p >= end || *p != '"')
+      return -1;
+    const char *close = find_string_end(p, end);
+    if (close == NULL)
+      return -1;
+    uint32_t key_hash = socket_io_hash_n(p + 1, close - p - 1);
+
+    // :
+    p = skip_spaces(close + 1, end);
+    if (p >= end || *p != ':')
+      return -1;
+
+    // value
+    p = skip_spaces(p + 1, end);
+    const char *value_end = skip_value(p, end);
+    if (value_end == NULL)
+      return -1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+      if (fields[i].key_hash == key_hash)
+      {
+        store_field(&fields[i], p, value_end, (uint8_t *) out);
+        found++;
+        break;
+      }
+    }
+
+    // , or }
+    p = skip_spaces(value_end, end);
+    if (p < end && *p == ',')
+      p++;
+    else if (!(p < end && *p == '}'))
+      return -1;
+  }
+}
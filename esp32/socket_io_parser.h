@@ -0,0 +1,61 @@
+#ifndef _SOCKET_IO_PARSER_H_
+#define _SOCKET_IO_PARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// In-place parser for Socket.IO event packets: /devices,["name",{...}]
+//
+// Nothing is copied or allocated. The event name is reduced to an FNV-1a hash
+// that can be compared against socket_io_hash("name") in a switch, and the
+// fields of the data object are read straight into a struct described by a
+// table of socket_io_field_t. Every read is bounded by the packet length.
+//
+// Supports flat data objects: nested values are skipped, string values are
+// not unescaped (keys and hashed values are expected to be plain ASCII).
+// No Arduino dependencies, builds on a Linux host.
+
+// FNV-1a, usable in case labels
+constexpr uint32_t socket_io_hash(const char *text, uint32_t hash = 2166136261u)
+{
+  return *text ? socket_io_hash(text + 1, (hash ^ (uint8_t) *text) * 16777619u) : hash;
+}
+
+uint32_t socket_io_hash_n(const char *text, size_t length);
+
+typedef struct {
+  const char *text;   // Points into the packet, not terminated
+  uint16_t length;
+} socket_io_span_t;
+
+typedef struct {
+  uint32_t name_hash;
+  socket_io_span_t name;
+  socket_io_span_t data;   // Second array element as raw JSON, length 0 if absent
+} socket_io_event_t;
+
+typedef enum {
+  SOCKET_IO_U32,      // uint32_t, fraction dropped, negatives read as 0
+  SOCKET_IO_BOOL,     // bool, from true/false or a number
+  SOCKET_IO_HASH,     // uint32_t, socket_io_hash() of a string value
+  SOCKET_IO_STRING    // socket_io_span_t into the packet
+} socket_io_field_type_t;
+
+typedef struct {
+  uint32_t key_hash;
+  socket_io_field_type_t type;
+  uint16_t offset;
+} socket_io_field_t;
+
+#define SOCKET_IO_FIELD(_STRUCT, _MEMBER, _KEY, _TYPE) \
+  { socket_io_hash(_KEY), _TYPE, (uint16_t) offsetof(_STRUCT, _MEMBER) }
+
+// Split a packet into event name and data, false if it is malformed
+bool socket_io_parse_event(const char *packet, size_t length, socket_io_event_t *event);
+
+// Fill `out` from the data object of `event` in one pass. Fields missing from
+// the packet are left untouched. Returns the number of fields set, or -1 if
+// the data is not a well-formed object.
+int socket_io_read_fields(const socket_io_event_t *event, const socket_io_field_t *fields, size_t count, void *out);
+
+#endif //_SOCKET_IO_PARSER_H_
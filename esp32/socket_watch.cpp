@@ -0,0 +1,183 @@
+#include <Arduino.h>
+#include <sys/select.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_vfs_eventfd.h"
+
+#include "executor.h"
+#include "socket_watch.h"
+
+static portMUX_TYPE sockets_mux = portMUX_INITIALIZER_UNLOCKED;
+static_assert(SOCKET_WATCH_MAX_SOCKETS == 4, "Update the free slot initializer");
+static int sockets[SOCKET_WATCH_MAX_SOCKETS] = {-1, -1, -1, -1};
+
+// Written when the socket list changes, so a blocked select() picks it up
+static int wake_fd = -1;
+
+static TaskHandle_t watch_task_handle = NULL;
+static volatile bool waiting_for_pass = false;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static socket_watch_stats_t stats = {0, 0};
+
+static void count(uint32_t *counter)
+{
+  portENTER_CRITICAL(&stats_mux);
+  (*counter)++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+static void signal_change(void)
+{
+  if (wake_fd >= 0)
+    eventfd_write(wake_fd, 1);
+}
+
+bool socket_watch_init(void)
+{
+  esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  if (esp_vfs_eventfd_register(&config) != ESP_OK)
+  {
+    Serial.println("[Watch] eventfd registration failed");
+    return false;
+  }
+
+  wake_fd = eventfd(0, 0);
+  if (wake_fd < 0)
+  {
+    Serial.println("[Watch] Failed to create eventfd");
+    return false;
+  }
+  return true;
+}
+
+bool socket_watch_add(int fd)
+{
+  if (fd < 0)
+    return false;
+
+  bool added = false;
+  portENTER_CRITICAL(&sockets_mux);
+  for (int i = 0; i < SOCKET_WATCH_MAX_SOCKETS && !added; i++)
+  {
+    if (sockets[i] == fd)
+      added = true;
+  }
+  for (int i = 0; i < SOCKET_WATCH_MAX_SOCKETS && !added; i++)
+  {
+    if (sockets[i] < 0)
+    {
+      sockets[i] = fd;
+      added = true;
+    }
+  }
+  portEXIT_CRITICAL(&sockets_mux);
+
+  if (!added)
+  {
+    Serial.println("[Watch] Too many sockets!");
+    return false;
+  }
+
+  signal_change();
+  return true;
+}
+
+void socket_watch_remove(int fd)
+{
+  if (fd < 0)
+    return;
+
+  portENTER_CRITICAL(&sockets_mux);
+  for (int i = 0; i < SOCKET_WATCH_MAX_SOCKETS; i++)
+  {
+    if (sockets[i] == fd)
+      sockets[i] = -1;
+  }
+  portEXIT_CRITICAL(&sockets_mux);
+
+  signal_change();
+}
+
+void socket_watch_task(void *pvParams)
+{
+  watch_task_handle = xTaskGetCurrentTaskHandle();
+
+  if (wake_fd < 0)
+  {
+    vTaskDelete(NULL);
+    return;
+  }
+
+  while (true)
+  {
+    int watched[SOCKET_WATCH_MAX_SOCKETS];
+    fd_set readable;
+    int max_fd = wake_fd;
+
+    FD_ZERO(&readable);
+    FD_SET(wake_fd, &readable);
+
+    portENTER_CRITICAL(&sockets_mux);
+    memcpy(watched, sockets, sizeof(watched));
+    portEXIT_CRITICAL(&sockets_mux);
+
+    for (int i = 0; i < SOCKET_WATCH_MAX_SOCKETS; i++)
+    {
+      if (watched[i] < 0)
+        continue;
+      FD_SET(watched[i], &readable);
+      if (watched[i] > max_fd)
+        max_fd = watched[i];
+    }
+
+    if (select(max_fd + 1, &readable, NULL, NULL, NULL) < 0)
+    {
+      count(&stats.errors);
+      vTaskDelay(pdMS_TO_TICKS(SOCKET_WATCH_RETRY_MS));
+      continue;
+    }
+
+    if (FD_ISSET(wake_fd, &readable))
+    {
+      eventfd_t value;
+      eventfd_read(wake_fd, &value);
+    }
+
+    bool input = false;
+    for (int i = 0; i < SOCKET_WATCH_MAX_SOCKETS; i++)
+    {
+      if (watched[i] >= 0 && FD_ISSET(watched[i], &readable))
+        input = true;
+    }
+
+    if (!input)
+      continue;
+
+    // Input stays readable until a handler takes it, do not look again
+    // before the executor has made a pass
+    count(&stats.wakes);
+    waiting_for_pass = true;
+    executor_wake();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+uint32_t socket_watch_poll(void)
+{
+  if (waiting_for_pass && watch_task_handle != NULL)
+  {
+    waiting_for_pass = false;
+    xTaskNotifyGive(watch_task_handle);
+  }
+
+  return EXECUTOR_WAIT_FOREVER;
+}
+
+void socket_watch_get_stats(socket_watch_stats_t *out)
+{
+  portENTER_CRITICAL(&stats_mux);
+  *out = stats;
+  portEXIT_CRITICAL(&stats_mux);
+}
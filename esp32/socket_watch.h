@@ -0,0 +1,43 @@
+#ifndef _SOCKET_WATCH_H_
+#define _SOCKET_WATCH_H_
+
+#include <stdint.h>
+
+// Wakes the executor (executor.h) when one of the controller's sockets has
+// input, so the network handlers return their own deadlines instead of
+// polling every millisecond. A small task blocks in select() on the watched
+// sockets; once one is readable it wakes the executor and waits for the
+// pass that drains it before it looks again.
+//
+// The task notification stays the executor's only wake-up: the FSM, timer,
+// motor and traffic light producers notify it directly, and select() cannot
+// wait on a notification.
+
+#define SOCKET_WATCH_MAX_SOCKETS 4
+
+// Back-off after select() fails, e.g. on a socket closed under it
+#define SOCKET_WATCH_RETRY_MS    10
+
+typedef struct {
+  uint32_t wakes;     // Executor wakes for socket input
+  uint32_t errors;    // select() failures
+} socket_watch_stats_t;
+
+// Create the wake-up descriptor, before the watcher task starts
+bool socket_watch_init(void);
+
+// Watch or stop watching a socket's input, safe from any task. Sockets
+// below 0 are ignored.
+bool socket_watch_add(int fd);
+void socket_watch_remove(int fd);
+
+// Watcher task, executor layout only
+void socket_watch_task(void *pvParams);
+
+// Executor handler, register it last: the sockets have been drained by the
+// handlers before it, the watcher may look again
+uint32_t socket_watch_poll(void);
+
+void socket_watch_get_stats(socket_watch_stats_t *stats);
+
+#endif //_SOCKET_WATCH_H_
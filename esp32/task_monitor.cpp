@@ -0,0 +1,47 @@
+#include <Arduino.h>
+
+#include "task_monitor.h"
+
+typedef struct {
+  const char *name;
+  TaskHandle_t task;
+  uint32_t stack_size;
+} task_monitor_slot_t;
+
+static task_monitor_slot_t tasks[TASK_MONITOR_MAX_TASKS];
+static volatile uint8_t task_count = 0;
+
+bool task_monitor_add(const char *name, TaskHandle_t task, uint32_t stack_size)
+{
+  if (task == NULL)
+    return false;
+
+  if (task_count >= TASK_MONITOR_MAX_TASKS)
+  {
+    Serial.println("[Tasks] Too many monitored tasks!");
+    return false;
+  }
+
+  tasks[task_count].name = name;
+  tasks[task_count].task = task;
+  tasks[task_count].stack_size = stack_size;
+  task_count++;
+  return true;
+}
+
+uint8_t task_monitor_count(void)
+{
+  return task_count;
+}
+
+bool task_monitor_get(uint8_t index, task_monitor_entry_t *entry)
+{
+  if (index >= task_count)
+    return false;
+
+  entry->name = tasks[index].name;
+  entry->stack_size = tasks[index].stack_size;
+  // ESP-IDF stacks are byte arrays, the mark is already in bytes
+  entry->stack_free_min = uxTaskGetStackHighWaterMark(tasks[index].task) * sizeof(StackType_t);
+  return true;
+}
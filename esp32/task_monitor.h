@@ -0,0 +1,27 @@
+#ifndef _TASK_MONITOR_H_
+#define _TASK_MONITOR_H_
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Registry of the application tasks, so status reports can show how much
+// of every stack was never touched (the FreeRTOS high-water mark).
+
+#define TASK_MONITOR_MAX_TASKS 8
+
+typedef struct {
+  const char *name;
+  uint32_t stack_size;       // Bytes given to xTaskCreate*()
+  uint32_t stack_free_min;   // Fewest bytes ever left unused on the stack
+} task_monitor_entry_t;
+
+// Register a created task (handle from xTaskCreatePinnedToCore())
+bool task_monitor_add(const char *name, TaskHandle_t task, uint32_t stack_size);
+
+uint8_t task_monitor_count(void);
+
+// Sample the high-water mark of a registered task
+bool task_monitor_get(uint8_t index, task_monitor_entry_t *entry);
+
+#endif //_TASK_MONITOR_H_
@@ -0,0 +1,174 @@
+#include <Arduino.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "timer_service.h"
+
+// One-shot software timers served by a single task. The task sleeps until the
+// nearest deadline (or until a timer is scheduled/cancelled), so callbacks
+// fire within one RTOS tick of their deadline without any polling.
+
+typedef struct
+{
+  bool active;
+  uint16_t generation;   // Bumped on every reuse so stale ids cannot cancel a new timer
+  uint32_t deadline_us;
+  timer_callback_t callback;
+  void *arg;
+  uint32_t tag;
+} timer_slot_t;
+
+static timer_slot_t timers[TIMER_SERVICE_MAX_TIMERS];
+static portMUX_TYPE timers_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t timer_task_handle = NULL;
+
+static timer_id_t make_id(int index, uint16_t generation)
+{
+  return ((uint32_t) generation << 8) | (uint32_t)(index + 1);
+}
+
+void timer_service_init(void)
+{
+  timer_task_handle = xTaskGetCurrentTaskHandle();
+
+  Serial.println("[Timer] Timer service started");
+}
+
+uint32_t timer_service_poll(void)
+{
+  timer_callback_t due_callbacks[TIMER_SERVICE_MAX_TIMERS];
+  void *due_args[TIMER_SERVICE_MAX_TIMERS];
+  uint32_t due_tags[TIMER_SERVICE_MAX_TIMERS];
+  int due_count = 0;
+
+  uint32_t now = micros();
+  int32_t next_wait_us = INT32_MAX;
+
+  // Collect expired timers and find the nearest deadline
+  portENTER_CRITICAL(&timers_mux);
+  for (int i = 0; i < TIMER_SERVICE_MAX_TIMERS; i++)
+  {
+    if (!timers[i].active)
+      continue;
+
+    int32_t remaining = (int32_t)(timers[i].deadline_us - now);
+    if (remaining <= 0)
+    {
+      timers[i].active = false;
+      due_callbacks[due_count] = timers[i].callback;
+      due_args[due_count] = timers[i].arg;
+      due_tags[due_count] = timers[i].tag;
+      due_count++;
+    }
+    else if (remaining < next_wait_us)
+    {
+      next_wait_us = remaining;
+    }
+  }
+  portEXIT_CRITICAL(&timers_mux);
+
+  // Run callbacks outside the critical section
+  for (int i = 0; i < due_count; i++)
+  {
+    due_callbacks[i](due_args[i], due_tags[i]);
+  }
+
+  // Callbacks may have scheduled new timers, look again right away
+  if (due_count > 0)
+    return 0;
+
+  if (next_wait_us == INT32_MAX)
+    return TIMER_SERVICE_WAIT_FOREVER;
+
+  // Round up so we never wake before the deadline
+  return (uint32_t)(next_wait_us + 999) / 1000;
+}
+
+void timer_service_task(void *pvParams)
+{
+  timer_service_init();
+
+  while (true)
+  {
+    uint32_t wait_ms = timer_service_poll();
+    if (wait_ms == 0)
+      continue;
+
+    TickType_t wait = portMAX_DELAY;
+    if (wait_ms != TIMER_SERVICE_WAIT_FOREVER)
+    {
+      wait = pdMS_TO_TICKS(wait_ms);
+      if (wait == 0)
+        wait = 1;
+    }
+
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+timer_id_t timer_service_schedule(uint32_t delay_ms, timer_callback_t callback, void *arg, uint32_t tag)
+{
+  if (callback == NULL)
+    return TIMER_ID_NONE;
+
+  timer_id_t id = TIMER_ID_NONE;
+  uint32_t deadline = micros() + delay_ms * 1000UL;
+
+  portENTER_CRITICAL(&timers_mux);
+  for (int i = 0; i < TIMER_SERVICE_MAX_TIMERS; i++)
+  {
+    if (!timers[i].active)
+    {
+      timers[i].active = true;
+      timers[i].generation++;
+      timers[i].deadline_us = deadline;
+      timers[i].callback = callback;
+      timers[i].arg = arg;
+      timers[i].tag = tag;
+      id = make_id(i, timers[i].generation);
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&timers_mux);
+
+  if (id == TIMER_ID_NONE)
+  {
+    Serial.println("[Timer] No free timer slot!");
+    return TIMER_ID_NONE;
+  }
+
+  // Let the task recompute its sleep time
+  if (timer_task_handle != NULL)
+    xTaskNotifyGive(timer_task_handle);
+
+  return id;
+}
+
+bool timer_service_cancel(timer_id_t id)
+{
+  if (id == TIMER_ID_NONE)
+    return false;
+
+  int index = (int)(id & 0xFF) - 1;
+  uint16_t generation = (uint16_t)(id >> 8);
+  bool cancelled = false;
+
+  if (index < 0 || index >= TIMER_SERVICE_MAX_TIMERS)
+    return false;
+
+  portENTER_CRITICAL(&timers_mux);
+  if (timers[index].active && timers[index].generation == generation)
+  {
+    timers[index].active = false;
+    cancelled = true;
+  }
+  portEXIT_CRITICAL(&timers_mux);
+
+  return cancelled;
+}
+
+bool timer_service_is_ready()
+{
+  return timer_task_handle != NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef _TIMER_SERVICE_H_
+#define _TIMER_SERVICE_H_
+
+#include <stdint.h>
+
+// Maximum number of timers pending at the same time
+#define TIMER_SERVICE_MAX_TIMERS  8
+
+#define TIMER_ID_NONE             0
+
+// Callbacks run in the timer service task, keep them short and never block.
+// `tag` is the value given at scheduling time, callers use it to recognise
+// a timer that fired after it was superseded.
+typedef void (*timer_callback_t)(void *arg, uint32_t tag);
+
+// Handle of a scheduled timer, TIMER_ID_NONE when scheduling failed
+typedef uint32_t timer_id_t;
+
+// Returned by timer_service_poll() when no timer is pending
+#define TIMER_SERVICE_WAIT_FOREVER  UINT32_MAX
+
+// Main task function
+void timer_service_task(void *pvParams);
+
+// Executor layout (executor.h): init from the executor task, then poll it.
+// Runs due callbacks and returns the milliseconds until the next deadline.
+void timer_service_init(void);
+uint32_t timer_service_poll(void);
+
+// Run callback(arg, tag) once, delay_ms from now. Safe to call from any task.
+timer_id_t timer_service_schedule(uint32_t delay_ms, timer_callback_t callback, void *arg, uint32_t tag);
+
+// Cancel a pending timer, returns false if it already fired or was cancelled
+bool timer_service_cancel(timer_id_t id);
+
+bool timer_service_is_ready();
+
+#endif //_TIMER_SERVICE_H_
@@ -1,16 +1,19 @@
-
 #include <Arduino.h>
 
 #include "traffic_light.h"
-#include "pin_config.h"
+#include "intersection_config.h"
+#include "executor.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 
+#include "soc/gpio_reg.h"
+
 typedef enum
 {
   CHANGE_COLOR,
+  SET_PHASE,
   SET_DURATION,
   TURN_OFF_ALL,
 } traffic_light_command_type_t;
@@ -19,17 +22,27 @@ typedef struct
 {
   traffic_light_id_t id;
   traffic_light_color_t color;
+  traffic_light_mask_t mask;
   uint32_t duration_ms;
+  uint32_t timestamp_us;
   traffic_light_command_type_t type;
 } traffic_light_command_t;
 
 static QueueHandle_t traffic_light_queue = NULL;
 
-static uint32_t traffic_light_durations[2] = {MIN_GREEN_DURATION_MS, MIN_GREEN_DURATION_MS}; // Default durations for TRAFFIC_LIGHT_1 and TRAFFIC_LIGHT_2
+static uint32_t traffic_light_durations[APPROACH_COUNT]; // Per approach durations
 
-static void light(traffic_light_id_t id, traffic_light_color_t color);
+// Signals currently lit (only written by the traffic light task)
+static traffic_light_mask_t current_mask = 0;
 
-void traffic_light_task(void *pvParams)
+static portMUX_TYPE latency_mux = portMUX_INITIALIZER_UNLOCKED;
+static traffic_light_latency_t latency = {0, 0, 0};
+static volatile uint32_t dropped_commands = 0;
+
+static bool write_mask(traffic_light_mask_t mask);
+static void send_command(traffic_light_command_t *command);
+
+void traffic_light_init(void)
 {
   traffic_light_queue = xQueueCreate(10, sizeof(traffic_light_command_t));
 
@@ -37,144 +50,186 @@ void traffic_light_task(void *pvParams)
   {
     // Queue creation failed
     Serial.println("[Traffic Light] Failed to create traffic light queue");
-    vTaskDelete(NULL);
+    return;
   }
 
-  pinMode(TRAFFIC_1_RED, OUTPUT);
-  pinMode(TRAFFIC_1_YELLOW, OUTPUT);
-  pinMode(TRAFFIC_1_GREEN, OUTPUT);
-  pinMode(TRAFFIC_2_RED, OUTPUT);
-  pinMode(TRAFFIC_2_YELLOW, OUTPUT);
-  pinMode(TRAFFIC_2_GREEN, OUTPUT);
+  for (int a = 0; a < APPROACH_COUNT; a++)
+  {
+    traffic_light_durations[a] = MIN_GREEN_DURATION_MS;
+    for (int c = 0; c < 3; c++)
+    {
+      pinMode(APPROACHES[a].pins[c], OUTPUT);
+    }
+  }
 
-  digitalWrite(TRAFFIC_1_RED, LOW);
-  digitalWrite(TRAFFIC_1_YELLOW, LOW);
-  digitalWrite(TRAFFIC_1_GREEN, LOW);
-  digitalWrite(TRAFFIC_2_RED, LOW);
-  digitalWrite(TRAFFIC_2_YELLOW, LOW);
-  digitalWrite(TRAFFIC_2_GREEN, LOW);
+  write_mask(0);
 
-  Serial.println("[Traffic Light] Traffic light task started");
+  Serial.println("[Traffic Light] Traffic light started");
+}
 
-  traffic_light_command_t command;
+static void apply_command(const traffic_light_command_t &command)
+{
+  bool written = false;
 
-  while (true)
+  switch (command.type)
   {
-    if (xQueueReceive(traffic_light_queue, &command, pdMS_TO_TICKS(10)) == pdTRUE)
+  case CHANGE_COLOR:
+    if (command.id < APPROACH_COUNT)
+    {
+      traffic_light_mask_t head = traffic_light_approach_mask(command.id);
+      written = write_mask((current_mask & ~head) | traffic_light_head_mask(command.id, command.color));
+    }
+    break;
+
+  case SET_PHASE:
+    written = write_mask(command.mask);
+    break;
+
+  case SET_DURATION:
+    if (command.id < APPROACH_COUNT)
     {
-      switch (command.type)
-      {
-      case CHANGE_COLOR:
-        light(command.id, command.color);
-        break;
-
-      case SET_DURATION:
-        if (command.id == TRAFFIC_LIGHT_1)
-        {
-          traffic_light_durations[TRAFFIC_LIGHT_1] = command.duration_ms;
-        }
-        else if (command.id == TRAFFIC_LIGHT_2)
-        {
-          traffic_light_durations[TRAFFIC_LIGHT_2] = command.duration_ms;
-        }
-        break;
-
-      case TURN_OFF_ALL:
-        digitalWrite(TRAFFIC_1_RED, LOW);
-        digitalWrite(TRAFFIC_1_YELLOW, LOW);
-        digitalWrite(TRAFFIC_1_GREEN, LOW);
-        digitalWrite(TRAFFIC_2_RED, LOW);
-        digitalWrite(TRAFFIC_2_YELLOW, LOW);
-        digitalWrite(TRAFFIC_2_GREEN, LOW);
-      }
+      traffic_light_durations[command.id] = command.duration_ms;
     }
-    vTaskDelay(pdMS_TO_TICKS(10)); // Small delay to prevent task hogging CPU
+    break;
+
+  case TURN_OFF_ALL:
+    written = write_mask(0);
+    break;
+  }
+
+  if (written)
+  {
+    uint32_t elapsed_us = micros() - command.timestamp_us;
+
+    portENTER_CRITICAL(&latency_mux);
+    latency.count++;
+    latency.last_us = elapsed_us;
+    if (elapsed_us > latency.max_us)
+      latency.max_us = elapsed_us;
+    portEXIT_CRITICAL(&latency_mux);
   }
 }
 
-void traffic_light_set(traffic_light_id_t id, traffic_light_color_t color)
+uint32_t traffic_light_poll(void)
 {
-  if (traffic_light_queue != NULL)
+  traffic_light_command_t command;
+
+  while (xQueueReceive(traffic_light_queue, &command, 0) == pdTRUE)
+    apply_command(command);
+
+  // Nothing time driven, wait for the next command
+  return EXECUTOR_WAIT_FOREVER;
+}
+
+void traffic_light_task(void *pvParams)
+{
+  traffic_light_init();
+
+  if (traffic_light_queue == NULL)
+    vTaskDelete(NULL);
+
+  traffic_light_command_t command;
+
+  while (true)
   {
-    traffic_light_command_t command;
-    command.id = id;
-    command.color = color;
-    command.type = CHANGE_COLOR;
-    xQueueSend(traffic_light_queue, &command, pdMS_TO_TICKS(100));
+    // Block until a command arrives, it is applied right away
+    if (xQueueReceive(traffic_light_queue, &command, portMAX_DELAY) == pdTRUE)
+      apply_command(command);
   }
 }
 
-void traffic_light_set_duration(traffic_light_id_t id, uint32_t duration_ms)
+void traffic_light_set(traffic_light_id_t id, traffic_light_color_t color)
 {
-  if (traffic_light_queue != NULL)
+  traffic_light_command_t command;
+  command.id = id;
+  command.color = color;
+  command.type = CHANGE_COLOR;
+  send_command(&command);
+}
+
+// Switch every head at once, `mask` comes from PHASE_MASKS
+bool traffic_light_set_phase(traffic_light_mask_t mask)
+{
+  if (!traffic_light_mask_is_safe(mask))
   {
-    traffic_light_command_t command;
-    command.id = id;
-    command.duration_ms = duration_ms;
-    command.type = SET_DURATION;
-    xQueueSend(traffic_light_queue, &command, pdMS_TO_TICKS(100));
+    Serial.println("[Traffic Light] Refusing conflicting phase mask!");
+    return false;
   }
+
+  traffic_light_command_t command;
+  command.mask = mask;
+  command.type = SET_PHASE;
+  send_command(&command);
+  return true;
+}
+
+void traffic_light_set_duration(traffic_light_id_t id, uint32_t duration_ms)
+{
+  traffic_light_command_t command;
+  command.id = id;
+  command.duration_ms = duration_ms;
+  command.type = SET_DURATION;
+  send_command(&command);
 }
 
 void traffic_light_turn_off_all()
+{
+  traffic_light_command_t command;
+  command.type = TURN_OFF_ALL;
+  send_command(&command);
+}
+
+bool traffic_light_is_ready()
+{
+  return traffic_light_queue != NULL;
+}
+
+void traffic_light_get_latency(traffic_light_latency_t *out)
+{
+  portENTER_CRITICAL(&latency_mux);
+  *out = latency;
+  portEXIT_CRITICAL(&latency_mux);
+}
+
+static void send_command(traffic_light_command_t *command)
 {
   if (traffic_light_queue != NULL)
   {
-    traffic_light_command_t command;
-    command.type = TURN_OFF_ALL;
-    xQueueSend(traffic_light_queue, &command, pdMS_TO_TICKS(100));
+    command->timestamp_us = micros();
+    // The executor drains the queue itself, it must never wait on it
+    TickType_t wait = executor_is_running() ? 0 : pdMS_TO_TICKS(100);
+    if (xQueueSend(traffic_light_queue, command, wait) == pdTRUE)
+      executor_wake();
+    else
+      dropped_commands++;
   }
 }
 
-bool traffic_light_is_ready()
+void traffic_light_get_queue_stats(traffic_light_queue_stats_t *out)
 {
-  return traffic_light_queue != NULL;
+  out->depth = traffic_light_queue != NULL ? uxQueueMessagesWaiting(traffic_light_queue) : 0;
+  out->dropped = dropped_commands;
 }
 
-void light(traffic_light_id_t id, traffic_light_color_t color)
+// Apply a full set of signal outputs. Lamps going dark are cleared first and
+// new ones lit right after through the W1TC/W1TS registers, back to back with
+// interrupts off, so heads never show two aspects and the motor pins sharing
+// the output register are not touched (no read-modify-write of GPIO_OUT).
+static bool write_mask(traffic_light_mask_t mask)
 {
-  switch (id)
+  if (!traffic_light_mask_is_safe(mask))
   {
-  case TRAFFIC_LIGHT_1:
-    switch (color)
-    {
-    case RED:
-      digitalWrite(TRAFFIC_1_RED, HIGH);
-      digitalWrite(TRAFFIC_1_YELLOW, LOW);
-      digitalWrite(TRAFFIC_1_GREEN, LOW);
-      break;
-    case YELLOW:
-      digitalWrite(TRAFFIC_1_RED, LOW);
-      digitalWrite(TRAFFIC_1_YELLOW, HIGH);
-      digitalWrite(TRAFFIC_1_GREEN, LOW);
-      break;
-    case GREEN:
-      digitalWrite(TRAFFIC_1_RED, LOW);
-      digitalWrite(TRAFFIC_1_YELLOW, LOW);
-      digitalWrite(TRAFFIC_1_GREEN, HIGH);
-      break;
-    }
-    break;
-  
-  case TRAFFIC_LIGHT_2:
-    switch (color)
-    {
-    case RED:
-      digitalWrite(TRAFFIC_2_RED, HIGH);
-      digitalWrite(TRAFFIC_2_YELLOW, LOW);
-      digitalWrite(TRAFFIC_2_GREEN, LOW);
-      break;
-    case YELLOW:
-      digitalWrite(TRAFFIC_2_RED, LOW);
-      digitalWrite(TRAFFIC_2_YELLOW, HIGH);
-      digitalWrite(TRAFFIC_2_GREEN, LOW);
-      break;
-    case GREEN:
-      digitalWrite(TRAFFIC_2_RED, LOW);
-      digitalWrite(TRAFFIC_2_YELLOW, LOW);
-      digitalWrite(TRAFFIC_2_GREEN, HIGH);
-      break;
-    }
-    break;
+    Serial.println("[Traffic Light] Refusing conflicting signal mask!");
+    return false;
   }
+
+  static portMUX_TYPE gpio_mux = portMUX_INITIALIZER_UNLOCKED;
+
+  portENTER_CRITICAL(&gpio_mux);
+  REG_WRITE(GPIO_OUT_W1TC_REG, TRAFFIC_LIGHT_ALL_MASK & ~mask);
+  REG_WRITE(GPIO_OUT_W1TS_REG, mask);
+  portEXIT_CRITICAL(&gpio_mux);
+
+  current_mask = mask;
+  return true;
 }
@@ -10,19 +10,39 @@ typedef enum {
   GREEN = 2
 } traffic_light_color_t;
 
-// Traffic light identifiers
-typedef enum {
-  TRAFFIC_LIGHT_1 = 0,
-  TRAFFIC_LIGHT_2 = 1
-} traffic_light_id_t;
+// Traffic light identifier: index of the approach in intersection_config.h
+typedef uint8_t traffic_light_id_t;
+
+// One bit per signal GPIO, written to the GPIO output register in one go
+typedef uint32_t traffic_light_mask_t;
+
+// Command-to-pin latency: from queueing a command until the pins were written
+typedef struct {
+  uint32_t count;
+  uint32_t last_us;
+  uint32_t max_us;
+} traffic_light_latency_t;
+
+// Command queue occupancy and commands lost because it stayed full
+typedef struct {
+  uint32_t depth;
+  uint32_t dropped;
+} traffic_light_queue_stats_t;
 
 // Main task function
 void traffic_light_task(void *pvParams);
 
+// Executor layout (executor.h): init once, then poll to apply queued commands
+void traffic_light_init(void);
+uint32_t traffic_light_poll(void);
+
 // Manual control functions
 void traffic_light_set(traffic_light_id_t id, traffic_light_color_t color);
+bool traffic_light_set_phase(traffic_light_mask_t mask);
 void traffic_light_set_duration(traffic_light_id_t id, uint32_t duration_ms);
 void traffic_light_turn_off_all();
 bool traffic_light_is_ready();
+void traffic_light_get_latency(traffic_light_latency_t *latency);
+void traffic_light_get_queue_stats(traffic_light_queue_stats_t *stats);
 
-#endif //_TRAFFIC_LIGHT_H_
\ No newline at end of file
+#endif //_TRAFFIC_LIGHT_H_
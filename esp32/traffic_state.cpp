@@ -0,0 +1,72 @@
+#include <Arduino.h>
+#include <atomic>
+
+#include "fsm.h"
+#include "event_queue.h"
+#include "seqlock.h"
+#include "traffic_state.h"
+
+static Seqlock<traffic_detection_t> detection;
+static LockFreeRing<traffic_command_t, TRAFFIC_COMMAND_SLOTS> mailbox;
+
+// Only touched by the network task
+static traffic_detection_t draft;
+
+static std::atomic<uint32_t> published(0);
+static std::atomic<uint32_t> posted(0);
+static std::atomic<uint32_t> dropped(0);
+
+traffic_detection_t *traffic_state_edit(void)
+{
+  return &draft;
+}
+
+void traffic_state_publish(void)
+{
+  draft.updated_ms = (uint32_t) millis();
+  detection.write(draft);
+  published.fetch_add(1, std::memory_order_relaxed);
+
+  fsm_dispatcher_wake();
+}
+
+bool traffic_state_post(traffic_command_type_t type, uint32_t value)
+{
+  traffic_command_t command;
+  command.type = type;
+  command.value = value;
+
+  if (!mailbox.push(command))
+  {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    Serial.println("[Traffic] Command mailbox full, command dropped!");
+    return false;
+  }
+
+  posted.fetch_add(1, std::memory_order_relaxed);
+  fsm_dispatcher_wake();
+  return true;
+}
+
+bool traffic_state_read(traffic_detection_t *out, uint32_t *version)
+{
+  if (detection.version() == 0)
+    return false;
+
+  uint32_t seen = detection.read(*out);
+  if (version != NULL)
+    *version = seen;
+  return true;
+}
+
+bool traffic_state_take(traffic_command_t *command)
+{
+  return mailbox.pop(*command);
+}
+
+void traffic_state_get_stats(traffic_state_stats_t *out)
+{
+  out->published = published.load(std::memory_order_relaxed);
+  out->posted = posted.load(std::memory_order_relaxed);
+  out->dropped = dropped.load(std::memory_order_relaxed);
+}
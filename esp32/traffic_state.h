@@ -0,0 +1,65 @@
+#ifndef _TRAFFIC_STATE_H_
+#define _TRAFFIC_STATE_H_
+
+#include <stdint.h>
+
+#include "intersection_config.h"
+
+// Traffic state handed from the network task to the control side (the FSM
+// dispatcher task, or the executor in that layout).
+//
+// Detection results are one versioned snapshot behind a seqlock: the
+// network task edits a private draft and publishes it whole, the control
+// side always reads a consistent (counts, ambulance, timestamps) tuple and
+// only acts when the version moved. Operator commands go through a
+// lock-free mailbox. Both wake the control side, so the socket callbacks
+// only publish and return.
+
+#define TRAFFIC_COMMAND_SLOTS 8
+
+typedef struct {
+  uint32_t counts[APPROACH_COUNT];  // Vehicles waiting per approach
+  uint32_t capture_us;              // Camera clock (esp_timer) of the counted frame, 0 if unknown
+  uint32_t updated_ms;              // millis() when published
+  bool ambulance;                   // Ambulance on any approach
+  bool edge;                        // Counts from the camera's edge counter (detection_link.h)
+} traffic_detection_t;
+
+typedef enum {
+  TRAFFIC_COMMAND_EMERGENCY = 0,    // Operator raised the emergency
+  TRAFFIC_COMMAND_RESET,            // Operator cleared it, motor stopped
+  TRAFFIC_COMMAND_PUMP_OPEN,
+  TRAFFIC_COMMAND_PUMP_CLOSE,
+  TRAFFIC_COMMAND_MOTOR_STOP,
+  TRAFFIC_COMMAND_EMERGENCY_STOP,   // Motor stopped and every light off
+  TRAFFIC_COMMAND_PREEMPT,          // Preemption channel: hold the emergency phase
+  TRAFFIC_COMMAND_PREEMPT_CLEAR     // Preemption channel: release the hold
+} traffic_command_type_t;
+
+typedef struct {
+  traffic_command_type_t type;
+  uint32_t value;
+} traffic_command_t;
+
+typedef struct {
+  uint32_t published;   // Detection snapshots published
+  uint32_t posted;      // Commands accepted by the mailbox
+  uint32_t dropped;     // Commands lost because the mailbox was full
+} traffic_state_stats_t;
+
+// Network side, one task only. The draft starts as the last published
+// snapshot, change what the update carries and publish it.
+traffic_detection_t *traffic_state_edit(void);
+void traffic_state_publish(void);
+
+// Any task
+bool traffic_state_post(traffic_command_type_t type, uint32_t value);
+
+// Control side. read() returns false until the first publish, the version
+// changes with every publish.
+bool traffic_state_read(traffic_detection_t *detection, uint32_t *version);
+bool traffic_state_take(traffic_command_t *command);
+
+void traffic_state_get_stats(traffic_state_stats_t *stats);
+
+#endif //_TRAFFIC_STATE_H_
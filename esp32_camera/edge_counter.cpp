@@ -0,0 +1,131 @@
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include "detection_protocol.h"
+#include "edge_counter.h"
+#include "lane_config.h"
+#include "stream_config.h"
+
+static WiFiUDP udp;
+static IPAddress controller_ip;
+static uint16_t controller_port = 0;
+
+// Only touched by the capture task
+static vehicle_counter_t counter;
+static uint8_t approach_count = 1;
+static uint32_t last_count_ms = 0;
+static uint32_t window_start_ms = 0;
+static uint32_t window_sums[COUNTER_MAX_APPROACHES] = {};
+static uint32_t window_frames = 0;
+static uint32_t last_capture_us = 0;
+static uint32_t session = 0;          // New at every boot, the controller restarts its window on it
+static uint32_t sequence = 0;
+static bool started = false;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static edge_counter_stats_t stats = {};
+static uint64_t count_sum_us = 0;
+static uint32_t count_samples = 0;
+
+void edge_counter_init(IPAddress controller, uint16_t port)
+{
+  controller_ip = controller;
+  controller_port = port;
+  session = esp_random();
+
+  vehicle_counter_config_t config = {COUNTER_THRESHOLD, COUNTER_BACKGROUND_SHIFT, COUNTER_FOREGROUND_SHIFT,
+                                     COUNTER_MIN_BLOB_PIXELS, COUNTER_WARMUP_FRAMES,
+                                     COUNTER_LANES, (uint8_t) COUNTER_LANE_COUNT};
+  vehicle_counter_init(&counter, &config);
+
+  // Approaches past the last one with a lane keep their counts on the controller
+  for (size_t l = 0; l < COUNTER_LANE_COUNT; l++)
+    if (COUNTER_LANES[l].approach < COUNTER_MAX_APPROACHES && COUNTER_LANES[l].approach >= approach_count)
+      approach_count = COUNTER_LANES[l].approach + 1;
+}
+
+bool edge_counter_due(uint32_t now_ms)
+{
+  return !started || now_ms - last_count_ms >= EDGE_COUNTER_INTERVAL_MS;
+}
+
+// Rounded average of the counts since the last datagram
+static void publish(void)
+{
+  uint16_t counts[COUNTER_MAX_APPROACHES];
+  for (int a = 0; a < COUNTER_MAX_APPROACHES; a++)
+    counts[a] = (uint16_t) ((window_sums[a] + window_frames / 2) / window_frames);
+
+  detection_datagram_t datagram;
+  detection_datagram_encode(&datagram, session, ++sequence, last_capture_us, counts, approach_count, 0);
+
+  bool sent = udp.beginPacket(controller_ip, controller_port) &&
+              udp.write((const uint8_t *) &datagram, sizeof(datagram)) == sizeof(datagram) &&
+              udp.endPacket();
+
+  portENTER_CRITICAL(&stats_mux);
+  stats.published++;
+  if (!sent)
+    stats.send_errors++;
+  memcpy(stats.counts, counts, sizeof(stats.counts));
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void edge_counter_process(const uint8_t *luma, uint16_t width, uint16_t height, uint32_t now_ms, uint32_t capture_us)
+{
+  if (!started)
+  {
+    started = true;
+    window_start_ms = now_ms;
+  }
+  last_count_ms = now_ms;
+
+  int64_t start_us = esp_timer_get_time();
+  vehicle_count_t count;
+  bool ready = vehicle_counter_process(&counter, luma, width, height, &count);
+  uint32_t elapsed_us = (uint32_t) (esp_timer_get_time() - start_us);
+
+  if (ready)
+  {
+    for (int a = 0; a < COUNTER_MAX_APPROACHES; a++)
+      window_sums[a] += count.counts[a];
+    window_frames++;
+    last_capture_us = capture_us;
+  }
+
+  portENTER_CRITICAL(&stats_mux);
+  stats.frames++;
+  stats.ready = ready;
+  count_sum_us += elapsed_us;
+  count_samples++;
+  if (elapsed_us > stats.count_max_us)
+    stats.count_max_us = elapsed_us;
+  portEXIT_CRITICAL(&stats_mux);
+
+  if (now_ms - window_start_ms < EDGE_COUNTER_PUBLISH_MS)
+    return;
+
+  // Nothing is sent until the background is learned, or while frames fail
+  // to decode: the controller then keeps waiting for the server
+  if (window_frames > 0)
+    publish();
+
+  memset(window_sums, 0, sizeof(window_sums));
+  window_frames = 0;
+  window_start_ms = now_ms;
+}
+
+void edge_counter_get_stats(edge_counter_stats_t *out)
+{
+  portENTER_CRITICAL(&stats_mux);
+  *out = stats;
+  out->count_avg_us = count_samples > 0 ? (uint32_t) (count_sum_us / count_samples) : 0;
+  stats.count_max_us = 0;
+  count_sum_us = 0;
+  count_samples = 0;
+  portEXIT_CRITICAL(&stats_mux);
+}
@@ -0,0 +1,39 @@
+#ifndef _EDGE_COUNTER_H_
+#define _EDGE_COUNTER_H_
+
+#include <stdint.h>
+#include <WiFi.h>
+
+#include "vehicle_counter.h"
+
+// Fallback vehicle counting on the camera (EDGE_COUNTER in
+// stream_config.h). The capture task hands it a block luma image every
+// EDGE_COUNTER_INTERVAL_MS, streaming or not; every EDGE_COUNTER_PUBLISH_MS
+// the counts averaged over that period go to the controller as a detection
+// datagram (detection_protocol.h). The controller only applies them while
+// the server's counts have gone quiet, so they matter exactly when
+// model.py or the laptop is down. Only the capture task may count.
+
+typedef struct {
+  uint32_t frames;           // Frames counted
+  uint32_t published;        // Datagrams sent
+  uint32_t send_errors;
+  uint32_t count_avg_us;     // Counter time per frame, since the last read
+  uint32_t count_max_us;
+  uint16_t counts[COUNTER_MAX_APPROACHES];  // Last published
+  bool ready;                // Background learned
+} edge_counter_stats_t;
+
+void edge_counter_init(IPAddress controller, uint16_t port);
+
+// True when the next frame should be counted
+bool edge_counter_due(uint32_t now_ms);
+
+// Count one frame, NULL luma if it could not be decoded. `capture_us` is
+// the frame's capture time, sent with the counts it ends up in.
+void edge_counter_process(const uint8_t *luma, uint16_t width, uint16_t height, uint32_t now_ms, uint32_t capture_us);
+
+// Copy, and start a new timing window
+void edge_counter_get_stats(edge_counter_stats_t *stats);
+
+#endif //_EDGE_COUNTER_H_
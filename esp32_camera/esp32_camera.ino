@@ -19,15 +19,16 @@
 #include "freertos/semphr.h"
 #include "esp_system.h"
 
-#define CHUNK_SIZE  1400
-
-#define STREAM_FPS  30
+#include "stream_config.h"
+#include "frame_sender.h"
+#include "frame_stats.h"
+#include "frame_pipeline.h"
+#include "rate_control.h"
+#include "edge_counter.h"
 
 WiFiMulti WiFiMulti;
 SocketIOclient socketIO;
 
-WiFiUDP udp;
-
 // Server (laptop) IP and Port number
 // IPAddress serverIP(192, 168, 137, 1);
 // IPAddress serverIP(192, 168, 1, 4);
@@ -35,6 +36,10 @@ IPAddress serverIP(10, 42, 0, 1);
 uint16_t serverPort = 5000;
 uint16_t updPort    = 3000;
 
+// Traffic controller, where the edge counter sends its counts. Give it a
+// fixed address (DHCP reservation).
+IPAddress controllerIP(10, 42, 0, 2);
+
 const char *videoNS = "/video";
 
 int status = WL_IDLE_STATUS;
@@ -51,10 +56,12 @@ char pass[] = "12345678";  // your network password (use for WPA, or use as key
 volatile bool isStreaming = false;
 SemaphoreHandle_t mutex = NULL;
 TaskHandle_t socketIOTaskHandle = NULL;
-UBaseType_t socketIOTaskPriority = 20;
+UBaseType_t socketIOTaskPriority = SOCKET_IO_PRIORITY;
 
 void startStream();
 void pauseStream();
+void sendStreamSettings();
+void reportStreamStats();
 
 void hexdump(const uint8_t *data, const size_t &length) {
   for (size_t i = 0; i < length; i++) {
@@ -88,26 +95,47 @@ void socketIOEvent(const socketIOmessageType_t &type, uint8_t *payload, const si
 
     case sIOtype_EVENT:
       {
-        Serial.print("[IOc] Get event: ");
-        Serial.println((char *)payload);
-
-        char *packet = (char *)payload;
-
-        // Skip to the beginning of array /video,["start"]
-        while (packet[0] != '[') packet++;
-
-        Serial.println(packet);
+        // Skip to the beginning of array /video,["start"]. rx_stats arrives
+        // every second, so events are not printed.
+        const char *packet = (const char *)payload;
+        size_t remaining = length;
+        while (remaining > 0 && packet[0] != '[') {
+          packet++;
+          remaining--;
+        }
+        if (remaining == 0) {
+          break;
+        }
 
         JsonDocument doc;
 
-        deserializeJson(doc, (char *)packet);
+        if (deserializeJson(doc, packet, remaining)) {
+          break;
+        }
 
         String eventName = doc[0];
 
         if (eventName == "start") {
           startStream();
+          sendStreamSettings();
         } else if (eventName == "pause") {
           pauseStream();
+        } else if (eventName == "rx_stats") {
+          JsonVariant stats = doc[1];
+          rate_feedback_t feedback;
+
+          feedback.frames_complete = stats["framesComplete"].as<uint16_t>();
+          feedback.frames_incomplete = stats["framesIncomplete"].as<uint16_t>();
+          feedback.raw_loss_permille = stats["rawLossPermille"].as<uint16_t>();
+          feedback.residual_loss_permille = stats["residualLossPermille"].as<uint16_t>();
+          feedback.detector_queue = stats["detectorQueue"].as<uint16_t>();
+          feedback.detector_capacity = stats["detectorCapacity"].as<uint16_t>();
+          feedback.detector_dropped = stats["detectorDropped"].as<uint16_t>();
+          feedback.detector_fps_x10 = stats["detectorFpsX10"].as<uint16_t>();
+
+          if (rate_control_feedback(&feedback)) {
+            sendStreamSettings();
+          }
         }
       }
       break;
@@ -204,13 +232,14 @@ void setup() {
   cameraConfig.pin_pwdn = PWDN_GPIO_NUM;
   cameraConfig.pin_reset = RESET_GPIO_NUM;
   cameraConfig.xclk_freq_hz = 24000000;
-  cameraConfig.frame_size = FRAMESIZE_XGA;
+  // Largest size rate control may pick, the frame buffers are sized for it
+  cameraConfig.frame_size = RATE_FRAMESIZE_MAX;
   cameraConfig.pixel_format = PIXFORMAT_JPEG;  // for streaming
   //cameraConfig.pixel_format = PIXFORMAT_RGB565; // for face detection/recognition
   cameraConfig.grab_mode = CAMERA_GRAB_LATEST;
   cameraConfig.fb_location = CAMERA_FB_IN_PSRAM;
-  cameraConfig.jpeg_quality = 4;
-  cameraConfig.fb_count = 6;
+  cameraConfig.jpeg_quality = RATE_QUALITY_BEST;
+  cameraConfig.fb_count = CAMERA_FB_COUNT;
 
   // camera init
   esp_err_t err = esp_camera_init(&cameraConfig);
@@ -219,6 +248,8 @@ void setup() {
     return;
   }
 
+  rate_control_init();
+
   delay(200);
 
   WiFiMulti.addAP(ssid, pass);
@@ -252,84 +283,191 @@ void setup() {
   // To use default EIO=4 from v2.5.1
   socketIO.begin(serverIP, serverPort);
 
+  frame_sender_init(serverIP, updPort);
+
+#if EDGE_COUNTER
+  edge_counter_init(controllerIP, EDGE_COUNTER_PORT);
+#endif
+
+#if CAMERA_PIPELINE
+  if (!frame_pipeline_init()) {
+    return;
+  }
+#endif
+
   // event handler
   socketIO.onEvent(socketIOEvent);
-  xTaskCreatePinnedToCore(socket_io_task, "Socket.IO Client Task", 4096, NULL, socketIOTaskPriority, &socketIOTaskHandle, 1);
+  xTaskCreatePinnedToCore(socket_io_task, "Socket.IO Client Task", SOCKET_IO_STACK_SIZE, NULL, socketIOTaskPriority, &socketIOTaskHandle, SOCKET_IO_CORE);
 
 }
 
+// Stats are reported from here, the only task that may use socketIO
 void socket_io_task(void *pvParams) {
+  uint32_t lastReportTime = millis();
+
   while (true) {
     socketIO.loop();
-    vTaskDelay(pdMS_TO_TICKS(1));
+
+    if (millis() - lastReportTime >= STATS_REPORT_MS) {
+      lastReportTime = millis();
+      reportStreamStats();
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(SOCKET_IO_POLL_MS));
+  }
+}
+
+void reportStreamStats() {
+  frame_stats_t stats;
+  frame_stats_report(&stats);
+
+  printStreamStats(stats);
+  if (socketIO.isConnected()) {
+    sendStreamStats(stats);
+  }
+}
+
+void printStreamStats(const frame_stats_t &stats) {
+  Serial.printf("[Camera] %lu.%lu fps, interval %.2f ms, jitter avg %.2f ms max %.2f ms, "
+                "captured %lu, dropped %lu, no frame %lu, send errors %lu",
+                (unsigned long)(stats.fps_x10 / 10), (unsigned long)(stats.fps_x10 % 10),
+                stats.interval_avg_us / 1000.0, stats.jitter_avg_us / 1000.0, stats.jitter_max_us / 1000.0,
+                (unsigned long)stats.captured, (unsigned long)stats.dropped,
+                (unsigned long)stats.no_frame, (unsigned long)stats.send_errors);
+
+  for (int core = 0; core < FRAME_STATS_CORES; core++) {
+    if (stats.idle_permille[core] < 0) {
+      Serial.printf(", idle core%d n/a", core);
+    } else {
+      Serial.printf(", idle core%d %d.%d%%", core, stats.idle_permille[core] / 10, stats.idle_permille[core] % 10);
+    }
+  }
+
+  frame_sender_stats_t sender;
+  frame_sender_get_stats(&sender);
+
+#if CAMERA_PIPELINE && MOTION_GATE
+  Serial.printf(", still %lu, keyframes %lu, gate avg %.2f ms max %.2f ms",
+                (unsigned long)stats.still, (unsigned long)stats.keyframes,
+                stats.gate_avg_us / 1000.0, stats.gate_max_us / 1000.0);
+#endif
+
+  Serial.printf(", fragments %lu, parity %lu, failed %lu, paced %lu",
+                (unsigned long)sender.fragments, (unsigned long)sender.parity_fragments,
+                (unsigned long)sender.send_errors, (unsigned long)sender.pace_waits);
+
+  rate_settings_t settings;
+  rate_control_get(&settings);
+
+  Serial.printf(", frame size %d, quality %d, target %d fps", settings.frame_size, settings.quality, settings.fps);
+
+#if EDGE_COUNTER
+  edge_counter_stats_t counter;
+  edge_counter_get_stats(&counter);
+
+  if (counter.ready) {
+    Serial.printf(", counts %u/%u/%u/%u", counter.counts[0], counter.counts[1], counter.counts[2], counter.counts[3]);
+  } else {
+    Serial.print(", counter learning");
   }
+  Serial.printf(", count avg %.2f ms max %.2f ms, published %lu, failed %lu",
+                counter.count_avg_us / 1000.0, counter.count_max_us / 1000.0,
+                (unsigned long)counter.published, (unsigned long)counter.send_errors);
+#endif
+  Serial.println();
+}
+
+// Stage histograms and counters of the last report window for the
+// dashboard, bucket b counts frames under FRAME_STATS_BUCKET_US << b
+void sendStreamStats(const frame_stats_t &stats) {
+  static const char *stageNames[FRAME_STAGE_COUNT] = { "acquire", "fragment", "send", "total" };
+
+  JsonDocument doc;
+  doc[0] = "camera_stats";
+  JsonObject data = doc[1].to<JsonObject>();
+
+  data["windowMs"] = stats.window_ms;
+  data["fpsX10"] = stats.fps_x10;
+  data["captured"] = stats.captured;
+  data["sent"] = stats.sent;
+  data["dropped"] = stats.dropped;
+  data["noFrame"] = stats.no_frame;
+  data["sendErrors"] = stats.send_errors;
+  data["still"] = stats.still;
+  data["bucketUs"] = FRAME_STATS_BUCKET_US;
+
+  JsonObject histograms = data["histograms"].to<JsonObject>();
+  for (int stage = 0; stage < FRAME_STAGE_COUNT; stage++) {
+    JsonArray buckets = histograms[stageNames[stage]].to<JsonArray>();
+    for (int bucket = 0; bucket < FRAME_STATS_BUCKETS; bucket++) {
+      buckets.add(stats.histograms[stage][bucket]);
+    }
+  }
+
+  String event = videoNS;
+  event += ',';
+  serializeJson(doc, event);
+  socketIO.sendEVENT(event);
+}
+
+// Tell the server what rate control picked
+void sendStreamSettings() {
+  rate_settings_t settings;
+  rate_control_get(&settings);
+
+  char event[128];
+  snprintf(event, sizeof(event), "%s,[\"stream_settings\",{\"frameSize\":%d,\"quality\":%d,\"fps\":%d}]",
+           videoNS, settings.frame_size, settings.quality, settings.fps);
+  socketIO.sendEVENT(event);
 }
 
+#if CAMERA_PIPELINE
+
+// Capture and transmit run in their own tasks, stats are reported by the
+// Socket.IO task: nothing left to do here
+void loop() {
+  vTaskDelete(NULL);
+}
+
+#else
+
 static int64_t lastFrameTime = 0;
 static uint32_t frameNum = 0;
 
+// The original single loop: spin until the next frame is due, then grab,
+// chunk and send it before anything else happens
 void loop() {
   if (isStreaming) {
     if (esp_camera_available_frames() == 0) {
-      Serial.println("There are no available frames");
       return;
     }
 
-    if (esp_timer_get_time() - lastFrameTime > (1000000 / STREAM_FPS))
+    if (esp_timer_get_time() - lastFrameTime > rate_control_interval_us())
     {
       lastFrameTime = esp_timer_get_time();
 
       camera_fb_t *frame = esp_camera_fb_get();
+      frame_stats_stage(FRAME_STAGE_ACQUIRE, (uint32_t)(esp_timer_get_time() - lastFrameTime));
+      if (frame == NULL) {
+        frame_stats_no_frame();
+        return;
+      }
 
-      size_t totalSize = frame->len;
-      size_t totalChunks = (totalSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
-
-      // Serial.print("Frame Grap Time: ");
-      // Serial.println((float)(esp_timer_get_time() - lastFrameTime) / 1000);
+      frame_stats_captured(lastFrameTime);
 
       frameNum++;
 
-      // int64_t sum = 0;
-      // int64_t timeBeforeEncoding = 0;
-      // int64_t timeBeforeSending = esp_timer_get_time();
-      
-      for (size_t i = 0; i < totalChunks; i++) {
-        size_t offset = i * CHUNK_SIZE;
-        size_t chunkSize = min((size_t)CHUNK_SIZE, (size_t)(totalSize - offset));
-
-        udp.beginPacket(serverIP, updPort);
-        // timeBeforeEncoding = esp_timer_get_time();
-        // String chunkBase64 = base64::encode(frame->buf + offset, chunkSize);
-        // sum += esp_timer_get_time() - timeBeforeEncoding;
-        
-        // String output = videoNS;
-        // output += ",[ \"frame_chunk\" , \"" + chunk64Encoded + "\" ]";
-        udp.write(frame->buf + offset, chunkSize);
-        udp.write((uint8_t*)&frameNum, sizeof(frameNum));
-        udp.write((uint8_t*)&totalChunks, sizeof(totalChunks));
-        udp.write((uint8_t*)&i, sizeof(i));
-        udp.endPacket();
-      }
-
-      // Serial.print("Sending Time: ");
-      // Serial.println((float)(esp_timer_get_time() - timeBeforeSending) / 1000.0);
+      bool sent = frame_sender_send(frame, frameNum);
       esp_camera_fb_return(frame);
 
-      
-      Serial.print("[Camera] Frame sent,    Total Time: ");
-      Serial.println((float)(esp_timer_get_time() - lastFrameTime) / 1000.0);
-      
-      // String output = videoNS;
-      // output += ",[ \"frame_end\" ]";
-
-      // socketIO.sendEVENT(output);
-      // Serial.print("    Encode Time: ");
-      // Serial.println((float)sum / 1000);
-      // vTaskDelay(pdMS_TO_TICKS(1000));
+      frame_stats_sent(sent);
+      frame_stats_stage(FRAME_STAGE_TOTAL, (uint32_t)(esp_timer_get_time() - lastFrameTime));
     }
   }
 }
 
+#endif
+
 void startStream() {
   // Already Streaming, just return
   if (isStreaming == true) return;
@@ -337,6 +475,12 @@ void startStream() {
   // Set isStreaming value to true
   isStreaming = true;
 
+#if CAMERA_PIPELINE
+  frame_pipeline_start();
+#else
+  frame_stats_restart();
+#endif
+
   Serial.println("[Camera] Start Stream");
 }
 
@@ -347,5 +491,9 @@ void pauseStream() {
   // Set isStreaming value to false
   isStreaming = false;
 
+#if CAMERA_PIPELINE
+  frame_pipeline_stop();
+#endif
+
   Serial.println("[Camera] Pause Stream");
 }
\ No newline at end of file
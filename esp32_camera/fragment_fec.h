@@ -0,0 +1,73 @@
+#ifndef _FRAGMENT_FEC_H_
+#define _FRAGMENT_FEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// XOR parity over the data fragments of one frame. The n data fragments
+// are split into `groups` interleaved groups, fragment i belongs to group
+// i % groups, and every group gets one parity fragment: the XOR of its
+// members' payloads, each zero padded to the longest. The receiver rebuilds
+// one lost fragment per group, and because consecutive fragments fall into
+// different groups, a burst of up to `groups` lost datagrams is recovered.
+//
+// No Arduino dependencies, server/frame_reassembler.js does the recovery.
+
+// Groups for groups of at most `group_size` members, 0 without parity
+static inline uint16_t fragment_fec_groups(uint32_t fragment_count, uint32_t group_size)
+{
+  if (group_size == 0 || fragment_count == 0)
+    return 0;
+  return (uint16_t) ((fragment_count + group_size - 1) / group_size);
+}
+
+static inline void fragment_fec_xor(uint8_t *parity, const uint8_t *data, size_t length)
+{
+  size_t i = 0;
+
+  // Word at a time when both are aligned, the common case with the frame
+  // buffer and a CHUNK_SIZE that is a multiple of 4
+  if ((((uintptr_t) parity | (uintptr_t) data) & 3) == 0)
+  {
+    uint8_t *p = (uint8_t *) __builtin_assume_aligned(parity, 4);
+    const uint8_t *d = (const uint8_t *) __builtin_assume_aligned(data, 4);
+
+    for (; i + 4 <= length; i += 4)
+    {
+      uint32_t a, b;
+      memcpy(&a, p + i, 4);
+      memcpy(&b, d + i, 4);
+      a ^= b;
+      memcpy(p + i, &a, 4);
+    }
+  }
+
+  for (; i < length; i++)
+    parity[i] ^= data[i];
+}
+
+// Parity payload of group `group` into `parity` (chunk_size bytes), returns
+// its length. `frame` holds the whole frame, fragment i at i * chunk_size.
+static inline uint16_t fragment_fec_parity(const uint8_t *frame, uint32_t frame_size, uint16_t chunk_size,
+                                           uint16_t groups, uint16_t group, uint8_t *parity)
+{
+  uint32_t fragment_count = (frame_size + chunk_size - 1) / chunk_size;
+  uint16_t length = 0;
+
+  memset(parity, 0, chunk_size);
+
+  for (uint32_t i = group; i < fragment_count; i += groups)
+  {
+    uint32_t offset = i * chunk_size;
+    uint16_t member = (uint16_t) (frame_size - offset < chunk_size ? frame_size - offset : chunk_size);
+
+    fragment_fec_xor(parity, frame + offset, member);
+    if (member > length)
+      length = member;
+  }
+
+  return length;
+}
+
+#endif //_FRAGMENT_FEC_H_
@@ -0,0 +1,83 @@
+#ifndef _FRAGMENT_PROTOCOL_H_
+#define _FRAGMENT_PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// One UDP datagram per fragment of a JPEG frame: this header, then
+// payload_length image bytes. Little-endian, 32 bytes:
+//
+//   0  u8   magic           FRAGMENT_MAGIC
+//   1  u8   version         FRAGMENT_VERSION
+//   2  u8   stream_id       Camera stream, frames of different streams never mix
+//   3  u8   flags           fragment_flags_t
+//   4  u32  frame_number    Incremented for every frame sent
+//   8  u32  frame_size      Bytes of the whole frame
+//  12  u32  offset          Byte offset of the payload in the frame.
+//                           Parity: bytes per data fragment
+//  16  u32  timestamp_us    Capture time, camera clock (esp_timer)
+//  20  u16  fragment_index  Parity: parity group
+//  22  u16  fragment_count  Data fragments of the frame
+//  24  u16  payload_length
+//  26  u16  parity_groups   Parity fragments sent for the frame
+//                           (fragment_fec.h), 0 without
+//  28  u32  crc             CRC-32 (zlib) of the header with crc = 0, then
+//                           the payload
+//
+// server/frame_reassembler.js reads the same layout. No Arduino
+// dependencies, the CRC is computed by the caller. Version 1 had no parity
+// (flags and parity_groups always 0).
+
+#define FRAGMENT_MAGIC   0xF7
+#define FRAGMENT_VERSION 2
+
+typedef enum {
+  FRAGMENT_FLAG_PARITY = 0x01   // Payload is the XOR parity of a group
+} fragment_flags_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t stream_id;
+  uint8_t flags;
+  uint32_t frame_number;
+  uint32_t frame_size;
+  uint32_t offset;
+  uint32_t timestamp_us;
+  uint16_t fragment_index;
+  uint16_t fragment_count;
+  uint16_t payload_length;
+  uint16_t parity_groups;
+  uint32_t crc;
+} fragment_header_t;
+
+static_assert(sizeof(fragment_header_t) == 32, "Fragment header layout changed");
+
+// Fragments needed for a frame
+static inline uint32_t fragment_count_for(uint32_t frame_size, uint16_t payload_size)
+{
+  return (frame_size + payload_size - 1) / payload_size;
+}
+
+// Fills every field but the flags and the CRC (left 0)
+static inline void fragment_header_encode(fragment_header_t *header, uint8_t stream_id, uint32_t frame_number,
+                                          uint32_t frame_size, uint32_t timestamp_us, uint16_t index,
+                                          uint16_t count, uint32_t offset, uint16_t payload_length,
+                                          uint16_t parity_groups)
+{
+  memset(header, 0, sizeof(*header));
+  header->magic = FRAGMENT_MAGIC;
+  header->version = FRAGMENT_VERSION;
+  header->stream_id = stream_id;
+  header->frame_number = frame_number;
+  header->frame_size = frame_size;
+  header->offset = offset;
+  header->timestamp_us = timestamp_us;
+  header->fragment_index = index;
+  header->fragment_count = count;
+  header->payload_length = payload_length;
+  header->parity_groups = parity_groups;
+}
+
+#endif //_FRAGMENT_PROTOCOL_H_
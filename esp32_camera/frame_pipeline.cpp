@@ -0,0 +1,249 @@
+#include <Arduino.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_camera.h"
+
+#include "edge_counter.h"
+#include "frame_pipeline.h"
+#include "frame_sender.h"
+#include "frame_stats.h"
+#include "jpeg_dc.h"
+#include "motion_gate.h"
+#include "stream_config.h"
+
+// A captured frame and when its tick fired, for the total frame time
+typedef struct {
+  camera_fb_t *frame;
+  int64_t start_us;
+} ring_entry_t;
+
+static QueueHandle_t frame_ring = NULL;
+static esp_timer_handle_t frame_timer = NULL;
+static TaskHandle_t capture_task_handle = NULL;
+static TaskHandle_t transmit_task_handle = NULL;
+static volatile bool pacing = false;
+static uint32_t interval_us = 1000000 / STREAM_FPS;
+
+// Only touched by the transmit task
+static uint32_t frame_number = 0;
+
+#if MOTION_GATE
+// Only touched by the capture task, reset there when streaming starts
+static motion_gate_t motion_gate;
+static volatile bool motion_gate_stale = true;
+#endif
+
+#if MOTION_GATE || EDGE_COUNTER
+// Only touched by the capture task: the block luma image of the current
+// frame, decoded once for the gate and the counter
+static jpeg_dc_t jpeg;
+static uint8_t luma[LUMA_IMAGE_SIZE];
+static const camera_fb_t *luma_frame = NULL;
+static const uint8_t *luma_image = NULL;
+
+// NULL if the frame cannot be read
+static const uint8_t *frame_luma(const camera_fb_t *frame)
+{
+  if (luma_frame != frame)
+  {
+    luma_frame = frame;
+    luma_image = jpeg_dc_luma_image(&jpeg, frame->buf, frame->len, luma, sizeof(luma)) ? luma : NULL;
+  }
+  return luma_image;
+}
+#endif
+
+// Streaming: the stream's frame interval. Paused: the edge counter's, or
+// no ticks at all without it.
+static void restart_timer(void)
+{
+  esp_timer_stop(frame_timer);
+
+  if (pacing)
+    esp_timer_start_periodic(frame_timer, interval_us);
+#if EDGE_COUNTER
+  else
+    esp_timer_start_periodic(frame_timer, EDGE_COUNTER_INTERVAL_MS * 1000);
+#endif
+}
+
+// esp_timer task context: wake the capture task, which grabs the frame
+static void frame_timer_callback(void *arg)
+{
+  xTaskNotifyGive(capture_task_handle);
+}
+
+static void capture_task(void *pvParams)
+{
+  while (true)
+  {
+    // Ticks missed while capturing collapse into one
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    bool streaming = pacing;
+#if !EDGE_COUNTER
+    if (!streaming)
+      continue;
+#endif
+
+    // Same point as the single loop, so intervals compare
+    int64_t now_us = esp_timer_get_time();
+#if MOTION_GATE || EDGE_COUNTER
+    uint32_t now_ms = (uint32_t) (now_us / 1000);
+#endif
+
+    camera_fb_t *frame = esp_camera_fb_get();
+    if (streaming)
+      frame_stats_stage(FRAME_STAGE_ACQUIRE, (uint32_t) (esp_timer_get_time() - now_us));
+
+    if (frame == NULL)
+    {
+      if (streaming)
+        frame_stats_no_frame();
+      continue;
+    }
+
+#if MOTION_GATE || EDGE_COUNTER
+    luma_frame = NULL;
+#endif
+
+#if EDGE_COUNTER
+    if (edge_counter_due(now_ms))
+    {
+      // Same clock and truncation as the fragment header's timestamp
+      uint32_t capture_us = (uint32_t) ((uint64_t) frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec);
+      edge_counter_process(frame_luma(frame), jpeg.blocks_w, jpeg.blocks_h, now_ms, capture_us);
+    }
+#endif
+
+    if (!streaming)
+    {
+      esp_camera_fb_return(frame);
+      continue;
+    }
+
+    frame_stats_captured(now_us);
+
+#if MOTION_GATE
+    if (motion_gate_stale)
+    {
+      motion_gate_stale = false;
+      motion_gate_reset(&motion_gate);
+    }
+
+    int64_t gate_start_us = esp_timer_get_time();
+    motion_decision_t decision = motion_gate_check(&motion_gate, frame_luma(frame), jpeg.blocks_w, jpeg.blocks_h,
+                                                   now_ms);
+    frame_stats_gated(decision, (uint32_t) (esp_timer_get_time() - gate_start_us));
+
+    if (decision == MOTION_SKIP)
+    {
+      esp_camera_fb_return(frame);
+      continue;
+    }
+#endif
+
+    ring_entry_t entry = {frame, now_us};
+    if (xQueueSend(frame_ring, &entry, 0) != pdTRUE)
+    {
+      esp_camera_fb_return(frame);
+      frame_stats_dropped();
+    }
+  }
+}
+
+static void transmit_task(void *pvParams)
+{
+  ring_entry_t entry;
+
+  while (true)
+  {
+    if (xQueueReceive(frame_ring, &entry, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    frame_number++;
+    bool sent = frame_sender_send(entry.frame, frame_number);
+    esp_camera_fb_return(entry.frame);
+
+    frame_stats_sent(sent);
+    frame_stats_stage(FRAME_STAGE_TOTAL, (uint32_t) (esp_timer_get_time() - entry.start_us));
+  }
+}
+
+bool frame_pipeline_init(void)
+{
+#if MOTION_GATE
+  motion_gate_config_t gate_config = {MOTION_CELL_DELTA, MOTION_CHANGED_CELLS, MOTION_KEYFRAME_MS};
+  motion_gate_init(&motion_gate, &gate_config);
+#endif
+
+  frame_ring = xQueueCreate(FRAME_RING_SIZE, sizeof(ring_entry_t));
+  if (frame_ring == NULL)
+  {
+    Serial.println("[Camera] Failed to create the frame ring");
+    return false;
+  }
+
+  if (xTaskCreatePinnedToCore(capture_task, "Capture Task", CAPTURE_STACK_SIZE, NULL, CAPTURE_PRIORITY,
+                              &capture_task_handle, CAPTURE_CORE) != pdPASS ||
+      xTaskCreatePinnedToCore(transmit_task, "Transmit Task", TRANSMIT_STACK_SIZE, NULL, TRANSMIT_PRIORITY,
+                              &transmit_task_handle, TRANSMIT_CORE) != pdPASS)
+  {
+    Serial.println("[Camera] Failed to create the pipeline tasks");
+    return false;
+  }
+
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = frame_timer_callback;
+  timer_args.dispatch_method = ESP_TIMER_TASK;
+  timer_args.name = "frame";
+  timer_args.skip_unhandled_events = true;
+
+  if (esp_timer_create(&timer_args, &frame_timer) != ESP_OK)
+  {
+    Serial.println("[Camera] Failed to create the frame timer");
+    return false;
+  }
+
+#if EDGE_COUNTER
+  // Counting starts before the first stream
+  restart_timer();
+#endif
+
+  return true;
+}
+
+void frame_pipeline_start(void)
+{
+  if (frame_timer == NULL || pacing)
+    return;
+
+  frame_stats_restart();
+#if MOTION_GATE
+  motion_gate_stale = true;
+#endif
+  pacing = true;
+  restart_timer();
+}
+
+void frame_pipeline_stop(void)
+{
+  if (frame_timer == NULL || !pacing)
+    return;
+
+  pacing = false;
+  restart_timer();
+}
+
+void frame_pipeline_set_interval(uint32_t new_interval_us)
+{
+  interval_us = new_interval_us;
+
+  if (frame_timer == NULL || !pacing)
+    return;
+
+  restart_timer();
+}
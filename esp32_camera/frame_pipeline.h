@@ -0,0 +1,28 @@
+#ifndef _FRAME_PIPELINE_H_
+#define _FRAME_PIPELINE_H_
+
+#include <stdint.h>
+
+// Capture and transmit run as two tasks on separate cores
+// (stream_config.h), connected by a ring of FRAME_RING_SIZE frame buffer
+// pointers, so the next frame is grabbed while the previous one is still
+// being sent. A periodic esp_timer paces capture at STREAM_FPS: the capture
+// task sleeps until the timer notifies it, nothing spins. When transmit
+// falls behind the ring fills and new frames go back to the driver unsent
+// (counted as dropped), the stream never stalls on a full ring. With
+// MOTION_GATE the capture task also drops frames of a static scene before
+// they reach the ring (motion_gate.h). With EDGE_COUNTER it hands frames to
+// the edge counter (edge_counter.h), and keeps capturing at the counter's
+// rate while the stream is paused.
+
+// Create the ring, the timer and both tasks, after the camera and Wi-Fi
+bool frame_pipeline_init(void);
+
+// Start or stop streaming; frames already captured are still sent
+void frame_pipeline_start(void);
+void frame_pipeline_stop(void);
+
+// New capture period, takes effect right away when streaming
+void frame_pipeline_set_interval(uint32_t interval_us);
+
+#endif //_FRAME_PIPELINE_H_
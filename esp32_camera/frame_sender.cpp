@@ -0,0 +1,172 @@
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+
+#include "fragment_fec.h"
+#include "fragment_protocol.h"
+#include "frame_sender.h"
+#include "frame_stats.h"
+#include "stream_config.h"
+#include "token_bucket.h"
+
+#define DATAGRAM_SIZE (sizeof(fragment_header_t) + CHUNK_SIZE)
+
+static WiFiUDP udp;
+static IPAddress server_ip;
+static uint16_t server_port = 0;
+static volatile uint32_t interval_us = 1000000 / STREAM_FPS;
+
+// Only touched by the sending task
+static token_bucket_t pacer;
+static uint8_t parity[CHUNK_SIZE] __attribute__((aligned(4)));
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static frame_sender_stats_t stats = {0, 0, 0, 0, 0};
+
+void frame_sender_init(IPAddress server, uint16_t port)
+{
+  server_ip = server;
+  server_port = port;
+  token_bucket_init(&pacer, 0, PACER_BURST_FRAGMENTS * DATAGRAM_SIZE, esp_timer_get_time());
+}
+
+void frame_sender_set_interval(uint32_t new_interval_us)
+{
+  interval_us = new_interval_us;
+}
+
+// Rate that sends the frame in FRAME_SPREAD_PERCENT of the interval. The
+// pacer sleeps whole ticks, so the burst also covers a tick of sending.
+static void pace_frame(uint32_t frame_bytes)
+{
+  uint64_t spread_us = (uint64_t) interval_us * FRAME_SPREAD_PERCENT / 100;
+  uint32_t rate = spread_us > 0 ? (uint32_t) ((uint64_t) frame_bytes * 1000000 / spread_us) : UINT32_MAX;
+  uint32_t tick_bytes = (uint32_t) ((uint64_t) rate * portTICK_PERIOD_MS / 1000);
+
+  token_bucket_set_rate(&pacer, rate, max((uint32_t) (PACER_BURST_FRAGMENTS * DATAGRAM_SIZE), tick_bytes),
+                        esp_timer_get_time());
+}
+
+static void pace_fragment(uint32_t bytes)
+{
+  uint32_t wait_us;
+
+  while ((wait_us = token_bucket_take(&pacer, bytes, esp_timer_get_time())) > 0)
+  {
+    portENTER_CRITICAL(&stats_mux);
+    stats.pace_waits++;
+    portEXIT_CRITICAL(&stats_mux);
+
+    vTaskDelay(max((TickType_t) 1, (TickType_t) pdMS_TO_TICKS(wait_us / 1000)));
+  }
+}
+
+// CRC over the header and the payload, the last step of building a fragment
+static void seal_fragment(fragment_header_t *header, const uint8_t *payload)
+{
+  uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *) header, sizeof(*header));
+  header->crc = esp_rom_crc32_le(crc, payload, header->payload_length);
+}
+
+// Pace and send one fragment, false if the stack refused it. Time spent in
+// the UDP calls adds to send_us.
+static bool send_fragment(const fragment_header_t *header, const uint8_t *payload, uint32_t *send_us)
+{
+#if FRAGMENT_PACING
+  pace_fragment(sizeof(*header) + header->payload_length);
+#endif
+
+  int64_t start_us = esp_timer_get_time();
+
+  udp.beginPacket(server_ip, server_port);
+  udp.write((const uint8_t *) header, sizeof(*header));
+  udp.write(payload, header->payload_length);
+  bool ok = udp.endPacket();
+
+  *send_us += (uint32_t) (esp_timer_get_time() - start_us);
+  return ok;
+}
+
+bool frame_sender_send(const camera_fb_t *frame, uint32_t frame_number)
+{
+  uint32_t frame_size = frame->len;
+  uint32_t fragment_count = fragment_count_for(frame_size, CHUNK_SIZE);
+  uint16_t parity_groups = fragment_fec_groups(fragment_count, FEC_GROUP_SIZE);
+  uint32_t timestamp_us = (uint32_t) ((uint64_t) frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec);
+  uint32_t sent_fragments = 0;
+  uint32_t sent_parity = 0;
+  uint32_t errors = 0;
+  uint32_t fragment_us = 0;
+  uint32_t send_us = 0;
+
+  if (fragment_count > UINT16_MAX)
+  {
+    portENTER_CRITICAL(&stats_mux);
+    stats.frames_too_big++;
+    portEXIT_CRITICAL(&stats_mux);
+    return false;
+  }
+
+#if FRAGMENT_PACING
+  pace_frame(frame_size + fragment_count * sizeof(fragment_header_t) +
+             parity_groups * (sizeof(fragment_header_t) + CHUNK_SIZE));
+#endif
+
+  fragment_header_t header;
+
+  for (uint32_t i = 0; i < fragment_count; i++)
+  {
+    uint32_t offset = i * CHUNK_SIZE;
+    uint16_t payload_length = (uint16_t) min((uint32_t) CHUNK_SIZE, frame_size - offset);
+    int64_t start_us = esp_timer_get_time();
+
+    fragment_header_encode(&header, STREAM_ID, frame_number, frame_size, timestamp_us, (uint16_t) i,
+                           (uint16_t) fragment_count, offset, payload_length, parity_groups);
+    seal_fragment(&header, frame->buf + offset);
+    fragment_us += (uint32_t) (esp_timer_get_time() - start_us);
+
+    if (send_fragment(&header, frame->buf + offset, &send_us))
+      sent_fragments++;
+    else
+      errors++;
+  }
+
+  // After the data, so a burst that takes out data fragments spares them
+  for (uint16_t group = 0; group < parity_groups; group++)
+  {
+    int64_t start_us = esp_timer_get_time();
+    uint16_t payload_length = fragment_fec_parity(frame->buf, frame_size, CHUNK_SIZE, parity_groups, group, parity);
+
+    fragment_header_encode(&header, STREAM_ID, frame_number, frame_size, timestamp_us, group,
+                           (uint16_t) fragment_count, CHUNK_SIZE, payload_length, parity_groups);
+    header.flags = FRAGMENT_FLAG_PARITY;
+    seal_fragment(&header, parity);
+    fragment_us += (uint32_t) (esp_timer_get_time() - start_us);
+
+    // A lost parity fragment only costs the frame its protection
+    if (send_fragment(&header, parity, &send_us))
+      sent_parity++;
+  }
+
+  portENTER_CRITICAL(&stats_mux);
+  stats.fragments += sent_fragments;
+  stats.parity_fragments += sent_parity;
+  stats.send_errors += errors;
+  portEXIT_CRITICAL(&stats_mux);
+
+  frame_stats_stage(FRAME_STAGE_FRAGMENT, fragment_us);
+  frame_stats_stage(FRAME_STAGE_SEND, send_us);
+
+  return errors == 0;
+}
+
+void frame_sender_get_stats(frame_sender_stats_t *out)
+{
+  portENTER_CRITICAL(&stats_mux);
+  *out = stats;
+  portEXIT_CRITICAL(&stats_mux);
+}
@@ -0,0 +1,36 @@
+#ifndef _FRAME_SENDER_H_
+#define _FRAME_SENDER_H_
+
+#include <stdint.h>
+#include <WiFi.h>
+
+#include "esp_camera.h"
+
+// Splits a JPEG frame into fragments of CHUNK_SIZE image bytes, each sent
+// as one UDP datagram with a fragment header (fragment_protocol.h) to the
+// server's reassembler. With FRAGMENT_PACING a token bucket spreads the
+// fragments over the frame interval instead of bursting them into the
+// Wi-Fi and receiver buffers. With FEC_GROUP_SIZE, XOR parity fragments
+// (fragment_fec.h) follow the data so the server can rebuild lost ones.
+// Fragmenting and UDP send time of every frame go to frame_stats.h.
+// Only one task may send.
+
+typedef struct {
+  uint32_t fragments;       // Data datagrams sent
+  uint32_t parity_fragments;
+  uint32_t send_errors;     // Datagrams the stack refused
+  uint32_t frames_too_big;  // More fragments than the header can count, not sent
+  uint32_t pace_waits;      // Times the pacer put the sender to sleep
+} frame_sender_stats_t;
+
+void frame_sender_init(IPAddress server, uint16_t port);
+
+// Frame interval the fragments of a frame are spread over
+void frame_sender_set_interval(uint32_t interval_us);
+
+// False if any datagram could not be sent
+bool frame_sender_send(const camera_fb_t *frame, uint32_t frame_number);
+
+void frame_sender_get_stats(frame_sender_stats_t *stats);
+
+#endif //_FRAME_SENDER_H_
@@ -0,0 +1,211 @@
+#include <Arduino.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "frame_stats.h"
+
+// Idle time comes from the FreeRTOS run time counters, which are only
+// kept when the sdkconfig enables them
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+#define FRAME_STATS_IDLE 1
+#define FRAME_STATS_MAX_TASKS 32
+#else
+#define FRAME_STATS_IDLE 0
+#endif
+
+typedef struct {
+  uint32_t captured;
+  uint32_t sent;
+  uint32_t dropped;
+  uint32_t no_frame;
+  uint32_t send_errors;
+  uint32_t still;
+  uint32_t keyframes;
+  uint32_t gated;
+  uint64_t gate_sum_us;
+  uint32_t gate_max_us;
+  uint32_t intervals;
+  uint64_t interval_sum_us;
+  uint64_t jitter_sum_us;
+  uint32_t jitter_max_us;
+  uint32_t histograms[FRAME_STAGE_COUNT][FRAME_STATS_BUCKETS];
+} frame_counters_t;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static frame_counters_t counters = {};
+static uint32_t period_us = 0;
+static int64_t last_capture_us = -1;
+
+// Only touched by frame_stats_report()
+static int64_t window_start_us = 0;
+
+#if FRAME_STATS_IDLE
+static TaskStatus_t task_status[FRAME_STATS_MAX_TASKS];
+static uint64_t last_total_time = 0;
+static uint64_t last_idle_time[FRAME_STATS_CORES] = {};
+#endif
+
+void frame_stats_set_period(uint32_t new_period_us)
+{
+  portENTER_CRITICAL(&stats_mux);
+  period_us = new_period_us;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void frame_stats_restart(void)
+{
+  portENTER_CRITICAL(&stats_mux);
+  last_capture_us = -1;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void frame_stats_captured(int64_t now_us)
+{
+  portENTER_CRITICAL(&stats_mux);
+  counters.captured++;
+
+  if (last_capture_us >= 0)
+  {
+    uint32_t interval = (uint32_t) (now_us - last_capture_us);
+    uint32_t jitter = interval > period_us ? interval - period_us : period_us - interval;
+
+    counters.intervals++;
+    counters.interval_sum_us += interval;
+    counters.jitter_sum_us += jitter;
+    if (jitter > counters.jitter_max_us)
+      counters.jitter_max_us = jitter;
+  }
+
+  last_capture_us = now_us;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void frame_stats_sent(bool ok)
+{
+  portENTER_CRITICAL(&stats_mux);
+  counters.sent++;
+  if (!ok)
+    counters.send_errors++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void frame_stats_dropped(void)
+{
+  portENTER_CRITICAL(&stats_mux);
+  counters.dropped++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void frame_stats_no_frame(void)
+{
+  portENTER_CRITICAL(&stats_mux);
+  counters.no_frame++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+void frame_stats_gated(motion_decision_t decision, uint32_t gate_us)
+{
+  portENTER_CRITICAL(&stats_mux);
+  if (decision == MOTION_SKIP)
+    counters.still++;
+  else if (decision == MOTION_SEND_KEYFRAME)
+    counters.keyframes++;
+
+  counters.gated++;
+  counters.gate_sum_us += gate_us;
+  if (gate_us > counters.gate_max_us)
+    counters.gate_max_us = gate_us;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+// Highest set bit of the time in bucket units: a shift and a count of
+// leading zeros
+static uint32_t bucket_of(uint32_t elapsed_us)
+{
+  uint32_t units = elapsed_us / FRAME_STATS_BUCKET_US;
+  if (units == 0)
+    return 0;
+
+  uint32_t bucket = 32 - __builtin_clz(units);
+  return bucket < FRAME_STATS_BUCKETS ? bucket : FRAME_STATS_BUCKETS - 1;
+}
+
+void frame_stats_stage(frame_stage_t stage, uint32_t elapsed_us)
+{
+  uint32_t bucket = bucket_of(elapsed_us);
+
+  portENTER_CRITICAL(&stats_mux);
+  counters.histograms[stage][bucket]++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+// Idle task share of every core since the last call, in permille
+static void sample_idle(int16_t *idle_permille)
+{
+  for (int core = 0; core < FRAME_STATS_CORES; core++)
+    idle_permille[core] = -1;
+
+#if FRAME_STATS_IDLE
+  configRUN_TIME_COUNTER_TYPE total_time = 0;
+  UBaseType_t tasks = uxTaskGetSystemState(task_status, FRAME_STATS_MAX_TASKS, &total_time);
+
+  // 0 when there are more tasks than entries
+  if (tasks == 0)
+    return;
+
+  uint64_t elapsed = (uint64_t) total_time - last_total_time;
+  last_total_time = total_time;
+
+  for (int core = 0; core < FRAME_STATS_CORES && core < portNUM_PROCESSORS; core++)
+  {
+    TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+
+    for (UBaseType_t i = 0; i < tasks; i++)
+    {
+      if (task_status[i].xHandle != idle)
+        continue;
+
+      uint64_t idle_time = task_status[i].ulRunTimeCounter;
+      if (elapsed > 0)
+        idle_permille[core] = (int16_t) min((uint64_t) 1000, (idle_time - last_idle_time[core]) * 1000 / elapsed);
+      last_idle_time[core] = idle_time;
+      break;
+    }
+  }
+#endif
+}
+
+void frame_stats_report(frame_stats_t *report)
+{
+  frame_counters_t window;
+  int64_t now_us = esp_timer_get_time();
+
+  portENTER_CRITICAL(&stats_mux);
+  window = counters;
+  counters = {};
+  portEXIT_CRITICAL(&stats_mux);
+
+  uint32_t window_us = (uint32_t) (now_us - window_start_us);
+  window_start_us = now_us;
+
+  report->window_ms = window_us / 1000;
+  report->captured = window.captured;
+  report->sent = window.sent;
+  report->dropped = window.dropped;
+  report->no_frame = window.no_frame;
+  report->send_errors = window.send_errors;
+  report->still = window.still;
+  report->keyframes = window.keyframes;
+  report->gate_avg_us = window.gated > 0 ? (uint32_t) (window.gate_sum_us / window.gated) : 0;
+  report->gate_max_us = window.gate_max_us;
+  report->fps_x10 = window_us > 0 ? (uint32_t) ((uint64_t) window.sent * 10000000 / window_us) : 0;
+  report->interval_avg_us = window.intervals > 0 ? (uint32_t) (window.interval_sum_us / window.intervals) : 0;
+  report->jitter_avg_us = window.intervals > 0 ? (uint32_t) (window.jitter_sum_us / window.intervals) : 0;
+  report->jitter_max_us = window.jitter_max_us;
+  memcpy(report->histograms, window.histograms, sizeof(report->histograms));
+
+  sample_idle(report->idle_permille);
+}
@@ -0,0 +1,64 @@
+#ifndef _FRAME_STATS_H_
+#define _FRAME_STATS_H_
+
+#include <stdint.h>
+
+#include "motion_gate.h"
+
+// Stream statistics over a report window: frames delivered per second,
+// how evenly frames are captured (interval jitter against the target
+// period), how long each stage of a frame takes and how busy each core
+// is. Recording is safe from any task.
+
+#define FRAME_STATS_CORES 2
+
+// Stage times go into fixed power-of-two buckets: bucket 0 holds times
+// under FRAME_STATS_BUCKET_US, bucket b under FRAME_STATS_BUCKET_US << b,
+// the last one everything longer (over 262 ms)
+#define FRAME_STATS_BUCKETS   12
+#define FRAME_STATS_BUCKET_US 256
+
+typedef enum {
+  FRAME_STAGE_ACQUIRE,   // esp_camera_fb_get()
+  FRAME_STAGE_FRAGMENT,  // Headers, CRCs and parity of a frame
+  FRAME_STAGE_SEND,      // UDP calls of a frame, pacing excluded
+  FRAME_STAGE_TOTAL,     // Capture to last fragment sent
+  FRAME_STAGE_COUNT
+} frame_stage_t;
+
+typedef struct {
+  uint32_t window_ms;        // Time covered by this report
+  uint32_t captured;
+  uint32_t sent;
+  uint32_t dropped;          // Transmit fell behind, frame returned unsent
+  uint32_t no_frame;         // The driver had no frame
+  uint32_t send_errors;      // Frames with a datagram that failed to send
+  uint32_t still;            // Static scene, not sent (motion_gate.h)
+  uint32_t keyframes;        // Static scene, sent to keep the server fresh
+  uint32_t gate_avg_us;      // Time to decide per frame
+  uint32_t gate_max_us;
+  uint32_t fps_x10;          // Frames sent per second, times 10
+  uint32_t interval_avg_us;  // Capture to capture
+  uint32_t jitter_avg_us;    // Mean |interval - target period|
+  uint32_t jitter_max_us;
+  int16_t idle_permille[FRAME_STATS_CORES];  // -1 without FreeRTOS run time stats
+  uint32_t histograms[FRAME_STAGE_COUNT][FRAME_STATS_BUCKETS];  // Frames per bucket
+} frame_stats_t;
+
+// Target capture period the jitter is measured against
+void frame_stats_set_period(uint32_t period_us);
+
+// The next capture starts a new interval (stream started or resumed)
+void frame_stats_restart(void);
+
+void frame_stats_captured(int64_t now_us);
+void frame_stats_sent(bool ok);
+void frame_stats_dropped(void);
+void frame_stats_no_frame(void);
+void frame_stats_gated(motion_decision_t decision, uint32_t gate_us);
+void frame_stats_stage(frame_stage_t stage, uint32_t elapsed_us);
+
+// Summarize the window since the last report and start a new one
+void frame_stats_report(frame_stats_t *report);
+
+#endif //_FRAME_STATS_H_
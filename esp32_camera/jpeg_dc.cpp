@@ -0,0 +1,471 @@
+#include <string.h>
+
+#include "jpeg_dc.h"
+
+#define MARKER_SOF0 0xC0
+#define MARKER_SOF1 0xC1
+#define MARKER_DHT  0xC4
+#define MARKER_RST0 0xD0
+#define MARKER_RST7 0xD7
+#define MARKER_SOI  0xD8
+#define MARKER_EOI  0xD9
+#define MARKER_SOS  0xDA
+#define MARKER_DQT  0xDB
+#define MARKER_DRI  0xDD
+
+static uint16_t read_u16(const uint8_t *p)
+{
+  return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+// Canonical codes from the code counts per length (JPEG Annex C)
+static bool build_huffman(jpeg_dc_huffman_t *table, const uint8_t *counts, const uint8_t *symbols, int total)
+{
+  memset(table->lookup, 0, sizeof(table->lookup));
+  memcpy(table->symbols, symbols, total);
+
+  int32_t code = 0;
+  int k = 0;
+
+  for (int length = 1; length <= 16; length++)
+  {
+    table->value_offset[length] = k - code;
+
+    for (int i = 0; i < counts[length - 1]; i++, k++, code++)
+    {
+      if (length <= JPEG_DC_LOOKUP_BITS)
+      {
+        int shift = JPEG_DC_LOOKUP_BITS - length;
+        for (int fill = 0; fill < (1 << shift); fill++)
+          table->lookup[(code << shift) | fill] = (uint16_t) ((length << 8) | symbols[k]);
+      }
+    }
+
+    table->max_code[length] = counts[length - 1] ? code - 1 : -1;
+    if (code > (1 << length))
+      return false;
+    code <<= 1;
+  }
+
+  table->max_code[17] = INT32_MAX;
+  table->defined = true;
+  return true;
+}
+
+static bool read_dht(jpeg_dc_t *jpeg, const uint8_t *p, size_t length)
+{
+  while (length >= 17)
+  {
+    uint8_t table_class = p[0] >> 4;
+    uint8_t id = p[0] & 0x0F;
+    int total = 0;
+
+    for (int i = 0; i < 16; i++)
+      total += p[1 + i];
+
+    if (table_class > 1 || id > 1 || total > 256 || length < (size_t) (17 + total))
+      return false;
+
+    jpeg_dc_huffman_t *table = table_class == 0 ? &jpeg->dc_tables[id] : &jpeg->ac_tables[id];
+    if (!build_huffman(table, p + 1, p + 17, total))
+      return false;
+
+    p += 17 + total;
+    length -= 17 + total;
+  }
+  return length == 0;
+}
+
+// Only the DC entry of each table is kept
+static bool read_dqt(jpeg_dc_t *jpeg, const uint8_t *p, size_t length)
+{
+  while (length > 0)
+  {
+    uint8_t precision = p[0] >> 4;
+    uint8_t id = p[0] & 0x0F;
+    size_t size = 1 + (precision ? 128 : 64);
+
+    if (id > 3 || length < size)
+      return false;
+
+    jpeg->dc_quant[id] = precision ? read_u16(p + 1) : p[1];
+    p += size;
+    length -= size;
+  }
+  return true;
+}
+
+static bool read_sof(jpeg_dc_t *jpeg, const uint8_t *p, size_t length)
+{
+  if (length < 6 || p[0] != 8)
+    return false;
+
+  jpeg->height = read_u16(p + 1);
+  jpeg->width = read_u16(p + 3);
+  jpeg->component_count = p[5];
+
+  if (jpeg->width == 0 || jpeg->height == 0 || jpeg->component_count == 0 ||
+      jpeg->component_count > JPEG_DC_MAX_COMPONENTS || length < (size_t) (6 + 3 * jpeg->component_count))
+    return false;
+
+  jpeg->h_max = 1;
+  jpeg->v_max = 1;
+  for (int i = 0; i < jpeg->component_count; i++)
+  {
+    jpeg_dc_component_t *component = &jpeg->components[i];
+    component->id = p[6 + 3 * i];
+    component->h = p[7 + 3 * i] >> 4;
+    component->v = p[7 + 3 * i] & 0x0F;
+    component->quant_table = p[8 + 3 * i];
+
+    if (component->h < 1 || component->h > 4 || component->v < 1 || component->v > 4 || component->quant_table > 3)
+      return false;
+    if (component->h > jpeg->h_max)
+      jpeg->h_max = component->h;
+    if (component->v > jpeg->v_max)
+      jpeg->v_max = component->v;
+  }
+
+  // The first component is luma
+  const jpeg_dc_component_t *luma = &jpeg->components[0];
+  jpeg->blocks_w = (uint16_t) (((jpeg->width * luma->h + jpeg->h_max - 1) / jpeg->h_max + 7) / 8);
+  jpeg->blocks_h = (uint16_t) (((jpeg->height * luma->v + jpeg->v_max - 1) / jpeg->v_max + 7) / 8);
+  return true;
+}
+
+static bool read_sos(jpeg_dc_t *jpeg, const uint8_t *p, size_t length)
+{
+  if (length < 1)
+    return false;
+
+  jpeg->scan_count = p[0];
+  if (jpeg->scan_count == 0 || jpeg->scan_count > jpeg->component_count || length < (size_t) (4 + 2 * jpeg->scan_count))
+    return false;
+
+  for (int i = 0; i < jpeg->scan_count; i++)
+  {
+    int index = -1;
+    for (int c = 0; c < jpeg->component_count; c++)
+      if (jpeg->components[c].id == p[1 + 2 * i])
+        index = c;
+
+    uint8_t dc_table = p[2 + 2 * i] >> 4;
+    uint8_t ac_table = p[2 + 2 * i] & 0x0F;
+    if (index < 0 || dc_table > 1 || ac_table > 1 ||
+        !jpeg->dc_tables[dc_table].defined || !jpeg->ac_tables[ac_table].defined)
+      return false;
+
+    jpeg->scan[i] = (uint8_t) index;
+    jpeg->components[index].dc_table = dc_table;
+    jpeg->components[index].ac_table = ac_table;
+  }
+
+  // Single sequential scan holding luma
+  const uint8_t *spectral = p + 1 + 2 * jpeg->scan_count;
+  return spectral[0] == 0 && spectral[1] == 63 && spectral[2] == 0 && jpeg->scan[0] == 0;
+}
+
+bool jpeg_dc_open(jpeg_dc_t *jpeg, const uint8_t *data, size_t length)
+{
+  memset(jpeg, 0, sizeof(*jpeg));
+  jpeg->data = data;
+  jpeg->length = length;
+
+  if (length < 4 || data[0] != 0xFF || data[1] != MARKER_SOI)
+    return false;
+
+  bool have_frame = false;
+  size_t position = 2;
+
+  while (position + 4 <= length)
+  {
+    if (data[position] != 0xFF)
+      return false;
+
+    uint8_t marker = data[position + 1];
+    if (marker == 0xFF)
+    {
+      position++;  // Fill byte
+      continue;
+    }
+
+    uint16_t segment = read_u16(data + position + 2);
+    if (segment < 2 || position + 2 + segment > length)
+      return false;
+
+    const uint8_t *p = data + position + 4;
+    size_t payload = segment - 2;
+    bool ok = true;
+
+    switch (marker)
+    {
+      case MARKER_SOF0:
+      case MARKER_SOF1:
+        ok = read_sof(jpeg, p, payload);
+        have_frame = ok;
+        break;
+      case MARKER_DHT:
+        ok = read_dht(jpeg, p, payload);
+        break;
+      case MARKER_DQT:
+        ok = read_dqt(jpeg, p, payload);
+        break;
+      case MARKER_DRI:
+        ok = payload >= 2;
+        if (ok)
+          jpeg->restart_interval = read_u16(p);
+        break;
+      case MARKER_SOS:
+        if (!have_frame || !read_sos(jpeg, p, payload))
+          return false;
+        jpeg->position = position + 2 + segment;
+        return true;
+      default:
+        // Progressive, lossless and arithmetic coded frames are not handled
+        if (marker >= 0xC2 && marker <= 0xCF && marker != MARKER_DHT && marker != 0xC8 && marker != 0xCC)
+          return false;
+        break;  // APPn, COM and friends
+    }
+
+    if (!ok)
+      return false;
+    position += 2 + segment;
+  }
+
+  return false;
+}
+
+// Keep at least 25 bits buffered. Stuffed 0xFF00 bytes are unstuffed; a
+// marker ends the data and zeros are shifted in from there.
+static inline void fill_bits(jpeg_dc_t *jpeg)
+{
+  while (jpeg->bit_count <= 24)
+  {
+    uint32_t byte = 0;
+
+    if (!jpeg->marker && jpeg->position < jpeg->length)
+    {
+      byte = jpeg->data[jpeg->position++];
+      if (byte == 0xFF)
+      {
+        uint8_t next = jpeg->position < jpeg->length ? jpeg->data[jpeg->position] : MARKER_EOI;
+        if (next == 0x00)
+        {
+          jpeg->position++;
+        }
+        else
+        {
+          jpeg->marker = true;
+          jpeg->position--;
+          byte = 0;
+        }
+      }
+    }
+
+    jpeg->bits |= byte << (24 - jpeg->bit_count);
+    jpeg->bit_count += 8;
+  }
+}
+
+static inline uint32_t get_bits(jpeg_dc_t *jpeg, int count)
+{
+  if (count == 0)
+    return 0;
+
+  fill_bits(jpeg);
+  uint32_t value = jpeg->bits >> (32 - count);
+  jpeg->bits <<= count;
+  jpeg->bit_count -= count;
+  return value;
+}
+
+static inline int decode_symbol(jpeg_dc_t *jpeg, const jpeg_dc_huffman_t *table)
+{
+  fill_bits(jpeg);
+
+  uint16_t entry = table->lookup[jpeg->bits >> (32 - JPEG_DC_LOOKUP_BITS)];
+  if (entry != 0)
+  {
+    int length = entry >> 8;
+    jpeg->bits <<= length;
+    jpeg->bit_count -= length;
+    return entry & 0xFF;
+  }
+
+  // Longer than the lookup, one bit at a time
+  int32_t code = (int32_t) get_bits(jpeg, JPEG_DC_LOOKUP_BITS);
+  for (int length = JPEG_DC_LOOKUP_BITS + 1; length <= 16; length++)
+  {
+    code = (code << 1) | (int32_t) get_bits(jpeg, 1);
+    if (code <= table->max_code[length])
+      return table->symbols[code + table->value_offset[length]];
+  }
+  return -1;
+}
+
+// Sign extension of a magnitude category (JPEG F.2.2.1)
+static inline int32_t extend(uint32_t value, int size)
+{
+  return value < (1u << (size - 1)) ? (int32_t) value - (int32_t) (1u << size) + 1 : (int32_t) value;
+}
+
+// Decode one block; the DC difference updates the predictor, AC
+// coefficients are only skipped
+static inline bool decode_block(jpeg_dc_t *jpeg, jpeg_dc_component_t *component)
+{
+  int size = decode_symbol(jpeg, &jpeg->dc_tables[component->dc_table]);
+  if (size < 0 || size > 11)
+    return false;
+  if (size > 0)
+    component->predictor += extend(get_bits(jpeg, size), size);
+
+  const jpeg_dc_huffman_t *ac = &jpeg->ac_tables[component->ac_table];
+  for (int k = 1; k < 64; k++)
+  {
+    int symbol = decode_symbol(jpeg, ac);
+    if (symbol < 0)
+      return false;
+
+    int run = symbol >> 4;
+    int bits = symbol & 0x0F;
+    if (bits == 0)
+    {
+      if (run != 15)
+        break;  // End of block
+      k += 15;
+    }
+    else
+    {
+      k += run;
+      get_bits(jpeg, bits);
+    }
+  }
+  return true;
+}
+
+static inline uint8_t block_luma(const jpeg_dc_t *jpeg, const jpeg_dc_component_t *component)
+{
+  // Rounded like a 1/8 scale IDCT, then level shifted
+  int32_t dc = component->predictor * jpeg->dc_quant[component->quant_table];
+  int32_t luma = ((dc + 4) >> 3) + 128;
+  return (uint8_t) (luma < 0 ? 0 : luma > 255 ? 255 : luma);
+}
+
+// Skip to the restart marker the data should be at and reset the predictors
+static bool restart(jpeg_dc_t *jpeg)
+{
+  jpeg->bits = 0;
+  jpeg->bit_count = 0;
+  jpeg->marker = false;
+
+  while (jpeg->position + 1 < jpeg->length)
+  {
+    if (jpeg->data[jpeg->position] == 0xFF)
+    {
+      uint8_t marker = jpeg->data[jpeg->position + 1];
+      if (marker >= MARKER_RST0 && marker <= MARKER_RST7)
+      {
+        jpeg->position += 2;
+        for (int i = 0; i < jpeg->component_count; i++)
+          jpeg->components[i].predictor = 0;
+        return true;
+      }
+      if (marker != 0x00 && marker != 0xFF)
+        return false;
+    }
+    jpeg->position++;
+  }
+  return false;
+}
+
+bool jpeg_dc_decode(jpeg_dc_t *jpeg, jpeg_dc_block_t block, void *context)
+{
+  uint32_t mcus_w;
+  uint32_t mcus_h;
+  bool interleaved = jpeg->scan_count > 1;
+
+  if (interleaved)
+  {
+    mcus_w = (jpeg->width + 8 * jpeg->h_max - 1) / (8 * jpeg->h_max);
+    mcus_h = (jpeg->height + 8 * jpeg->v_max - 1) / (8 * jpeg->v_max);
+  }
+  else
+  {
+    // One block per MCU, the luma component alone
+    mcus_w = jpeg->blocks_w;
+    mcus_h = jpeg->blocks_h;
+  }
+
+  uint32_t restarts_left = jpeg->restart_interval;
+
+  for (uint32_t my = 0; my < mcus_h; my++)
+  {
+    for (uint32_t mx = 0; mx < mcus_w; mx++)
+    {
+      if (jpeg->restart_interval != 0)
+      {
+        if (restarts_left == 0)
+        {
+          if (!restart(jpeg))
+            return false;
+          restarts_left = jpeg->restart_interval;
+        }
+        restarts_left--;
+      }
+
+      if (!interleaved)
+      {
+        jpeg_dc_component_t *luma = &jpeg->components[0];
+        if (!decode_block(jpeg, luma))
+          return false;
+        block(context, (uint16_t) mx, (uint16_t) my, block_luma(jpeg, luma));
+        continue;
+      }
+
+      for (int s = 0; s < jpeg->scan_count; s++)
+      {
+        uint8_t index = jpeg->scan[s];
+        jpeg_dc_component_t *component = &jpeg->components[index];
+
+        for (int v = 0; v < component->v; v++)
+        {
+          for (int h = 0; h < component->h; h++)
+          {
+            if (!decode_block(jpeg, component))
+              return false;
+            if (index != 0)
+              continue;
+
+            // Padding blocks past the image edge are decoded, not reported
+            uint32_t bx = mx * component->h + h;
+            uint32_t by = my * component->v + v;
+            if (bx < jpeg->blocks_w && by < jpeg->blocks_h)
+              block(context, (uint16_t) bx, (uint16_t) by, block_luma(jpeg, component));
+          }
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+typedef struct {
+  uint8_t *image;
+  uint16_t width;
+} luma_image_t;
+
+static void store_block(void *context, uint16_t bx, uint16_t by, uint8_t luma)
+{
+  luma_image_t *target = (luma_image_t *) context;
+  target->image[(uint32_t) by * target->width + bx] = luma;
+}
+
+bool jpeg_dc_luma_image(jpeg_dc_t *jpeg, const uint8_t *data, size_t length, uint8_t *image, size_t capacity)
+{
+  if (!jpeg_dc_open(jpeg, data, length) || (size_t) jpeg->blocks_w * jpeg->blocks_h > capacity)
+    return false;
+
+  luma_image_t target = {image, jpeg->blocks_w};
+  return jpeg_dc_decode(jpeg, store_block, &target);
+}
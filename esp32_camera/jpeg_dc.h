@@ -0,0 +1,78 @@
+#ifndef _JPEG_DC_H_
+#define _JPEG_DC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal baseline JPEG reader that recovers only the DC coefficient of
+// every luma block: the mean brightness of each 8x8 tile, a 1/8 scale
+// grayscale thumbnail. AC coefficients are Huffman decoded to find the next
+// block but never dequantized or transformed, so this costs a fraction of a
+// full decode. Handles any sampling factors and restart intervals of a
+// single-scan baseline (or extended Huffman, 8-bit) image, which is what
+// the camera sensor produces. Progressive images are refused.
+//
+// No Arduino dependencies, the same code runs in tools/motion_replay.
+
+#define JPEG_DC_MAX_COMPONENTS 3
+#define JPEG_DC_LOOKUP_BITS    9
+
+typedef struct {
+  uint16_t lookup[1 << JPEG_DC_LOOKUP_BITS];  // (length << 8) | symbol, 0: longer code
+  int32_t max_code[18];                       // Largest code of each length, -1 if none
+  int32_t value_offset[17];                   // Code to symbol index, per length
+  uint8_t symbols[256];
+  bool defined;
+} jpeg_dc_huffman_t;
+
+typedef struct {
+  uint8_t id;
+  uint8_t h;
+  uint8_t v;
+  uint8_t quant_table;
+  uint8_t dc_table;
+  uint8_t ac_table;
+  int32_t predictor;
+} jpeg_dc_component_t;
+
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  uint16_t blocks_w;     // Luma blocks across the image
+  uint16_t blocks_h;
+
+  // Parser state, filled by jpeg_dc_open()
+  const uint8_t *data;
+  size_t length;
+  size_t position;
+  uint16_t dc_quant[4];
+  jpeg_dc_huffman_t dc_tables[2];
+  jpeg_dc_huffman_t ac_tables[2];
+  jpeg_dc_component_t components[JPEG_DC_MAX_COMPONENTS];
+  uint8_t component_count;
+  uint8_t scan[JPEG_DC_MAX_COMPONENTS];  // Component indexes in the scan
+  uint8_t scan_count;
+  uint8_t h_max;
+  uint8_t v_max;
+  uint16_t restart_interval;
+
+  uint32_t bits;         // Left aligned
+  int bit_count;
+  bool marker;           // Entropy data ended at a marker
+} jpeg_dc_t;
+
+// Luma of one block, (bx, by) in blocks from the top left
+typedef void (*jpeg_dc_block_t)(void *context, uint16_t bx, uint16_t by, uint8_t luma);
+
+// Read the headers up to the scan. False if not a JPEG this reader handles.
+bool jpeg_dc_open(jpeg_dc_t *jpeg, const uint8_t *data, size_t length);
+
+// Decode the scan, calling `block` for every luma block. False on corrupt
+// data; blocks before the error have been reported.
+bool jpeg_dc_decode(jpeg_dc_t *jpeg, jpeg_dc_block_t block, void *context);
+
+// Both steps into a row-major image of blocks_w x blocks_h luma values.
+// False if the JPEG cannot be read or the image exceeds `capacity` bytes.
+bool jpeg_dc_luma_image(jpeg_dc_t *jpeg, const uint8_t *data, size_t length, uint8_t *image, size_t capacity);
+
+#endif //_JPEG_DC_H_
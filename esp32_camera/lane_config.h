@@ -0,0 +1,34 @@
+#ifndef _LANE_CONFIG_H_
+#define _LANE_CONFIG_H_
+
+#include "vehicle_counter.h"
+
+// What the edge counter (EDGE_COUNTER in stream_config.h) watches, set for
+// where this camera is mounted. Regions are in permille of the frame, so
+// they hold at every frame size rate control picks. The vehicle area is
+// what one car covers inside its lane; larger blobs (a queue) count as
+// several cars. tools/counter_bench checks a setup against recorded
+// footage.
+
+static const counter_lane_t COUNTER_LANES[] = {
+  // left, top, right, bottom, approach, vehicle area (permille)
+  {0, 380, 1000, 660, 0, 12},
+};
+
+#define COUNTER_LANE_COUNT (sizeof(COUNTER_LANES) / sizeof(COUNTER_LANES[0]))
+
+// Luma difference from the background that is foreground
+#define COUNTER_THRESHOLD        20
+
+// Background learning, per counted frame: 1/64 (about 16 s at 4 frames/s),
+// 1/1024 under foreground (about 4 minutes, longer than a red light)
+#define COUNTER_BACKGROUND_SHIFT 6
+#define COUNTER_FOREGROUND_SHIFT 10
+
+// Blobs smaller than this many 64x48 grid pixels are noise
+#define COUNTER_MIN_BLOB_PIXELS  6
+
+// Frames learned before the first count
+#define COUNTER_WARMUP_FRAMES    20
+
+#endif //_LANE_CONFIG_H_
@@ -0,0 +1,90 @@
+#include <string.h>
+
+#include "motion_gate.h"
+
+// Average the blocks into the thumbnail. Images with fewer blocks than
+// cells leave some cells empty, they compare equal.
+static void build_thumbnail(motion_gate_t *gate, const uint8_t *luma, uint16_t width, uint16_t height)
+{
+  memset(gate->sum, 0, sizeof(gate->sum));
+  memset(gate->count, 0, sizeof(gate->count));
+
+  for (uint32_t y = 0; y < height; y++)
+  {
+    uint32_t row = y * MOTION_GRID_H / height * MOTION_GRID_W;
+    for (uint32_t x = 0; x < width; x++)
+    {
+      uint32_t cell = row + x * MOTION_GRID_W / width;
+      gate->sum[cell] += luma[y * width + x];
+      gate->count[cell]++;
+    }
+  }
+
+  for (int cell = 0; cell < MOTION_GRID_CELLS; cell++)
+    gate->thumbnail[cell] = gate->count[cell] ? (uint8_t) (gate->sum[cell] / gate->count[cell]) : 0;
+}
+
+// Cells that moved by more than cell_delta once the change of the whole
+// scene's brightness is taken out
+static uint16_t count_changed(const motion_gate_t *gate)
+{
+  int32_t shift = 0;
+  for (int cell = 0; cell < MOTION_GRID_CELLS; cell++)
+    shift += gate->thumbnail[cell] - gate->reference[cell];
+  shift /= MOTION_GRID_CELLS;
+
+  uint16_t changed = 0;
+  for (int cell = 0; cell < MOTION_GRID_CELLS; cell++)
+  {
+    int32_t delta = gate->thumbnail[cell] - gate->reference[cell] - shift;
+    if (delta > gate->config.cell_delta || delta < -gate->config.cell_delta)
+      changed++;
+  }
+  return changed;
+}
+
+void motion_gate_init(motion_gate_t *gate, const motion_gate_config_t *config)
+{
+  memset(gate, 0, sizeof(*gate));
+  gate->config = *config;
+}
+
+void motion_gate_reset(motion_gate_t *gate)
+{
+  gate->have_reference = false;
+}
+
+motion_decision_t motion_gate_check(motion_gate_t *gate, const uint8_t *luma, uint16_t width, uint16_t height,
+                                    uint32_t now_ms)
+{
+  if (luma == NULL || width == 0 || height == 0)
+  {
+    // Nothing to compare the next frame against
+    gate->have_reference = false;
+    gate->changed = MOTION_GRID_CELLS;
+    gate->last_sent_ms = now_ms;
+    return MOTION_SEND_UNDECODED;
+  }
+
+  build_thumbnail(gate, luma, width, height);
+
+  // A new frame size (rate control) is a new picture
+  bool same_size = gate->have_reference && width == gate->width && height == gate->height;
+  gate->changed = same_size ? count_changed(gate) : MOTION_GRID_CELLS;
+
+  motion_decision_t decision;
+  if (gate->changed >= gate->config.changed_cells)
+    decision = MOTION_SEND_CHANGED;
+  else if (now_ms - gate->last_sent_ms >= gate->config.keyframe_ms)
+    decision = MOTION_SEND_KEYFRAME;
+  else
+    return MOTION_SKIP;
+
+  // Later frames are compared with what the server last saw
+  memcpy(gate->reference, gate->thumbnail, sizeof(gate->reference));
+  gate->have_reference = true;
+  gate->width = width;
+  gate->height = height;
+  gate->last_sent_ms = now_ms;
+  return decision;
+}
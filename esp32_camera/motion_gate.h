@@ -0,0 +1,59 @@
+#ifndef _MOTION_GATE_H_
+#define _MOTION_GATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Decides whether a frame is worth sending. The luma DC of every JPEG block
+// (jpeg_dc_luma_image()) is averaged into a MOTION_GRID_W x MOTION_GRID_H
+// thumbnail and compared against the thumbnail of the last frame sent: a
+// frame goes out when enough cells changed, and otherwise only as a
+// keyframe once keyframe_ms has passed, so the server and the detector
+// never go longer than that without a fresh image. A brightness change of
+// the whole scene (auto exposure, a cloud) is taken out before comparing.
+//
+// No Arduino dependencies, the same code runs in tools/motion_replay.
+
+#define MOTION_GRID_W 32
+#define MOTION_GRID_H 24
+#define MOTION_GRID_CELLS (MOTION_GRID_W * MOTION_GRID_H)
+
+typedef struct {
+  uint8_t cell_delta;       // Luma change that marks a cell as changed
+  uint16_t changed_cells;   // Changed cells that make a frame worth sending
+  uint32_t keyframe_ms;     // Longest time without sending a frame
+} motion_gate_config_t;
+
+typedef enum {
+  MOTION_SKIP = 0,          // Static scene, not sent
+  MOTION_SEND_CHANGED,
+  MOTION_SEND_KEYFRAME,     // Static, but keyframe_ms passed
+  MOTION_SEND_UNDECODED,    // Could not read the JPEG, sent to be safe
+} motion_decision_t;
+
+typedef struct {
+  motion_gate_config_t config;
+  uint8_t reference[MOTION_GRID_CELLS];  // Thumbnail of the last frame sent
+  bool have_reference;
+  uint16_t width;                        // Luma image size of the reference
+  uint16_t height;
+  uint32_t last_sent_ms;
+  uint16_t changed;                      // Changed cells in the last frame checked
+
+  // Scratch of motion_gate_check()
+  uint32_t sum[MOTION_GRID_CELLS];
+  uint16_t count[MOTION_GRID_CELLS];
+  uint8_t thumbnail[MOTION_GRID_CELLS];
+} motion_gate_t;
+
+void motion_gate_init(motion_gate_t *gate, const motion_gate_config_t *config);
+
+// Forget the reference, the next frame is sent (stream started)
+void motion_gate_reset(motion_gate_t *gate);
+
+// Decide on one frame from its block luma image, NULL if the JPEG could not
+// be read. now_ms from any monotonic millisecond clock.
+motion_decision_t motion_gate_check(motion_gate_t *gate, const uint8_t *luma, uint16_t width, uint16_t height,
+                                    uint32_t now_ms);
+
+#endif //_MOTION_GATE_H_
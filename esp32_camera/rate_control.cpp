@@ -0,0 +1,155 @@
+#include <Arduino.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_camera.h"
+
+#include "frame_pipeline.h"
+#include "frame_sender.h"
+#include "frame_stats.h"
+#include "rate_control.h"
+#include "stream_config.h"
+
+// Changed by the Socket.IO task only, the copy for others is under the lock
+static rate_settings_t settings = {RATE_FRAMESIZE_MAX, RATE_QUALITY_START, RATE_FPS_MAX};
+static rate_settings_t published = settings;
+static portMUX_TYPE settings_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t interval_us = 1000000 / RATE_FPS_MAX;
+static uint8_t clean_reports = 0;
+
+// Frame rate the detector kept up with last time it fell behind
+static uint8_t fps_ceiling = RATE_FPS_MAX;
+
+static void apply(const rate_settings_t *previous)
+{
+  sensor_t *sensor = esp_camera_sensor_get();
+
+  portENTER_CRITICAL(&settings_mux);
+  published = settings;
+  portEXIT_CRITICAL(&settings_mux);
+
+  if (sensor != NULL && settings.frame_size != previous->frame_size)
+    sensor->set_framesize(sensor, settings.frame_size);
+  if (sensor != NULL && settings.quality != previous->quality)
+    sensor->set_quality(sensor, settings.quality);
+
+  if (settings.fps != previous->fps)
+  {
+    interval_us = 1000000 / settings.fps;
+    frame_sender_set_interval(interval_us);
+    frame_stats_set_period(interval_us);
+#if CAMERA_PIPELINE
+    frame_pipeline_set_interval(interval_us);
+#endif
+  }
+}
+
+// Fewer bytes per frame: quality, then frame size, then frame rate
+static bool step_down(void)
+{
+  if (settings.quality < RATE_QUALITY_WORST)
+  {
+    settings.quality = (uint8_t) min(RATE_QUALITY_WORST, settings.quality + RATE_QUALITY_STEP);
+    return true;
+  }
+  if (settings.frame_size > RATE_FRAMESIZE_MIN)
+  {
+    settings.frame_size = (framesize_t) (settings.frame_size - 1);
+    return true;
+  }
+  if (settings.fps > RATE_FPS_MIN)
+  {
+    settings.fps = (uint8_t) max(RATE_FPS_MIN, settings.fps - RATE_FPS_STEP);
+    return true;
+  }
+  return false;
+}
+
+// Frame rate first, up to what the detector kept up with, then frame size,
+// then quality. With nothing left, probe the detector with a higher rate.
+static bool step_up(void)
+{
+  if (settings.fps < fps_ceiling)
+  {
+    settings.fps = (uint8_t) min((int) fps_ceiling, settings.fps + RATE_FPS_STEP);
+    return true;
+  }
+  if (settings.frame_size < RATE_FRAMESIZE_MAX)
+  {
+    settings.frame_size = (framesize_t) (settings.frame_size + 1);
+    return true;
+  }
+  if (settings.quality > RATE_QUALITY_BEST)
+  {
+    settings.quality = (uint8_t) max(RATE_QUALITY_BEST, settings.quality - RATE_QUALITY_STEP);
+    return true;
+  }
+  if (settings.fps < RATE_FPS_MAX)
+  {
+    fps_ceiling = (uint8_t) min(RATE_FPS_MAX, settings.fps + RATE_FPS_STEP);
+    settings.fps = fps_ceiling;
+    return true;
+  }
+  return false;
+}
+
+void rate_control_init(void)
+{
+  rate_settings_t previous = {FRAMESIZE_INVALID, 0, 0};
+  apply(&previous);
+}
+
+bool rate_control_feedback(const rate_feedback_t *feedback)
+{
+  rate_settings_t previous = settings;
+  bool congested = feedback->residual_loss_permille > RATE_LOSS_HIGH_PERMILLE;
+  bool saturated = feedback->detector_dropped > 0 ||
+                   (feedback->detector_capacity > 0 && feedback->detector_queue * 2 >= feedback->detector_capacity);
+  bool clean = feedback->residual_loss_permille <= RATE_LOSS_LOW_PERMILLE &&
+               feedback->raw_loss_permille <= RATE_RAW_LOSS_LOW_PERMILLE &&
+               feedback->detector_queue <= 1 && feedback->frames_complete > 0;
+
+  if (congested)
+  {
+    clean_reports = 0;
+    step_down();
+  }
+  else if (saturated)
+  {
+    // Just above what the detector finished, so its queue drains
+    clean_reports = 0;
+    uint8_t target = (uint8_t) min(255, feedback->detector_fps_x10 / 10 + 1);
+    settings.fps = (uint8_t) constrain(min(target, (uint8_t) (settings.fps - 1)), RATE_FPS_MIN, RATE_FPS_MAX);
+    fps_ceiling = settings.fps;
+  }
+  else if (clean)
+  {
+    if (++clean_reports >= RATE_UPGRADE_REPORTS)
+    {
+      clean_reports = 0;
+      step_up();
+    }
+  }
+  else
+  {
+    clean_reports = 0;
+  }
+
+  bool changed = settings.frame_size != previous.frame_size || settings.quality != previous.quality ||
+                 settings.fps != previous.fps;
+  if (changed)
+    apply(&previous);
+
+  return changed;
+}
+
+void rate_control_get(rate_settings_t *out)
+{
+  portENTER_CRITICAL(&settings_mux);
+  *out = published;
+  portEXIT_CRITICAL(&settings_mux);
+}
+
+uint32_t rate_control_interval_us(void)
+{
+  return interval_us;
+}
@@ -0,0 +1,52 @@
+#ifndef _RATE_CONTROL_H_
+#define _RATE_CONTROL_H_
+
+#include <stdint.h>
+
+#include "esp_camera.h"
+
+// Closed-loop stream rate: the server reports every second how much of the
+// stream it reassembled and how far behind the detector is ("rx_stats" on
+// /video), and the camera moves JPEG quality, frame size and frame rate
+// within the RATE_* bounds of stream_config.h:
+//
+// - Chunks lost even after parity: fewer bytes per frame, quality first,
+//   then frame size, the frame rate last.
+// - Detector queue filling up or dropping frames: frame rate down to what
+//   the detector gets through.
+// - Several clean reports in a row: one step back up. Frame rate first, up
+//   to what the detector last kept up with, then the image, then probe the
+//   detector with a higher rate again. The detector gets as many frames as
+//   it can take, at the best image the network carries.
+//
+// Feedback is handled on the Socket.IO task.
+
+typedef struct {
+  uint16_t frames_complete;
+  uint16_t frames_incomplete;
+  uint16_t raw_loss_permille;       // Chunks lost on the way
+  uint16_t residual_loss_permille;  // Chunks parity could not rebuild
+  uint16_t detector_queue;          // Frames waiting in model.py
+  uint16_t detector_capacity;
+  uint16_t detector_dropped;        // Frames model.py refused (queue full)
+  uint16_t detector_fps_x10;        // Frames the detector finished per second, times 10
+} rate_feedback_t;
+
+typedef struct {
+  framesize_t frame_size;
+  uint8_t quality;                  // jpeg_quality, lower is better
+  uint8_t fps;
+} rate_settings_t;
+
+// Apply the starting settings, after esp_camera_init()
+void rate_control_init(void);
+
+// True when the settings changed
+bool rate_control_feedback(const rate_feedback_t *feedback);
+
+void rate_control_get(rate_settings_t *settings);
+
+// Current frame interval, read by whoever paces capture
+uint32_t rate_control_interval_us(void);
+
+#endif //_RATE_CONTROL_H_
@@ -0,0 +1,129 @@
+#ifndef _STREAM_CONFIG_H_
+#define _STREAM_CONFIG_H_
+
+// Streaming setup of the camera: frame rate, chunking, the capture/transmit
+// pipeline and where its tasks run.
+
+// 1: capture and transmit tasks on separate cores, paced by a periodic
+// timer (frame_pipeline.h). 0: the original single loop() that grabs and
+// sends each frame in turn, kept to compare the two with the same stats.
+#ifndef CAMERA_PIPELINE
+#define CAMERA_PIPELINE 1
+#endif
+
+// Highest frame rate, where the stream starts. Rate control
+// (rate_control.h) lowers it when the network or the detector fall behind.
+#define STREAM_FPS  30
+
+// Image bytes per fragment. With the 32-byte fragment header
+// (fragment_protocol.h) a datagram stays within one 1500-byte IP packet.
+#define CHUNK_SIZE  1400
+
+// Stream id carried by every fragment
+#define STREAM_ID   0
+
+// 1: a token bucket spreads the fragments of a frame over
+// FRAME_SPREAD_PERCENT of the frame interval. 0: fragments go out back to
+// back, to compare chunk loss with and without pacing.
+#ifndef FRAGMENT_PACING
+#define FRAGMENT_PACING 1
+#endif
+
+#define FRAME_SPREAD_PERCENT 80
+
+// Data fragments per XOR parity fragment (fragment_fec.h): one lost
+// fragment in every FEC_GROUP_SIZE is rebuilt by the server, for
+// 1 / FEC_GROUP_SIZE more bytes on the air. 0 sends no parity.
+#ifndef FEC_GROUP_SIZE
+#define FEC_GROUP_SIZE 8
+#endif
+
+// Fragments that may still leave back to back, what the Wi-Fi TX buffers
+// absorb without dropping
+#define PACER_BURST_FRAGMENTS 4
+
+// Frame buffers allocated by the camera driver
+#define CAMERA_FB_COUNT 6
+
+// Captured frames waiting for the transmit task. With one more frame being
+// sent and one being captured, the driver must keep at least one buffer to
+// fill, or capture stalls.
+#define FRAME_RING_SIZE 3
+
+static_assert(FRAME_RING_SIZE + 2 < CAMERA_FB_COUNT, "The camera driver needs a free frame buffer");
+
+// Capture sits next to the camera driver on the application core, transmit
+// next to the Wi-Fi/lwIP tasks on the protocol core
+#define CAPTURE_CORE        1
+#define CAPTURE_PRIORITY    6
+#define CAPTURE_STACK_SIZE  4096   // lwIP sends on it with EDGE_COUNTER
+
+#define TRANSMIT_CORE       0
+#define TRANSMIT_PRIORITY   5
+#define TRANSMIT_STACK_SIZE 4096
+
+// Control messages (start/pause) and the stats report, no reason to
+// preempt the stream
+#define SOCKET_IO_CORE       1
+#define SOCKET_IO_PRIORITY   3
+#define SOCKET_IO_POLL_MS    5
+#define SOCKET_IO_STACK_SIZE 6144   // Formats and serializes the stats report
+
+// Rate control bounds. The camera is initialized at the largest frame
+// size, the driver sizes its frame buffers for it.
+#define RATE_FRAMESIZE_MIN FRAMESIZE_QVGA
+#define RATE_FRAMESIZE_MAX FRAMESIZE_XGA
+#define RATE_QUALITY_BEST  4     // Lowest jpeg_quality (largest frames)
+#define RATE_QUALITY_WORST 30
+#define RATE_QUALITY_START 10
+#define RATE_QUALITY_STEP  4
+#define RATE_FPS_MIN       5
+#define RATE_FPS_MAX       STREAM_FPS
+#define RATE_FPS_STEP      2
+
+// Feedback thresholds: chunk loss left after parity, and raw loss the
+// parity can still absorb (permille)
+#define RATE_LOSS_HIGH_PERMILLE 20
+#define RATE_LOSS_LOW_PERMILLE  5
+#define RATE_RAW_LOSS_LOW_PERMILLE 30
+
+// Consecutive clean reports before stepping up again
+#define RATE_UPGRADE_REPORTS 3
+
+// 1: frames of a static scene are not sent (motion_gate.h), only a
+// keyframe every MOTION_KEYFRAME_MS. 0: every captured frame is sent.
+// Gating runs in the capture task, the single loop always sends.
+#ifndef MOTION_GATE
+#define MOTION_GATE 1
+#endif
+
+// A frame is sent when at least MOTION_CHANGED_CELLS of the 32x24 luma
+// thumbnail cells moved by more than MOTION_CELL_DELTA levels
+#define MOTION_CELL_DELTA    10
+#define MOTION_CHANGED_CELLS 6
+#define MOTION_KEYFRAME_MS   1000
+
+// 1: count vehicles on the camera (vehicle_counter.h, lanes in
+// lane_config.h) and send the counts straight to the controller, which
+// falls back to them while the server is silent. Runs in the capture task,
+// streaming or not; needs CAMERA_PIPELINE.
+#ifndef EDGE_COUNTER
+#define EDGE_COUNTER 0
+#endif
+
+#define EDGE_COUNTER_INTERVAL_MS 250   // Frames counted
+#define EDGE_COUNTER_PUBLISH_MS  1000  // Counts sent, averaged over this period
+#define EDGE_COUNTER_PORT        4212  // DETECTION_EDGE_UDP_PORT of the controller
+
+#if EDGE_COUNTER && !CAMERA_PIPELINE
+#error "EDGE_COUNTER runs in the capture task of CAMERA_PIPELINE"
+#endif
+
+// Block luma image (jpeg_dc.h) of the largest frame, RATE_FRAMESIZE_MAX
+#define LUMA_IMAGE_SIZE ((1024 / 8) * (768 / 8))
+
+// Period of the stats line on the serial port and of the camera_stats
+// event on /video (stage histograms for the dashboard)
+#define STATS_REPORT_MS 5000
+
+#endif //_STREAM_CONFIG_H_
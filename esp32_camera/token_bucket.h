@@ -0,0 +1,66 @@
+#ifndef _TOKEN_BUCKET_H_
+#define _TOKEN_BUCKET_H_
+
+#include <stdint.h>
+
+// Byte token bucket: refills at `rate` bytes per second up to `burst`
+// bytes, a send of n bytes takes n tokens. The caller passes the time, so
+// the bucket has no platform dependencies.
+
+typedef struct {
+  uint32_t rate;        // Bytes per second
+  uint32_t burst;       // Most tokens kept
+  uint64_t tokens_us;   // Tokens times 1000000, no rounding loss on refill
+  int64_t last_us;
+} token_bucket_t;
+
+static inline void token_bucket_init(token_bucket_t *bucket, uint32_t rate, uint32_t burst, int64_t now_us)
+{
+  bucket->rate = rate;
+  bucket->burst = burst;
+  bucket->tokens_us = (uint64_t) burst * 1000000;
+  bucket->last_us = now_us;
+}
+
+static inline void token_bucket_refill(token_bucket_t *bucket, int64_t now_us)
+{
+  if (now_us > bucket->last_us)
+  {
+    uint64_t limit = (uint64_t) bucket->burst * 1000000;
+    bucket->tokens_us += (uint64_t) (now_us - bucket->last_us) * bucket->rate;
+    if (bucket->tokens_us > limit)
+      bucket->tokens_us = limit;
+  }
+  bucket->last_us = now_us;
+}
+
+// Keeps the tokens collected so far
+static inline void token_bucket_set_rate(token_bucket_t *bucket, uint32_t rate, uint32_t burst, int64_t now_us)
+{
+  token_bucket_refill(bucket, now_us);
+  bucket->rate = rate;
+  bucket->burst = burst;
+  if (bucket->tokens_us > (uint64_t) burst * 1000000)
+    bucket->tokens_us = (uint64_t) burst * 1000000;
+}
+
+// 0 when `bytes` may be sent now (the tokens are taken), otherwise the
+// microseconds until they are available. `bytes` must not exceed the burst.
+static inline uint32_t token_bucket_take(token_bucket_t *bucket, uint32_t bytes, int64_t now_us)
+{
+  token_bucket_refill(bucket, now_us);
+
+  uint64_t needed = (uint64_t) bytes * 1000000;
+  if (bucket->tokens_us >= needed)
+  {
+    bucket->tokens_us -= needed;
+    return 0;
+  }
+
+  if (bucket->rate == 0)
+    return UINT32_MAX;
+
+  return (uint32_t) ((needed - bucket->tokens_us + bucket->rate - 1) / bucket->rate);
+}
+
+#endif //_TOKEN_BUCKET_H_
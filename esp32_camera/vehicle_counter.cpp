@@ -0,0 +1,246 @@
+#include <string.h>
+
+#include "vehicle_counter.h"
+
+#define MASK_FOREGROUND 1
+#define MASK_VISITED    2
+
+// Learning rate of every pixel while warming up, so vehicles in the first
+// frames do not stay behind as ghosts
+#define WARMUP_SHIFT 2
+
+// Box average of the source pixels under every grid pixel; a source
+// smaller than the grid repeats pixels
+static void resample(vehicle_counter_t *counter, const uint8_t *luma, uint16_t width, uint16_t height)
+{
+  for (uint32_t gy = 0; gy < COUNTER_GRID_H; gy++)
+  {
+    uint32_t y0 = gy * height / COUNTER_GRID_H;
+    uint32_t y1 = (gy + 1) * height / COUNTER_GRID_H;
+    if (y1 <= y0)
+      y1 = y0 + 1;
+
+    for (uint32_t gx = 0; gx < COUNTER_GRID_W; gx++)
+    {
+      uint32_t x0 = gx * width / COUNTER_GRID_W;
+      uint32_t x1 = (gx + 1) * width / COUNTER_GRID_W;
+      if (x1 <= x0)
+        x1 = x0 + 1;
+
+      uint32_t sum = 0;
+      for (uint32_t y = y0; y < y1; y++)
+        for (uint32_t x = x0; x < x1; x++)
+          sum += luma[y * width + x];
+
+      counter->gray[gy * COUNTER_GRID_W + gx] = (uint8_t) (sum / ((y1 - y0) * (x1 - x0)));
+    }
+  }
+}
+
+// Median of frame minus background, the brightness change of the scene
+static int16_t brightness_shift(vehicle_counter_t *counter)
+{
+  memset(counter->histogram, 0, sizeof(counter->histogram));
+  for (int i = 0; i < COUNTER_GRID_PIXELS; i++)
+    counter->histogram[counter->gray[i] - (counter->background[i] >> 8) + 255]++;
+
+  uint32_t seen = 0;
+  for (int bin = 0; bin < 511; bin++)
+  {
+    seen += counter->histogram[bin];
+    if (seen * 2 >= COUNTER_GRID_PIXELS)
+      return (int16_t) (bin - 255);
+  }
+  return 0;
+}
+
+static void threshold(vehicle_counter_t *counter, int16_t shift)
+{
+  int32_t limit = counter->config.threshold;
+
+  for (int i = 0; i < COUNTER_GRID_PIXELS; i++)
+  {
+    int32_t delta = counter->gray[i] - (counter->background[i] >> 8) - shift;
+    counter->raw[i] = delta > limit || delta < -limit;
+  }
+}
+
+// 3x3 majority: drops isolated pixels, fills pinholes
+static uint16_t clean(vehicle_counter_t *counter)
+{
+  uint16_t foreground = 0;
+
+  for (int y = 0; y < COUNTER_GRID_H; y++)
+  {
+    for (int x = 0; x < COUNTER_GRID_W; x++)
+    {
+      int votes = 0;
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        int ny = y + dy;
+        if (ny < 0 || ny >= COUNTER_GRID_H)
+          continue;
+        for (int dx = -1; dx <= 1; dx++)
+        {
+          int nx = x + dx;
+          if (nx >= 0 && nx < COUNTER_GRID_W)
+            votes += counter->raw[ny * COUNTER_GRID_W + nx];
+        }
+      }
+
+      uint8_t value = votes >= 5 ? MASK_FOREGROUND : 0;
+      counter->mask[y * COUNTER_GRID_W + x] = value;
+      foreground += value;
+    }
+  }
+  return foreground;
+}
+
+static void learn(vehicle_counter_t *counter)
+{
+  bool warming_up = counter->frames < counter->config.warmup_frames;
+
+  for (int i = 0; i < COUNTER_GRID_PIXELS; i++)
+  {
+    int32_t target = counter->gray[i] << 8;
+    int32_t current = counter->background[i];
+    uint8_t shift = counter->mask[i] ? counter->config.foreground_shift : counter->config.background_shift;
+    if (warming_up)
+      shift = WARMUP_SHIFT;
+
+    counter->background[i] = (uint16_t) (current + ((target - current) >> shift));
+  }
+}
+
+// Flood fill the blob at `start`, marking it visited
+static uint32_t fill_blob(vehicle_counter_t *counter, uint16_t start, uint32_t *sum_x, uint32_t *sum_y)
+{
+  uint32_t depth = 0;
+  uint32_t area = 0;
+
+  counter->mask[start] = MASK_VISITED;
+  counter->stack[depth++] = start;
+
+  while (depth > 0)
+  {
+    uint16_t pixel = counter->stack[--depth];
+    uint16_t x = pixel % COUNTER_GRID_W;
+    uint16_t y = pixel / COUNTER_GRID_W;
+
+    area++;
+    *sum_x += x;
+    *sum_y += y;
+
+    uint16_t neighbours[4];
+    int found = 0;
+    if (x > 0)
+      neighbours[found++] = pixel - 1;
+    if (x + 1 < COUNTER_GRID_W)
+      neighbours[found++] = pixel + 1;
+    if (y > 0)
+      neighbours[found++] = pixel - COUNTER_GRID_W;
+    if (y + 1 < COUNTER_GRID_H)
+      neighbours[found++] = pixel + COUNTER_GRID_W;
+
+    // Every pixel is pushed once, the stack cannot overflow
+    for (int n = 0; n < found; n++)
+    {
+      if (counter->mask[neighbours[n]] == MASK_FOREGROUND)
+      {
+        counter->mask[neighbours[n]] = MASK_VISITED;
+        counter->stack[depth++] = neighbours[n];
+      }
+    }
+  }
+  return area;
+}
+
+static void count_blobs(vehicle_counter_t *counter, vehicle_count_t *count)
+{
+  for (uint16_t start = 0; start < COUNTER_GRID_PIXELS; start++)
+  {
+    if (counter->mask[start] != MASK_FOREGROUND)
+      continue;
+
+    uint32_t sum_x = 0;
+    uint32_t sum_y = 0;
+    uint32_t area = fill_blob(counter, start, &sum_x, &sum_y);
+    if (area < counter->config.min_blob_pixels)
+      continue;
+
+    uint32_t cx = sum_x / area;
+    uint32_t cy = sum_y / area;
+
+    for (int l = 0; l < counter->config.lane_count; l++)
+    {
+      const counter_lane_pixels_t *lane = &counter->lanes[l];
+      if (cx < lane->left || cx >= lane->right || cy < lane->top || cy >= lane->bottom)
+        continue;
+
+      uint32_t vehicles = (area + lane->vehicle_pixels / 2) / lane->vehicle_pixels;
+      count->counts[counter->config.lanes[l].approach] += (uint16_t) (vehicles > 0 ? vehicles : 1);
+      count->blobs++;
+      break;
+    }
+  }
+}
+
+void vehicle_counter_init(vehicle_counter_t *counter, const vehicle_counter_config_t *config)
+{
+  memset(counter, 0, sizeof(*counter));
+  counter->config = *config;
+
+  if (counter->config.lane_count > COUNTER_MAX_LANES)
+    counter->config.lane_count = COUNTER_MAX_LANES;
+
+  for (int l = 0; l < counter->config.lane_count; l++)
+  {
+    const counter_lane_t *lane = &config->lanes[l];
+    counter_lane_pixels_t *pixels = &counter->lanes[l];
+    uint32_t vehicle_pixels = (uint32_t) lane->vehicle_permille * COUNTER_GRID_PIXELS / 1000;
+
+    pixels->left = (uint8_t) (lane->left * COUNTER_GRID_W / 1000);
+    pixels->top = (uint8_t) (lane->top * COUNTER_GRID_H / 1000);
+    pixels->right = (uint8_t) ((lane->right * COUNTER_GRID_W + 999) / 1000);
+    pixels->bottom = (uint8_t) ((lane->bottom * COUNTER_GRID_H + 999) / 1000);
+    pixels->vehicle_pixels = (uint16_t) (vehicle_pixels > 0 ? vehicle_pixels : 1);
+
+    // Counts of a lane pointing past the datagram go nowhere
+    if (lane->approach >= COUNTER_MAX_APPROACHES)
+      pixels->right = pixels->left;
+  }
+}
+
+void vehicle_counter_reset(vehicle_counter_t *counter)
+{
+  counter->frames = 0;
+}
+
+bool vehicle_counter_process(vehicle_counter_t *counter, const uint8_t *luma, uint16_t width, uint16_t height,
+                             vehicle_count_t *count)
+{
+  memset(count, 0, sizeof(*count));
+  if (luma == NULL || width == 0 || height == 0)
+    return false;
+
+  resample(counter, luma, width, height);
+
+  // The first frame is the background
+  if (counter->frames == 0)
+  {
+    for (int i = 0; i < COUNTER_GRID_PIXELS; i++)
+      counter->background[i] = (uint16_t) (counter->gray[i] << 8);
+  }
+
+  count->brightness_shift = brightness_shift(counter);
+  threshold(counter, count->brightness_shift);
+  count->foreground = clean(counter);
+  learn(counter);
+
+  counter->frames++;
+  count->ready = counter->frames > counter->config.warmup_frames;
+  if (count->ready)
+    count_blobs(counter, count);
+
+  return count->ready;
+}
@@ -0,0 +1,92 @@
+#ifndef _VEHICLE_COUNTER_H_
+#define _VEHICLE_COUNTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Approximate vehicle counts per approach from a grayscale image, without a
+// neural network. The image (any size, on the camera the block luma image
+// of jpeg_dc_luma_image()) is resampled to COUNTER_GRID_W x COUNTER_GRID_H
+// and compared against a learned background:
+//
+// - Background: per pixel running average in 8.8 fixed point, learning
+//   1/2^background_shift of the difference per frame. Under foreground it
+//   learns 1/2^foreground_shift, much slower, so a queue waiting at a red
+//   light stays foreground for minutes while a parked object fades in.
+// - A brightness change of the whole scene (auto exposure) is taken out
+//   with the median difference before thresholding.
+// - Foreground pixels are cleaned with a 3x3 majority and grouped into
+//   4-connected blobs. A blob counts in the lane holding its centroid, as
+//   its area over the lane's vehicle area, so a queue merged into one blob
+//   still counts as several vehicles.
+//
+// Integer arithmetic only. No Arduino dependencies, the same code runs in
+// tools/counter_bench.
+
+#define COUNTER_GRID_W 64
+#define COUNTER_GRID_H 48
+#define COUNTER_GRID_PIXELS (COUNTER_GRID_W * COUNTER_GRID_H)
+
+#define COUNTER_MAX_LANES      8
+#define COUNTER_MAX_APPROACHES 4
+
+// Lane region of interest, in permille of the frame width and height
+typedef struct {
+  uint16_t left;
+  uint16_t top;
+  uint16_t right;
+  uint16_t bottom;
+  uint8_t approach;           // Approach the lane feeds
+  uint8_t vehicle_permille;   // Area of one vehicle in this lane, permille of the frame
+} counter_lane_t;
+
+typedef struct {
+  uint8_t threshold;          // Luma difference from the background that is foreground
+  uint8_t background_shift;
+  uint8_t foreground_shift;
+  uint8_t min_blob_pixels;    // Smaller blobs are noise, in grid pixels
+  uint8_t warmup_frames;      // Frames the background learns before counting
+  const counter_lane_t *lanes;
+  uint8_t lane_count;
+} vehicle_counter_config_t;
+
+typedef struct {
+  uint16_t counts[COUNTER_MAX_APPROACHES];
+  uint16_t blobs;              // Blobs counted in a lane
+  uint16_t foreground;         // Foreground pixels after cleanup
+  int16_t brightness_shift;    // Scene brightness against the background
+  bool ready;                  // Background learned, counts are valid
+} vehicle_count_t;
+
+typedef struct {
+  uint8_t left;
+  uint8_t top;
+  uint8_t right;               // Exclusive
+  uint8_t bottom;
+  uint16_t vehicle_pixels;
+} counter_lane_pixels_t;
+
+typedef struct {
+  vehicle_counter_config_t config;
+  counter_lane_pixels_t lanes[COUNTER_MAX_LANES];
+  uint32_t frames;
+  uint16_t background[COUNTER_GRID_PIXELS];   // 8.8 fixed point luma
+
+  // Scratch of vehicle_counter_process()
+  uint8_t gray[COUNTER_GRID_PIXELS];
+  uint8_t raw[COUNTER_GRID_PIXELS];           // Thresholded
+  uint8_t mask[COUNTER_GRID_PIXELS];          // Cleaned, visited blobs marked
+  uint16_t stack[COUNTER_GRID_PIXELS];
+  uint16_t histogram[511];
+} vehicle_counter_t;
+
+void vehicle_counter_init(vehicle_counter_t *counter, const vehicle_counter_config_t *config);
+
+// Learn the background again (camera moved)
+void vehicle_counter_reset(vehicle_counter_t *counter);
+
+// Count one frame, returns count->ready
+bool vehicle_counter_process(vehicle_counter_t *counter, const uint8_t *luma, uint16_t width, uint16_t height,
+                             vehicle_count_t *count);
+
+#endif //_VEHICLE_COUNTER_H_
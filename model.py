@@ -56,12 +56,14 @@ def detection_worker():
     while True:
         try:
             # Get frame from queue (blocks until frame is available)
-            frame_data = frame_queue.get(timeout=1)
-            if frame_data is None:  # Poison pill to stop thread
+            item = frame_queue.get(timeout=1)
+            if item is None:  # Poison pill to stop thread
                 break
+            frame_data, capture_us = item
             
-            # Process the frame
+            # Process the frame, the capture time goes back with its results
             results = detect_vehicles(frame_data)
+            results["capture_us"] = capture_us
             
             # Send results to server
             send_detection_results(results)
@@ -79,13 +81,19 @@ def detect_endpoint():
     frame_data = request.get_data()
     if not frame_data:
       return jsonify({"error": "No frame data received"}), 400
+
+    # Camera clock of the capture (fragment header), None if the server sent none
+    capture_us = request.headers.get('X-Capture-Us', type=int)
     
-    # Add frame to queue (non-blocking)
+    # Add frame to queue (non-blocking). The queue depth goes back to the
+    # camera through the server, which lowers its frame rate when we fall behind
     if not frame_queue.full():
-      frame_queue.put(frame_data)
-      return jsonify({"status": "queued"}), 200
+      frame_queue.put((frame_data, capture_us))
+      return jsonify({"status": "queued", "queue_depth": frame_queue.qsize(),
+                      "queue_capacity": frame_queue.maxsize}), 200
     else:
-      return jsonify({"status": "queue_full", "message": "Frame dropped"}), 503
+      return jsonify({"status": "queue_full", "message": "Frame dropped", "queue_depth": frame_queue.qsize(),
+                      "queue_capacity": frame_queue.maxsize}), 503
   except Exception as e:
     print(f"Error queueing frame: {e}")
     return jsonify({"error": str(e)}), 500
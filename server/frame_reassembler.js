@@ -0,0 +1,370 @@
+// Reassembles JPEG frames from the camera's UDP fragments. Same header
+// layout as esp32_camera/fragment_protocol.h (little-endian, 32 bytes):
+//
+//   0 magic, 1 version, 2 stream id, 3 flags, 4 frame number, 8 frame size,
+//   12 byte offset, 16 capture timestamp (us), 20 fragment index,
+//   22 fragment count, 24 payload length, 26 parity groups, 28 CRC-32
+//
+// Parity fragments (esp32_camera/fragment_fec.h) rebuild one lost data
+// fragment per interleaved group. What could not be rebuilt is counted:
+// fragments that never arrived, frames that were never completed and frame
+// numbers that were skipped entirely.
+
+export const FRAGMENT_MAGIC = 0xF7;
+export const FRAGMENT_VERSION = 2;
+export const FRAGMENT_HEADER_SIZE = 32;
+export const FRAGMENT_FLAG_PARITY = 0x01;
+// Larger than any JPEG the camera makes (UXGA, quality 4)
+export const FRAGMENT_MAX_FRAME_SIZE = 4 * 1024 * 1024;
+
+const CRC_OFFSET = 28;
+// Frame numbers remembered after completion, so late duplicates are ignored
+const FINISHED_HISTORY = 64;
+
+const CRC_TABLE = (() => {
+  const table = new Uint32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) {
+      c = c & 1 ? 0xEDB88320 ^ (c >>> 1) : c >>> 1;
+    }
+    table[n] = c >>> 0;
+  }
+  return table;
+})();
+
+// zlib CRC-32, chained like esp_rom_crc32_le(crc, buf, len)
+export function crc32(buffer, crc = 0) {
+  crc = ~crc >>> 0;
+  for (let i = 0; i < buffer.length; i++) {
+    crc = CRC_TABLE[(crc ^ buffer[i]) & 0xFF] ^ (crc >>> 8);
+  }
+  return ~crc >>> 0;
+}
+
+// Build one fragment datagram, as the camera does (tools and tests)
+export function encodeFragment({ streamId = 0, flags = 0, frameNumber, frameSize, offset, timestampUs = 0,
+                                 index, count, parityGroups = 0, payload }) {
+  const datagram = Buffer.alloc(FRAGMENT_HEADER_SIZE + payload.length);
+
+  datagram.writeUInt8(FRAGMENT_MAGIC, 0);
+  datagram.writeUInt8(FRAGMENT_VERSION, 1);
+  datagram.writeUInt8(streamId, 2);
+  datagram.writeUInt8(flags, 3);
+  datagram.writeUInt32LE(frameNumber >>> 0, 4);
+  datagram.writeUInt32LE(frameSize >>> 0, 8);
+  datagram.writeUInt32LE(offset >>> 0, 12);
+  datagram.writeUInt32LE(timestampUs >>> 0, 16);
+  datagram.writeUInt16LE(index, 20);
+  datagram.writeUInt16LE(count, 22);
+  datagram.writeUInt16LE(payload.length, 24);
+  datagram.writeUInt16LE(parityGroups, 26);
+  payload.copy(datagram, FRAGMENT_HEADER_SIZE);
+
+  const crc = crc32(payload, crc32(datagram.subarray(0, FRAGMENT_HEADER_SIZE)));
+  datagram.writeUInt32LE(crc, CRC_OFFSET);
+  return datagram;
+}
+
+function xorInto(target, source) {
+  for (let i = 0; i < source.length; i++) {
+    target[i] ^= source[i];
+  }
+}
+
+// All datagrams of a frame, data then parity, as frame_sender_send() sends
+// them (tools and tests)
+export function encodeFrame(frame, { streamId = 0, frameNumber, timestampUs = 0, chunkSize = 1400, groupSize = 0 }) {
+  const count = Math.ceil(frame.length / chunkSize);
+  const parityGroups = groupSize > 0 ? Math.ceil(count / groupSize) : 0;
+  const datagrams = [];
+
+  for (let i = 0; i < count; i++) {
+    const offset = i * chunkSize;
+    datagrams.push(encodeFragment({ streamId, frameNumber, frameSize: frame.length, offset, timestampUs,
+                                    index: i, count, parityGroups,
+                                    payload: frame.subarray(offset, offset + chunkSize) }));
+  }
+
+  for (let group = 0; group < parityGroups; group++) {
+    const parity = Buffer.alloc(chunkSize);
+    let length = 0;
+    for (let i = group; i < count; i += parityGroups) {
+      const member = frame.subarray(i * chunkSize, (i + 1) * chunkSize);
+      xorInto(parity, member);
+      length = Math.max(length, member.length);
+    }
+    datagrams.push(encodeFragment({ streamId, flags: FRAGMENT_FLAG_PARITY, frameNumber, frameSize: frame.length,
+                                    offset: chunkSize, timestampUs, index: group, count, parityGroups,
+                                    payload: parity.subarray(0, length) }));
+  }
+
+  return datagrams;
+}
+
+// { fragment } when well formed with a matching CRC, { error } otherwise
+export function decodeFragment(datagram) {
+  if (datagram.length < FRAGMENT_HEADER_SIZE ||
+      datagram.readUInt8(0) !== FRAGMENT_MAGIC ||
+      datagram.readUInt8(1) < 1 || datagram.readUInt8(1) > FRAGMENT_VERSION) {
+    return { error: 'invalid' };
+  }
+
+  const fragment = {
+    streamId: datagram.readUInt8(2),
+    parity: (datagram.readUInt8(3) & FRAGMENT_FLAG_PARITY) !== 0,
+    frameNumber: datagram.readUInt32LE(4),
+    frameSize: datagram.readUInt32LE(8),
+    offset: datagram.readUInt32LE(12),
+    timestampUs: datagram.readUInt32LE(16),
+    index: datagram.readUInt16LE(20),
+    count: datagram.readUInt16LE(22),
+    parityGroups: datagram.readUInt16LE(26),
+    payload: datagram.subarray(FRAGMENT_HEADER_SIZE),
+  };
+
+  // A parity fragment carries the data fragment size in `offset`
+  const inBounds = fragment.parity
+    ? fragment.index < fragment.parityGroups && fragment.payload.length <= fragment.offset &&
+      fragment.offset * fragment.count >= fragment.frameSize
+    : fragment.index < fragment.count && fragment.offset + fragment.payload.length <= fragment.frameSize;
+
+  if (datagram.readUInt16LE(24) !== fragment.payload.length ||
+      fragment.frameSize > FRAGMENT_MAX_FRAME_SIZE ||
+      fragment.parityGroups > fragment.count ||
+      !inBounds) {
+    return { error: 'invalid' };
+  }
+
+  // The CRC covers the header with the CRC field zeroed
+  const header = Buffer.from(datagram.subarray(0, FRAGMENT_HEADER_SIZE));
+  header.writeUInt32LE(0, CRC_OFFSET);
+  if (crc32(fragment.payload, crc32(header)) !== datagram.readUInt32LE(CRC_OFFSET)) {
+    return { error: 'crc' };
+  }
+
+  return { fragment };
+}
+
+function emptyStats() {
+  return {
+    fragments: 0,            // Data fragments received
+    parityFragments: 0,
+    recovered: 0,            // Data fragments rebuilt from parity
+    duplicates: 0,
+    invalid: 0,              // Bad size, magic, version or bounds
+    badCrc: 0,
+    framesComplete: 0,
+    framesRecovered: 0,      // Complete only thanks to parity
+    framesIncomplete: 0,     // Timed out with fragments missing
+    framesMissing: 0,        // Frame numbers never seen
+    fragmentsExpected: 0,    // Data fragments of finished frames
+    fragmentsLost: 0,        // Of those, never received
+    fragmentsUnrecovered: 0, // Of those, neither received nor rebuilt
+  };
+}
+
+export class FrameReassembler {
+  // onFrame(frame, info) gets every completed frame
+  constructor({ timeoutMs = 3000, onFrame = () => {} } = {}) {
+    this.timeoutMs = timeoutMs;
+    this.onFrame = onFrame;
+    this.frames = new Map();
+    this.streams = new Map();
+    this.stats = emptyStats();
+  }
+
+  stream(streamId) {
+    let stream = this.streams.get(streamId);
+    if (!stream) {
+      stream = { highest: null, finished: new Set(), finishedOrder: [] };
+      this.streams.set(streamId, stream);
+    }
+    return stream;
+  }
+
+  // A frame number gap counts the skipped frames as missing; a big step
+  // back means the camera restarted
+  track(stream, frameNumber) {
+    if (stream.highest === null || frameNumber + FINISHED_HISTORY < stream.highest) {
+      stream.highest = frameNumber;
+      stream.finished.clear();
+      stream.finishedOrder = [];
+      return;
+    }
+    if (frameNumber > stream.highest) {
+      this.stats.framesMissing += frameNumber - stream.highest - 1;
+      stream.highest = frameNumber;
+    }
+  }
+
+  finish(key, entry, complete) {
+    const stream = this.stream(entry.streamId);
+
+    this.frames.delete(key);
+    stream.finished.add(entry.frameNumber);
+    stream.finishedOrder.push(entry.frameNumber);
+    if (stream.finishedOrder.length > FINISHED_HISTORY) {
+      stream.finished.delete(stream.finishedOrder.shift());
+    }
+
+    this.stats.fragmentsExpected += entry.count;
+    this.stats.fragmentsLost += entry.count - entry.directCount;
+    this.stats.fragmentsUnrecovered += entry.count - entry.receivedCount;
+    if (complete) {
+      this.stats.framesComplete++;
+      if (entry.directCount < entry.count) {
+        this.stats.framesRecovered++;
+      }
+    } else {
+      this.stats.framesIncomplete++;
+    }
+  }
+
+  createEntry(fragment, now) {
+    const groups = fragment.parityGroups;
+    const entry = {
+      streamId: fragment.streamId,
+      frameNumber: fragment.frameNumber,
+      timestampUs: fragment.timestampUs,
+      buffer: Buffer.alloc(fragment.frameSize),
+      received: new Uint8Array(fragment.count),
+      count: fragment.count,
+      groups,
+      parity: new Array(groups).fill(null),
+      missing: new Uint16Array(groups),  // Data fragments still missing per group
+      chunkSize: 0,
+      receivedCount: 0,                  // Received or rebuilt
+      directCount: 0,                    // Received
+      updated: now,
+    };
+
+    for (let i = 0; i < fragment.count && groups > 0; i++) {
+      entry.missing[i % groups]++;
+    }
+    return entry;
+  }
+
+  // Rebuild the one missing member of a group: parity XOR the others
+  recover(entry, group) {
+    const parity = entry.parity[group];
+    if (!parity || entry.missing[group] !== 1) {
+      return;
+    }
+
+    let lost = -1;
+    const rebuilt = Buffer.from(parity.payload);
+    for (let i = group; i < entry.count; i += entry.groups) {
+      if (!entry.received[i]) {
+        lost = i;
+        continue;
+      }
+      const offset = i * entry.chunkSize;
+      xorInto(rebuilt, entry.buffer.subarray(offset, Math.min(offset + entry.chunkSize, entry.buffer.length)));
+    }
+    if (lost < 0) {
+      return;
+    }
+
+    const offset = lost * entry.chunkSize;
+    const length = Math.min(entry.chunkSize, entry.buffer.length - offset);
+    if (length <= 0 || length > rebuilt.length) {
+      return;
+    }
+
+    rebuilt.copy(entry.buffer, offset, 0, length);
+    entry.received[lost] = 1;
+    entry.receivedCount++;
+    entry.missing[group] = 0;
+    this.stats.recovered++;
+  }
+
+  push(datagram, now = Date.now()) {
+    const { fragment, error } = decodeFragment(datagram);
+    if (!fragment) {
+      if (error === 'crc') {
+        this.stats.badCrc++;
+      } else {
+        this.stats.invalid++;
+      }
+      return;
+    }
+
+    const stream = this.stream(fragment.streamId);
+    this.track(stream, fragment.frameNumber);
+    if (stream.finished.has(fragment.frameNumber)) {
+      this.stats.duplicates++;
+      return;
+    }
+
+    const key = `${fragment.streamId}:${fragment.frameNumber}`;
+    let entry = this.frames.get(key);
+    if (!entry) {
+      entry = this.createEntry(fragment, now);
+      this.frames.set(key, entry);
+    }
+
+    if (fragment.count !== entry.count || fragment.frameSize !== entry.buffer.length ||
+        fragment.parityGroups !== entry.groups) {
+      this.stats.invalid++;
+      return;
+    }
+
+    let group = -1;
+    if (fragment.parity) {
+      if (entry.parity[fragment.index]) {
+        this.stats.duplicates++;
+        return;
+      }
+      entry.parity[fragment.index] = fragment;
+      entry.chunkSize = fragment.offset;
+      group = fragment.index;
+      this.stats.parityFragments++;
+    } else {
+      if (entry.received[fragment.index]) {
+        this.stats.duplicates++;
+        return;
+      }
+      fragment.payload.copy(entry.buffer, fragment.offset);
+      entry.received[fragment.index] = 1;
+      entry.receivedCount++;
+      entry.directCount++;
+      this.stats.fragments++;
+
+      if (entry.groups > 0) {
+        group = fragment.index % entry.groups;
+        entry.missing[group]--;
+      }
+    }
+    entry.updated = now;
+
+    if (group >= 0 && entry.receivedCount < entry.count) {
+      this.recover(entry, group);
+    }
+
+    if (entry.receivedCount === entry.count) {
+      this.finish(key, entry, true);
+      this.onFrame(entry.buffer, { streamId: entry.streamId, frameNumber: entry.frameNumber,
+                                   timestampUs: entry.timestampUs });
+    }
+  }
+
+  // Give up on frames without a fragment for timeoutMs
+  expire(now = Date.now()) {
+    for (const [key, entry] of this.frames) {
+      if (now - entry.updated > this.timeoutMs) {
+        this.finish(key, entry, false);
+      }
+    }
+  }
+
+  // Counters since the last call. fragmentLoss is the share of data
+  // fragments lost on the way, residualLoss what parity could not rebuild.
+  takeStats() {
+    const stats = this.stats;
+    this.stats = emptyStats();
+    stats.fragmentLoss = stats.fragmentsExpected > 0 ? stats.fragmentsLost / stats.fragmentsExpected : 0;
+    stats.residualLoss = stats.fragmentsExpected > 0 ? stats.fragmentsUnrecovered / stats.fragmentsExpected : 0;
+    return stats;
+  }
+}
@@ -1,10 +1,12 @@
 
 import udp from 'dgram';
 import http from 'http';
+import { randomBytes } from 'crypto';
 import express from 'express';
 import { Server } from 'socket.io';
 import { fileURLToPath } from 'url';
 import { dirname, join } from 'path';
+import { FrameReassembler } from './frame_reassembler.js';
 
 const __filename = fileURLToPath(import.meta.url);
 const __dirname = dirname(__filename);
@@ -13,6 +15,9 @@ const PORT = process.env.SERVER_PORT || 5000;
 const UDP_PORT = process.env.UPD_PORT || 3000;
 const DETECTION_URL = process.env.DETECTION_URL || 'http://0.0.0.0:8000/detect';
 const CAR_LIMIT = process.env.CAR_LIMIT || 9;
+// Detection updates go to the ESP32 as binary datagrams unless DETECTION_BINARY=0
+const DETECTION_BINARY = process.env.DETECTION_BINARY !== '0';
+const DETECTION_UDP_PORT = process.env.DETECTION_UDP_PORT || 4210;
 
 const app = express();
 const server = http.createServer(app);
@@ -25,10 +30,16 @@ const io = new Server(server, {
   pingInterval: 10000,
   pingTimeout: 5000
 });
-// Store frames as array of packets
-// Structure: frames[frameNumber] = { packets: [], totalPackets: N, timestamp: Date, receivedCount: N }
-const frames = {};
 const FRAME_TIMEOUT = 3000; // 3 second timeout for incomplete frames
+const VIDEO_STATS_INTERVAL = process.env.VIDEO_STATS_INTERVAL || 10000;
+// Receive statistics sent back to the camera for its rate control
+const VIDEO_FEEDBACK_INTERVAL = process.env.VIDEO_FEEDBACK_INTERVAL || 1000;
+
+// Complete frames go to the detection model
+const reassembler = new FrameReassembler({
+  timeoutMs: FRAME_TIMEOUT,
+  onFrame: (frame, info) => sendFrameToDetection(frame, info.timestampUs)
+});
 
 app.use(express.static(join(__dirname, 'static')));
 
@@ -42,12 +53,75 @@ const systemStatus = {
   detectionModel_connected: false,
   esp32_connected: false,
   car_count: 0,
+  stream_settings: null,
+  camera_stats: null,
+}
+
+// Detector side of the stream since the last feedback: queue depth from
+// the last /detect response, frames refused with a full queue and
+// detection results received
+const detectorStats = {
+  queue: 0,
+  capacity: 0,
+  dropped: 0,
+  results: 0
 }
 
 const connection_ids = {
   esp32camera_id: null,
   detectionModel_id: null,
-  esp32_id: null
+  esp32_id: null,
+  esp32_address: null
+}
+
+// Binary detection update, same layout as esp32/detection_protocol.h
+const DETECTION_MAGIC = 0xD7;
+const DETECTION_VERSION = 2;
+const DETECTION_MAX_APPROACHES = 4;
+const DETECTION_DATAGRAM_SIZE = 24;
+
+// New at every start, so the ESP32 takes our numbering from 1 again
+const detectionSession = randomBytes(4).readUInt32LE(0);
+let detectionSequence = 0;
+
+function encodeDetectionUpdate({ session, sequence, captureUs, counts, ambulanceMask }) {
+  const buffer = Buffer.alloc(DETECTION_DATAGRAM_SIZE);
+  const approaches = Math.min(counts.length, DETECTION_MAX_APPROACHES);
+
+  buffer.writeUInt8(DETECTION_MAGIC, 0);
+  buffer.writeUInt8(DETECTION_VERSION, 1);
+  buffer.writeUInt8(approaches, 2);
+  buffer.writeUInt8(ambulanceMask & 0x0F, 3);
+  buffer.writeUInt32LE(session >>> 0, 4);
+  buffer.writeUInt32LE(sequence >>> 0, 8);
+  buffer.writeUInt32LE(captureUs >>> 0, 12);
+  for (let i = 0; i < approaches; i++) {
+    buffer.writeUInt16LE(Math.min(Math.max(counts[i] | 0, 0), 0xFFFF), 16 + 2 * i);
+  }
+
+  return buffer;
+}
+
+// Forward the latest detection to the ESP32: one datagram when its address is
+// known, the JSON event otherwise. The camera watches approach 0. captureUs
+// is the camera's capture time of the frame, echoed back by model.py.
+function sendDetectionUpdate(carCount, hasAmbulance, captureUs) {
+  if (DETECTION_BINARY && connection_ids.esp32_address) {
+    const datagram = encodeDetectionUpdate({
+      session: detectionSession,
+      sequence: ++detectionSequence,
+      captureUs: captureUs ?? 0,
+      counts: [carCount],
+      ambulanceMask: hasAmbulance ? 0x01 : 0x00
+    });
+    udpSocket.send(datagram, DETECTION_UDP_PORT, connection_ids.esp32_address);
+    return;
+  }
+
+  devicesNS.emit('detection_update', {
+    car_count: carCount,
+    has_ambulance: hasAmbulance
+  });
 }
 
 // Middleware to parse JSON
@@ -56,8 +130,9 @@ app.use(express.json({ limit: '50mb' }));
 // HTTP endpoint to receive detection results from model.py
 app.post('/detection_results', (req, res) => {
   try {
-    const { car_count, has_ambulance, frame } = req.body;
+    const { car_count, has_ambulance, frame, capture_us } = req.body;
     res.status(200).json({ status: 'success' });
+    detectorStats.results++;
     
     // Update system status
     systemStatus.car_count = car_count || 0;
@@ -70,27 +145,35 @@ app.post('/detection_results', (req, res) => {
       webInterfaceNS.emit('frame', processedFrame);
     }
     
-    devicesNS.emit('detection_update', {
-      car_count: systemStatus.car_count,
-      has_ambulance: systemStatus.has_ambulance
-    });
+    sendDetectionUpdate(systemStatus.car_count, systemStatus.has_ambulance, capture_us);
 
   } catch (error) {
     console.error('Error processing detection results:', error);
   }
 });
 
-async function sendFrameToDetection(frameBuffer) {
+// captureUs (camera clock, from the fragment header) comes back with the result
+async function sendFrameToDetection(frameBuffer, captureUs) {
   try {
     const response = await fetch(DETECTION_URL, {
       method: 'POST',
       headers: {
-        'Content-Type': 'application/octet-stream'
+        'Content-Type': 'application/octet-stream',
+        'X-Capture-Us': String(captureUs >>> 0)
       },
       body: frameBuffer
     });
     
-    if (!response.ok) {
+    const body = await response.json().catch(() => ({}));
+    if (typeof body.queue_depth === 'number') {
+      detectorStats.queue = body.queue_depth;
+      detectorStats.capacity = body.queue_capacity || detectorStats.capacity;
+    }
+
+    // Queue full: expected under load, the camera slows down on the next feedback
+    if (response.status === 503) {
+      detectorStats.dropped++;
+    } else if (!response.ok) {
       console.error('Detection server returned error:', response.status);
     }
   } catch (error) {
@@ -104,63 +187,79 @@ udpSocket.on('error', (err) => {
 });
 
 udpSocket.on('message', (msg, rinfo) => {
-  // Parse metadata from end of packet (last 12 bytes)
-  if (msg.length < 12) {
-    console.log('Invalid packet: too small');
-    return;
-  }
+  reassembler.push(msg);
+});
 
-  const frameNumber = msg.readUInt32LE(msg.length - 12);
-  const totalPackets = msg.readUInt32LE(msg.length - 8);
-  const packetIndex = msg.readUInt32LE(msg.length - 4);
-  const packetData = msg.subarray(0, msg.length - 12); // Actual image data
-
-  // console.log(`Frame ${frameNumber}, Packet ${packetIndex + 1}/${totalPackets}, ${packetData.length} bytes`);
-
-  // Initialize frame if it doesn't exist
-  if (!frames[frameNumber]) {
-    frames[frameNumber] = {
-      packets: new Array(totalPackets),
-      totalPackets: totalPackets,
-      timestamp: Date.now(),
-      receivedCount: 0
-    };
-  }
+// Give up on incomplete frames periodically
+setInterval(() => {
+  reassembler.expire();
+}, FRAME_TIMEOUT / 3);
 
-  // Store packet at correct position (only if not already received)
-  if (!frames[frameNumber].packets[packetIndex]) {
-    frames[frameNumber].packets[packetIndex] = packetData;
-    frames[frameNumber].timestamp = Date.now(); // Update timestamp on each received packet
-    frames[frameNumber].receivedCount++;
-  }
+// Reassembly counters since the last log line
+let videoTotals = null;
+let lastFeedback = Date.now();
 
-  // Check if frame is complete: packetIndex + 1 == totalPackets means last packet received
-  // But we also need to ensure ALL packets are received
-  if (frames[frameNumber].receivedCount === totalPackets) {
-    // console.log(`Frame ${frameNumber} complete! Concatenating ${totalPackets} packets...`);
-    
-    // Concatenate all packets in order
-    const completeFrame = Buffer.concat(frames[frameNumber].packets);
-    // console.log(`Complete frame size: ${completeFrame.length} bytes`);
-    
-    // Send to detection model
-    sendFrameToDetection(completeFrame);
-    
-    // Clean up this frame
-    delete frames[frameNumber];
+function addVideoStats(total, stats) {
+  if (!total) {
+    return { ...stats };
   }
-});
+  for (const key of Object.keys(stats)) {
+    total[key] += stats[key];
+  }
+  return total;
+}
 
-// Cleanup old incomplete frames periodically
+// Tell the camera how much of its stream arrived and how far behind the
+// detector is, it adjusts quality, frame size and rate from that
 setInterval(() => {
   const now = Date.now();
-  for (const frameNumber in frames) {
-    if (now - frames[frameNumber].timestamp > FRAME_TIMEOUT) {
-      console.log(`Frame ${frameNumber} timeout - discarding ${frames[frameNumber].receivedCount}/${frames[frameNumber].totalPackets} packets`);
-      delete frames[frameNumber];
-    }
+  const intervalMs = Math.max(1, now - lastFeedback);
+  const stats = reassembler.takeStats();
+
+  lastFeedback = now;
+  videoTotals = addVideoStats(videoTotals, stats);
+
+  if (systemStatus.esp32camera_connected) {
+    videoNS.emit('rx_stats', {
+      intervalMs,
+      framesComplete: stats.framesComplete,
+      framesIncomplete: stats.framesIncomplete,
+      framesMissing: stats.framesMissing,
+      rawLossPermille: Math.round(stats.fragmentLoss * 1000),
+      residualLossPermille: Math.round(stats.residualLoss * 1000),
+      detectorQueue: detectorStats.queue,
+      detectorCapacity: detectorStats.capacity,
+      detectorDropped: detectorStats.dropped,
+      detectorFpsX10: Math.round(detectorStats.results * 10000 / intervalMs)
+    });
+  }
+
+  detectorStats.dropped = 0;
+  detectorStats.results = 0;
+}, VIDEO_FEEDBACK_INTERVAL);
+
+// Chunk loss of the frames finished since the last report
+setInterval(() => {
+  const stats = videoTotals;
+  videoTotals = null;
+  if (!stats) {
+    return;
+  }
+
+  const frames = stats.framesComplete + stats.framesIncomplete;
+  if (frames === 0 && stats.invalid === 0 && stats.badCrc === 0) {
+    return;
   }
-}, FRAME_TIMEOUT);
+
+  const fragmentLoss = stats.fragmentsExpected > 0 ? stats.fragmentsLost / stats.fragmentsExpected : 0;
+  const residualLoss = stats.fragmentsExpected > 0 ? stats.fragmentsUnrecovered / stats.fragmentsExpected : 0;
+
+  console.log(`Video: ${frames} frames, ${stats.framesComplete} complete (${stats.framesRecovered} by parity), ` +
+              `${stats.framesIncomplete} incomplete, ${stats.framesMissing} missing, ` +
+              `chunk loss ${(fragmentLoss * 100).toFixed(2)}% (${stats.fragmentsLost}/${stats.fragmentsExpected}), ` +
+              `${stats.recovered} recovered, after parity ${(residualLoss * 100).toFixed(2)}%, ` +
+              `${stats.duplicates} duplicates, ${stats.badCrc} bad CRC, ${stats.invalid} invalid`);
+}, VIDEO_STATS_INTERVAL);
 
 udpSocket.bind(UDP_PORT);
 
@@ -175,6 +274,18 @@ videoNS.on('connection', (socket) => {
     connection_ids.esp32camera_id = null;
   });
 
+  // Chosen by the camera's rate control
+  socket.on('stream_settings', (settings) => {
+    console.log('Camera stream settings:', settings);
+    systemStatus.stream_settings = settings;
+  });
+
+  // Stage timing histograms and frame counters, once per report window
+  socket.on('camera_stats', (stats) => {
+    systemStatus.camera_stats = stats;
+    webInterfaceNS.emit('camera_stats', stats);
+  });
+
   setTimeout(() => {
     socket.emit('start');
   }, 5000);
@@ -202,21 +313,54 @@ detectionNS.on('connection', (socket) => {
 });
 
 
+// Decode the hex encoded FSM trace dumped by the ESP32 (see esp32/fsm_trace.h)
+function decodeFsmTrace(data) {
+  const buffer = Buffer.from(data.records || '', 'hex');
+  const recordSize = data.recordSize || 12;
+  const records = [];
+
+  for (let offset = 0; offset + recordSize <= buffer.length; offset += recordSize) {
+    records.push({
+      timestampUs: buffer.readUInt32LE(offset),
+      actionUs: buffer.readUInt32LE(offset + 4),
+      instance: buffer.readUInt8(offset + 8),
+      fromState: buffer.readUInt8(offset + 9),
+      toState: buffer.readUInt8(offset + 10),
+      event: buffer.readUInt8(offset + 11)
+    });
+  }
+
+  return { total: data.total, records };
+}
+
 devicesNS.on('connection', (socket) => {
   console.log('A new ESP32 connected to the devices namespace', 'socketID:', socket.id);
   systemStatus.esp32_connected = true;
   connection_ids.esp32_id = socket.id;
+  connection_ids.esp32_address = socket.handshake.address.replace(/^::ffff:/, '');
+
+  socket.on('fsm_trace', (data) => {
+    const trace = decodeFsmTrace(data);
+    console.log(`FSM trace received: ${trace.records.length} of ${trace.total} transitions`);
+    webInterfaceNS.emit('fsm_trace', trace);
+  });
 
   socket.on('disconnect', () => {
     console.log('ESP32 disconnected from the devices namespace', 'socketID:', socket.id);
     systemStatus.esp32_connected = false;
     connection_ids.esp32_id = null;
+    connection_ids.esp32_address = null;
   });
 });
 
 
 webInterfaceNS.on('connection', (socket) => {
   console.log('A new Web Interface connected to the webinterface namespace', 'socketID:', socket.id);
+
+  // Last camera report, so the dashboard does not wait for the next one
+  if (systemStatus.camera_stats) {
+    socket.emit('camera_stats', systemStatus.camera_stats);
+  }
   
   socket.on('disconnect', () => {
     console.log('Web Interface disconnected from the webinterface namespace', 'socketID:', socket.id);
@@ -239,6 +383,12 @@ webInterfaceNS.on('connection', (socket) => {
     // Forward speed to ESP32 if connected
     devicesNS.emit('set_speed', data);
   });
+
+  socket.on('dump_fsm_trace', () => {
+    console.log('FSM trace requested from web interface');
+    // Ask the ESP32 to dump its transition history
+    devicesNS.emit('dump_fsm_trace');
+  });
 });
 
 
@@ -100,4 +100,77 @@ socket.on("detection_update", (data) => {
     emergencyStatus.style.background = "#e0e0e0";
     emergencyStatus.style.color = "#555";
   }
-});
\ No newline at end of file
+});
+// Camera stage timing: one histogram per stage, bucket b counts frames
+// under bucketUs << b, the last bucket everything longer
+const stageNames = {
+  acquire: "Frame buffer",
+  fragment: "Fragmenting",
+  send: "UDP send",
+  total: "Total frame"
+};
+const stageHistograms = document.getElementById("stageHistograms");
+const cameraFps = document.getElementById("cameraFps");
+const cameraFrames = document.getElementById("cameraFrames");
+const cameraMissed = document.getElementById("cameraMissed");
+const cameraSendErrors = document.getElementById("cameraSendErrors");
+
+function bucketLimit(bucketUs, bucket) {
+  return ((bucketUs * 2 ** bucket) / 1000).toFixed(bucketUs * 2 ** bucket < 1000 ? 2 : 0) + " ms";
+}
+
+// Upper bound of the bucket holding the given share of the frames
+function percentile(buckets, bucketUs, share) {
+  const total = buckets.reduce((sum, count) => sum + count, 0);
+  if (total === 0) {
+    return "-";
+  }
+
+  let seen = 0;
+  for (let b = 0; b < buckets.length; b++) {
+    seen += buckets[b];
+    if (seen >= total * share) {
+      return b === buckets.length - 1 ? "> " + bucketLimit(bucketUs, b - 1) : "< " + bucketLimit(bucketUs, b);
+    }
+  }
+  return "-";
+}
+
+function renderStage(name, buckets, bucketUs) {
+  const stage = document.createElement("div");
+  stage.className = "stage";
+
+  const header = document.createElement("div");
+  header.className = "stage-header";
+  const label = document.createElement("span");
+  label.className = "stage-name";
+  label.textContent = stageNames[name] || name;
+  const summary = document.createElement("span");
+  summary.textContent = `p50 ${percentile(buckets, bucketUs, 0.5)}, p95 ${percentile(buckets, bucketUs, 0.95)}`;
+  header.append(label, summary);
+
+  const bars = document.createElement("div");
+  bars.className = "stage-bars";
+  const highest = Math.max(1, ...buckets);
+  buckets.forEach((count, b) => {
+    const bar = document.createElement("div");
+    bar.className = "stage-bar";
+    bar.style.height = `${(count * 100) / highest}%`;
+    bar.title = `${b === buckets.length - 1 ? "> " + bucketLimit(bucketUs, b - 1) : "< " + bucketLimit(bucketUs, b)}: ${count} frames`;
+    bars.appendChild(bar);
+  });
+
+  stage.append(header, bars);
+  return stage;
+}
+
+socket.on("camera_stats", (stats) => {
+  cameraFps.textContent = (stats.fpsX10 / 10).toFixed(1);
+  cameraFrames.textContent = `${stats.sent} / ${stats.captured}`;
+  cameraMissed.textContent = `${stats.dropped} / ${stats.noFrame}`;
+  cameraSendErrors.textContent = stats.sendErrors;
+
+  stageHistograms.replaceChildren(
+    ...Object.entries(stats.histograms || {}).map(([name, buckets]) => renderStage(name, buckets, stats.bucketUs))
+  );
+});
@@ -0,0 +1,352 @@
+// Runs the camera's edge counter (esp32_camera/vehicle_counter.h) over
+// recorded footage on the host: per frame cost of the DC decode and of the
+// counter, and, given hand counted ground truth, how far its counts are
+// off, per frame and as published to the controller. See README.md.
+
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#else
+#define HAVE_CYCLES 0
+#endif
+
+#include "footage.h"
+#include "jpeg_dc.h"
+#include "lane_config.h"
+#include "stream_config.h"
+#include "vehicle_counter.h"
+
+typedef struct {
+  double fps;
+  uint32_t interval_ms;
+  uint32_t publish_ms;
+  const char *truth;
+  bool verbose;
+} options_t;
+
+static options_t options = {STREAM_FPS, EDGE_COUNTER_INTERVAL_MS, EDGE_COUNTER_PUBLISH_MS, NULL, false};
+static vehicle_counter_config_t config = {COUNTER_THRESHOLD, COUNTER_BACKGROUND_SHIFT, COUNTER_FOREGROUND_SHIFT,
+                                          COUNTER_MIN_BLOB_PIXELS, COUNTER_WARMUP_FRAMES, NULL, 0};
+static std::vector<counter_lane_t> lanes(COUNTER_LANES, COUNTER_LANES + COUNTER_LANE_COUNT);
+
+typedef std::vector<int> counts_t;
+
+// Absolute and signed error per approach
+typedef struct {
+  uint32_t samples;
+  uint32_t exact;
+  uint32_t within_one;
+  double absolute;
+  double bias;
+} count_error_t;
+
+static double now_us()
+{
+  using namespace std::chrono;
+  return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t cycles()
+{
+#if HAVE_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void usage()
+{
+  printf("usage: counter_bench [options] FILE...\n\n"
+         "  FILE                 JPEG image or MJPEG stream, frames in the order given\n"
+         "  --fps N              rate the footage was captured at (%g)\n"
+         "  --interval-ms N      EDGE_COUNTER_INTERVAL_MS, frames counted (%u)\n"
+         "  --publish-ms N       EDGE_COUNTER_PUBLISH_MS (%u)\n"
+         "  --truth FILE         ground truth: \"frame count0 [count1 ...]\" per line\n"
+         "  --threshold N        COUNTER_THRESHOLD (%u)\n"
+         "  --min-blob N         COUNTER_MIN_BLOB_PIXELS (%u)\n"
+         "  --lane L,T,R,B,A,V   lane in permille and its approach and vehicle area,\n"
+         "                       repeat for more; replaces the lanes of lane_config.h\n"
+         "  --verbose            one line per counted frame\n",
+         options.fps, (unsigned) options.interval_ms, (unsigned) options.publish_ms, config.threshold,
+         config.min_blob_pixels);
+  exit(1);
+}
+
+static bool parse_lane(const char *text, std::vector<counter_lane_t> *out)
+{
+  unsigned left, top, right, bottom, approach, vehicle;
+  if (sscanf(text, "%u,%u,%u,%u,%u,%u", &left, &top, &right, &bottom, &approach, &vehicle) != 6 ||
+      left >= right || top >= bottom || right > 1000 || bottom > 1000 || approach >= COUNTER_MAX_APPROACHES ||
+      vehicle == 0 || vehicle > 255)
+    return false;
+
+  counter_lane_t lane = {(uint16_t) left, (uint16_t) top, (uint16_t) right, (uint16_t) bottom, (uint8_t) approach,
+                         (uint8_t) vehicle};
+  out->push_back(lane);
+  return true;
+}
+
+static bool read_truth(const char *path, std::map<size_t, counts_t> *truth)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    if (line[0] == '#')
+      continue;
+
+    char *cursor = line;
+    char *end;
+    long frame = strtol(cursor, &end, 10);
+    if (end == cursor)
+      continue;
+
+    counts_t counts;
+    for (cursor = end;; cursor = end)
+    {
+      long count = strtol(cursor, &end, 10);
+      if (end == cursor || counts.size() == COUNTER_MAX_APPROACHES)
+        break;
+      counts.push_back((int) count);
+    }
+    (*truth)[(size_t) frame] = counts;
+  }
+
+  fclose(file);
+  return true;
+}
+
+static void add_error(count_error_t *errors, const counts_t &truth, const int *counted)
+{
+  for (size_t a = 0; a < truth.size(); a++)
+  {
+    int error = counted[a] - truth[a];
+    errors[a].samples++;
+    errors[a].exact += error == 0;
+    errors[a].within_one += error >= -1 && error <= 1;
+    errors[a].absolute += abs(error);
+    errors[a].bias += error;
+  }
+}
+
+static void print_errors(const char *title, const count_error_t *errors)
+{
+  for (int a = 0; a < COUNTER_MAX_APPROACHES; a++)
+  {
+    const count_error_t *e = &errors[a];
+    if (e->samples == 0)
+      continue;
+
+    printf("%-10s a%d  %5u samples  exact %5.1f%%  within 1 %5.1f%%  mean abs error %.2f  bias %+.2f\n", title, a,
+           e->samples, 100.0 * e->exact / e->samples, 100.0 * e->within_one / e->samples, e->absolute / e->samples,
+           e->bias / e->samples);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::vector<uint8_t>> frames;
+  std::vector<counter_lane_t> custom_lanes;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string argument = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if (argument == "--verbose")
+      options.verbose = true;
+    else if (argument == "--fps" && has_value)
+      options.fps = atof(argv[++i]);
+    else if (argument == "--interval-ms" && has_value)
+      options.interval_ms = (uint32_t) atoi(argv[++i]);
+    else if (argument == "--publish-ms" && has_value)
+      options.publish_ms = (uint32_t) atoi(argv[++i]);
+    else if (argument == "--truth" && has_value)
+      options.truth = argv[++i];
+    else if (argument == "--threshold" && has_value)
+      config.threshold = (uint8_t) atoi(argv[++i]);
+    else if (argument == "--min-blob" && has_value)
+      config.min_blob_pixels = (uint8_t) atoi(argv[++i]);
+    else if (argument == "--lane" && has_value)
+    {
+      if (!parse_lane(argv[++i], &custom_lanes))
+        usage();
+    }
+    else if (argument.rfind("--", 0) == 0)
+      usage();
+    else if (!footage_read(argv[i], &frames))
+      return 1;
+  }
+
+  if (frames.empty() || options.fps <= 0)
+    usage();
+
+  std::map<size_t, counts_t> truth;
+  if (options.truth != NULL && !read_truth(options.truth, &truth))
+    return 1;
+
+  if (!custom_lanes.empty())
+    lanes = custom_lanes;
+  config.lanes = lanes.data();
+  config.lane_count = (uint8_t) lanes.size();
+
+  static vehicle_counter_t counter;
+  static jpeg_dc_t jpeg;
+  static uint8_t luma[FOOTAGE_LUMA_SIZE];
+  vehicle_counter_init(&counter, &config);
+
+  count_error_t frame_errors[COUNTER_MAX_APPROACHES] = {};
+  count_error_t published_errors[COUNTER_MAX_APPROACHES] = {};
+  double decode_total_us = 0;
+  double count_total_us = 0;
+  double count_max_us = 0;
+  uint64_t count_cycles = 0;
+  uint32_t counted = 0;
+  uint32_t undecoded = 0;
+  uint32_t published = 0;
+
+  // What the camera would publish: counts averaged over a window, and the
+  // truth of the same frames averaged the same way
+  int window_sums[COUNTER_MAX_APPROACHES] = {};
+  int truth_sums[COUNTER_MAX_APPROACHES] = {};
+  uint32_t window_frames = 0;
+  uint32_t truth_frames = 0;
+  size_t truth_width = 0;
+  uint32_t window_start_ms = 0;
+  bool started = false;
+  uint32_t last_count_ms = 0;
+
+  for (size_t n = 0; n < frames.size(); n++)
+  {
+    uint32_t now_ms = (uint32_t) (n * 1000 / options.fps);
+    if (started && now_ms - last_count_ms < options.interval_ms)
+      continue;
+    if (!started)
+      window_start_ms = now_ms;
+    started = true;
+    last_count_ms = now_ms;
+
+    const std::vector<uint8_t> &frame = frames[n];
+    double start = now_us();
+    bool decoded = jpeg_dc_luma_image(&jpeg, frame.data(), frame.size(), luma, sizeof(luma));
+    double decode_us = now_us() - start;
+
+    if (!decoded)
+    {
+      undecoded++;
+      continue;
+    }
+
+    vehicle_count_t count;
+    uint64_t start_cycles = cycles();
+    start = now_us();
+    bool ready = vehicle_counter_process(&counter, luma, jpeg.blocks_w, jpeg.blocks_h, &count);
+    double count_us = now_us() - start;
+    count_cycles += cycles() - start_cycles;
+
+    counted++;
+    decode_total_us += decode_us;
+    count_total_us += count_us;
+    if (count_us > count_max_us)
+      count_max_us = count_us;
+
+    int counts[COUNTER_MAX_APPROACHES];
+    for (int a = 0; a < COUNTER_MAX_APPROACHES; a++)
+      counts[a] = count.counts[a];
+
+    std::map<size_t, counts_t>::const_iterator expected = truth.find(n);
+    if (ready)
+    {
+      for (int a = 0; a < COUNTER_MAX_APPROACHES; a++)
+        window_sums[a] += counts[a];
+      window_frames++;
+
+      if (expected != truth.end())
+      {
+        add_error(frame_errors, expected->second, counts);
+        for (size_t a = 0; a < expected->second.size(); a++)
+          truth_sums[a] += expected->second[a];
+        truth_width = expected->second.size();
+        truth_frames++;
+      }
+    }
+
+    if (options.verbose)
+    {
+      printf("%6zu %8u ms  %s  counts %d/%d/%d/%d", n, (unsigned) now_ms, ready ? "ready   " : "learning", counts[0],
+             counts[1], counts[2], counts[3]);
+      if (expected != truth.end())
+      {
+        printf("  truth");
+        for (int value : expected->second)
+          printf(" %d", value);
+      }
+      printf("  blobs %u foreground %u shift %+d\n", count.blobs, count.foreground, count.brightness_shift);
+    }
+
+    if (now_ms - window_start_ms < options.publish_ms)
+      continue;
+
+    // Rounded averages, as edge_counter.cpp publishes them
+    if (window_frames > 0)
+    {
+      published++;
+      if (truth_frames == window_frames)
+      {
+        int averaged[COUNTER_MAX_APPROACHES];
+        counts_t expected_average(truth_width);
+        for (int a = 0; a < COUNTER_MAX_APPROACHES; a++)
+          averaged[a] = (window_sums[a] + (int) window_frames / 2) / (int) window_frames;
+        for (size_t a = 0; a < truth_width; a++)
+          expected_average[a] = (truth_sums[a] + (int) truth_frames / 2) / (int) truth_frames;
+        add_error(published_errors, expected_average, averaged);
+      }
+    }
+
+    memset(window_sums, 0, sizeof(window_sums));
+    memset(truth_sums, 0, sizeof(truth_sums));
+    window_frames = 0;
+    truth_frames = 0;
+    window_start_ms = now_ms;
+  }
+
+  if (options.verbose)
+    printf("\n");
+
+  printf("%zu frames at %g fps, counted every %u ms: %u frames, %u undecoded, %u published\n", frames.size(),
+         options.fps, (unsigned) options.interval_ms, counted, undecoded, published);
+  printf("%zu lanes, threshold %u, min blob %u, warmup %u frames\n\n", lanes.size(), config.threshold,
+         config.min_blob_pixels, config.warmup_frames);
+
+  if (counted > 0)
+  {
+    printf("DC decode        %8.3f ms/frame avg\n", decode_total_us / counted / 1000);
+    printf("counter          %8.3f ms/frame avg, %.3f ms max", count_total_us / counted / 1000, count_max_us / 1000);
+    if (HAVE_CYCLES)
+      printf(", %.0f cycles (TSC)", (double) count_cycles / counted);
+    printf("\n");
+  }
+
+  if (!truth.empty())
+  {
+    printf("\n");
+    print_errors("per frame", frame_errors);
+    print_errors("published", published_errors);
+  }
+  return 0;
+}
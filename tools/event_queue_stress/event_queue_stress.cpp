@@ -0,0 +1,246 @@
+// Host concurrency stress test of PriorityEventQueue (esp32/event_queue.h).
+//
+// Overflow phase: one thread fills the safety ring and the latch, pushes one
+// more safety event that must overwrite the oldest latched one, and checks
+// that the newest safety state comes out in push order, superseded events
+// skipped, with the latch in its place between older and newer ring entries.
+//
+// Stress phase: several threads push numbered safety events into a tiny
+// safety ring, so the latch is taken all the time, and one more pushes
+// normal events, while the consumer drains the queue the way
+// fsm_process_events() does. Safety events must never be refused and must
+// arrive in their producer's order, each one either delivered or counted as
+// coalesced. Normal events must arrive exactly once and in order, their
+// producer retries an event the queue refused.
+//
+// Events are stamped with the steady clock when they are pushed. The
+// consumer takes the delay to the pop and reports the pushed and delivered
+// events per second and the maximum and 99th percentile delay of each lane.
+//
+// See README.md.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "event_queue.h"
+
+#define SAFETY_PRODUCERS 4
+#define PRODUCERS        (SAFETY_PRODUCERS + 1)  // The last one pushes normal events
+#define PRODUCER_SHIFT   28
+#define SEQUENCE_MASK    ((1u << PRODUCER_SHIFT) - 1)
+
+typedef struct {
+  uint32_t event;         // Producer << PRODUCER_SHIFT | sequence
+  uint32_t timestamp_us;  // Steady clock at push, now_us()
+} test_event_t;
+
+// Small safety ring so producers overflow into the latch
+typedef PriorityEventQueue<test_event_t, 2, 16, SAFETY_PRODUCERS> TestQueue;
+
+// One safety producer: a two-slot latch
+typedef PriorityEventQueue<test_event_t, 2, 16, 1> OverflowQueue;
+
+static uint32_t iterations = 1000000;
+static uint64_t errors = 0;
+
+static std::atomic<int> producers_running(PRODUCERS);
+static std::chrono::steady_clock::time_point epoch;
+
+static void fail(const char *what, uint32_t a, uint32_t b)
+{
+  if (errors++ < 10)
+    printf("%s: %u / %u\n", what, a, b);
+}
+
+// Microseconds since the start, wraps after 71 minutes like micros()
+static uint32_t now_us(void)
+{
+  return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static test_event_t make_event(uint32_t producer, uint32_t sequence)
+{
+  test_event_t event;
+  event.event = (producer << PRODUCER_SHIFT) | sequence;
+  event.timestamp_us = now_us();
+  return event;
+}
+
+static void print_lane(const char *lane, uint32_t pushed, std::vector<uint32_t> &delays, double seconds)
+{
+  uint32_t max_us = 0, p99_us = 0;
+
+  if (!delays.empty())
+  {
+    std::sort(delays.begin(), delays.end());
+    max_us = delays.back();
+    p99_us = delays[(delays.size() - 1) * 99 / 100];
+  }
+  printf("  %-6s pushed %9.0f /s, delivered %9.0f /s, delay max %6u us p99 %6u us\n",
+         lane, pushed / seconds, delays.size() / seconds, max_us, p99_us);
+}
+
+static void overflow_phase(void)
+{
+  static OverflowQueue queue;
+  test_event_t event;
+
+  // Ring (2) and latch (2) take four events, the fifth overwrites 3
+  for (uint32_t i = 1; i <= 5; i++)
+  {
+    if (!queue.push(make_event(0, i), OverflowQueue::LANE_SAFETY))
+      fail("safety event refused (event, -)", i, 0);
+  }
+
+  // Free one ring slot: 6 goes to the ring behind the latched 4 and 5
+  if (!queue.pop(event, now_us()) || event.event != 1)
+    fail("first event (got, expected)", event.event, 1);
+  if (!queue.push(make_event(0, 6), OverflowQueue::LANE_SAFETY))
+    fail("safety event refused (event, -)", 6, 0);
+  queue.push(make_event(0, 100), OverflowQueue::LANE_NORMAL);
+
+  // 5 is newer than 4, which is skipped
+  static const uint32_t expected[] = {2, 5, 6, 100};
+  for (uint32_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+  {
+    if (!queue.pop(event, now_us()) || event.event != expected[i])
+      fail("event order (got, expected)", event.event, expected[i]);
+  }
+  if (!queue.empty())
+    fail("queue not empty (-, -)", 0, 0);
+
+  EventLaneStats stats;
+  queue.get_stats(OverflowQueue::LANE_SAFETY, &stats);
+  if (stats.pushed != 6 || stats.dropped != 0 || stats.coalesced != 2)
+    fail("safety stats (pushed, coalesced)", stats.pushed, stats.coalesced);
+
+  printf("overflow: pushed=%u coalesced=%u dropped=%u\n", stats.pushed, stats.coalesced, stats.dropped);
+}
+
+static void producer_thread(TestQueue *queue, uint32_t producer, uint64_t *refused)
+{
+  TestQueue::Lane lane = producer < SAFETY_PRODUCERS ? TestQueue::LANE_SAFETY : TestQueue::LANE_NORMAL;
+
+  for (uint32_t i = 1; i <= iterations; i++)
+  {
+    while (!queue->push(make_event(producer, i), lane))
+    {
+      if (lane == TestQueue::LANE_SAFETY)
+      {
+        fail("safety event refused (producer, sequence)", producer, i);
+        break;
+      }
+      (*refused)++;
+      std::this_thread::yield();
+    }
+  }
+  producers_running--;
+}
+
+static void stress_phase(void)
+{
+  static TestQueue queue;
+  uint64_t refused[PRODUCERS] = {};
+  uint32_t last[PRODUCERS] = {};
+  uint64_t safety_delivered = 0;
+  std::vector<uint32_t> safety_delays, normal_delays;
+  std::thread producers[PRODUCERS];
+
+  normal_delays.reserve(iterations);
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t p = 0; p < PRODUCERS; p++)
+    producers[p] = std::thread(producer_thread, &queue, p, &refused[p]);
+
+  bool done = false;
+  while (!done)
+  {
+    done = producers_running.load() == 0;
+    bool idle = true;
+
+    test_event_t event;
+    while (queue.pop(event, now_us()))
+    {
+      idle = false;
+      uint32_t delay_us = now_us() - event.timestamp_us;
+
+      uint32_t producer = event.event >> PRODUCER_SHIFT;
+      uint32_t sequence = event.event & SEQUENCE_MASK;
+
+      // Safety events may be coalesced, but never reordered
+      bool in_order = producer < SAFETY_PRODUCERS ? sequence > last[producer] : sequence == last[producer] + 1;
+      if (producer >= PRODUCERS || !in_order)
+      {
+        fail("event out of order (producer, sequence)", producer, sequence);
+        continue;
+      }
+      last[producer] = sequence;
+      if (producer < SAFETY_PRODUCERS)
+      {
+        safety_delivered++;
+        safety_delays.push_back(delay_us);
+      }
+      else
+        normal_delays.push_back(delay_us);
+    }
+
+    // The FSM task would block on its notification here
+    if (idle)
+      std::this_thread::yield();
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for (uint32_t p = 0; p < PRODUCERS; p++)
+    producers[p].join();
+  if (last[SAFETY_PRODUCERS] != iterations)
+    fail("normal events received (count, expected)", last[SAFETY_PRODUCERS], iterations);
+
+  EventLaneStats safety, normal;
+  queue.get_stats(TestQueue::LANE_SAFETY, &safety);
+  queue.get_stats(TestQueue::LANE_NORMAL, &normal);
+
+  if (safety.pushed != SAFETY_PRODUCERS * iterations || safety_delivered + safety.coalesced != safety.pushed)
+    fail("safety events lost (delivered, coalesced)", (uint32_t) safety_delivered, safety.coalesced);
+  if (!queue.empty())
+    fail("queue not empty (-, -)", 0, 0);
+
+  printf("stress: safety pushed=%u delivered=%llu coalesced=%u, normal pushed=%u refused=%llu\n",
+         safety.pushed, (unsigned long long) safety_delivered, safety.coalesced,
+         normal.pushed, (unsigned long long) refused[SAFETY_PRODUCERS]);
+  print_lane("safety", safety.pushed, safety_delays, seconds);
+  print_lane("normal", normal.pushed, normal_delays, seconds);
+}
+
+int main(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+      iterations = (uint32_t) strtoul(argv[++i], NULL, 10);
+  }
+
+  if (iterations == 0 || iterations > SEQUENCE_MASK)
+  {
+    fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+    return 2;
+  }
+
+  epoch = std::chrono::steady_clock::now();
+  auto start = epoch;
+
+  overflow_phase();
+  stress_phase();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%.2f s, %s (%llu errors)\n", seconds, errors == 0 ? "PASS" : "FAIL", (unsigned long long) errors);
+
+  return errors == 0 ? 0 : 1;
+}
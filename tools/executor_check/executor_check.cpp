@@ -0,0 +1,321 @@
+// Host check of the executor's scheduling (esp32/executor.cpp).
+//
+// Registers handlers in the order executor_task() does, on the simulated
+// clock: the timer service, FSM (intersection_control) and motor are the
+// controller's own, the preemption and Socket IO handlers are stand-ins
+// (lwIP and the client library do not build on the host) that consume a
+// datagram or send a status report and return what the real ones return.
+// Emergency requests arrive every couple of minutes, cleared 3 s later.
+//
+// It checks that
+//   - every pass runs each handler once, in registration order
+//   - work a producer handler hands on is finished in the same pass: a
+//     datagram's emergency action, and the phase switch of a timer that
+//     fired, run before the pass ends
+// and counts the passes per second for two layouts:
+//   polled   preemption and Socket IO return 1 ms, as before the socket watcher
+//   watched  they return their real deadlines, the socket watcher wakes the
+//            executor when a datagram arrives (socket_watch.h)
+//
+// See README.md.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+
+#include "executor.h"
+#include "fsm.h"
+#include "intersection_config.h"
+#include "intersection_control.h"
+#include "motor.h"
+#include "host_timer_service.h"
+
+#define SIM_DURATION_US        3600000000ULL  // One hour per layout
+#define EMERGENCY_PERIOD_US    120000000ULL   // One request every 2 min, plus up to 1 min at random
+#define CLEAR_AFTER_US         3000000ULL
+#define STATUS_INTERVAL_MS     2000           // STATUS_UPDATE_INTERVAL_MS
+#define MAX_WATCHED_PASS_RATE  5.0            // Passes per second the watched layout may make
+
+uint64_t sim_clock_us = 0;
+HostSerial Serial;
+
+typedef enum {
+  LAYOUT_POLLED = 0,
+  LAYOUT_WATCHED
+} layout_t;
+
+typedef enum {
+  HANDLER_PREEMPT = 0,
+  HANDLER_SOCKET,
+  HANDLER_TIMER,
+  HANDLER_FSM,
+  HANDLER_MOTOR,
+  HANDLER_WATCH,
+  HANDLER_COUNT
+} handler_id_t;
+
+static layout_t layout;
+
+static uint32_t currentPass;
+static int traceNext;              // Handler expected next in this pass
+static uint32_t producerPass;      // Pass in which a timer fired or a datagram was taken
+
+static bool datagramPending;       // Stand-in for the preemption socket
+static uint64_t datagramArrivalUs;
+static Event datagramEvent;
+static uint64_t statusUs;          // Last status report
+
+static uint32_t orderErrors;
+static uint32_t passErrors;
+static uint32_t emergencies;
+static uint32_t statuses;
+static uint64_t maxPreemptUs;      // Datagram arrival to emergency action
+
+static uint64_t rng_state = 1;
+
+static double rng_uniform(void)
+{
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (double)((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static void trace(handler_id_t id)
+{
+  if (id != traceNext && orderErrors++ < 10)
+    printf("pass %u: handler %d ran, expected %d\n", currentPass, id, traceNext);
+  traceNext = id + 1;
+}
+
+static void check_same_pass(const char *what)
+{
+  if (producerPass != currentPass && passErrors++ < 10)
+    printf("pass %u: %s, its producer ran in pass %u\n", currentPass, what, producerPass);
+}
+
+static uint32_t wait_ms(uint32_t watched)
+{
+  return layout == LAYOUT_POLLED ? 1 : watched;
+}
+
+// ---- Controller hooks ------------------------------------------------------
+
+static void show_phase(uint8_t phase)
+{
+  check_same_pass("phase started");
+}
+
+static void show_emergency(void)
+{
+  check_same_pass("emergency applied");
+
+  uint64_t elapsed = sim_clock_us - datagramArrivalUs;
+  if (elapsed > maxPreemptUs)
+    maxPreemptUs = elapsed;
+  emergencies++;
+}
+
+static const intersection_control_hooks_t controlHooks = { show_phase, show_emergency };
+
+// ---- Handlers, in executor_task() order ------------------------------------
+
+static uint32_t preempt_poll(void)
+{
+  trace(HANDLER_PREEMPT);
+
+  if (datagramPending)
+  {
+    datagramPending = false;
+    producerPass = currentPass;
+    fsm_push_event(&intersectionFsm, datagramEvent);
+  }
+  return wait_ms(EXECUTOR_WAIT_FOREVER);
+}
+
+static uint32_t socket_poll(void)
+{
+  trace(HANDLER_SOCKET);
+
+  uint32_t since_status = (uint32_t)((sim_clock_us - statusUs) / 1000);
+  if (since_status > STATUS_INTERVAL_MS)
+  {
+    statusUs = sim_clock_us;
+    since_status = 0;
+    statuses++;
+  }
+  return wait_ms(STATUS_INTERVAL_MS + 1 - since_status);
+}
+
+static uint32_t timer_poll(void)
+{
+  trace(HANDLER_TIMER);
+
+  if (host_timer_service_next_deadline() <= sim_clock_us)
+    producerPass = currentPass;
+  host_timer_service_run();
+
+  uint64_t next = host_timer_service_next_deadline();
+  if (next == UINT64_MAX)
+    return EXECUTOR_WAIT_FOREVER;
+  return next > sim_clock_us ? (uint32_t)((next - sim_clock_us + 999) / 1000) : 0;
+}
+
+static uint32_t fsm_poll(void)
+{
+  trace(HANDLER_FSM);
+
+  fsm_dispatcher_process();
+  return EXECUTOR_WAIT_FOREVER;
+}
+
+static uint32_t motor_handler(void)
+{
+  trace(HANDLER_MOTOR);
+  return motor_poll();
+}
+
+static uint32_t watch_poll(void)
+{
+  trace(HANDLER_WATCH);
+  return EXECUTOR_WAIT_FOREVER;
+}
+
+// ---- Check -----------------------------------------------------------------
+
+typedef struct {
+  uint32_t passes;
+  double passes_per_s;
+  uint64_t max_preempt_us;
+  uint32_t emergencies;
+  uint32_t statuses;
+} run_results_t;
+
+static void run(layout_t run_layout, uint64_t seed, run_results_t *results)
+{
+  layout = run_layout;
+  rng_state = seed ? seed : 1;
+  sim_clock_us = 0;
+  currentPass = 0;
+  producerPass = 0;
+  datagramPending = false;
+  statusUs = 0;
+  emergencies = 0;
+  statuses = 0;
+  maxPreemptUs = 0;
+
+  host_timer_service_reset();
+  intersection_control_init(SIGNAL_TIMING_WEBSTER, &controlHooks);
+  fsm_push_event(&intersectionFsm, EVENT_START);
+
+  uint64_t next_request_us = EMERGENCY_PERIOD_US / 2;
+  uint64_t clear_us = UINT64_MAX;
+
+  while (sim_clock_us < SIM_DURATION_US)
+  {
+    // Datagrams arriving since the last pass
+    if (sim_clock_us >= next_request_us)
+    {
+      datagramPending = true;
+      datagramArrivalUs = next_request_us;
+      datagramEvent = EVENT_EMERGENCY;
+      clear_us = next_request_us + CLEAR_AFTER_US;
+      next_request_us += EMERGENCY_PERIOD_US + (uint64_t)(rng_uniform() * 60e6);
+    }
+    else if (sim_clock_us >= clear_us)
+    {
+      datagramPending = true;
+      datagramArrivalUs = clear_us;
+      datagramEvent = EVENT_CLEAR_EMERGENCY;
+      clear_us = UINT64_MAX;
+    }
+
+    traceNext = 0;
+    uint32_t wait = executor_poll();
+    if (traceNext != HANDLER_COUNT && orderErrors++ < 10)
+      printf("pass %u: ended after %d handlers\n", currentPass, traceNext);
+    currentPass++;
+
+    // Sleep until the nearest handler deadline. A timer scheduled during
+    // the pass notifies the executor on the board, a datagram only wakes
+    // it through the socket watcher.
+    uint64_t next_us = wait == EXECUTOR_WAIT_FOREVER ? UINT64_MAX : sim_clock_us + (uint64_t)(wait ? wait : 1) * 1000;
+    if (host_timer_service_next_deadline() < next_us)
+      next_us = host_timer_service_next_deadline();
+    if (layout == LAYOUT_WATCHED)
+    {
+      if (next_request_us < next_us)
+        next_us = next_request_us;
+      if (clear_us < next_us)
+        next_us = clear_us;
+    }
+    sim_clock_us = next_us;
+  }
+
+  results->passes = currentPass;
+  results->passes_per_s = currentPass / (SIM_DURATION_US / 1e6);
+  results->max_preempt_us = maxPreemptUs;
+  results->emergencies = emergencies;
+  results->statuses = statuses;
+}
+
+static void print_results(const char *name, const run_results_t *results)
+{
+  printf("%-8s passes %8u (%7.1f /s), emergencies %3u, preemption max %4llu us, status reports %u\n",
+         name, results->passes, results->passes_per_s, results->emergencies,
+         (unsigned long long) results->max_preempt_us, results->statuses);
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t seed = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      seed = strtoull(argv[++i], NULL, 0);
+    else
+    {
+      fprintf(stderr, "usage: %s [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  // As executor_task() registers them, traffic lights left out (GPIO)
+  motor_init();
+  executor_add("preempt", preempt_poll);
+  executor_add("socket", socket_poll);
+  executor_add("timer", timer_poll);
+  executor_add("fsm", fsm_poll);
+  executor_add("motor", motor_handler);
+  executor_add("watch", watch_poll);
+  fsm_dispatcher_add(&intersectionFsm);
+
+  run_results_t polled, watched;
+
+  run(LAYOUT_POLLED, seed, &polled);
+  print_results("polled", &polled);
+
+  run(LAYOUT_WATCHED, seed, &watched);
+  print_results("watched", &watched);
+
+  uint32_t failures = orderErrors + passErrors;
+  if (watched.passes_per_s > MAX_WATCHED_PASS_RATE)
+  {
+    printf("watched: %.1f passes per second\n", watched.passes_per_s);
+    failures++;
+  }
+  if (watched.emergencies != polled.emergencies || watched.max_preempt_us != 0)
+  {
+    printf("watched: %u emergencies, preemption max %llu us\n", watched.emergencies,
+           (unsigned long long) watched.max_preempt_us);
+    failures++;
+  }
+
+  printf("order errors %u, same-pass errors %u, %s\n", orderErrors, passErrors, failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
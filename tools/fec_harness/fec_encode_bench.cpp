@@ -0,0 +1,76 @@
+// Camera side cost of the XOR parity (esp32_camera/fragment_fec.h): time to
+// build the parity fragments of a frame, next to the CRC pass every frame
+// already gets. zlib's crc32() stands in for esp_rom_crc32_le(). See
+// README.md.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+#include "fragment_fec.h"
+#include "fragment_protocol.h"
+
+#define CHUNK_SIZE 1400
+
+static volatile uint32_t sink;
+
+static double now_us()
+{
+  using namespace std::chrono;
+  return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t frame_size = argc > 1 ? (uint32_t) atoi(argv[1]) : 100000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+  static const uint32_t group_sizes[] = {16, 8, 4};
+
+  std::vector<uint8_t> frame(frame_size);
+  for (uint32_t i = 0; i < frame_size; i++)
+    frame[i] = (uint8_t) (rand() >> 7);
+
+  static uint8_t parity[CHUNK_SIZE] __attribute__((aligned(4)));
+  uint32_t fragments = fragment_count_for(frame_size, CHUNK_SIZE);
+
+  double start = now_us();
+  for (int r = 0; r < rounds; r++)
+  {
+    uint32_t crc = 0;
+    for (uint32_t i = 0; i < fragments; i++)
+    {
+      uint32_t offset = i * CHUNK_SIZE;
+      uint32_t length = frame_size - offset < CHUNK_SIZE ? frame_size - offset : CHUNK_SIZE;
+      crc ^= crc32(0, frame.data() + offset, length);
+    }
+    sink = crc;
+  }
+  double crc_us = (now_us() - start) / rounds;
+
+  printf("frame %u bytes, %u fragments\n\n", frame_size, fragments);
+  printf("CRC of all fragments       %8.1f us/frame\n", crc_us);
+
+  for (uint32_t group_size : group_sizes)
+  {
+    uint16_t groups = fragment_fec_groups(fragments, group_size);
+
+    start = now_us();
+    for (int r = 0; r < rounds; r++)
+    {
+      for (uint16_t g = 0; g < groups; g++)
+      {
+        uint16_t length = fragment_fec_parity(frame.data(), frame_size, CHUNK_SIZE, groups, g, parity);
+        sink = crc32(0, parity, length);
+      }
+    }
+    double parity_us = (now_us() - start) / rounds;
+
+    printf("parity, group size %2u      %8.1f us/frame  (%u parity fragments, %.0f%% of the CRC pass)\n",
+           group_size, parity_us, groups, 100.0 * parity_us / crc_us);
+  }
+
+  return 0;
+}
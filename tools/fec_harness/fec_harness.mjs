@@ -0,0 +1,163 @@
+// Loss harness for the camera stream: encodes synthetic frames the way the
+// camera does (data fragments, then XOR parity), drops datagrams with a
+// random or bursty loss model and feeds the rest to the server's
+// reassembler. Prints the share of frames delivered intact and the CPU
+// time spent per frame for every parity group size. See README.md.
+
+import crypto from 'crypto';
+import { encodeFrame, FrameReassembler } from '../../server/frame_reassembler.js';
+
+const options = {
+  frames: 2000,
+  loss: 0.02,
+  burst: 1,
+  minSize: 60000,
+  maxSize: 140000,
+  chunk: 1400,
+  groups: [0, 16, 8, 4],
+  seed: 1,
+};
+
+function usage() {
+  console.log(`usage: node tools/fec_harness/fec_harness.mjs [options]
+
+  --frames N        frames per run (${options.frames})
+  --loss P          average datagram loss ratio (${options.loss})
+  --burst L         average loss burst length in datagrams, 1 = independent losses (${options.burst})
+  --min-size BYTES  smallest frame (${options.minSize})
+  --max-size BYTES  largest frame (${options.maxSize})
+  --chunk BYTES     image bytes per fragment (${options.chunk})
+  --groups LIST     comma separated FEC_GROUP_SIZE values, 0 = no parity (${options.groups.join(',')})
+  --seed N          random seed (${options.seed})`);
+  process.exit(1);
+}
+
+function parseArguments(argv) {
+  const names = {
+    '--frames': 'frames', '--loss': 'loss', '--burst': 'burst', '--min-size': 'minSize', '--max-size': 'maxSize',
+    '--chunk': 'chunk', '--groups': 'groups', '--seed': 'seed',
+  };
+
+  for (let i = 0; i < argv.length; i += 2) {
+    const name = names[argv[i]];
+    if (!name || i + 1 >= argv.length) {
+      usage();
+    }
+    options[name] = name === 'groups' ? argv[i + 1].split(',').map(Number) : Number(argv[i + 1]);
+  }
+
+  if (options.loss < 0 || options.loss >= 1 || options.burst < 1 || options.minSize > options.maxSize) {
+    usage();
+  }
+}
+
+// mulberry32, so every group size sees the same frame sizes and losses
+function random(seed) {
+  let state = seed >>> 0;
+  return () => {
+    state = (state + 0x6D2B79F5) >>> 0;
+    let t = state;
+    t = Math.imul(t ^ (t >>> 15), t | 1);
+    t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+}
+
+// Two-state (Gilbert) channel: every datagram in the bad state is lost.
+// Bursts average `burst` datagrams and the long-run loss is `loss`.
+function lossModel(next) {
+  const leaveBad = 1 / options.burst;
+  const enterBad = options.loss * leaveBad / (1 - options.loss);
+  let bad = false;
+
+  return () => {
+    bad = bad ? next() >= leaveBad : next() < enterBad;
+    return bad;
+  };
+}
+
+function run(groupSize) {
+  const frameRandom = random(options.seed);
+  const lost = lossModel(random(options.seed + 1));
+  let delivered = 0;
+  let corrupt = 0;
+  let current = null;
+
+  // Time is counted in frames: a frame is given up once the next has been sent
+  const reassembler = new FrameReassembler({
+    timeoutMs: 1,
+    onFrame: (frame) => {
+      if (frame.equals(current)) {
+        delivered++;
+      } else {
+        corrupt++;
+      }
+    },
+  });
+
+  let encodeUs = 0;
+  let receiveUs = 0;
+  let sentBytes = 0;
+  let dataBytes = 0;
+
+  for (let n = 1; n <= options.frames; n++) {
+    const size = options.minSize + Math.floor(frameRandom() * (options.maxSize - options.minSize + 1));
+    current = crypto.randomFillSync(Buffer.alloc(size));
+
+    let start = process.cpuUsage();
+    const datagrams = encodeFrame(current, { frameNumber: n, chunkSize: options.chunk, groupSize });
+    encodeUs += process.cpuUsage(start).user;
+
+    dataBytes += size;
+    start = process.cpuUsage();
+    for (const datagram of datagrams) {
+      sentBytes += datagram.length;
+      if (!lost()) {
+        reassembler.push(datagram, n);
+      }
+    }
+    reassembler.expire(n);
+    receiveUs += process.cpuUsage(start).user;
+  }
+
+  reassembler.expire(Infinity);
+  const stats = reassembler.takeStats();
+
+  return {
+    groupSize,
+    delivered: delivered / options.frames,
+    corrupt,
+    overhead: sentBytes / dataBytes - 1,
+    fragmentLoss: stats.fragmentLoss,
+    residualLoss: stats.residualLoss,
+    encodeUs: encodeUs / options.frames,
+    receiveUs: receiveUs / options.frames,
+  };
+}
+
+function main() {
+  parseArguments(process.argv.slice(2));
+
+  console.log(`${options.frames} frames of ${options.minSize}-${options.maxSize} bytes, ` +
+              `loss ${(options.loss * 100).toFixed(1)}%, average burst ${options.burst}\n`);
+  console.log('group  frames ok  bytes sent  chunk loss  after parity  encode us/frame  receive us/frame');
+
+  for (const groupSize of options.groups) {
+    const result = run(groupSize);
+
+    console.log(`${String(groupSize || 'off').padStart(5)}  ` +
+                `${(result.delivered * 100).toFixed(1).padStart(8)}%  ` +
+                `${('+' + (result.overhead * 100).toFixed(1)).padStart(9)}%  ` +
+                `${(result.fragmentLoss * 100).toFixed(2).padStart(9)}%  ` +
+                `${(result.residualLoss * 100).toFixed(2).padStart(11)}%  ` +
+                `${result.encodeUs.toFixed(0).padStart(15)}  ` +
+                `${result.receiveUs.toFixed(0).padStart(16)}` +
+                (result.corrupt > 0 ? `  ${result.corrupt} CORRUPT` : ''));
+  }
+
+  console.log('\nbytes sent: headers and parity on top of the JPEG bytes. Encode and receive are');
+  console.log('host CPU time of this JavaScript; tools/fec_harness/fec_encode_bench.cpp measures');
+  console.log('the camera side code.');
+}
+
+main();
@@ -0,0 +1,85 @@
+#ifndef _FOOTAGE_H_
+#define _FOOTAGE_H_
+
+// Recorded camera footage for the host tools: JPEG files and MJPEG streams
+// (concatenated JPEGs) split into frames.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Block luma image (esp32_camera/jpeg_dc.h) of frames up to 2048x2048
+#define FOOTAGE_LUMA_SIZE ((2048 / 8) * (2048 / 8))
+
+// Length of the JPEG starting at data, up to and including EOI; 0 if it
+// does not end in this buffer
+static inline size_t footage_jpeg_length(const uint8_t *data, size_t length)
+{
+  size_t position = 2;
+  bool entropy = false;
+
+  while (position + 1 < length)
+  {
+    if (data[position] != 0xFF)
+    {
+      if (!entropy)
+        return 0;
+      position++;
+      continue;
+    }
+
+    uint8_t marker = data[position + 1];
+    if (marker == 0xD9)
+      return position + 2;
+    if (marker == 0xFF || (entropy && (marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7))))
+    {
+      position += marker == 0xFF ? 1 : 2;
+      continue;
+    }
+
+    if (position + 4 > length)
+      return 0;
+    position += 2 + ((data[position + 2] << 8) | data[position + 3]);
+    entropy = marker == 0xDA;
+  }
+  return 0;
+}
+
+// Every JPEG in the file; a single image is a stream of one
+static inline bool footage_read(const char *path, std::vector<std::vector<uint8_t>> *frames)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+
+  std::vector<uint8_t> data;
+  uint8_t buffer[65536];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + count);
+  fclose(file);
+
+  size_t found = 0;
+  for (size_t position = 0; position + 2 < data.size(); position++)
+  {
+    if (data[position] != 0xFF || data[position + 1] != 0xD8)
+      continue;
+
+    size_t length = footage_jpeg_length(data.data() + position, data.size() - position);
+    if (length == 0)
+      break;
+
+    frames->emplace_back(data.begin() + position, data.begin() + position + length);
+    position += length - 1;
+    found++;
+  }
+
+  if (found == 0)
+    fprintf(stderr, "%s: no JPEG frames\n", path);
+  return found > 0;
+}
+
+#endif //_FOOTAGE_H_
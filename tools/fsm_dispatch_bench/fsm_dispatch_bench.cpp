@@ -0,0 +1,95 @@
+// Host microbenchmark of the FSM dispatcher (esp32/fsm.cpp) as the number
+// of instances grows.
+//
+// Every instance runs the intersection's transition table with an empty
+// action, so only the dispatcher's own work is timed. For each instance
+// count it measures:
+//   idle   fsm_dispatcher_process() with every queue empty, the pass the
+//          dispatcher task makes after each wake-up
+//   one    an event pushed to one instance and dispatched (push included)
+//   all    an event pushed to every instance and dispatched, per event
+//
+// See README.md.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <Arduino.h>
+
+#include "fsm.h"
+#include "intersection_fsm.h"
+
+#define BENCH_ROUNDS 2000000
+
+uint64_t sim_clock_us = 0;
+HostSerial Serial;
+
+static uint64_t actions = 0;
+
+static void count_action(Fsm *fsm, State nextState)
+{
+  actions++;
+}
+
+static constexpr IntersectionTransitions transitions = intersection_build_transitions(count_action, count_action);
+static constexpr TransitionTable transitionTable = fsm_make_table(transitions.items);
+
+static Fsm instances[FSM_MAX_INSTANCES];
+
+template <typename Body>
+static double time_rounds(uint32_t rounds, Body body)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; i++)
+    body(i);
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() / rounds;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t rounds = BENCH_ROUNDS;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+      rounds = (uint32_t) strtoul(argv[++i], NULL, 10);
+  }
+
+  printf("%9s %9s %9s %12s\n", "instances", "idle ns", "one ns", "all ns/event");
+
+  int count = 0;
+  for (int target = 1; target <= FSM_MAX_INSTANCES; target *= 2)
+  {
+    // Instances stay registered, add the new ones
+    for (; count < target; count++)
+    {
+      fsm_init(&instances[count], (uint8_t) count, intersection_phase_state(FIRST_PHASE), &transitionTable, NULL);
+      fsm_dispatcher_add(&instances[count]);
+    }
+
+    double idle_ns = time_rounds(rounds, [](uint32_t) {
+      fsm_dispatcher_process();
+    });
+
+    double one_ns = time_rounds(rounds, [count](uint32_t i) {
+      fsm_push_event(&instances[i % count], EVENT_SWITCH);
+      fsm_dispatcher_process();
+    });
+
+    double all_ns = time_rounds(rounds / count, [count](uint32_t) {
+      for (int f = 0; f < count; f++)
+        fsm_push_event(&instances[f], EVENT_SWITCH);
+      fsm_dispatcher_process();
+    }) / count;
+
+    printf("%9d %9.1f %9.1f %12.1f\n", count, idle_ns, one_ns, all_ns);
+  }
+
+  printf("actions run: %llu\n", (unsigned long long) actions);
+  return 0;
+}
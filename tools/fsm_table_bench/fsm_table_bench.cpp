@@ -0,0 +1,164 @@
+// Host microbenchmark of the FSM transition lookup.
+//
+// Compares the dense State x Event table of esp32/fsm_table.h with the
+// linear scan over the transition list that find_transition() used before,
+// first on the intersection's own transitions (intersection_fsm.h), then on
+// synthetic machines as the number of states and events grows. Lookups are
+// drawn from the transitions in the list plus one miss in eight (an event
+// the current state ignores). It prints ns per lookup and the bytes each
+// form takes, since the table grows with states x events rather than with
+// the number of transitions.
+//
+// See README.md.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <Arduino.h>
+
+#include "fsm.h"
+#include "intersection_fsm.h"
+
+#define BENCH_LOOKUPS  20000000
+#define BENCH_QUERIES  4096      // Power of two, cycled through
+#define BENCH_EVENTS_PER_STATE 3 // Like a phase state: switch, emergency, one more
+
+uint64_t sim_clock_us = 0;
+HostSerial Serial;
+
+static void phase_action(Fsm *fsm, State nextState) {}
+
+static constexpr IntersectionTransitions intersection = intersection_build_transitions(phase_action, phase_action);
+
+// Same layout as Transition, with plain indices for the synthetic machines
+typedef struct {
+  uint16_t currentState;
+  uint16_t nextState;
+  uint16_t transitionEvent;
+  ActionFunction action;
+} BenchTransition;
+
+typedef struct {
+  uint16_t state;
+  uint16_t event;
+} bench_query_t;
+
+static uint64_t rng_state = 1;
+
+static uint32_t rng_next(void)
+{
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (uint32_t)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+// The lookup fsm.cpp did before the table
+template <typename T>
+static const T *scan_find(const T *transitions, size_t count, size_t state, size_t event)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    if ((size_t) transitions[i].currentState == state && (size_t) transitions[i].transitionEvent == event)
+      return &transitions[i];
+  }
+  return NULL;
+}
+
+// Queries drawn from the list, one in eight replaced by a miss
+template <typename T>
+static void make_queries(const T *transitions, size_t count, size_t events, bench_query_t *queries)
+{
+  for (size_t q = 0; q < BENCH_QUERIES; q++)
+  {
+    const T &t = transitions[rng_next() % count];
+    queries[q].state = (uint16_t) t.currentState;
+    queries[q].event = (uint16_t) t.transitionEvent;
+    if ((rng_next() & 7) == 0)
+    {
+      queries[q].event = (uint16_t) (rng_next() % events);
+      if (scan_find(transitions, count, queries[q].state, queries[q].event) == NULL)
+        continue;
+      // Landed on a real transition, use an event past the table instead
+      queries[q].event = (uint16_t) events;
+    }
+  }
+}
+
+template <typename Lookup>
+static double time_lookups(const bench_query_t *queries, Lookup lookup, uintptr_t *check)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  uintptr_t sum = 0;
+  for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+  {
+    const bench_query_t &q = queries[i & (BENCH_QUERIES - 1)];
+    sum += (uintptr_t) lookup(q.state, q.event);
+  }
+
+  auto stop = std::chrono::steady_clock::now();
+  *check += sum;
+  return std::chrono::duration<double, std::nano>(stop - start).count() / BENCH_LOOKUPS;
+}
+
+template <typename T, size_t NUM_STATES, size_t NUM_EVENTS, size_t N>
+static void run(const char *name, const T (&transitions)[N])
+{
+  static bench_query_t queries[BENCH_QUERIES];
+  // Built at run time here, the firmware builds it at compile time
+  static const FsmTable<T, NUM_STATES, NUM_EVENTS> table = fsm_build_table<T, NUM_STATES, NUM_EVENTS>(transitions);
+  uintptr_t check = 0;
+
+  make_queries(transitions, N, NUM_EVENTS, queries);
+
+  double scan_ns = time_lookups(queries, [&](size_t s, size_t e) { return scan_find(transitions, N, s, e); }, &check);
+  double table_ns = time_lookups(queries, [&](size_t s, size_t e) { return table.find(s, e); }, &check);
+
+  printf("%-14s %4zu %4zu %5zu %8.2f %8.2f %8zu %9zu   (check %u)\n", name, NUM_STATES, NUM_EVENTS, N,
+         scan_ns, table_ns, sizeof(transitions), sizeof(table), (unsigned) (check & 0xFFFF));
+}
+
+// Synthetic machine: every state handles BENCH_EVENTS_PER_STATE events
+template <size_t NUM_STATES, size_t NUM_EVENTS>
+static void run_synthetic(void)
+{
+  static BenchTransition transitions[NUM_STATES * BENCH_EVENTS_PER_STATE];
+  size_t n = 0;
+
+  for (size_t s = 0; s < NUM_STATES; s++)
+  {
+    for (size_t k = 0; k < BENCH_EVENTS_PER_STATE; k++)
+    {
+      transitions[n].currentState = (uint16_t) s;
+      transitions[n].nextState = (uint16_t) ((s + k + 1) % NUM_STATES);
+      transitions[n].transitionEvent = (uint16_t) ((s * 7 + k * (NUM_EVENTS / BENCH_EVENTS_PER_STATE)) % NUM_EVENTS);
+      transitions[n].action = phase_action;
+      n++;
+    }
+  }
+
+  run<BenchTransition, NUM_STATES, NUM_EVENTS>("synthetic", transitions);
+}
+
+int main(int argc, char **argv)
+{
+  printf("%-14s %4s %4s %5s %8s %8s %8s %9s\n", "machine", "S", "E", "trans", "scan ns", "table ns", "list B", "table B");
+
+  run<Transition, STATE_COUNT, EVENT_COUNT>("intersection", intersection.items);
+
+  run_synthetic<8, 8>();
+  run_synthetic<16, 16>();
+  run_synthetic<32, 16>();
+  run_synthetic<64, 16>();
+  run_synthetic<64, 32>();
+  run_synthetic<128, 32>();
+  run_synthetic<256, 64>();
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Replays recorded camera footage through the camera's motion gate
+// (esp32_camera/motion_gate.h) and reports what gating saves: frames and
+// bytes not sent, and frames the detector does not have to process.
+// Input is JPEG files or MJPEG streams (concatenated JPEGs), taken as
+// captured at --fps. See README.md.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "footage.h"
+#include "fragment_fec.h"
+#include "fragment_protocol.h"
+#include "jpeg_dc.h"
+#include "motion_gate.h"
+#include "stream_config.h"
+
+typedef struct {
+  double fps;
+  motion_gate_config_t gate;
+  bool verbose;
+} options_t;
+
+static options_t options = {STREAM_FPS, {MOTION_CELL_DELTA, MOTION_CHANGED_CELLS, MOTION_KEYFRAME_MS}, false};
+
+static double now_us()
+{
+  using namespace std::chrono;
+  return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void usage()
+{
+  printf("usage: motion_replay [options] FILE...\n\n"
+         "  FILE              JPEG image or MJPEG stream, frames in the order given\n"
+         "  --fps N           rate the footage was captured at (%g)\n"
+         "  --cell-delta N    MOTION_CELL_DELTA (%u)\n"
+         "  --changed-cells N MOTION_CHANGED_CELLS (%u)\n"
+         "  --keyframe-ms N   MOTION_KEYFRAME_MS (%u)\n"
+         "  --verbose         one line per frame\n",
+         options.fps, options.gate.cell_delta, options.gate.changed_cells, (unsigned) options.gate.keyframe_ms);
+  exit(1);
+}
+
+// Bytes the camera puts on the air for a frame: headers and FEC parity
+// included, as frame_sender.cpp sends it
+static uint64_t air_bytes(size_t frame_size)
+{
+  uint32_t fragments = fragment_count_for((uint32_t) frame_size, CHUNK_SIZE);
+  uint32_t parity = fragment_fec_groups(fragments, FEC_GROUP_SIZE);
+  uint64_t header = sizeof(fragment_header_t);
+  return frame_size + fragments * header + parity * (header + CHUNK_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::vector<uint8_t>> frames;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string argument = argv[i];
+    bool has_value = i + 1 < argc;
+
+    if (argument == "--verbose")
+      options.verbose = true;
+    else if (argument == "--fps" && has_value)
+      options.fps = atof(argv[++i]);
+    else if (argument == "--cell-delta" && has_value)
+      options.gate.cell_delta = (uint8_t) atoi(argv[++i]);
+    else if (argument == "--changed-cells" && has_value)
+      options.gate.changed_cells = (uint16_t) atoi(argv[++i]);
+    else if (argument == "--keyframe-ms" && has_value)
+      options.gate.keyframe_ms = (uint32_t) atoi(argv[++i]);
+    else if (argument.rfind("--", 0) == 0)
+      usage();
+    else if (!footage_read(argv[i], &frames))
+      return 1;
+  }
+
+  if (frames.empty() || options.fps <= 0)
+    usage();
+
+  static motion_gate_t gate;
+  static jpeg_dc_t jpeg;
+  static uint8_t luma[FOOTAGE_LUMA_SIZE];
+  motion_gate_init(&gate, &options.gate);
+
+  uint32_t decisions[MOTION_SEND_UNDECODED + 1] = {};
+  uint64_t bytes_all = 0;
+  uint64_t bytes_sent = 0;
+  double gate_total_us = 0;
+  double gate_max_us = 0;
+  static const char *names[] = {"skip", "changed", "keyframe", "undecoded"};
+
+  for (size_t n = 0; n < frames.size(); n++)
+  {
+    const std::vector<uint8_t> &frame = frames[n];
+    uint32_t now_ms = (uint32_t) (n * 1000 / options.fps);
+
+    // Decode included, as on the camera
+    double start = now_us();
+    bool decoded = jpeg_dc_luma_image(&jpeg, frame.data(), frame.size(), luma, sizeof(luma));
+    motion_decision_t decision =
+        motion_gate_check(&gate, decoded ? luma : NULL, jpeg.blocks_w, jpeg.blocks_h, now_ms);
+    double elapsed = now_us() - start;
+
+    gate_total_us += elapsed;
+    if (elapsed > gate_max_us)
+      gate_max_us = elapsed;
+
+    decisions[decision]++;
+    bytes_all += air_bytes(frame.size());
+    if (decision != MOTION_SKIP)
+      bytes_sent += air_bytes(frame.size());
+
+    if (options.verbose)
+      printf("%6zu %8u ms %7zu bytes %3u changed  %s\n", n, (unsigned) now_ms, frame.size(), gate.changed,
+             names[decision]);
+  }
+
+  size_t total = frames.size();
+  size_t sent = total - decisions[MOTION_SKIP];
+  double seconds = total / options.fps;
+
+  if (options.verbose)
+    printf("\n");
+  printf("%zu frames, %.1f s at %g fps, cell delta %u, changed cells %u, keyframe %u ms\n\n", total, seconds,
+         options.fps, options.gate.cell_delta, options.gate.changed_cells, (unsigned) options.gate.keyframe_ms);
+  printf("sent             %7zu  (%u changed, %u keyframes, %u undecoded)\n", sent,
+         decisions[MOTION_SEND_CHANGED], decisions[MOTION_SEND_KEYFRAME], decisions[MOTION_SEND_UNDECODED]);
+  printf("skipped          %7u  %.1f%%\n", decisions[MOTION_SKIP], 100.0 * decisions[MOTION_SKIP] / total);
+  printf("bandwidth        %7.2f Mbit/s instead of %.2f, saved %.1f%%\n", bytes_sent * 8 / seconds / 1e6,
+         bytes_all * 8 / seconds / 1e6, bytes_all ? 100.0 * (bytes_all - bytes_sent) / bytes_all : 0.0);
+  printf("detector         %7.1f frames/s instead of %.1f, saved %.1f%%\n", sent / seconds, total / seconds,
+         100.0 * (total - sent) / total);
+  printf("gate on host     %7.2f ms/frame avg, %.2f ms max\n", gate_total_us / total / 1000, gate_max_us / 1000);
+  return 0;
+}
@@ -0,0 +1,277 @@
+// Emergency vehicle preemption sender for the controller's direct UDP
+// channel (esp32/preemption_protocol.h). Sends authenticated requests and
+// clears, retransmits until acknowledged and measures the time to the
+// acknowledgement and to the "applied" acknowledgement sent once the
+// emergency phase is set. See README.md.
+
+import udp from 'dgram';
+import crypto from 'crypto';
+
+const PREEMPTION_MAGIC = 0xE7;
+const PREEMPTION_VERSION = 1;
+const PREEMPTION_MESSAGE_SIZE = 24;
+const PREEMPTION_SIGNED_SIZE = 16;
+const PREEMPTION_TAG_SIZE = 8;
+
+const PREEMPTION_REQUEST = 0x01;
+const PREEMPTION_CLEAR = 0x02;
+const PREEMPTION_ACK = 0x81;
+
+const STATUS_NAMES = ['accepted', 'duplicate', 'stale', 'busy', 'applied'];
+const STATUS_ACCEPTED = 0;
+const STATUS_DUPLICATE = 1;
+const STATUS_STALE = 2;
+const STATUS_BUSY = 3;
+const STATUS_APPLIED = 4;
+
+// Sessions count tenths of a second since 2024, so a restarted sender is
+// always newer than the last one the controller saw
+const SESSION_EPOCH_MS = Date.UTC(2024, 0, 1);
+
+const options = {
+  host: process.env.PREEMPTION_HOST || '192.168.1.50',
+  port: Number(process.env.PREEMPTION_PORT || 4211),
+  key: process.env.PREEMPTION_KEY || 'change-me-preemption-key',
+  count: 20,
+  interval: 2000,
+  retryMs: 20,
+  retries: 10,
+  appliedTimeout: 2000,
+};
+
+function usage() {
+  console.log(`usage: node tools/preemption_sender/preempt.js <request|clear|bench> [options]
+
+  --host ADDR         controller address (PREEMPTION_HOST, ${options.host})
+  --port N            controller port (PREEMPTION_PORT, ${options.port})
+  --key TEXT          shared HMAC key (PREEMPTION_KEY)
+  --count N           bench: request/clear rounds (${options.count})
+  --interval MS       bench: time between rounds (${options.interval})
+  --retry-ms MS       retransmit period until acknowledged (${options.retryMs})
+  --retries N         retransmissions before giving up (${options.retries})
+  --applied-timeout MS  wait for the emergency phase (${options.appliedTimeout})`);
+  process.exit(1);
+}
+
+function parseArguments(argv) {
+  const command = argv[0];
+  const names = {
+    '--host': 'host', '--port': 'port', '--key': 'key', '--count': 'count',
+    '--interval': 'interval', '--retry-ms': 'retryMs', '--retries': 'retries', '--applied-timeout': 'appliedTimeout',
+  };
+
+  for (let i = 1; i < argv.length; i += 2) {
+    const name = names[argv[i]];
+    if (!name || i + 1 >= argv.length) {
+      usage();
+    }
+    options[name] = name === 'host' || name === 'key' ? argv[i + 1] : Number(argv[i + 1]);
+  }
+
+  if (!['request', 'clear', 'bench'].includes(command)) {
+    usage();
+  }
+  return command;
+}
+
+function tag(buffer) {
+  return crypto.createHmac('sha256', options.key)
+    .update(buffer.subarray(0, PREEMPTION_SIGNED_SIZE))
+    .digest()
+    .subarray(0, PREEMPTION_TAG_SIZE);
+}
+
+function encode(type, arg, session, sequence) {
+  const buffer = Buffer.alloc(PREEMPTION_MESSAGE_SIZE);
+
+  buffer.writeUInt8(PREEMPTION_MAGIC, 0);
+  buffer.writeUInt8(PREEMPTION_VERSION, 1);
+  buffer.writeUInt8(type, 2);
+  buffer.writeUInt8(arg, 3);
+  buffer.writeUInt32LE(session >>> 0, 4);
+  buffer.writeUInt32LE(sequence >>> 0, 8);
+  buffer.writeUInt32LE(Date.now() >>> 0, 12);
+  tag(buffer).copy(buffer, PREEMPTION_SIGNED_SIZE);
+
+  return buffer;
+}
+
+// null unless an authentic acknowledgement
+function decodeAck(buffer) {
+  if (buffer.length < PREEMPTION_MESSAGE_SIZE ||
+      buffer.readUInt8(0) !== PREEMPTION_MAGIC ||
+      buffer.readUInt8(1) !== PREEMPTION_VERSION ||
+      buffer.readUInt8(2) !== PREEMPTION_ACK) {
+    return null;
+  }
+  if (!crypto.timingSafeEqual(tag(buffer), buffer.subarray(PREEMPTION_SIGNED_SIZE, PREEMPTION_MESSAGE_SIZE))) {
+    return null;
+  }
+
+  return {
+    status: buffer.readUInt8(3),
+    session: buffer.readUInt32LE(4),
+    sequence: buffer.readUInt32LE(8),
+    elapsedUs: buffer.readUInt32LE(12),
+  };
+}
+
+class PreemptionSender {
+  constructor() {
+    this.socket = udp.createSocket('udp4');
+    this.session = Math.floor((Date.now() - SESSION_EPOCH_MS) / 100) >>> 0;
+    this.sequence = 0;
+    this.waiters = new Map();
+
+    this.socket.on('message', (message) => {
+      const ack = decodeAck(message);
+      if (!ack || ack.session !== this.session) {
+        return;
+      }
+      const waiter = this.waiters.get(ack.sequence);
+      if (waiter) {
+        waiter(ack);
+      }
+    });
+  }
+
+  // Resolves with the timings of one request or clear
+  send(type) {
+    const sequence = ++this.sequence;
+    const datagram = encode(type, 0, this.session, sequence);
+    const start = process.hrtime.bigint();
+    const elapsedMs = () => Number(process.hrtime.bigint() - start) / 1e6;
+
+    return new Promise((resolve) => {
+      const result = { sequence, ackMs: null, appliedMs: null, status: null, controllerApplyUs: null, transmissions: 0 };
+      let retryTimer = null;
+      let appliedTimer = null;
+
+      const finish = () => {
+        clearTimeout(retryTimer);
+        clearTimeout(appliedTimer);
+        this.waiters.delete(sequence);
+        resolve(result);
+      };
+
+      const transmit = () => {
+        if (result.transmissions > options.retries) {
+          finish();
+          return;
+        }
+        result.transmissions++;
+        this.socket.send(datagram, options.port, options.host);
+        retryTimer = setTimeout(transmit, options.retryMs);
+      };
+
+      this.waiters.set(sequence, (ack) => {
+        if (ack.status === STATUS_APPLIED) {
+          // May overtake the first acknowledgement
+          result.appliedMs = elapsedMs();
+          result.controllerApplyUs = ack.elapsedUs;
+          if (result.ackMs === null) {
+            result.ackMs = result.appliedMs;
+            result.status = STATUS_ACCEPTED;
+          }
+          finish();
+          return;
+        }
+
+        if (ack.status === STATUS_BUSY) {
+          return;  // Keep retransmitting
+        }
+
+        if (result.ackMs === null) {
+          result.ackMs = elapsedMs();
+          result.status = ack.status;
+          clearTimeout(retryTimer);
+
+          if (type !== PREEMPTION_REQUEST || ack.status === STATUS_STALE) {
+            finish();
+          } else {
+            appliedTimer = setTimeout(finish, options.appliedTimeout);
+          }
+        }
+      });
+
+      transmit();
+    });
+  }
+
+  close() {
+    this.socket.close();
+  }
+}
+
+function describe(name, result) {
+  if (result.ackMs === null) {
+    return `${name} #${result.sequence}: no acknowledgement after ${result.transmissions} transmissions`;
+  }
+
+  let line = `${name} #${result.sequence}: ${STATUS_NAMES[result.status]} in ${result.ackMs.toFixed(2)} ms` +
+             ` (${result.transmissions} transmissions)`;
+  if (result.appliedMs !== null) {
+    line += `, emergency phase after ${result.appliedMs.toFixed(2)} ms` +
+            ` (${(result.controllerApplyUs / 1000).toFixed(2)} ms inside the controller)`;
+  } else if (name === 'request' && result.status !== STATUS_STALE) {
+    line += ', not applied';
+  }
+  return line;
+}
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) {
+    return NaN;
+  }
+  return sorted[Math.min(sorted.length - 1, Math.ceil(p * sorted.length) - 1)];
+}
+
+function summarize(name, values) {
+  const sorted = values.filter((v) => v !== null).sort((a, b) => a - b);
+  const format = (v) => (Number.isNaN(v) ? '-' : v.toFixed(2));
+  console.log(`${name.padEnd(22)} n=${sorted.length} min=${format(sorted[0] ?? NaN)} p50=${format(percentile(sorted, 0.5))}` +
+              ` p95=${format(percentile(sorted, 0.95))} max=${format(sorted[sorted.length - 1] ?? NaN)} ms`);
+}
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+async function main() {
+  const command = parseArguments(process.argv.slice(2));
+  const sender = new PreemptionSender();
+
+  if (command === 'request') {
+    console.log(describe('request', await sender.send(PREEMPTION_REQUEST)));
+  } else if (command === 'clear') {
+    console.log(describe('clear', await sender.send(PREEMPTION_CLEAR)));
+  } else {
+    const ack = [];
+    const applied = [];
+    const inside = [];
+    let lost = 0;
+
+    for (let round = 0; round < options.count; round++) {
+      const request = await sender.send(PREEMPTION_REQUEST);
+      console.log(describe('request', request));
+      if (request.ackMs === null || request.appliedMs === null) {
+        lost++;
+      }
+      ack.push(request.ackMs);
+      applied.push(request.appliedMs);
+      inside.push(request.controllerApplyUs === null ? null : request.controllerApplyUs / 1000);
+
+      await sleep(options.interval / 2);
+      console.log(describe('clear', await sender.send(PREEMPTION_CLEAR)));
+      await sleep(options.interval / 2);
+    }
+
+    console.log();
+    summarize('request acknowledged', ack);
+    summarize('emergency phase set', applied);
+    summarize('inside the controller', inside);
+    console.log(`rounds without an applied acknowledgement: ${lost}/${options.count}`);
+  }
+
+  sender.close();
+}
+
+main();
@@ -0,0 +1,253 @@
+// Host test of FSM event latency while the pump moves.
+//
+// Runs the controller's timer service, FSM (intersection_control) and
+// motor as executor handlers in the firmware's order on a simulated
+// clock. Every trial opens the pump from the FSM task, the way
+// traffic_control_poll() runs TRAFFIC_COMMAND_PUMP_OPEN, then raises an
+// emergency at a random point of the travel. The emergency action closes
+// the pump again, as emergency_action() does.
+//
+// Two pump implementations are compared:
+//   async     the firmware's: motor_move_to() queues the target and returns,
+//             motor.cpp ramps it from its own handler
+//   blocking  the one before the timer service and motor task: the FSM task
+//             sat in vTaskDelay(PUMP_DURATION_MS) while the pump ran
+//
+// For each it reports the latency of the emergency events (push to action
+// done) on the simulated clock, and the longest executor pass on the host
+// while the pump moved. The async run must dispatch every emergency within
+// one millisecond and leave the pump closed after every trial, or the test
+// fails.
+//
+// See README.md.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <Arduino.h>
+
+#include "executor.h"
+#include "fsm.h"
+#include "intersection_config.h"
+#include "intersection_control.h"
+#include "motor.h"
+#include "host_timer_service.h"
+
+#define TRIAL_PERIOD_US      60000000ULL  // One pump operation a minute, at a random point of the cycle
+#define CLEAR_AFTER_US       3000000ULL   // Emergency cleared 3 s after it was raised
+#define DEFAULT_TRIALS       1000
+
+uint64_t sim_clock_us = 0;
+HostSerial Serial;
+
+typedef enum {
+  PUMP_ASYNC = 0,
+  PUMP_BLOCKING
+} pump_mode_t;
+
+static pump_mode_t mode;
+static bool pumpOpenRequested;         // Posted to the FSM task, like TRAFFIC_COMMAND_PUMP_OPEN
+static uint64_t fsmBusyUntilUs;        // Blocking pump: the FSM task is in vTaskDelay
+static uint32_t pumpCloses;
+
+static uint64_t rng_state = 1;
+
+static double rng_uniform(void)
+{
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (double)((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static void move_pump(uint16_t position)
+{
+  motor_move_to(position, NULL, NULL);
+  if (mode == PUMP_BLOCKING)
+    fsmBusyUntilUs = sim_clock_us + (uint64_t) PUMP_DURATION_MS * 1000;
+}
+
+// ---- Controller hooks and executor handlers, as in esp32.ino ---------------
+
+static void show_phase(uint8_t phase)
+{
+}
+
+static void show_emergency(void)
+{
+  pumpCloses++;
+  move_pump(MOTOR_POSITION_CLOSED);
+}
+
+static const intersection_control_hooks_t controlHooks = { show_phase, show_emergency };
+
+static uint32_t timer_poll(void)
+{
+  host_timer_service_run();
+
+  uint64_t next = host_timer_service_next_deadline();
+  if (next == UINT64_MAX)
+    return EXECUTOR_WAIT_FOREVER;
+  return next > sim_clock_us ? (uint32_t)((next - sim_clock_us + 999) / 1000) : 0;
+}
+
+static uint32_t fsm_poll(void)
+{
+  // Blocking pump: nothing runs on the FSM task until the delay is over
+  if (sim_clock_us < fsmBusyUntilUs)
+    return (uint32_t)((fsmBusyUntilUs - sim_clock_us + 999) / 1000);
+
+  if (pumpOpenRequested)
+  {
+    pumpOpenRequested = false;
+    move_pump(MOTOR_POSITION_OPEN);
+    if (mode == PUMP_BLOCKING)
+      return PUMP_DURATION_MS;
+  }
+
+  fsm_dispatcher_process();
+  return EXECUTOR_WAIT_FOREVER;
+}
+
+// ---- Test ------------------------------------------------------------------
+
+typedef struct {
+  FsmLatencyStats safety;      // Emergency and clear
+  double max_pass_us;          // Host time of the longest pass while the pump moved
+  uint32_t failures;
+} run_results_t;
+
+static void run(pump_mode_t pump_mode, uint32_t trials, uint64_t seed, run_results_t *results)
+{
+  memset(results, 0, sizeof(*results));
+  mode = pump_mode;
+  rng_state = seed ? seed : 1;
+  sim_clock_us = 0;
+  pumpOpenRequested = false;
+  fsmBusyUntilUs = 0;
+  pumpCloses = 0;
+
+  host_timer_service_reset();
+  intersection_control_init(SIGNAL_TIMING_WEBSTER, &controlHooks);
+  fsm_push_event(&intersectionFsm, EVENT_START);
+
+  uint64_t next_open_us = TRIAL_PERIOD_US / 2;
+  uint64_t emergency_us = UINT64_MAX;
+  uint64_t clear_us = UINT64_MAX;
+  uint32_t trial = 0;
+  while (true)
+  {
+    // Producers running in other tasks, each would wake the executor
+    if (sim_clock_us >= next_open_us)
+    {
+      if (trial > 0 && motor_get_position() != MOTOR_POSITION_CLOSED)
+      {
+        printf("trial %u: pump left at %u permille\n", trial, motor_get_position());
+        results->failures++;
+      }
+      if (trial == trials)
+        break;
+
+      pumpOpenRequested = true;
+      emergency_us = sim_clock_us + 1000 + (uint64_t)(rng_uniform() * (PUMP_DURATION_MS - 1) * 1000);
+      clear_us = emergency_us + CLEAR_AFTER_US;
+      next_open_us += TRIAL_PERIOD_US + (uint64_t)(rng_uniform() * 10e6);
+      trial++;
+    }
+    if (sim_clock_us >= emergency_us)
+    {
+      fsm_push_event(&intersectionFsm, EVENT_EMERGENCY);
+      emergency_us = UINT64_MAX;
+    }
+    if (sim_clock_us >= clear_us)
+    {
+      fsm_push_event(&intersectionFsm, EVENT_CLEAR_EMERGENCY);
+      clear_us = UINT64_MAX;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t wait_ms = executor_poll();
+    double pass_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if (motor_is_moving() && pass_us > results->max_pass_us)
+      results->max_pass_us = pass_us;
+
+    // Sleep until the nearest handler deadline or producer. A timer
+    // scheduled during the pass notifies the executor on the board.
+    uint64_t next_us = wait_ms == EXECUTOR_WAIT_FOREVER ? UINT64_MAX : sim_clock_us + (uint64_t)(wait_ms ? wait_ms : 1) * 1000;
+    if (host_timer_service_next_deadline() < next_us)
+      next_us = host_timer_service_next_deadline();
+    if (next_open_us < next_us)
+      next_us = next_open_us;
+    if (emergency_us < next_us)
+      next_us = emergency_us;
+    if (clear_us < next_us)
+      next_us = clear_us;
+    sim_clock_us = next_us;
+  }
+
+  fsm_get_latency_stats(&intersectionFsm, &results->safety, NULL);
+
+  if (pumpCloses != trials)
+  {
+    printf("%u emergencies closed the pump, expected %u\n", pumpCloses, trials);
+    results->failures++;
+  }
+}
+
+static void print_results(const char *name, const run_results_t *results)
+{
+  printf("%-9s emergency latency avg %7.1f ms p99 %7.1f ms max %7.1f ms, longest pass while moving %.1f us\n",
+         name,
+         results->safety.avg_us / 1000.0,
+         fsm_latency_percentile(&results->safety, 990) / 1000.0,
+         results->safety.max_us / 1000.0,
+         results->max_pass_us);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t trials = DEFAULT_TRIALS;
+  uint64_t seed = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc)
+      trials = (uint32_t) strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      seed = strtoull(argv[++i], NULL, 0);
+    else
+    {
+      fprintf(stderr, "usage: %s [--trials N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  motor_init();
+  executor_add("timer", timer_poll);
+  executor_add("fsm", fsm_poll);
+  executor_add("motor", motor_poll);
+  fsm_dispatcher_add(&intersectionFsm);
+
+  static run_results_t blocking, async;
+
+  run(PUMP_BLOCKING, trials, seed, &blocking);
+  print_results("blocking", &blocking);
+
+  run(PUMP_ASYNC, trials, seed, &async);
+  print_results("async", &async);
+
+  uint32_t failures = async.failures;
+  if (async.safety.max_us > 1000)
+  {
+    printf("async: emergency waited %u us\n", async.safety.max_us);
+    failures++;
+  }
+
+  printf("%u trials, %s\n", trials, failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
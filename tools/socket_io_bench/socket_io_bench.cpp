@@ -0,0 +1,338 @@
+// Host microbenchmark of the inbound Socket.IO event path.
+//
+// Runs a mix of the events the server sends through esp32/socket_io_parser
+// and reports events per second and heap bytes allocated per event. Built
+// with -DWITH_ARDUINOJSON and the ArduinoJson 7 headers on the include path,
+// it also runs the previous path (JsonDocument + String name + chain of
+// string comparisons) for comparison. Detection updates are also measured as
+// JSON events against the binary datagram of detection_protocol.h.
+// See README.md.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <new>
+#include <string>
+
+#include "socket_io_parser.h"
+#include "detection_protocol.h"
+
+#ifdef WITH_ARDUINOJSON
+#include <ArduinoJson.h>
+#endif
+
+#define BENCH_ITERATIONS 2000000
+
+static const char *const PACKETS[] = {
+  "/devices,[\"detection_update\",{\"car_count\":12,\"has_ambulance\":false}]",
+  "/devices,[\"detection_update\",{\"car_count\":3,\"has_ambulance\":true}]",
+  "/devices,[\"set_car_count\",{\"car_count\":17}]",
+  "/devices,[\"set_speed\",{\"speed\":92}]",
+  "/devices,[\"control_command\",{\"action\":\"emergency\"}]",
+  "/devices,[\"control_command\",{\"action\":\"reset\"}]",
+  "/devices,[\"message\",{\"message\":\"hello from the server\"}]",
+  "/devices,[\"dump_fsm_trace\"]",
+};
+
+#define PACKET_COUNT (sizeof(PACKETS) / sizeof(PACKETS[0]))
+
+// ---- Allocation counting -----------------------------------------------------
+
+static uint64_t allocated_bytes = 0;
+static uint64_t allocations = 0;
+
+void *operator new(size_t size)
+{
+  allocated_bytes += size;
+  allocations++;
+  void *p = malloc(size ? size : 1);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// ---- Handler state (what the firmware would update) --------------------------
+
+typedef struct {
+  uint32_t car_count;
+  uint32_t speed;
+  uint32_t ambulance;
+  uint32_t actions;
+  uint32_t messages;
+  uint32_t traces;
+} bench_state_t;
+
+typedef struct {
+  socket_io_span_t message;
+} message_event_t;
+
+typedef struct {
+  uint32_t action;
+} control_command_event_t;
+
+typedef struct {
+  uint32_t car_count;
+  bool has_ambulance;
+} detection_event_t;
+
+typedef struct {
+  uint32_t speed;
+} speed_event_t;
+
+static const socket_io_field_t MESSAGE_FIELDS[] = {
+  SOCKET_IO_FIELD(message_event_t, message, "message", SOCKET_IO_STRING),
+};
+
+static const socket_io_field_t CONTROL_COMMAND_FIELDS[] = {
+  SOCKET_IO_FIELD(control_command_event_t, action, "action", SOCKET_IO_HASH),
+};
+
+static const socket_io_field_t DETECTION_FIELDS[] = {
+  SOCKET_IO_FIELD(detection_event_t, car_count, "car_count", SOCKET_IO_U32),
+  SOCKET_IO_FIELD(detection_event_t, has_ambulance, "has_ambulance", SOCKET_IO_BOOL),
+};
+
+static const socket_io_field_t SPEED_FIELDS[] = {
+  SOCKET_IO_FIELD(speed_event_t, speed, "speed", SOCKET_IO_U32),
+};
+
+#define SOCKET_IO_READ(_EVENT, _FIELDS, _OUT) \
+  socket_io_read_fields(_EVENT, _FIELDS, sizeof(_FIELDS) / sizeof(_FIELDS[0]), _OUT)
+
+// Same dispatch as socket_io_handle_event() in the firmware
+static void handle_parser(const char *packet, size_t length, bench_state_t *state)
+{
+  socket_io_event_t event;
+
+  if (!socket_io_parse_event(packet, length, &event))
+    return;
+
+  switch (event.name_hash)
+  {
+    case socket_io_hash("message"):
+    {
+      message_event_t data = {};
+      SOCKET_IO_READ(&event, MESSAGE_FIELDS, &data);
+      state->messages += data.message.length;
+      break;
+    }
+
+    case socket_io_hash("control_command"):
+    {
+      control_command_event_t data = {};
+      SOCKET_IO_READ(&event, CONTROL_COMMAND_FIELDS, &data);
+      if (data.action == socket_io_hash("emergency") || data.action == socket_io_hash("reset"))
+        state->actions++;
+      break;
+    }
+
+    case socket_io_hash("set_car_count"):
+    case socket_io_hash("detection_update"):
+    {
+      detection_event_t data = {};
+      SOCKET_IO_READ(&event, DETECTION_FIELDS, &data);
+      state->car_count += data.car_count;
+      state->ambulance += data.has_ambulance;
+      break;
+    }
+
+    case socket_io_hash("set_speed"):
+    {
+      speed_event_t data = {};
+      SOCKET_IO_READ(&event, SPEED_FIELDS, &data);
+      state->speed += data.speed;
+      break;
+    }
+
+    case socket_io_hash("dump_fsm_trace"):
+      state->traces++;
+      break;
+
+    default:
+      break;
+  }
+}
+
+#ifdef WITH_ARDUINOJSON
+// JsonDocument allocations go through this allocator so they are counted too
+class CountingAllocator : public ArduinoJson::Allocator {
+public:
+  void *allocate(size_t size) override
+  {
+    allocated_bytes += size;
+    allocations++;
+    return malloc(size);
+  }
+
+  void deallocate(void *pointer) override
+  {
+    free(pointer);
+  }
+
+  void *reallocate(void *pointer, size_t new_size) override
+  {
+    allocated_bytes += new_size;
+    allocations++;
+    return realloc(pointer, new_size);
+  }
+};
+
+static CountingAllocator countingAllocator;
+
+// The previous socketIOEvent() path, with std::string standing in for String
+static void handle_arduinojson(const char *packet, size_t length, bench_state_t *state)
+{
+  const char *p = packet;
+  while (p[0] != '[') p++;
+
+  JsonDocument request(&countingAllocator);
+  deserializeJson(request, p);
+
+  std::string eventName = request[0].as<std::string>();
+  JsonVariant requestData = request[1];
+
+  JsonDocument response(&countingAllocator);
+  JsonObject responseData = response.to<JsonObject>();
+  (void) responseData;
+
+  if (eventName == "message")
+  {
+    std::string output = requestData["message"].as<std::string>();
+    state->messages += output.size();
+  }
+  else if (eventName == "control_command")
+  {
+    std::string action = requestData["action"].as<std::string>();
+    if (action == "emergency" || action == "reset")
+      state->actions++;
+  }
+  else if (eventName == "set_car_count")
+  {
+    state->car_count += requestData["car_count"].as<uint32_t>();
+  }
+  else if (eventName == "set_speed")
+  {
+    state->speed += requestData["speed"].as<uint32_t>();
+  }
+  else if (eventName == "detection_update")
+  {
+    state->car_count += requestData["car_count"].as<uint32_t>();
+    state->ambulance += requestData["has_ambulance"].as<bool>();
+  }
+  else if (eventName == "emergency_stop")
+  {
+  }
+  else if (eventName == "dump_fsm_trace")
+  {
+    state->traces++;
+  }
+}
+#endif
+
+// Detection updates only, as JSON events and as datagrams
+static const char *const DETECTION_PACKETS[] = {
+  "/devices,[\"detection_update\",{\"car_count\":12,\"has_ambulance\":false}]",
+  "/devices,[\"detection_update\",{\"car_count\":3,\"has_ambulance\":true}]",
+};
+
+#define DETECTION_PACKET_COUNT (sizeof(DETECTION_PACKETS) / sizeof(DETECTION_PACKETS[0]))
+
+static detection_datagram_t detection_datagrams[DETECTION_PACKET_COUNT];
+
+static void handle_datagram(const char *packet, size_t length, bench_state_t *state)
+{
+  const detection_datagram_t *update = detection_datagram_decode((const uint8_t *) packet, length);
+  if (update == NULL)
+    return;
+
+  state->car_count += update->counts[0];
+  state->ambulance += update->ambulance_mask != 0;
+}
+
+typedef void (*bench_handler_t)(const char *packet, size_t length, bench_state_t *state);
+
+static void run_packets(const char *name, bench_handler_t handler, const char *const *packets, const size_t *lengths, size_t count)
+{
+
+  bench_state_t state = {};
+  uint64_t bytes_before = allocated_bytes;
+  uint64_t allocations_before = allocations;
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+  {
+    size_t index = i % count;
+    handler(packets[index], lengths[index], &state);
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(stop - start).count();
+
+  printf("%-12s %12.0f events/s %8.1f bytes/event %6.2f allocations/event (check %u)\n",
+         name,
+         BENCH_ITERATIONS / seconds,
+         (double)(allocated_bytes - bytes_before) / BENCH_ITERATIONS,
+         (double)(allocations - allocations_before) / BENCH_ITERATIONS,
+         state.car_count + state.speed + state.ambulance + state.actions + state.messages + state.traces);
+}
+
+static void run(const char *name, bench_handler_t handler)
+{
+  size_t lengths[PACKET_COUNT];
+  for (size_t i = 0; i < PACKET_COUNT; i++)
+    lengths[i] = strlen(PACKETS[i]);
+
+  run_packets(name, handler, PACKETS, lengths, PACKET_COUNT);
+}
+
+static void run_detection(void)
+{
+  const char *datagrams[DETECTION_PACKET_COUNT];
+  size_t json_lengths[DETECTION_PACKET_COUNT];
+  size_t datagram_lengths[DETECTION_PACKET_COUNT];
+
+  for (size_t i = 0; i < DETECTION_PACKET_COUNT; i++)
+  {
+    socket_io_event_t event;
+    detection_event_t data = {};
+    json_lengths[i] = strlen(DETECTION_PACKETS[i]);
+    socket_io_parse_event(DETECTION_PACKETS[i], json_lengths[i], &event);
+    SOCKET_IO_READ(&event, DETECTION_FIELDS, &data);
+
+    uint16_t counts[1] = { (uint16_t) data.car_count };
+    detection_datagram_encode(&detection_datagrams[i], 1, (uint32_t) i + 1, 0, counts, 1, data.has_ambulance ? 1 : 0);
+    datagrams[i] = (const char *) &detection_datagrams[i];
+    datagram_lengths[i] = sizeof(detection_datagram_t);
+  }
+
+  // Socket.IO adds its "42" packet type, the WebSocket header comes on top
+  printf("detection update wire bytes: json %zu + websocket framing, datagram %zu\n",
+         json_lengths[0] + 2, sizeof(detection_datagram_t));
+
+  run_packets("json", handle_parser, DETECTION_PACKETS, json_lengths, DETECTION_PACKET_COUNT);
+#ifdef WITH_ARDUINOJSON
+  run_packets("json (old)", handle_arduinojson, DETECTION_PACKETS, json_lengths, DETECTION_PACKET_COUNT);
+#endif
+  run_packets("datagram", handle_datagram, datagrams, datagram_lengths, DETECTION_PACKET_COUNT);
+}
+
+int main(void)
+{
+  printf("event mix:\n");
+  run("parser", handle_parser);
+#ifdef WITH_ARDUINOJSON
+  run("arduinojson", handle_arduinojson);
+#else
+  printf("(build with -DWITH_ARDUINOJSON -I<ArduinoJson/src> to compare with the previous path)\n");
+#endif
+
+  printf("\ndetection updates:\n");
+  run_detection();
+  return 0;
+}
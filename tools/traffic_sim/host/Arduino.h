@@ -0,0 +1,31 @@
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+// Minimal Arduino API for building the controller sources on a Linux host.
+// Time comes from the simulated clock, serial output is discarded.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Simulated time, advanced by the simulator
+extern uint64_t sim_clock_us;
+
+static inline unsigned long micros(void) { return (unsigned long)(uint32_t) sim_clock_us; }
+static inline unsigned long millis(void) { return (unsigned long)(uint32_t)(sim_clock_us / 1000); }
+
+class HostSerial {
+public:
+  void begin(unsigned long) {}
+  template <typename T> void print(const T &) {}
+  template <typename T> void println(const T &) {}
+  void println(void) {}
+};
+
+extern HostSerial Serial;
+
+// PWM outputs are discarded, motor.cpp reports its own position
+static inline bool ledcAttach(uint8_t pin, uint32_t frequency, uint8_t resolution) { return true; }
+static inline bool ledcWrite(uint8_t pin, uint32_t duty) { return true; }
+
+#endif //_HOST_ARDUINO_H_
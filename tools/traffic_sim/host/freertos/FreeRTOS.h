@@ -0,0 +1,15 @@
+#ifndef _HOST_FREERTOS_H_
+#define _HOST_FREERTOS_H_
+
+// The simulator is single threaded: critical sections and notifications are no-ops
+
+#include <stdint.h>
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(_MUX) ((void)(_MUX))
+#define portEXIT_CRITICAL(_MUX)  ((void)(_MUX))
+
+typedef void *TaskHandle_t;
+
+#endif //_HOST_FREERTOS_H_
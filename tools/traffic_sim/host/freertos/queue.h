@@ -0,0 +1,59 @@
+#ifndef _HOST_FREERTOS_QUEUE_H_
+#define _HOST_FREERTOS_QUEUE_H_
+
+// Single threaded FreeRTOS queue: a ring of copied items, never waits
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define pdFALSE 0
+
+typedef struct {
+  uint8_t *items;
+  uint32_t item_size;
+  uint32_t length;
+  uint32_t head;
+  uint32_t count;
+} host_queue_t;
+
+typedef host_queue_t *QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreate(uint32_t length, uint32_t item_size)
+{
+  host_queue_t *queue = (host_queue_t *) calloc(1, sizeof(host_queue_t));
+  queue->items = (uint8_t *) calloc(length, item_size);
+  queue->item_size = item_size;
+  queue->length = length;
+  return queue;
+}
+
+static inline int xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+  (void) wait;
+  if (queue->count == queue->length)
+    return pdFALSE;
+  memcpy(queue->items + ((queue->head + queue->count) % queue->length) * queue->item_size, item, queue->item_size);
+  queue->count++;
+  return pdTRUE;
+}
+
+static inline int xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+  (void) wait;
+  if (queue->count == 0)
+    return pdFALSE;
+  memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  return pdTRUE;
+}
+
+static inline uint32_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  return queue->count;
+}
+
+#endif //_HOST_FREERTOS_QUEUE_H_
@@ -0,0 +1,20 @@
+#ifndef _HOST_FREERTOS_TASK_H_
+#define _HOST_FREERTOS_TASK_H_
+
+#include "FreeRTOS.h"
+
+typedef uint32_t TickType_t;
+
+#define pdTRUE             1
+#define portMAX_DELAY      UINT32_MAX
+#define pdMS_TO_TICKS(_MS) ((TickType_t)(_MS))
+
+#define xTaskNotifyGive(_TASK) ((void)(_TASK))
+
+// There is only one thread: the current task is a fixed non-NULL handle and
+// waiting for a notification returns at once
+static inline TaskHandle_t xTaskGetCurrentTaskHandle(void) { return (TaskHandle_t) 1; }
+static inline uint32_t ulTaskNotifyTake(int clear, TickType_t wait) { (void) clear; (void) wait; return 0; }
+static inline void vTaskDelete(TaskHandle_t task) { (void) task; }
+
+#endif //_HOST_FREERTOS_TASK_H_
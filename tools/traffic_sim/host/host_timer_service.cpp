@@ -0,0 +1,92 @@
+#include <Arduino.h>
+
+#include "timer_service.h"
+#include "host_timer_service.h"
+
+// timer_service.h on the simulated clock: timers fire from
+// host_timer_service_run() instead of a FreeRTOS task.
+
+typedef struct {
+  bool active;
+  uint16_t generation;   // Bumped on every reuse, same id layout as the firmware
+  uint64_t deadline_us;
+  timer_callback_t callback;
+  void *arg;
+  uint32_t tag;
+} host_timer_t;
+
+static host_timer_t timers[TIMER_SERVICE_MAX_TIMERS];
+
+void timer_service_task(void *pvParams)
+{
+}
+
+timer_id_t timer_service_schedule(uint32_t delay_ms, timer_callback_t callback, void *arg, uint32_t tag)
+{
+  for (uint8_t i = 0; i < TIMER_SERVICE_MAX_TIMERS; i++)
+  {
+    host_timer_t *timer = &timers[i];
+    if (timer->active)
+      continue;
+
+    timer->active = true;
+    timer->generation++;
+    timer->deadline_us = sim_clock_us + (uint64_t) delay_ms * 1000;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->tag = tag;
+    return ((timer_id_t) timer->generation << 8) | (i + 1);
+  }
+  return TIMER_ID_NONE;
+}
+
+bool timer_service_cancel(timer_id_t id)
+{
+  if (id == TIMER_ID_NONE)
+    return false;
+
+  uint8_t index = (id & 0xFF) - 1;
+  if (index >= TIMER_SERVICE_MAX_TIMERS)
+    return false;
+
+  host_timer_t *timer = &timers[index];
+  if (!timer->active || timer->generation != (uint16_t)(id >> 8))
+    return false;
+
+  timer->active = false;
+  return true;
+}
+
+bool timer_service_is_ready()
+{
+  return true;
+}
+
+uint64_t host_timer_service_next_deadline(void)
+{
+  uint64_t next = UINT64_MAX;
+  for (uint8_t i = 0; i < TIMER_SERVICE_MAX_TIMERS; i++)
+  {
+    if (timers[i].active && timers[i].deadline_us < next)
+      next = timers[i].deadline_us;
+  }
+  return next;
+}
+
+void host_timer_service_run(void)
+{
+  for (uint8_t i = 0; i < TIMER_SERVICE_MAX_TIMERS; i++)
+  {
+    host_timer_t *timer = &timers[i];
+    if (!timer->active || timer->deadline_us > sim_clock_us)
+      continue;
+
+    timer->active = false;
+    timer->callback(timer->arg, timer->tag);
+  }
+}
+
+void host_timer_service_reset(void)
+{
+  memset(timers, 0, sizeof(timers));
+}
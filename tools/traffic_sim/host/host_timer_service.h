@@ -0,0 +1,15 @@
+#ifndef _HOST_TIMER_SERVICE_H_
+#define _HOST_TIMER_SERVICE_H_
+
+#include <stdint.h>
+
+// Earliest pending deadline on the simulated clock, UINT64_MAX when idle
+uint64_t host_timer_service_next_deadline(void);
+
+// Fire every timer whose deadline is at or before sim_clock_us
+void host_timer_service_run(void);
+
+// Drop all pending timers (between simulation runs)
+void host_timer_service_reset(void);
+
+#endif //_HOST_TIMER_SERVICE_H_
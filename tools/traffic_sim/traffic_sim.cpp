@@ -0,0 +1,414 @@
+// Microscopic traffic simulator for the intersection controller.
+//
+// Links the real controller sources (intersection_control, fsm, phase_timer,
+// signal_timing) against the host shims in host/ and drives them on a
+// simulated clock: vehicles arrive on every approach, queue at the stop line
+// and leave at the saturation flow while their approach shows green. The
+// controller sees the queues the way the camera reports them. Ambulances are
+// injected on the emergency approach and go through the same EMERGENCY /
+// CLEAR_EMERGENCY events as on the board.
+//
+// See README.md for the build command and options.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+
+#include <Arduino.h>
+
+#include "fsm.h"
+#include "intersection_config.h"
+#include "intersection_control.h"
+#include "host_timer_service.h"
+
+#define SIM_TICK_US           100000ULL  // 100 ms
+#define SIM_DETECT_PERIOD_US  1000000ULL // Detector report period, like detection_update
+#define SIM_DELAY_BINS        1800       // 1 s delay histogram bins, last one is overflow
+
+uint64_t sim_clock_us = 0;
+HostSerial Serial;
+
+typedef enum {
+  PROFILE_POISSON = 0,
+  PROFILE_PLATOON,
+  PROFILE_RUSH
+} sim_profile_t;
+
+typedef struct {
+  double hours;
+  uint64_t seed;
+  sim_profile_t profile;
+  double count_error;                // Chance a reported queue is one car off
+  double rate_vph[APPROACH_COUNT];   // Mean arrival rate per approach
+  double ambulances_per_hour;
+  double saturation_flow;            // Vehicles per second while green
+  bool run_webster;
+  bool run_legacy;
+} sim_options_t;
+
+typedef struct {
+  uint64_t arrival_us;
+  bool ambulance;
+} sim_vehicle_t;
+
+typedef struct {
+  uint64_t departed;
+  double delay_sum_s;
+  uint64_t delay_hist[SIM_DELAY_BINS];
+  double queue_sum;                  // Sum over ticks of the total queue
+  uint32_t queue_max;
+  uint64_t ambulances;
+  double clearance_sum_s;
+  double clearance_max_s;
+  uint32_t cycles;
+  uint64_t residual;                 // Vehicles still queued at the end
+} sim_results_t;
+
+// Intersection state
+static std::deque<sim_vehicle_t> queues[APPROACH_COUNT];
+static double dischargeCredit;
+static int greenApproach = -1;
+static bool ambulanceWaiting;
+
+static uint64_t rng_state;
+
+static double rng_uniform(void)
+{
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (double)((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+// ---- Controller hooks, the simulated counterpart of esp32.ino -------------
+
+static void show_phase(uint8_t phase)
+{
+  greenApproach = PHASES[phase].green ? PHASES[phase].approach : -1;
+}
+
+static void show_emergency(void)
+{
+  greenApproach = PHASES[EMERGENCY_PHASE].approach;
+}
+
+static const intersection_control_hooks_t controlHooks = { show_phase, show_emergency };
+
+// ---- Demand ------------------------------------------------------------------
+
+// Time of day multiplier: morning peak inbound (even approaches), evening
+// peak outbound (odd approaches), light traffic at night
+static double rush_multiplier(uint8_t approach, double hours)
+{
+  double h = fmod(hours, 24.0);
+  double morning = exp(-0.5 * pow((h - 8.0) / 1.2, 2));
+  double evening = exp(-0.5 * pow((h - 17.5) / 1.2, 2));
+  bool inbound = (approach % 2) == 0;
+
+  return 0.3 + 1.2 * morning * (inbound ? 1.0 : 0.5) + 1.2 * evening * (inbound ? 0.5 : 1.0);
+}
+
+static uint32_t arrivals_this_tick(const sim_options_t *options, uint8_t approach)
+{
+  double rate_per_tick = options->rate_vph[approach] / 3600.0 * (SIM_TICK_US / 1e6);
+
+  switch (options->profile)
+  {
+    case PROFILE_RUSH:
+    {
+      // The profile changes slowly, evaluate it once per simulated minute
+      static uint64_t minute = UINT64_MAX;
+      static double multiplier[APPROACH_COUNT];
+
+      if (sim_clock_us / 60000000ULL != minute)
+      {
+        minute = sim_clock_us / 60000000ULL;
+        for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+          multiplier[a] = rush_multiplier(a, minute / 60.0);
+      }
+      return rng_uniform() < rate_per_tick * multiplier[approach] ? 1 : 0;
+    }
+
+    case PROFILE_PLATOON:
+      // Platoons of 1-8 vehicles (mean 4.5) released by an upstream signal
+      if (rng_uniform() < rate_per_tick / 4.5)
+        return 1 + (uint32_t)(rng_uniform() * 8);
+      return 0;
+
+    default:
+      return rng_uniform() < rate_per_tick ? 1 : 0;
+  }
+}
+
+// ---- Simulation --------------------------------------------------------------
+
+static void record_departure(sim_results_t *results, const sim_vehicle_t *vehicle)
+{
+  double delay_s = (sim_clock_us - vehicle->arrival_us) / 1e6;
+  uint32_t bin = delay_s >= SIM_DELAY_BINS - 1 ? SIM_DELAY_BINS - 1 : (uint32_t) delay_s;
+
+  results->departed++;
+  results->delay_sum_s += delay_s;
+  results->delay_hist[bin]++;
+
+  if (vehicle->ambulance)
+  {
+    results->ambulances++;
+    results->clearance_sum_s += delay_s;
+    if (delay_s > results->clearance_max_s)
+      results->clearance_max_s = delay_s;
+
+    ambulanceWaiting = false;
+    fsm_push_event(&intersectionFsm, EVENT_CLEAR_EMERGENCY);
+  }
+}
+
+static void simulate(signal_timing_mode_t mode, const sim_options_t *options, sim_results_t *results)
+{
+  memset(results, 0, sizeof(*results));
+
+  for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+    queues[a].clear();
+  dischargeCredit = 0.0;
+  greenApproach = -1;
+  ambulanceWaiting = false;
+  rng_state = options->seed ? options->seed : 1;
+  sim_clock_us = 0;
+
+  host_timer_service_reset();
+  intersection_control_init(mode, &controlHooks);
+  fsm_push_event(&intersectionFsm, EVENT_START);
+
+  uint64_t end_us = (uint64_t)(options->hours * 3600e6);
+  uint64_t next_detect_us = 0;
+  double ambulance_per_tick = options->ambulances_per_hour / 3600.0 * (SIM_TICK_US / 1e6);
+  uint8_t emergency_approach = PHASES[EMERGENCY_PHASE].approach;
+
+  for (; sim_clock_us < end_us; sim_clock_us += SIM_TICK_US)
+  {
+    host_timer_service_run();
+    fsm_dispatcher_process();
+
+    // Arrivals
+    for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+    {
+      uint32_t count = arrivals_this_tick(options, a);
+      for (uint32_t i = 0; i < count; i++)
+        queues[a].push_back({ sim_clock_us, false });
+    }
+
+    // One ambulance at a time, detected as soon as it joins the queue
+    if (!ambulanceWaiting && rng_uniform() < ambulance_per_tick)
+    {
+      queues[emergency_approach].push_back({ sim_clock_us, true });
+      ambulanceWaiting = true;
+      fsm_push_event(&intersectionFsm, EVENT_EMERGENCY);
+    }
+
+    // Detector reports: the queue waiting now, like the camera's counts,
+    // one car off with the configured chance
+    if (sim_clock_us >= next_detect_us)
+    {
+      next_detect_us += SIM_DETECT_PERIOD_US;
+      for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+      {
+        uint32_t vehicles = (uint32_t) queues[a].size();
+        double error = rng_uniform();
+
+        if (error < options->count_error / 2)
+          vehicles++;
+        else if (error < options->count_error && vehicles > 0)
+          vehicles--;
+        signal_timing_set_demand(&signalTiming, a, vehicles);
+      }
+    }
+
+    // Discharge at saturation flow from the approach showing green
+    if (greenApproach >= 0)
+    {
+      std::deque<sim_vehicle_t> &queue = queues[greenApproach];
+
+      dischargeCredit += options->saturation_flow * (SIM_TICK_US / 1e6);
+      if (dischargeCredit > 1.0 && queue.empty())
+        dischargeCredit = 1.0;
+
+      while (dischargeCredit >= 1.0 && !queue.empty())
+      {
+        sim_vehicle_t vehicle = queue.front();
+        queue.pop_front();
+        dischargeCredit -= 1.0;
+        record_departure(results, &vehicle);
+      }
+    }
+    else
+    {
+      dischargeCredit = 0.0;
+    }
+
+    fsm_dispatcher_process();
+
+    uint32_t queued = 0;
+    for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+      queued += queues[a].size();
+
+    results->queue_sum += queued;
+    if (queued > results->queue_max)
+      results->queue_max = queued;
+  }
+
+  for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+    results->residual += queues[a].size();
+  results->cycles = signalTiming.cycles;
+}
+
+static double delay_percentile(const sim_results_t *results, double percentile)
+{
+  uint64_t target = (uint64_t) ceil(results->departed * percentile);
+  uint64_t seen = 0;
+
+  for (uint32_t bin = 0; bin < SIM_DELAY_BINS; bin++)
+  {
+    seen += results->delay_hist[bin];
+    if (seen >= target && seen > 0)
+      return bin + 1;
+  }
+  return SIM_DELAY_BINS;
+}
+
+static void print_results(const char *name, const sim_options_t *options, const sim_results_t *results)
+{
+  double ticks = options->hours * 3600e6 / SIM_TICK_US;
+
+  printf("%-8s throughput=%.1f veh/h avg_delay=%.1f s p95_delay=%.0f s avg_queue=%.1f max_queue=%u "
+         "residual=%llu cycles=%u ambulances=%llu clearance_avg=%.1f s clearance_max=%.1f s\n",
+         name,
+         results->departed / options->hours,
+         results->departed ? results->delay_sum_s / results->departed : 0.0,
+         delay_percentile(results, 0.95),
+         results->queue_sum / ticks,
+         results->queue_max,
+         (unsigned long long) results->residual,
+         results->cycles,
+         (unsigned long long) results->ambulances,
+         results->ambulances ? results->clearance_sum_s / results->ambulances : 0.0,
+         results->clearance_max_s);
+}
+
+// ---- Command line ------------------------------------------------------------
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [--hours H] [--seed N] [--profile poisson|platoon|rush]\n"
+          "          [--rates V1,V2,...] [--ambulances PER_HOUR] [--saturation VEH_PER_S]\n"
+          "          [--count-error P] [--mode webster|legacy|both]\n",
+          program);
+  exit(2);
+}
+
+static void parse_rates(const char *text, sim_options_t *options)
+{
+  char *end = NULL;
+
+  for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+  {
+    double rate = strtod(text, &end);
+    if (end == text)
+      break;
+    options->rate_vph[a] = rate;
+    // A shorter list repeats its last rate
+    for (uint8_t b = a + 1; b < APPROACH_COUNT; b++)
+      options->rate_vph[b] = rate;
+    if (*end != ',')
+      break;
+    text = end + 1;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  sim_options_t options = {};
+
+  options.hours = 1000;
+  options.seed = 1;
+  options.profile = PROFILE_RUSH;
+  options.ambulances_per_hour = 0.5;
+  options.saturation_flow = SATURATION_FLOW_VPS;
+  options.run_webster = true;
+  options.run_legacy = true;
+  parse_rates("600,400,300", &options);
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+    if (value == NULL)
+      usage(argv[0]);
+
+    if (strcmp(arg, "--hours") == 0)
+      options.hours = atof(value);
+    else if (strcmp(arg, "--seed") == 0)
+      options.seed = strtoull(value, NULL, 0);
+    else if (strcmp(arg, "--rates") == 0)
+      parse_rates(value, &options);
+    else if (strcmp(arg, "--ambulances") == 0)
+      options.ambulances_per_hour = atof(value);
+    else if (strcmp(arg, "--saturation") == 0)
+      options.saturation_flow = atof(value);
+    else if (strcmp(arg, "--profile") == 0)
+    {
+      if (strcmp(value, "poisson") == 0)
+        options.profile = PROFILE_POISSON;
+      else if (strcmp(value, "platoon") == 0)
+        options.profile = PROFILE_PLATOON;
+      else if (strcmp(value, "rush") == 0)
+        options.profile = PROFILE_RUSH;
+      else
+        usage(argv[0]);
+    }
+    else if (strcmp(arg, "--count-error") == 0)
+      options.count_error = atof(value);
+    else if (strcmp(arg, "--mode") == 0)
+    {
+      options.run_webster = strcmp(value, "webster") == 0 || strcmp(value, "both") == 0;
+      options.run_legacy = strcmp(value, "legacy") == 0 || strcmp(value, "both") == 0;
+      if (!options.run_webster && !options.run_legacy)
+        usage(argv[0]);
+    }
+    else
+      usage(argv[0]);
+
+    i++;
+  }
+
+  if (options.hours <= 0 || options.count_error < 0 || options.count_error > 1)
+    usage(argv[0]);
+
+  fsm_dispatcher_add(&intersectionFsm);
+
+  printf("approaches=%d hours=%.0f seed=%llu rates=", APPROACH_COUNT, options.hours, (unsigned long long) options.seed);
+  for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+    printf("%s%.0f", a ? "," : "", options.rate_vph[a]);
+  printf(" veh/h\n");
+
+  static sim_results_t results;
+
+  if (options.run_legacy)
+  {
+    simulate(SIGNAL_TIMING_LEGACY, &options, &results);
+    print_results("legacy", &options, &results);
+  }
+
+  if (options.run_webster)
+  {
+    simulate(SIGNAL_TIMING_WEBSTER, &options, &results);
+    print_results("webster", &options, &results);
+  }
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+// Host concurrency stress test of esp32/traffic_state.
+//
+// Snapshot phase: a network thread publishes detection snapshots whose
+// fields are all derived from one counter while the control thread reads
+// them in a tight loop. Every snapshot read must be one complete write (no
+// mix of two) and versions must never go backwards.
+//
+// Mailbox phase: two threads post numbered commands (the network task and
+// an operator) while the control thread drains them the way
+// traffic_control_poll() does. Every command must arrive exactly once and
+// in its producer's order, retrying when the mailbox is full.
+//
+// See README.md.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "Arduino.h"
+#include "traffic_state.h"
+
+uint64_t sim_clock_us = 0;
+HostSerial Serial;
+
+#define PRODUCERS 2
+#define PRODUCER_SHIFT 28
+#define SEQUENCE_MASK ((1u << PRODUCER_SHIFT) - 1)
+
+static uint32_t iterations = 2000000;
+static uint64_t errors = 0;
+
+static std::atomic<bool> writing(true);
+static std::atomic<int> producers_running(PRODUCERS);
+
+static uint32_t expected_count(uint32_t i, uint8_t approach)
+{
+  return i * (approach + 1) + approach;
+}
+
+static void fail(const char *what, uint32_t a, uint32_t b)
+{
+  if (errors++ < 10)
+    printf("%s: %u / %u\n", what, a, b);
+}
+
+static void network_thread(void)
+{
+  for (uint32_t i = 1; i <= iterations; i++)
+  {
+    traffic_detection_t *detection = traffic_state_edit();
+    for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+      detection->counts[a] = expected_count(i, a);
+    detection->capture_us = i;
+    detection->ambulance = (i % 3) == 0;
+    traffic_state_publish();
+  }
+  writing = false;
+}
+
+static void snapshot_phase(void)
+{
+  uint64_t reads = 0, changes = 0;
+  uint32_t last_version = 0, last_capture = 0;
+
+  std::thread network(network_thread);
+
+  // Spin like a busy control task so the writer gets preempted mid-write
+  bool done = false;
+  while (!done)
+  {
+    done = !writing.load();
+
+    traffic_detection_t detection;
+    uint32_t version;
+    if (!traffic_state_read(&detection, &version))
+      continue;
+
+    reads++;
+
+    uint32_t i = detection.capture_us;
+    bool consistent = detection.ambulance == ((i % 3) == 0);
+    for (uint8_t a = 0; a < APPROACH_COUNT; a++)
+      consistent = consistent && detection.counts[a] == expected_count(i, a);
+
+    if (!consistent)
+      fail("torn snapshot (capture, counts[0])", i, detection.counts[0]);
+    if ((int32_t) (version - last_version) < 0 || i < last_capture)
+      fail("snapshot went backwards (version, previous)", version, last_version);
+    if (version != last_version)
+      changes++;
+
+    last_version = version;
+    last_capture = i;
+  }
+
+  network.join();
+
+  if (last_capture != iterations)
+    fail("last snapshot (seen, expected)", last_capture, iterations);
+
+  printf("snapshots: published=%u reads=%llu distinct=%llu\n", iterations,
+         (unsigned long long) reads, (unsigned long long) changes);
+}
+
+static void producer_thread(uint32_t producer, uint64_t *full)
+{
+  traffic_command_type_t type = producer == 0 ? TRAFFIC_COMMAND_PUMP_OPEN : TRAFFIC_COMMAND_MOTOR_STOP;
+
+  for (uint32_t i = 1; i <= iterations / 8; i++)
+  {
+    while (!traffic_state_post(type, (producer << PRODUCER_SHIFT) | i))
+    {
+      (*full)++;
+      std::this_thread::yield();
+    }
+  }
+  producers_running--;
+}
+
+static void mailbox_phase(void)
+{
+  uint64_t full[PRODUCERS] = {0, 0};
+  uint32_t last_command[PRODUCERS] = {0, 0};
+  uint32_t received[PRODUCERS] = {0, 0};
+
+  std::thread network(producer_thread, 0, &full[0]);
+  std::thread operator_(producer_thread, 1, &full[1]);
+
+  bool done = false;
+  while (!done)
+  {
+    done = producers_running.load() == 0;
+    bool idle = true;
+
+    traffic_command_t command;
+    while (traffic_state_take(&command))
+    {
+      idle = false;
+
+      uint32_t producer = command.value >> PRODUCER_SHIFT;
+      uint32_t sequence = command.value & SEQUENCE_MASK;
+
+      if (producer >= PRODUCERS || sequence != last_command[producer] + 1)
+      {
+        fail("command out of order (producer, sequence)", producer, sequence);
+        continue;
+      }
+      last_command[producer] = sequence;
+      received[producer]++;
+    }
+
+    // The control task would block on its notification here
+    if (idle)
+      std::this_thread::yield();
+  }
+
+  network.join();
+  operator_.join();
+
+  for (uint32_t p = 0; p < PRODUCERS; p++)
+  {
+    if (received[p] != iterations / 8)
+      fail("commands received (producer, count)", p, received[p]);
+  }
+
+  traffic_state_stats_t stats;
+  traffic_state_get_stats(&stats);
+  printf("commands: posted=%u received=%u+%u mailbox_full=%llu\n", stats.posted, received[0], received[1],
+         (unsigned long long) (full[0] + full[1]));
+}
+
+int main(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+      iterations = (uint32_t) strtoul(argv[++i], NULL, 10);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  snapshot_phase();
+  mailbox_phase();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%.2f s, %s (%llu errors)\n", seconds, errors == 0 ? "PASS" : "FAIL", (unsigned long long) errors);
+
+  return errors == 0 ? 0 : 1;
+}